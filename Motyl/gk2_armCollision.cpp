@@ -0,0 +1,227 @@
+#include "gk2_armCollision.h"
+#include <emmintrin.h>
+#include <cmath>
+#include <map>
+#include <set>
+
+using namespace std;
+using namespace gk2;
+
+const float ArmCollision::CLUSTER_SIZE = 0.15f;
+
+namespace
+{
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	//Cell of pos on a grid of the given spacing, packed into one key
+	long long GridKey(const XMFLOAT3& pos, float spacing)
+	{
+		const long long OFFSET = 1 << 20;
+		long long x = static_cast<long long>(floor(pos.x / spacing)) + OFFSET;
+		long long y = static_cast<long long>(floor(pos.y / spacing)) + OFFSET;
+		long long z = static_cast<long long>(floor(pos.z / spacing)) + OFFSET;
+		return (x << 42) | (y << 21) | z;
+	}
+}
+
+ArmCollision::ArmCollision(const PumaKinematics& kinematics, float margin)
+	: m_kinematics(kinematics), m_margin(margin)
+{ }
+
+void ArmCollision::AddLink(unsigned int link, const VertexPosNormal* vertices, const unsigned short* indices,
+	unsigned int indexCount)
+{
+	//Barycentric grids on the triangles, fine enough to keep neighbouring samples within the margin
+	map<long long, vector<XMFLOAT3>> cubes;
+	set<long long> taken;
+	for (unsigned int t = 0; t + 2 < indexCount; t += 3)
+	{
+		const XMFLOAT3& a = vertices[indices[t]].Pos;
+		XMFLOAT3 ab = Sub(vertices[indices[t + 1]].Pos, a), ac = Sub(vertices[indices[t + 2]].Pos, a);
+		XMFLOAT3 bc = Sub(ac, ab);
+		float longest = sqrt(Dot(ab, ab));
+		longest = sqrt(Dot(ac, ac)) > longest ? sqrt(Dot(ac, ac)) : longest;
+		longest = sqrt(Dot(bc, bc)) > longest ? sqrt(Dot(bc, bc)) : longest;
+		unsigned int n = static_cast<unsigned int>(ceil(longest / m_margin));
+		n = n < 1 ? 1 : n;
+		for (unsigned int i = 0; i <= n; ++i)
+			for (unsigned int j = 0; i + j <= n; ++j)
+			{
+				float u = static_cast<float>(i) / n, v = static_cast<float>(j) / n;
+				XMFLOAT3 p(a.x + u * ab.x + v * ac.x, a.y + u * ab.y + v * ac.y, a.z + u * ab.z + v * ac.z);
+				//Edges are shared by two triangles, keep one sample of each spot
+				if (taken.insert(GridKey(p, 0.25f * m_margin)).second)
+					cubes[GridKey(p, CLUSTER_SIZE)].push_back(p);
+			}
+	}
+	for (map<long long, vector<XMFLOAT3>>::iterator it = cubes.begin(); it != cubes.end(); ++it)
+	{
+		vector<XMFLOAT3>& points = it->second;
+		Cluster cluster;
+		cluster.link = link;
+		cluster.first = static_cast<unsigned int>(m_x.size());
+		XMVECTOR min = XMLoadFloat3(&points[0]), max = min;
+		for (unsigned int i = 1; i < points.size(); ++i)
+		{
+			min = XMVectorMin(min, XMLoadFloat3(&points[i]));
+			max = XMVectorMax(max, XMLoadFloat3(&points[i]));
+		}
+		XMStoreFloat3(&cluster.center, 0.5f * (min + max));
+		cluster.radius = 0.0f;
+		//Whole SSE blocks, the last point repeated
+		while (points.size() % 4 != 0)
+			points.push_back(points.back());
+		for (unsigned int i = 0; i < points.size(); ++i)
+		{
+			XMFLOAT3 d = Sub(points[i], cluster.center);
+			float distance = sqrt(Dot(d, d));
+			cluster.radius = distance > cluster.radius ? distance : cluster.radius;
+			m_x.push_back(points[i].x);
+			m_y.push_back(points[i].y);
+			m_z.push_back(points[i].z);
+		}
+		cluster.count = static_cast<unsigned int>(points.size());
+		m_clusters.push_back(cluster);
+	}
+}
+
+unsigned int ArmCollision::AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal)
+{
+	Shape shape;
+	shape.type = PLANE;
+	shape.center = point;
+	XMStoreFloat3(&shape.axes[0], XMVector3Normalize(XMLoadFloat3(&normal)));
+	m_shapes.push_back(shape);
+	return static_cast<unsigned int>(m_shapes.size()) - 1;
+}
+
+unsigned int ArmCollision::AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose)
+{
+	Shape shape;
+	shape.type = BOX;
+	shape.halfSize = halfSize;
+	XMStoreFloat3(&shape.center, pose.r[3]);
+	for (int i = 0; i < 3; ++i)
+		XMStoreFloat3(&shape.axes[i], XMVector3Normalize(pose.r[i]));
+	m_shapes.push_back(shape);
+	return static_cast<unsigned int>(m_shapes.size()) - 1;
+}
+
+unsigned int ArmCollision::AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius)
+{
+	Shape shape;
+	shape.type = CYLINDER;
+	shape.center = p0;
+	XMVECTOR axis = XMLoadFloat3(&p1) - XMLoadFloat3(&p0);
+	XMStoreFloat3(&shape.axes[0], XMVector3Normalize(axis));
+	shape.halfSize = XMFLOAT3(XMVectorGetX(XMVector3Length(axis)), radius, 0.0f);
+	m_shapes.push_back(shape);
+	return static_cast<unsigned int>(m_shapes.size()) - 1;
+}
+
+bool ArmCollision::IsNear(const Shape& shape, const XMFLOAT3& center, float radius) const
+{
+	XMFLOAT3 d = Sub(center, shape.center);
+	float reach = radius + m_margin;
+	switch (shape.type)
+	{
+	case PLANE:
+		return Dot(d, shape.axes[0]) < reach;
+	case BOX:
+		{
+			const float half[3] = { shape.halfSize.x, shape.halfSize.y, shape.halfSize.z };
+			float outside = 0.0f;
+			for (int k = 0; k < 3; ++k)
+			{
+				float excess = fabs(Dot(d, shape.axes[k])) - half[k];
+				outside += excess > 0.0f ? excess * excess : 0.0f;
+			}
+			return outside < reach * reach;
+		}
+	default:
+		{
+			//Distance to the axis segment, the capsule around it contains the cylinder
+			float t = Dot(d, shape.axes[0]);
+			t = t < 0.0f ? 0.0f : (t > shape.halfSize.x ? shape.halfSize.x : t);
+			XMFLOAT3 r(d.x - t * shape.axes[0].x, d.y - t * shape.axes[0].y, d.z - t * shape.axes[0].z);
+			return sqrt(Dot(r, r)) - shape.halfSize.y < reach;
+		}
+	}
+}
+
+bool ArmCollision::Hits(const Shape& shape, const Cluster& cluster, CXMMATRIX pose) const
+{
+	XMFLOAT4X4 m;
+	XMStoreFloat4x4(&m, pose);
+	const __m128 margin = _mm_set1_ps(m_margin), signBit = _mm_set1_ps(-0.0f);
+	const __m128 cx = _mm_set1_ps(shape.center.x), cy = _mm_set1_ps(shape.center.y), cz = _mm_set1_ps(shape.center.z);
+	for (unsigned int i = cluster.first; i < cluster.first + cluster.count; i += 4)
+	{
+		//Mesh to world, then relative to the shape
+		__m128 x = _mm_loadu_ps(&m_x[i]), y = _mm_loadu_ps(&m_y[i]), z = _mm_loadu_ps(&m_z[i]);
+		__m128 d[3];
+		for (int c = 0; c < 3; ++c)
+			d[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m.m[0][c])), _mm_mul_ps(y, _mm_set1_ps(m.m[1][c]))),
+				_mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m.m[2][c])), _mm_set1_ps(m.m[3][c])));
+		d[0] = _mm_sub_ps(d[0], cx);
+		d[1] = _mm_sub_ps(d[1], cy);
+		d[2] = _mm_sub_ps(d[2], cz);
+		__m128 hit;
+		if (shape.type == BOX)
+		{
+			const float half[3] = { shape.halfSize.x, shape.halfSize.y, shape.halfSize.z };
+			hit = _mm_cmpeq_ps(x, x);
+			for (int k = 0; k < 3; ++k)
+			{
+				const XMFLOAT3& a = shape.axes[k];
+				__m128 local = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], _mm_set1_ps(a.x)), _mm_mul_ps(d[1], _mm_set1_ps(a.y))),
+					_mm_mul_ps(d[2], _mm_set1_ps(a.z)));
+				hit = _mm_and_ps(hit, _mm_cmplt_ps(_mm_andnot_ps(signBit, local), _mm_set1_ps(half[k] + m_margin)));
+			}
+		}
+		else
+		{
+			const XMFLOAT3& a = shape.axes[0];
+			__m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], _mm_set1_ps(a.x)), _mm_mul_ps(d[1], _mm_set1_ps(a.y))),
+				_mm_mul_ps(d[2], _mm_set1_ps(a.z)));
+			if (shape.type == PLANE)
+				hit = _mm_cmplt_ps(t, margin);
+			else
+			{
+				float reach = shape.halfSize.y + m_margin;
+				__m128 radial = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], d[0]), _mm_mul_ps(d[1], d[1])),
+					_mm_mul_ps(d[2], d[2])), _mm_mul_ps(t, t));
+				hit = _mm_and_ps(_mm_cmplt_ps(radial, _mm_set1_ps(reach * reach)),
+					_mm_and_ps(_mm_cmpgt_ps(t, _mm_sub_ps(_mm_setzero_ps(), margin)),
+					_mm_cmplt_ps(t, _mm_set1_ps(shape.halfSize.x + m_margin))));
+			}
+		}
+		if (_mm_movemask_ps(hit) != 0)
+			return true;
+	}
+	return false;
+}
+
+bool ArmCollision::IsFree(const float* angles) const
+{
+	XMMATRIX poses[PumaKinematics::LINKS];
+	m_kinematics.GetLinkMatrices(angles, poses);
+	for (unsigned int c = 0; c < m_clusters.size(); ++c)
+	{
+		const Cluster& cluster = m_clusters[c];
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&cluster.center), poses[cluster.link]));
+		for (unsigned int s = 0; s < m_shapes.size(); ++s)
+			if (IsNear(m_shapes[s], center, cluster.radius) && Hits(m_shapes[s], cluster, poses[cluster.link]))
+				return false;
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef __GK2_ARM_COLLISION_H_
+#define __GK2_ARM_COLLISION_H_
+
+#include <xnamath.h>
+#include <vector>
+#include "gk2_pumaKinematics.h"
+#include "gk2_vertices.h"
+
+namespace gk2
+{
+	//Tests whether the arm at given joint angles keeps a margin from the static obstacles of the cell.
+	//Link surfaces are sampled with points no farther apart than the margin, so a surface crossing an
+	//obstacle, however thin, leaves a point inside the obstacle grown by the margin. Points are grouped
+	//into clusters with a bounding sphere, and only clusters whose sphere comes near an obstacle have their
+	//points transformed and tested, four at a time. The links do not collide with each other.
+	//IsFree may be called from several threads at once.
+	class ArmCollision
+	{
+	public:
+		ArmCollision(const gk2::PumaKinematics& kinematics, float margin);
+
+		//Adds the surface of a closed mesh moving with link, in mesh coordinates
+		void AddLink(unsigned int link, const gk2::VertexPosNormal* vertices, const unsigned short* indices,
+			unsigned int indexCount);
+		//The arm stays on the side the normal points to
+		unsigned int AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal);
+		//Box of the given half size centered at the origin of pose, which must be rigid
+		unsigned int AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose);
+		unsigned int AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius);
+
+		bool IsFree(const float* angles) const;
+		unsigned int getPointCount() const { return static_cast<unsigned int>(m_x.size()); }
+
+	private:
+		static const float CLUSTER_SIZE;		//edge of the cubes points are grouped by
+
+		enum ShapeType { PLANE, BOX, CYLINDER };
+
+		struct Shape
+		{
+			ShapeType type;
+			XMFLOAT3 center;		//point on the plane, box center or cylinder base
+			XMFLOAT3 axes[3];		//plane normal or cylinder axis in axes[0], unit length
+			XMFLOAT3 halfSize;		//box half size, cylinder length in x and radius in y
+		};
+
+		struct Cluster
+		{
+			unsigned int link;
+			XMFLOAT3 center;
+			float radius;
+			unsigned int first;		//points [first, first + count), count a multiple of four
+			unsigned int count;
+		};
+
+		const gk2::PumaKinematics& m_kinematics;
+		float m_margin;
+		std::vector<Shape> m_shapes;
+		std::vector<Cluster> m_clusters;
+		std::vector<float> m_x;
+		std::vector<float> m_y;
+		std::vector<float> m_z;
+
+		//Whether a sphere around center comes within the margin of shape
+		bool IsNear(const Shape& shape, const XMFLOAT3& center, float radius) const;
+		//Whether any of the points of cluster, at pose, is within the margin of shape
+		bool Hits(const Shape& shape, const Cluster& cluster, CXMMATRIX pose) const;
+
+		ArmCollision(const ArmCollision& right) : m_kinematics(right.m_kinematics) { }
+		ArmCollision& operator=(const ArmCollision& right) { return *this; }
+	};
+}
+
+#endif __GK2_ARM_COLLISION_H_
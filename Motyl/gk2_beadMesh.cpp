@@ -0,0 +1,158 @@
+#include "gk2_beadMesh.h"
+#include <cmath>
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int BeadMesh::SIDES = 8;
+const unsigned int BeadMesh::INITIAL_RINGS = 256;
+const unsigned int BeadMesh::STRIDE = sizeof(VertexPosNormal);
+const unsigned int BeadMesh::OFFSET = 0;
+
+BeadMesh::BeadMesh(DeviceHelper& device, float width, float height, float spacing, unsigned int sides)
+	: m_device(device), m_width(width), m_height(height), m_spacing(spacing), m_sides(sides < 3 ? 3 : sides),
+	m_hasStart(false), m_hasLast(false), m_ringCount(0), m_verticesCount(0), m_indicesCount(0)
+{
+	//Two triangles per side between a ring and the next one
+	for (unsigned int k = 0; k < m_sides; ++k)
+	{
+		unsigned int a = k, b = (k + 1) % m_sides, c = k + m_sides, d = b + m_sides;
+		unsigned int quad[6] = { a, b, c, b, d, c };
+		m_segmentIndices.insert(m_segmentIndices.end(), quad, quad + 6);
+	}
+	m_vertexCapacity = INITIAL_RINGS * m_sides;
+	m_indexCapacity = INITIAL_RINGS * 6 * m_sides;
+	m_vertices = m_device.CreateVertexBuffer<VertexPosNormal>(m_vertexCapacity);
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(D3D11_BUFFER_DESC));
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	desc.ByteWidth = m_indexCapacity * sizeof(unsigned int);
+	m_indices = m_device.CreateBuffer(desc);
+}
+
+void BeadMesh::Clear()
+{
+	Break();
+	m_ringCount = 0;
+	m_verticesCount = 0;
+	m_indicesCount = 0;
+	m_newVertices.clear();
+	m_newIndices.clear();
+}
+
+void BeadMesh::AddPoint(const XMFLOAT3& pos, const XMFLOAT3& normal)
+{
+	if (m_ringCount >= MAX_RINGS)
+		return;
+	if (!m_hasStart && !m_hasLast)
+	{
+		m_start = pos;
+		m_startNormal = normal;
+		m_hasStart = true;
+		return;
+	}
+	XMFLOAT3 from = m_hasLast ? m_last : m_start;
+	XMFLOAT3 d(pos.x - from.x, pos.y - from.y, pos.z - from.z);
+	if (d.x * d.x + d.y * d.y + d.z * d.z < m_spacing * m_spacing)
+		return;
+	if (!m_hasLast)
+	{
+		//The first ring waited for a direction
+		AddRing(m_start, m_startNormal, d, false);
+		m_hasStart = false;
+		if (m_ringCount >= MAX_RINGS)
+			return;
+	}
+	AddRing(pos, normal, d, true);
+	m_last = pos;
+	m_hasLast = true;
+}
+
+void BeadMesh::AddRing(const XMFLOAT3& pos, const XMFLOAT3& normal, const XMFLOAT3& direction, bool join)
+{
+	//Side is across the bead on the surface, up is off the surface, both perpendicular to the path
+	XMVECTOR t = XMVector3Normalize(XMLoadFloat3(&direction));
+	XMVECTOR side = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&normal), t));
+	XMVECTOR up = XMVector3Cross(t, side);
+	XMVECTOR center = XMLoadFloat3(&pos);
+	float a = 0.5f * m_width, b = m_height;
+	unsigned int base = m_verticesCount + static_cast<unsigned int>(m_newVertices.size());
+	for (unsigned int k = 0; k < m_sides; ++k)
+	{
+		float angle = XM_2PI * k / m_sides;
+		float c = cos(angle), s = sin(angle);
+		VertexPosNormal v;
+		XMStoreFloat3(&v.Pos, center + side * (a * c) + up * (b * s));
+		//Normal of the ellipse x^2/a^2 + y^2/b^2 = 1
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(side * (b * c) + up * (a * s)));
+		m_newVertices.push_back(v);
+	}
+	if (join)
+		for (unsigned int i = 0; i < m_segmentIndices.size(); ++i)
+			m_newIndices.push_back(base - m_sides + m_segmentIndices[i]);
+	++m_ringCount;
+}
+
+shared_ptr<ID3D11Buffer> BeadMesh::Grow(shared_ptr<ID3D11DeviceContext>& context,
+	const shared_ptr<ID3D11Buffer>& buffer, unsigned int used, unsigned int capacity, D3D11_BIND_FLAG bindFlags)
+{
+	D3D11_BUFFER_DESC desc;
+	ZeroMemory(&desc, sizeof(D3D11_BUFFER_DESC));
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.BindFlags = bindFlags;
+	desc.ByteWidth = capacity;
+	shared_ptr<ID3D11Buffer> grown = m_device.CreateBuffer(desc);
+	if (used > 0)
+	{
+		D3D11_BOX box = { 0, 0, 0, used, 1, 1 };
+		context->CopySubresourceRegion(grown.get(), 0, 0, 0, 0, buffer.get(), 0, &box);
+	}
+	return grown;
+}
+
+void BeadMesh::Update(shared_ptr<ID3D11DeviceContext>& context)
+{
+	if (m_newVertices.empty())
+		return;
+	unsigned int vertices = m_verticesCount + static_cast<unsigned int>(m_newVertices.size());
+	unsigned int indices = m_indicesCount + static_cast<unsigned int>(m_newIndices.size());
+	const unsigned int indexSize = sizeof(unsigned int);
+	if (vertices > m_vertexCapacity)
+	{
+		while (m_vertexCapacity < vertices)
+			m_vertexCapacity *= 2;
+		m_vertices = Grow(context, m_vertices, m_verticesCount * STRIDE, m_vertexCapacity * STRIDE,
+			D3D11_BIND_VERTEX_BUFFER);
+	}
+	if (indices > m_indexCapacity)
+	{
+		while (m_indexCapacity < indices)
+			m_indexCapacity *= 2;
+		m_indices = Grow(context, m_indices, m_indicesCount * indexSize, m_indexCapacity * indexSize,
+			D3D11_BIND_INDEX_BUFFER);
+	}
+
+	//Only the new tail goes to the GPU
+	D3D11_BOX box = { m_verticesCount * STRIDE, 0, 0, vertices * STRIDE, 1, 1 };
+	context->UpdateSubresource(m_vertices.get(), 0, &box, m_newVertices.data(), 0, 0);
+	if (!m_newIndices.empty())
+	{
+		D3D11_BOX indexBox = { m_indicesCount * indexSize, 0, 0, indices * indexSize, 1, 1 };
+		context->UpdateSubresource(m_indices.get(), 0, &indexBox, m_newIndices.data(), 0, 0);
+	}
+	m_verticesCount = vertices;
+	m_indicesCount = indices;
+	m_newVertices.clear();
+	m_newIndices.clear();
+}
+
+void BeadMesh::Render(shared_ptr<ID3D11DeviceContext>& context)
+{
+	if (m_indicesCount == 0)
+		return;
+	ID3D11Buffer* b = m_vertices.get();
+	context->IASetVertexBuffers(0, 1, &b, &STRIDE, &OFFSET);
+	context->IASetIndexBuffer(m_indices.get(), DXGI_FORMAT_R32_UINT, 0);
+	context->DrawIndexed(m_indicesCount, 0, 0);
+}
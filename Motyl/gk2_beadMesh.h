@@ -0,0 +1,79 @@
+#ifndef __GK2_BEAD_MESH_H_
+#define __GK2_BEAD_MESH_H_
+
+#include <d3d11.h>
+#include <xnamath.h>
+#include <memory>
+#include <vector>
+#include "gk2_deviceHelper.h"
+#include "gk2_vertices.h"
+
+namespace gk2
+{
+	//Weld bead as a tube of flattened cross-sections laid along the torch path.
+	//The mesh only grows: a ring of vertices is added whenever the torch gets spacing away from the previous
+	//one, together with the triangles joining it to that ring, made by offsetting a precomputed pattern.
+	//Every Update uploads only what was added since the previous one into the unused tail of the buffers.
+	//Full buffers are replaced by ones twice as large, the old contents are copied over on the GPU.
+	class BeadMesh
+	{
+	public:
+		static const unsigned int MAX_RINGS = 1 << 16;
+
+		//Beads are width wide and height high, with sides vertices around a cross-section
+		BeadMesh(gk2::DeviceHelper& device, float width, float height, float spacing, unsigned int sides = SIDES);
+
+		//Extends the bead towards pos on a surface with the given normal, ignored after MAX_RINGS rings
+		void AddPoint(const XMFLOAT3& pos, const XMFLOAT3& normal);
+		//Ends the current bead, the next point starts a new one
+		void Break() { m_hasLast = false; m_hasStart = false; }
+		void Clear();
+		unsigned int getRingCount() const { return m_ringCount; }
+
+		void Update(std::shared_ptr<ID3D11DeviceContext>& context);
+		//Draws with the currently bound shaders and world matrix
+		void Render(std::shared_ptr<ID3D11DeviceContext>& context);
+
+	private:
+		static const unsigned int SIDES;
+		static const unsigned int INITIAL_RINGS;		//initial capacity of the buffers
+		static const unsigned int STRIDE;
+		static const unsigned int OFFSET;
+
+		gk2::DeviceHelper m_device;
+		float m_width;
+		float m_height;
+		float m_spacing;
+		unsigned int m_sides;
+
+		//Position of the first point of a bead, which gets its ring once the direction is known
+		XMFLOAT3 m_start;
+		XMFLOAT3 m_startNormal;
+		bool m_hasStart;
+		XMFLOAT3 m_last;				//position of the last ring
+		bool m_hasLast;
+		unsigned int m_ringCount;
+
+		std::vector<unsigned int> m_segmentIndices;		//triangles between rings 0 and 1
+		std::vector<gk2::VertexPosNormal> m_newVertices;
+		std::vector<unsigned int> m_newIndices;
+
+		std::shared_ptr<ID3D11Buffer> m_vertices;
+		std::shared_ptr<ID3D11Buffer> m_indices;
+		unsigned int m_vertexCapacity;
+		unsigned int m_indexCapacity;
+		unsigned int m_verticesCount;		//vertices and indices already on the GPU
+		unsigned int m_indicesCount;
+
+		void AddRing(const XMFLOAT3& pos, const XMFLOAT3& normal, const XMFLOAT3& direction, bool join);
+		//Returns a buffer of capacity bytes starting with the first used bytes of buffer
+		std::shared_ptr<ID3D11Buffer> Grow(std::shared_ptr<ID3D11DeviceContext>& context,
+			const std::shared_ptr<ID3D11Buffer>& buffer, unsigned int used, unsigned int capacity,
+			D3D11_BIND_FLAG bindFlags);
+
+		BeadMesh(const BeadMesh& right) { }
+		BeadMesh& operator=(const BeadMesh& right) { return *this; }
+	};
+}
+
+#endif __GK2_BEAD_MESH_H_
@@ -0,0 +1,1104 @@
+#include "gk2_benchmark.h"
+#include "gk2_particlePool.h"
+#include "gk2_particleSorter.h"
+#include "gk2_particleSimulation.h"
+#include "gk2_particles.h"
+#include "gk2_threadPool.h"
+#include "gk2_collisionWorld.h"
+#include "gk2_curlNoise.h"
+#include "gk2_heatField.h"
+#include "gk2_decalMap.h"
+#include "gk2_rope.h"
+#include "gk2_inverseDynamics.h"
+#include "gk2_servoBank.h"
+#include "gk2_armCollision.h"
+#include "gk2_pathPlanner.h"
+#include "gk2_distanceField.h"
+#include "gk2_trajectoryOptimizer.h"
+#include "gk2_pathTiming.h"
+#include "gk2_seamSequencer.h"
+#include "gk2_motionProgram.h"
+#include "gk2_targetStream.h"
+#include "gk2_telemetry.h"
+#include "gk2_jointLog.h"
+#include "gk2_kinematicCalibration.h"
+#include <Windows.h>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+using namespace std;
+using namespace gk2;
+
+namespace
+{
+	//Small deterministic generator, so every run measures the same data
+	unsigned int NextRandom(unsigned int& state)
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	float RandomFloat(unsigned int& state, float min, float max)
+	{
+		return min + (max - min) * static_cast<float>(NextRandom(state) >> 8) / 16777216.0f;
+	}
+
+	//Boxes of roughly the robot's links 1 - 5 instead of the meshes
+	const XMFLOAT3 LINK_CENTERS[] = { XMFLOAT3(0.0f, 0.1f, 0.0f), XMFLOAT3(-0.45f, 0.27f, -0.13f),
+		XMFLOAT3(-1.3f, 0.27f, -0.26f), XMFLOAT3(-1.72f, 0.27f, -0.26f), XMFLOAT3(-1.9f, 0.27f, -0.26f) };
+	const XMFLOAT3 LINK_HALF_SIZES[] = { XMFLOAT3(0.12f, 0.2f, 0.12f), XMFLOAT3(0.55f, 0.1f, 0.1f),
+		XMFLOAT3(0.45f, 0.07f, 0.07f), XMFLOAT3(0.06f, 0.06f, 0.06f), XMFLOAT3(0.15f, 0.03f, 0.03f) };
+
+	//Floor, plate and cylinder of Puma's cell, for anything with AddPlane, AddBox and AddCylinder
+	template<typename T>
+	void AddCell(T& obstacles)
+	{
+		obstacles.AddPlane(XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+		XMVECTOR plateU = XMVector3Normalize(XMVectorSet(-1.5f, 1.5f * sqrtf(3.0f), 0.0f, 0.0f));
+		XMMATRIX platePose = XMMatrixIdentity();
+		platePose.r[0] = plateU;
+		platePose.r[1] = XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f);
+		platePose.r[2] = XMVector3Cross(platePose.r[0], platePose.r[1]);
+		platePose.r[3] = XMVectorSet(-0.9f, -1.0f, 0.0f, 1.0f) + 1.5f * plateU;
+		obstacles.AddBox(XMFLOAT3(1.5f, 2.0f, 0.005f), platePose);
+		obstacles.AddCylinder(XMFLOAT3(-0.5f, -0.5f, 1.0f), XMFLOAT3(2.5f, -0.5f, 1.0f), 0.5f);
+	}
+
+	//Thread counts of the tables, the particle systems are meant to use every core of a large machine too
+	const unsigned int THREAD_COUNTS[] = { 1, 2, 4, 8 };
+	const unsigned int MANY_THREAD_COUNTS[] = { 1, 2, 4, 8, 16 };
+
+	//Checks of the run that failed
+	unsigned int failures = 0;
+
+	//Reports a result the measurements are worthless without
+	void Check(ostream& out, bool passed, const char* what)
+	{
+		if (passed)
+			return;
+		out << "FAILED: " << what << endl;
+		++failures;
+	}
+
+	//Header of a table with a column per thread count after the row label, the caller ends the line
+	template<unsigned int N>
+	void ThreadColumns(ostream& out, const char* rowLabel, const unsigned int (&threadCounts)[N])
+	{
+		out << setw(10) << rowLabel;
+		for (unsigned int t = 0; t < N; ++t)
+			out << setw(10) << threadCounts[t] << "T";
+	}
+
+	//Row of such a table: the label, then what measure returns given a pool of each thread count. The caller
+	//ends the line, the values come back in the order of the columns
+	template<typename L, unsigned int N, typename M>
+	vector<double> Sweep(ostream& out, const L& rowLabel, const unsigned int (&threadCounts)[N], M measure)
+	{
+		vector<double> values(N);
+		out << setw(10) << rowLabel;
+		for (unsigned int t = 0; t < N; ++t)
+		{
+			ThreadPool threads(threadCounts[t]);
+			values[t] = measure(threads);
+			out << setw(11) << values[t];
+		}
+		return values;
+	}
+
+	//Row of the speedups of the times of a row over its first column, the caller ends the line
+	void Speedups(ostream& out, const vector<double>& times)
+	{
+		out << setw(10) << "speedup";
+		for (unsigned int t = 0; t < times.size(); ++t)
+			out << setw(11) << times[0] / times[t];
+	}
+
+	//Torch pose of the model at the angles
+	void GetTorch(const KinematicModel& model, const float* angles, XMFLOAT3& position, XMFLOAT3& normal)
+	{
+		XMMATRIX links[PumaKinematics::LINKS];
+		model.Kinematics.GetLinkMatrices(angles, links);
+		XMStoreFloat3(&position, XMVector3TransformCoord(XMLoadFloat3(&model.TorchTip), links[PumaKinematics::JOINTS]));
+		XMStoreFloat3(&normal, XMVector3TransformNormal(XMLoadFloat3(&model.TorchAxis), links[PumaKinematics::JOINTS]));
+	}
+}
+
+double Benchmark::Now()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+int Benchmark::Run(const wstring& reportFile)
+{
+	ofstream out(reportFile.c_str());
+	if (!out)
+		return -1;
+	failures = 0;
+	out << fixed << setprecision(4);
+	ParticleSort(out);
+	ParticleScaling(out);
+	ParticleCollisions(out);
+	SmokeAdvection(out);
+	HeatDiffusion(out);
+	DecalSplats(out);
+	RopeSteps(out);
+	InverseDynamicsBatch(out);
+	ServoSteps(out);
+	PathPlanning(out);
+	TrajectoryOptimization(out);
+	PathTimingBatch(out);
+	SeamSequencing(out);
+	ProgramPlayback(out);
+	TargetStreaming(out);
+	TelemetryPublishing(out);
+	JointLogImport(out);
+	CalibrationFit(out);
+	out << (failures == 0 ? "All checks passed" : "Some checks FAILED") << endl;
+	return failures == 0 ? 0 : 1;
+}
+
+void Benchmark::ParticleSort(ostream& out)
+{
+	const unsigned int counts[] = { 1000, 10000, 100000, 1000000 };
+	const XMFLOAT4 camPos(0.0f, 3.0f, -7.0f, 1.0f);
+	const XMFLOAT4 camDir(0.0f, -3.0f, 7.0f, 0.0f);
+	out << "Particle depth sort [ms per frame]" << endl;
+	out << setw(10) << "count" << setw(14) << "std::sort" << setw(14) << "radix" << setw(14) << "coherent"
+		<< setw(14) << "incremental" << endl;
+	for (unsigned int c = 0; c < ARRAYSIZE(counts); ++c)
+	{
+		unsigned int count = counts[c];
+		unsigned int seed = 0x2545f491u;
+		ParticlePool pool(count);
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			XMFLOAT3 pos(RandomFloat(seed, -2.0f, 2.0f), RandomFloat(seed, -1.0f, 2.0f), RandomFloat(seed, -2.0f, 2.0f));
+			pool.Add(pos, XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f, 0.08f, 1.0f, 0.0f, 0.0f);
+		}
+		pool.ComputeDepths(camPos, camDir);
+
+		//What the old ParticleComparer did: reload positions and compute both depths on every comparison
+		vector<unsigned int> indices(count);
+		const float* px = pool.getPosX(); const float* py = pool.getPosY(); const float* pz = pool.getPosZ();
+		double comparison = Measure([&]()
+		{
+			for (unsigned int i = 0; i < count; ++i)
+				indices[i] = i;
+			sort(indices.begin(), indices.end(), [&](unsigned int i1, unsigned int i2)
+			{
+				float d1 = (px[i1] - camPos.x) * camDir.x + (py[i1] - camPos.y) * camDir.y + (pz[i1] - camPos.z) * camDir.z;
+				float d2 = (px[i2] - camPos.x) * camDir.x + (py[i2] - camPos.y) * camDir.y + (pz[i2] - camPos.z) * camDir.z;
+				return d1 > d2;
+			});
+		});
+
+		ParticleSorter sorter(count);
+		double radix = Measure([&]() { sorter.Sort(pool.getDepth(), count); });
+
+		//Two frames whose depths differ slightly, as between consecutive frames of a smooth animation
+		vector<float> frames[2];
+		frames[0].assign(pool.getDepth(), pool.getDepth() + count);
+		frames[1] = frames[0];
+		for (unsigned int i = 0; i < count; ++i)
+			frames[1][i] += RandomFloat(seed, -0.002f, 0.002f);
+		vector<unsigned int> identity(count);
+		for (unsigned int i = 0; i < count; ++i)
+			identity[i] = i;
+		sorter.Sort(frames[0].data(), count);
+		unsigned int frame = 0, incremental = 0, sorts = 0;
+		double coherent = Measure([&]()
+		{
+			frame ^= 1;
+			sorter.SortCoherent(frames[frame].data(), count, identity.data(), count, count);
+			incremental += sorter.WasIncremental() ? 1 : 0;
+			++sorts;
+		});
+
+		out << setw(10) << count << setw(14) << comparison << setw(14) << radix << setw(14) << coherent
+			<< setw(13) << (100 * incremental / sorts) << "%" << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::ParticleScaling(ostream& out)
+{
+	const unsigned int particles = 1000000;
+	const float dt = 1.0f / 60.0f, timeToLive = 1.0f, gravity = -4.0f;
+	const unsigned int perFrame = static_cast<unsigned int>(particles * dt / timeToLive);
+	const XMFLOAT4 camPos(0.0f, 3.0f, -7.0f, 1.0f);
+	const XMFLOAT4 camDir(0.0f, -3.0f, 7.0f, 0.0f);
+	out << "Particle simulation, " << particles << " particles, " << thread::hardware_concurrency()
+		<< " hardware threads [ms per frame]" << endl;
+	ThreadColumns(out, "", MANY_THREAD_COUNTS);
+	out << endl;
+	vector<ParticleVertex> vertices(particles);
+	bool steady = true;
+	vector<double> ms = Sweep(out, "frame", MANY_THREAD_COUNTS, [&](ThreadPool& threads) -> double
+	{
+		ParticleSimulation simulation(particles, threads);
+		unsigned int seed = 0x2545f491u;
+		auto frame = [&]()
+		{
+			simulation.Update(dt, gravity);
+			for (unsigned int i = 0; i < perFrame; ++i)
+			{
+				XMFLOAT3 velocity(RandomFloat(seed, 0.0f, 0.5f), RandomFloat(seed, 1.5f, 2.5f), RandomFloat(seed, -0.5f, 0.5f));
+				simulation.Add(XMFLOAT3(0.0f, 0.0f, 0.0f), velocity, RandomFloat(seed, -XM_PI, XM_PI), 0.08f,
+					timeToLive, dt * i / perFrame, gravity);
+			}
+			simulation.Sort(camPos, camDir);
+			simulation.WriteVertices(vertices.data());
+		};
+		//One lifetime of frames fills the system up to its steady state
+		for (unsigned int i = 0; i < static_cast<unsigned int>(timeToLive / dt) + 1; ++i)
+			frame();
+		double frameTime = Measure(frame, 1.0);
+		//As many sparks die in a frame as are born, give or take a frame's worth
+		steady = steady && simulation.getCount() + 2 * perFrame >= particles && simulation.getCount() <= particles;
+		return frameTime;
+	});
+	out << endl;
+	Speedups(out, ms);
+	out << endl;
+	Check(out, steady, "the number of sparks alive is not steady");
+	out << endl;
+}
+
+void Benchmark::ParticleCollisions(ostream& out)
+{
+	const unsigned int particles = 100000;
+	const float dt = 1.0f / 60.0f, gravity = -4.0f;
+	CollisionWorld world(XMFLOAT3(-10.0f, -1.0f, -10.0f), XMFLOAT3(10.0f, 10.0f, 10.0f), 0.5f);
+	world.AddPlane(XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	world.AddPlane(XMFLOAT3(0.0f, 10.0f, 0.0f), XMFLOAT3(0.0f, -1.0f, 0.0f));
+	world.AddPlane(XMFLOAT3(-10.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f));
+	world.AddPlane(XMFLOAT3(10.0f, 0.0f, 0.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f));
+	world.AddPlane(XMFLOAT3(0.0f, 0.0f, -10.0f), XMFLOAT3(0.0f, 0.0f, 1.0f));
+	world.AddPlane(XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(0.0f, 0.0f, -1.0f));
+	world.AddCylinder(XMFLOAT3(-0.5f, -0.5f, 1.0f), XMFLOAT3(2.5f, -0.5f, 1.0f), 0.5f);
+	for (unsigned int i = 0; i < 6; ++i)
+		world.AddBox(XMFLOAT3(0.3f, 0.1f, 0.1f), XMMatrixRotationZ(0.3f * i) * XMMatrixTranslation(0.3f * i, 0.2f * i, 0.0f));
+	world.Build();
+
+	out << "Particle collisions, " << particles << " particles [ms per frame]" << endl;
+	ThreadColumns(out, "", MANY_THREAD_COUNTS);
+	out << endl;
+	for (unsigned int collide = 0; collide < 2; ++collide)
+	{
+		const CollisionWorld* collisions = collide ? &world : nullptr;
+		Sweep(out, collide ? "colliding" : "ballistic", MANY_THREAD_COUNTS, [&](ThreadPool& threads)
+		{
+			//Particles rain over the robot and fall to the floor, so most of them bounce sooner or later
+			ParticleSimulation simulation(particles, threads);
+			unsigned int seed = 0x2545f491u;
+			for (unsigned int i = 0; i < particles; ++i)
+			{
+				XMFLOAT3 pos(RandomFloat(seed, -1.0f, 2.0f), RandomFloat(seed, -0.9f, 2.0f), RandomFloat(seed, -1.0f, 1.0f));
+				XMFLOAT3 velocity(RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f), RandomFloat(seed, -1.0f, 1.0f));
+				simulation.Add(pos, velocity, 0.0f, 0.08f, 1e6f, 0.0f, gravity);
+			}
+			return Measure([&]() { simulation.Update(dt, gravity, collisions); });
+		});
+		out << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::SmokeAdvection(ostream& out)
+{
+	const unsigned int particles = 200000;
+	const float dt = 1.0f / 60.0f;
+	CurlNoise noise(7, 0.8f, 0.4f);
+	SmokeMotion motion;
+	motion.Noise = &noise;
+	motion.Buoyancy = 0.3f;
+	motion.Drag = 2.0f;
+	motion.Growth = 0.15f;
+	out << "Smoke advection, " << particles << " particles [ms per frame]" << endl;
+	ThreadColumns(out, "", MANY_THREAD_COUNTS);
+	out << endl;
+	vector<double> ms = Sweep(out, "update", MANY_THREAD_COUNTS, [&](ThreadPool& threads) -> double
+	{
+		ParticleSimulation simulation(particles, threads);
+		unsigned int seed = 0x2545f491u;
+		for (unsigned int i = 0; i < particles; ++i)
+		{
+			XMFLOAT3 pos(RandomFloat(seed, -2.0f, 2.0f), RandomFloat(seed, -1.0f, 3.0f), RandomFloat(seed, -2.0f, 2.0f));
+			XMFLOAT3 velocity(RandomFloat(seed, -0.3f, 0.3f), RandomFloat(seed, 0.0f, 0.3f), RandomFloat(seed, -0.3f, 0.3f));
+			simulation.Add(pos, velocity, 0.0f, 0.05f, 1e6f, 0.0f, 0.0f, SMOKE_PARTICLE);
+		}
+		float time = 0.0f;
+		return Measure([&]()
+		{
+			time += dt;
+			noise.SetTime(time);
+			simulation.Update(dt, 0.0f, nullptr, &motion);
+		});
+	});
+	out << endl;
+	Speedups(out, ms);
+	out << endl << endl;
+}
+
+void Benchmark::HeatDiffusion(ostream& out)
+{
+	const unsigned int sizes[] = { 512, 1024, 2048, 4096 };
+	const float dt = 1.0f / 60.0f;
+	out << "Heat diffusion on the plate, one stencil step per frame [ms per frame]" << endl;
+	ThreadColumns(out, "size", MANY_THREAD_COUNTS);
+	out << endl;
+	for (unsigned int s = 0; s < ARRAYSIZE(sizes); ++s)
+	{
+		Sweep(out, sizes[s], MANY_THREAD_COUNTS, [&](ThreadPool& threads)
+		{
+			HeatField field(sizes[s], sizes[s], 3.0f, 4.0f, threads);
+			//Slow enough for a single stable step per frame at every size
+			field.SetMaterial(1e-7f, 0.1f);
+			float u = 0.0f;
+			return Measure([&]()
+			{
+				u = u > 1.0f ? 0.0f : u + 0.01f;
+				field.SetSource(XMFLOAT2(u, 0.5f), 0.03f, 0.05f);
+				field.Update(dt);
+			});
+		});
+		out << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::DecalSplats(ostream& out)
+{
+	const unsigned int sizes[] = { 256, 1024, 4096 };
+	const float radii[] = { 0.01f, 0.05f };
+	out << "Decal splats of the torch path against map size and splat radius [us per splat]" << endl;
+	out << setw(10) << "size";
+	for (unsigned int r = 0; r < ARRAYSIZE(radii); ++r)
+		out << setw(14) << radii[r];
+	out << endl;
+	for (unsigned int s = 0; s < ARRAYSIZE(sizes); ++s)
+	{
+		out << setw(10) << sizes[s];
+		DecalMap decals(sizes[s], sizes[s], 3.0f, 4.0f);
+		for (unsigned int r = 0; r < ARRAYSIZE(radii); ++r)
+		{
+			//Short segments around a circle, like the torch covers in a frame
+			float angle = 0.0f;
+			XMFLOAT2 from(0.8f, 0.5f);
+			double ms = Measure([&]()
+			{
+				angle += 0.01f;
+				XMFLOAT2 to(0.5f + 0.3f * cosf(angle), 0.5f + 0.3f * sinf(angle));
+				decals.Splat(SCORCH_LAYER, from, to, radii[r], 0.01f);
+				from = to;
+			});
+			out << setw(14) << 1000.0 * ms;
+		}
+		out << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::RopeSteps(ostream& out)
+{
+	const unsigned int segments[] = { 100, 200, 400, 800 };
+	const float dt = 1.0f / 60.0f;
+	out << "Welding cable swinging over a link [ms per frame], largest stretch after the last run" << endl;
+	ThreadColumns(out, "segments", THREAD_COUNTS);
+	out << setw(14) << "stretch" << endl;
+	for (unsigned int s = 0; s < ARRAYSIZE(segments); ++s)
+	{
+		float stretch = 0.0f;
+		Sweep(out, segments[s], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			Rope rope(segments[s], 2.5f, 0.02f, threads);
+			rope.SetFloor(-1.0f);
+			rope.AddBox(XMFLOAT3(0.3f, 0.2f, 0.3f), XMMatrixTranslation(0.9f, 0.2f, 0.0f));
+			float angle = 0.0f;
+			double ms = Measure([&]()
+			{
+				angle += dt;
+				rope.Attach(XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT3(1.5f + 0.3f * cosf(angle), 1.0f, 0.3f * sinf(angle)));
+				rope.Update(dt);
+			});
+			stretch = rope.getMaxStretch();
+			return ms;
+		});
+		out << setw(14) << stretch << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::InverseDynamicsBatch(ostream& out)
+{
+	const unsigned int sampleCounts[] = { 1000, 10000, 100000 };
+	const unsigned int joints = InverseDynamics::JOINTS;
+	out << "Inverse dynamics over a trajectory [ms per trajectory]" << endl;
+	ThreadColumns(out, "samples", THREAD_COUNTS);
+	out << endl;
+	//Links of roughly the robot's proportions, the cost does not depend on the values
+	PumaKinematics kinematics;
+	InverseDynamics dynamics(kinematics);
+	for (unsigned int i = 1; i < PumaKinematics::LINKS; ++i)
+	{
+		MassProperties link;
+		link.Mass = 100.0f / i;
+		link.CenterOfMass = XMFLOAT3(-0.4f * i, 0.27f, -0.1f * i);
+		link.Inertia = XMFLOAT3X3(link.Mass * 0.1f, 0.0f, 0.0f, 0.0f, link.Mass * 0.2f, 0.0f, 0.0f, 0.0f, link.Mass * 0.2f);
+		dynamics.SetLink(i, link);
+	}
+	bool batchMatches = true;
+	for (unsigned int s = 0; s < ARRAYSIZE(sampleCounts); ++s)
+	{
+		unsigned int samples = sampleCounts[s];
+		vector<float> angles(samples * joints), velocities(samples * joints), accelerations(samples * joints);
+		vector<float> torques(samples * joints);
+		for (unsigned int i = 0; i < samples; ++i)
+			for (unsigned int j = 0; j < joints; ++j)
+			{
+				//Sines of different frequencies, differentiated exactly
+				float w = 1.0f + 0.4f * j, time = 0.001f * i;
+				angles[i * joints + j] = sinf(w * time + j);
+				velocities[i * joints + j] = w * cosf(w * time + j);
+				accelerations[i * joints + j] = -w * w * sinf(w * time + j);
+			}
+		Sweep(out, samples, THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			double ms = Measure([&]()
+			{
+				dynamics.SolveBatch(samples, &angles[0], &velocities[0], &accelerations[0], &torques[0], threads);
+			});
+			//Every thread count gives the torques of one sample at a time
+			for (unsigned int i = 0; i < samples; i += samples / 10)
+			{
+				float single[joints];
+				dynamics.Solve(&angles[i * joints], &velocities[i * joints], &accelerations[i * joints], single);
+				for (unsigned int j = 0; j < joints; ++j)
+					batchMatches = batchMatches && fabs(single[j] - torques[i * joints + j]) <= 1e-3f * (1.0f + fabs(single[j]));
+			}
+			return ms;
+		});
+		out << endl;
+	}
+	Check(out, batchMatches, "batch torques differ from those of single samples");
+	out << endl;
+}
+
+void Benchmark::ServoSteps(ostream& out)
+{
+	const unsigned int robotCounts[] = { 1, 64, 1024, 8192 };
+	const unsigned int joints = PumaKinematics::JOINTS;
+	const float dt = 1.0f / 60.0f;
+	out << "Joint servos of many robots, " << static_cast<int>(1.0f / ServoBank::STEP + 0.5f) <<
+		" steps per second [ms per frame]" << endl;
+	ThreadColumns(out, "robots", THREAD_COUNTS);
+	out << endl;
+	for (unsigned int r = 0; r < ARRAYSIZE(robotCounts); ++r)
+	{
+		Sweep(out, robotCounts[r], THREAD_COUNTS, [&](ThreadPool& threads)
+		{
+			ServoBank servos(robotCounts[r] * joints, threads);
+			for (unsigned int c = 0; c < servos.getChannelCount(); ++c)
+				servos.Reset(c, 0.0f);
+			float time = 0.0f;
+			return Measure([&]()
+			{
+				time += dt;
+				for (unsigned int c = 0; c < servos.getChannelCount(); ++c)
+					servos.SetTarget(c, sinf(time + c));
+				servos.Update(dt);
+			});
+		});
+		out << endl;
+	}
+	out << endl;
+}
+
+void Benchmark::PathPlanning(ostream& out)
+{
+	const unsigned int joints = PathPlanner::JOINTS;
+	const unsigned int queries = 32;
+	out << "Transfer motions between random free poses, planned and smoothed [ms per query]" << endl;
+	ThreadColumns(out, "queries", THREAD_COUNTS);
+	out << endl;
+	const unsigned short faces[] = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4,
+		2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	PumaKinematics kinematics;
+	ArmCollision collision(kinematics, 0.03f);
+	for (unsigned int i = 0; i < ARRAYSIZE(LINK_CENTERS); ++i)
+	{
+		const XMFLOAT3& center = LINK_CENTERS[i];
+		const XMFLOAT3& halfSize = LINK_HALF_SIZES[i];
+		VertexPosNormal corners[8];
+		for (unsigned int c = 0; c < 8; ++c)
+		{
+			corners[c].Pos = XMFLOAT3(center.x + (c & 1 ? halfSize.x : -halfSize.x),
+				center.y + (c & 2 ? halfSize.y : -halfSize.y), center.z + (c & 4 ? halfSize.z : -halfSize.z));
+			corners[c].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+		}
+		collision.AddLink(i + 1, corners, faces, ARRAYSIZE(faces));
+	}
+	AddCell(collision);
+	//The same free start and goal poses for every thread count
+	vector<float> poses;
+	unsigned int state = 1;
+	while (poses.size() < 2 * queries * joints)
+	{
+		float q[joints];
+		for (unsigned int j = 0; j < joints; ++j)
+			q[j] = RandomFloat(state, -XM_PI, XM_PI);
+		if (collision.IsFree(q))
+			poses.insert(poses.end(), q, q + joints);
+	}
+	bool clear = true;
+	Sweep(out, queries, THREAD_COUNTS, [&](ThreadPool& threads) -> double
+	{
+		PathPlanner planner(collision, threads);
+		vector<float> path;
+		unsigned int query = 0;
+		double ms = Measure([&]()
+		{
+			const float* start = &poses[2 * query * joints];
+			if (planner.Plan(start, start + joints, path))
+				planner.Shortcut(path, 100);
+			query = (query + 1) % queries;
+		});
+		//A found path goes from the start to the goal through free waypoints
+		const float* start = &poses[0];
+		if (planner.Plan(start, start + joints, path))
+		{
+			planner.Shortcut(path, 100);
+			clear = clear && equal(start, start + joints, path.begin()) &&
+				equal(start + joints, start + 2 * joints, path.end() - joints);
+			for (unsigned int i = 0; i < path.size(); i += joints)
+				clear = clear && collision.IsFree(&path[i]);
+		}
+		return ms;
+	});
+	out << endl;
+	Check(out, clear, "a planned path is not free or misses its ends");
+	out << endl;
+}
+
+void Benchmark::TrajectoryOptimization(ostream& out)
+{
+	const unsigned int waypointCounts[] = { 50, 200, 1000 };
+	const unsigned int joints = TrajectoryOptimizer::JOINTS;
+	const unsigned int iterations = 10;
+	out << "Trajectory optimization through a cell like Puma's [ms per iteration]" << endl;
+	ThreadColumns(out, "waypoints", THREAD_COUNTS);
+	out << endl;
+	ThreadPool buildThreads;
+	DistanceField field(XMFLOAT3(-2.5f, -1.2f, -2.5f), XMFLOAT3(2.5f, 2.6f, 2.5f), 0.05f);
+	AddCell(field);
+	field.Build(buildThreads);
+	//A straight swing of the base joint from one side of the plate to the other, through it
+	const float start[joints] = { XM_PIDIV2, 0.0f, 0.0f, 0.0f, 0.0f };
+	const float goal[joints] = { -XM_PIDIV2, 0.0f, 0.0f, 0.0f, 0.0f };
+	vector<float> line(start, start + joints);
+	line.insert(line.end(), goal, goal + joints);
+	PumaKinematics kinematics;
+	bool improved = true;
+	for (unsigned int w = 0; w < ARRAYSIZE(waypointCounts); ++w)
+	{
+		vector<float> initial, trajectory;
+		TrajectoryOptimizer::Resample(line, waypointCounts[w], initial);
+		Sweep(out, waypointCounts[w], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			TrajectoryOptimizer optimizer(kinematics, field, threads);
+			//Spheres 0.1 apart along the longest side of each link box
+			for (unsigned int i = 0; i < ARRAYSIZE(LINK_CENTERS); ++i)
+			{
+				const XMFLOAT3& center = LINK_CENTERS[i];
+				const XMFLOAT3& halfSize = LINK_HALF_SIZES[i];
+				float radius = halfSize.y > halfSize.z ? halfSize.y : halfSize.z;
+				for (float x = -halfSize.x; x <= halfSize.x; x += 0.1f)
+					optimizer.AddSphere(i + 1, XMFLOAT3(center.x + x, center.y, center.z), radius);
+			}
+			trajectory = initial;
+			float firstCost = optimizer.Optimize(trajectory, 1, 0.0f);
+			double ms = Measure([&]()
+			{
+				trajectory = initial;
+				optimizer.Optimize(trajectory, iterations, 0.0f);
+			});
+			//More iterations lower the cost and leave the ends where they were
+			trajectory = initial;
+			float cost = optimizer.Optimize(trajectory, iterations, 0.0f);
+			improved = improved && cost < firstCost && equal(start, start + joints, trajectory.begin()) &&
+				equal(goal, goal + joints, trajectory.end() - joints);
+			return ms / iterations;
+		});
+		out << endl;
+	}
+	Check(out, improved, "optimization does not lower the cost or moves the ends");
+	out << endl;
+}
+
+void Benchmark::PathTimingBatch(ostream& out)
+{
+	const unsigned int pathCounts[] = { 100, 1000, 5000 };
+	const unsigned int joints = PathTiming::JOINTS;
+	const unsigned int waypoints = 200;
+	//Sample differences only approximate the derivatives the timing bounds
+	const float dt = 0.001f, slack = 1.05f;
+	out << "Time-optimal timing of " << waypoints << "-waypoint paths [ms per batch]" << endl;
+	ThreadColumns(out, "paths", THREAD_COUNTS);
+	out << endl;
+	const float maxVelocity[joints] = { 1.0f, 1.0f, 1.5f, 3.0f, 3.0f };
+	const float maxAcceleration[joints] = { 2.0f, 2.0f, 3.0f, 6.0f, 6.0f };
+	PathTiming timing;
+	timing.SetLimits(maxVelocity, maxAcceleration);
+	bool withinLimits = true, batchMatches = true;
+	for (unsigned int p = 0; p < ARRAYSIZE(pathCounts); ++p)
+	{
+		//Sines of random frequencies and phases
+		unsigned int state = 1;
+		vector<float> paths(pathCounts[p] * waypoints * joints), durations(pathCounts[p]);
+		for (unsigned int i = 0; i < pathCounts[p]; ++i)
+			for (unsigned int j = 0; j < joints; ++j)
+			{
+				float frequency = RandomFloat(state, 1.0f, 6.0f), phase = RandomFloat(state, 0.0f, XM_2PI);
+				for (unsigned int w = 0; w < waypoints; ++w)
+					paths[(i * waypoints + w) * joints + j] = sinf(frequency * w / (waypoints - 1) + phase);
+			}
+		Sweep(out, pathCounts[p], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			double ms = Measure([&]()
+			{
+				timing.ComputeBatch(&paths[0], pathCounts[p], waypoints, &durations[0], threads);
+			});
+			//Every thread count times the paths as one path at a time does
+			for (unsigned int i = 0; i < pathCounts[p]; i += pathCounts[p] / 10)
+			{
+				float duration = timing.Compute(&paths[i * waypoints * joints], waypoints);
+				batchMatches = batchMatches && fabs(duration - durations[i]) <= 1e-4f * duration;
+			}
+			return ms;
+		});
+		out << endl;
+		//The first path timed keeps within the limits: velocities by differences of neighbouring samples,
+		//accelerations by second differences over about a waypoint interval, since shorter ones are mostly rounding
+		vector<float> trajectory;
+		float duration = timing.Compute(&paths[0], waypoints);
+		withinLimits = withinLimits && timing.Resample(dt, trajectory);
+		unsigned int window = static_cast<unsigned int>(duration / (waypoints - 1) / dt + 0.5f);
+		window = window > 0 ? window : 1;
+		float step = window * dt;
+		for (unsigned int i = joints; i < trajectory.size(); ++i)
+		{
+			unsigned int j = i % joints;
+			float velocity = (trajectory[i] - trajectory[i - joints]) / dt;
+			withinLimits = withinLimits && fabs(velocity) <= slack * maxVelocity[j];
+			if (i < 2 * window * joints)
+				continue;
+			float acceleration = (trajectory[i] - 2.0f * trajectory[i - window * joints] +
+				trajectory[i - 2 * window * joints]) / (step * step);
+			withinLimits = withinLimits && fabs(acceleration) <= slack * maxAcceleration[j];
+		}
+	}
+	Check(out, batchMatches, "batch durations differ from those of single paths");
+	Check(out, withinLimits, "a timed path exceeds the joint limits");
+	out << endl;
+}
+
+void Benchmark::SeamSequencing(ostream& out)
+{
+	const unsigned int seamCounts[] = { 50, 200, 500 };
+	const unsigned int joints = SeamSequencer::JOINTS;
+	const unsigned int starts = 8;
+	out << "Seam order and directions from " << starts << " local searches [ms per fixture]" << endl;
+	ThreadColumns(out, "seams", THREAD_COUNTS);
+	out << setw(14) << "transfer [s]" << setw(14) << "in order [s]" << endl;
+	const float maxVelocity[joints] = { 1.0f, 1.0f, 1.5f, 3.0f, 3.0f };
+	const float maxAcceleration[joints] = { 2.0f, 2.0f, 3.0f, 6.0f, 6.0f };
+	const float home[joints] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	bool ordered = true;
+	for (unsigned int s = 0; s < ARRAYSIZE(seamCounts); ++s)
+	{
+		//Short seams scattered over the joint space, ends one after another
+		unsigned int state = 1;
+		vector<float> ends(2 * seamCounts[s] * joints);
+		for (unsigned int i = 0; i < seamCounts[s]; ++i)
+			for (unsigned int j = 0; j < joints; ++j)
+			{
+				ends[2 * i * joints + j] = RandomFloat(state, -1.5f, 1.5f);
+				ends[(2 * i + 1) * joints + j] = ends[2 * i * joints + j] + RandomFloat(state, -0.3f, 0.3f);
+			}
+		float transfer = 0.0f, inOrder = 0.0f;
+		Sweep(out, seamCounts[s], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			SeamSequencer sequencer(threads);
+			sequencer.SetLimits(maxVelocity, maxAcceleration);
+			sequencer.SetHome(home);
+			for (unsigned int i = 0; i < seamCounts[s]; ++i)
+				sequencer.AddSeam(&ends[2 * i * joints], &ends[(2 * i + 1) * joints], 2.0f);
+			double ms = Measure([&]()
+			{
+				sequencer.Solve(starts);
+			});
+			//Every seam once, and no slower between them than welding them as they were added
+			vector<bool> welded(seamCounts[s], false);
+			const vector<SeamStep>& program = sequencer.getProgram();
+			ordered = ordered && program.size() == seamCounts[s];
+			for (unsigned int i = 0; i < program.size(); ++i)
+			{
+				ordered = ordered && program[i].Seam < seamCounts[s] && !welded[program[i].Seam];
+				welded[program[i].Seam % seamCounts[s]] = true;
+			}
+			inOrder = sequencer.TransferTime(home, &ends[0]) +
+				sequencer.TransferTime(&ends[(2 * seamCounts[s] - 1) * joints], home);
+			for (unsigned int i = 1; i < seamCounts[s]; ++i)
+				inOrder += sequencer.TransferTime(&ends[(2 * i - 1) * joints], &ends[2 * i * joints]);
+			transfer = sequencer.getTransferTime();
+			ordered = ordered && transfer <= inOrder;
+			return ms;
+		});
+		out << setw(14) << transfer << setw(14) << inOrder << endl;
+	}
+	Check(out, ordered, "a fixture is not welded seam by seam or is slower than in order");
+	out << endl;
+}
+
+void Benchmark::ProgramPlayback(ostream& out)
+{
+	const unsigned int lineCounts[] = { 100, 10000, 100000 };
+	const unsigned int joints = MotionProgram::JOINTS;
+	const unsigned int targets = 1000000;
+	out << "Robot programs played by every thread from its own start [ns per target] and compiled [ms]" << endl;
+	ThreadColumns(out, "lines", THREAD_COUNTS);
+	out << setw(11) << "compile" << endl;
+	const float maxVelocity[joints] = { 1.0f, 1.0f, 1.5f, 3.0f, 3.0f };
+	const float maxAcceleration[joints] = { 2.0f, 2.0f, 3.0f, 6.0f, 6.0f };
+	const float home[joints] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	MotionProgram program;
+	program.SetLimits(maxVelocity, maxAcceleration);
+	//Angles are the torch position and direction, only the cost of the compiler's calls counts
+	program.SetKinematics([](const XMFLOAT3& pos, const XMFLOAT3& normal, float* angles)
+	{
+		angles[0] = pos.x;
+		angles[1] = pos.y;
+		angles[2] = pos.z;
+		angles[3] = normal.x;
+		angles[4] = normal.y;
+	}, [](const float* angles, XMFLOAT3& pos, XMFLOAT3& normal)
+	{
+		pos = XMFLOAT3(angles[0], angles[1], angles[2]);
+		normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	});
+	bool compiled = true;
+	for (unsigned int l = 0; l < ARRAYSIZE(lineCounts); ++l)
+	{
+		//Random lines and arcs with joint moves, dwells and speed changes in between
+		unsigned int state = 1;
+		ostringstream source;
+		source << fixed << setprecision(4);
+		for (unsigned int i = 0; i < lineCounts[l]; ++i)
+		{
+			unsigned int kind = NextRandom(state) % 8;
+			if (kind == 0)
+				source << "JOINT " << RandomFloat(state, -1.0f, 1.0f) << " 0.5 -0.5 0 0" << endl;
+			else if (kind == 1)
+				source << "DWELL " << RandomFloat(state, 0.1f, 1.0f) << endl;
+			else if (kind == 2)
+				source << "SPEED " << RandomFloat(state, 0.1f, 0.5f) << " ; faster or slower" << endl;
+			else
+			{
+				source << (kind < 5 ? "LINE" : "ARC");
+				for (unsigned int k = 0; k < (kind < 5 ? 3u : 6u); ++k)
+					source << " " << RandomFloat(state, -1.0f, 1.0f);
+				source << endl;
+			}
+		}
+		string text = source.str();
+		double compile = Measure([&]()
+		{
+			compiled = program.Compile(text, home) && compiled;
+		});
+		Sweep(out, lineCounts[l], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			unsigned int threadCount = threads.getThreadCount();
+			unsigned int perThread = targets / threadCount;
+			double ms = Measure([&]()
+			{
+				threads.Run(threadCount, [&](unsigned int thread)
+				{
+					//Kept in double, long programs run for days and a float would stop advancing
+					double dt = 0.0005, time = program.getDuration() * thread / threadCount;
+					unsigned int segment = 0;
+					MotionTarget target;
+					for (unsigned int i = 0; i < perThread; ++i)
+					{
+						program.Evaluate(static_cast<float>(time), target, segment);
+						time += dt;
+						time = time > program.getDuration() ? 0.0 : time;
+					}
+				});
+			});
+			return 1e6 * ms / (perThread * threadCount);
+		});
+		out << setw(11) << compile << endl;
+	}
+	Check(out, compiled, "a generated program does not compile");
+	out << endl;
+}
+
+void Benchmark::TargetStreaming(ostream& out)
+{
+	const unsigned int messages = 10000;
+	const double burstTime = 1.0;
+	TargetListener listener(TargetListener::DEFAULT_PORT + 1);
+	out << "Targets streamed over the loopback" << endl;
+	if (!listener.Start())
+	{
+		out << "port " << TargetListener::DEFAULT_PORT + 1 << " is taken" << endl << endl;
+		return;
+	}
+	TargetSender sender(TargetListener::DEFAULT_PORT + 1);
+	const float position[3] = { -1.55f, 0.13f, -0.5f }, normal[3] = { 0.87f, 0.5f, 0.0f };
+
+	//One at a time, from sending to the consumer seeing it
+	vector<double> latencies;
+	for (unsigned int i = 0; i < messages; ++i)
+	{
+		sender.Send(position, normal, true);
+		double start = Now();
+		const TargetSample* sample = 0;
+		while (!(sample = listener.Front()) && Now() - start < 0.1)
+			;
+		if (!sample)
+			continue;
+		latencies.push_back(Now() - sample->Message.Time);
+		listener.Pop();
+	}
+	sort(latencies.begin(), latencies.end());
+	out << setw(10) << "latency" << setw(11) << "median" << setw(11) << "99%" << setw(11) << "max" << setw(11) <<
+		"lost" << endl;
+	if (!latencies.empty())
+		out << setw(10) << "[us]" << setw(11) << 1e6 * latencies[latencies.size() / 2] << setw(11) <<
+			1e6 * latencies[latencies.size() * 99 / 100] << setw(11) << 1e6 * latencies.back() << setw(11) <<
+			messages - latencies.size() << endl;
+
+	//As fast as a sender thread can go while the consumer keeps emptying the queue
+	unsigned int dropped = listener.getDropped(), received = 0;
+	atomic<bool> sending(true);
+	thread burst([&]()
+	{
+		while (sending)
+			sender.Send(position, normal, true);
+	});
+	double start = Now();
+	while (Now() - start < burstTime)
+		for (const TargetSample* sample = listener.Front(); sample; sample = listener.Front())
+		{
+			++received;
+			listener.Pop();
+		}
+	sending = false;
+	burst.join();
+	out << setw(10) << "burst" << setw(11) << "sent/s" << setw(11) << "taken/s" << setw(11) << "dropped/s" << endl;
+	out << setw(10) << "" << setw(11) << (sender.getSent() - messages) / burstTime << setw(11) <<
+		received / burstTime << setw(11) << (listener.getDropped() - dropped) / burstTime << endl;
+	out << endl;
+}
+
+void Benchmark::TelemetryPublishing(ostream& out)
+{
+	const unsigned int batch = 1000;
+	const wchar_t* name = L"Local\\MotylTelemetryBenchmark";
+	TelemetryWriter writer(name);
+	out << "Telemetry records published to shared memory" << endl;
+	if (!writer.Create())
+	{
+		out << "the shared memory is taken" << endl << endl;
+		return;
+	}
+	TelemetryRecord record = TelemetryRecord();
+	auto publish = [&]()
+	{
+		for (unsigned int i = 0; i < batch; ++i)
+		{
+			record.Time = i;
+			writer.Publish(record);
+			++record.Step;
+		}
+	};
+	out << setw(10) << "readers" << setw(11) << "[ns]" << setw(11) << "read" << setw(11) << "torn" << endl;
+	out << setw(10) << 0 << setw(11) << 1e6 * Measure(publish) / batch << endl;
+
+	TelemetryReader reader;
+	if (!reader.Open(name))
+	{
+		out << endl;
+		return;
+	}
+	atomic<bool> reading(true);
+	unsigned int read = 0, torn = 0;
+	thread poll([&]()
+	{
+		TelemetryRecord copy;
+		while (reading)
+		{
+			unsigned int written = reader.getWritten();
+			if (written == 0 || !reader.Read(written - 1, copy))
+				continue;
+			++read;
+			if (copy.Time != static_cast<double>(copy.Step % batch))
+				++torn;
+		}
+	});
+	double ns = 1e6 * Measure(publish) / batch;
+	reading = false;
+	poll.join();
+	out << setw(10) << 1 << setw(11) << ns << setw(11) << read << setw(11) << torn << endl;
+	out << endl;
+}
+
+void Benchmark::JointLogImport(ostream& out)
+{
+	const unsigned int samples = 1000000;
+	const wchar_t* files[] = { L"benchmark_joints.csv", L"benchmark_joints.bin" };
+	const char* formats[] = { "text", "binary" };
+	//The same samples as text, in the format of encoder exports, and binary
+	unsigned int state = 1;
+	{
+		ofstream text(files[0], ios::binary);
+		ofstream binary(files[1], ios::binary);
+		JointLogHeader header = { JointLogHeader::MAGIC, JointLogHeader::VERSION, sizeof(JointSample) };
+		binary.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		text << "time,a1,a2,a3,a4,a5\n" << fixed;
+		for (unsigned int i = 0; i < samples; ++i)
+		{
+			JointSample sample = { 0.001 * i };
+			text << setprecision(3) << sample.Time << setprecision(6);
+			for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+			{
+				sample.Angles[j] = RandomFloat(state, -XM_PI, XM_PI);
+				text << "," << sample.Angles[j];
+			}
+			text << "\n";
+			binary.write(reinterpret_cast<const char*>(&sample), sizeof(sample));
+		}
+	}
+	out << "Joint logs of " << samples << " samples read from the page cache [MB/s]" << endl;
+	ThreadColumns(out, "format", THREAD_COUNTS);
+	out << endl;
+	//Every read of either file sees all the samples, the same up to the digits the text keeps
+	bool complete = true;
+	double sums[ARRAYSIZE(files)] = { 0.0, 0.0 };
+	for (unsigned int f = 0; f < ARRAYSIZE(files); ++f)
+	{
+		Sweep(out, formats[f], THREAD_COUNTS, [&](ThreadPool& threads) -> double
+		{
+			JointLog log(threads);
+			if (!log.Open(files[f]))
+			{
+				complete = false;
+				return 0.0;
+			}
+			vector<double> taskSums(log.getTaskCount());
+			double ms = Measure([&]()
+			{
+				fill(taskSums.begin(), taskSums.end(), 0.0);
+				log.Read([&](unsigned int task, const JointSample* batch, unsigned int count)
+				{
+					for (unsigned int i = 0; i < count; ++i)
+						taskSums[task] += batch[i].Angles[0];
+				});
+			});
+			double sum = 0.0;
+			for (unsigned int task = 0; task < taskSums.size(); ++task)
+				sum += taskSums[task];
+			complete = complete && log.getSampleCount() == samples &&
+				(sums[f] == 0.0 || fabs(sum - sums[f]) < 1e-6 * samples);
+			sums[f] = sum;
+			return log.getSize() / (1000.0 * ms);
+		});
+		out << endl;
+	}
+	complete = complete && fabs(sums[0] - sums[1]) < 1e-6 * samples;
+	for (unsigned int f = 0; f < ARRAYSIZE(files); ++f)
+		DeleteFileW(files[f]);
+	Check(out, complete, "a joint log is not read whole or text and binary differ");
+	out << endl;
+}
+
+void Benchmark::CalibrationFit(ostream& out)
+{
+	const unsigned int samples = 100000;
+	const unsigned int validation = 1000;
+	//Worst torch position and direction error of the fitted model away from the samples
+	const float positionTolerance = 0.0005f, directionTolerance = 0.001f;
+	//Measured poses of a robot a few millimetres and hundredths of a radian off the nominal one
+	unsigned int state = 1;
+	KinematicModel nominal;
+	nominal.TorchTip = XMFLOAT3(-2.06f, 0.27f, 0.0f);
+	nominal.TorchAxis = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	KinematicModel real = nominal;
+	for (unsigned int k = 1; k <= PumaKinematics::JOINTS; ++k)
+	{
+		XMFLOAT3 point = real.Kinematics.getJointPoint(k);
+		point.x += RandomFloat(state, -0.005f, 0.005f);
+		point.y += RandomFloat(state, -0.005f, 0.005f);
+		point.z += RandomFloat(state, -0.005f, 0.005f);
+		real.Kinematics.SetJoint(k, point, real.Kinematics.getJointAxis(k));
+		if (k < PumaKinematics::JOINTS)
+			real.Kinematics.SetZero(k, RandomFloat(state, -0.02f, 0.02f));
+	}
+	real.TorchTip.x += 0.003f;
+	XMStoreFloat3(&real.TorchAxis, XMVector3Normalize(XMVectorSet(1.0f, 0.01f, -0.02f, 0.0f)));
+	vector<CalibrationSample> poses(samples + validation);
+	for (unsigned int i = 0; i < poses.size(); ++i)
+	{
+		CalibrationSample& sample = poses[i];
+		for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+			sample.Angles[j] = RandomFloat(state, -1.5f, 1.5f);
+		GetTorch(real, sample.Angles, sample.Position, sample.Normal);
+		if (i < samples)
+			sample.Position.x += RandomFloat(state, -0.0001f, 0.0001f);
+	}
+	out << "Calibration of " << samples << " samples from the nominal geometry [ms]" << endl;
+	ThreadColumns(out, "samples", THREAD_COUNTS);
+	out << setw(11) << "iterations" << setw(11) << "rms [mm]" << endl;
+	unsigned int iterations = 0;
+	float positionAfter = 0.0f;
+	bool recovered = true;
+	Sweep(out, samples, THREAD_COUNTS, [&](ThreadPool& threads) -> double
+	{
+		KinematicCalibration calibration(threads);
+		for (unsigned int i = 0; i < samples; ++i)
+			calibration.AddSample(poses[i]);
+		bool fitted = true;
+		double ms = Measure([&]()
+		{
+			calibration.SetModel(nominal);
+			fitted = calibration.Fit() && fitted;
+		});
+		float positionBefore, directionBefore, directionAfter;
+		calibration.GetErrors(positionBefore, directionBefore, positionAfter, directionAfter);
+		iterations = calibration.getIterations();
+		//The fitted model places the torch where the real robot does at poses it was not fitted to
+		recovered = recovered && fitted;
+		for (unsigned int i = samples; i < poses.size(); ++i)
+		{
+			XMFLOAT3 position, normal;
+			GetTorch(calibration.getModel(), poses[i].Angles, position, normal);
+			float miss = XMVectorGetX(XMVector3Length(XMLoadFloat3(&position) - XMLoadFloat3(&poses[i].Position)));
+			float turn = XMVectorGetX(XMVector3Length(XMLoadFloat3(&normal) - XMLoadFloat3(&poses[i].Normal)));
+			recovered = recovered && miss <= positionTolerance && turn <= directionTolerance;
+		}
+		return ms;
+	});
+	out << setw(11) << iterations << setw(11) << 1000.0f * positionAfter << endl;
+	Check(out, recovered, "calibration does not recover the real geometry");
+	out << endl;
+}
@@ -0,0 +1,74 @@
+#ifndef __GK2_BENCHMARK_H_
+#define __GK2_BENCHMARK_H_
+
+#include <string>
+#include <ostream>
+
+namespace gk2
+{
+	//Headless performance measurements, started with the -benchmark command line switch.
+	//Nothing here needs a window or a Direct3D device.
+	class Benchmark
+	{
+	public:
+		//Runs every benchmark and writes the report to reportFile, returns the process exit code
+		static int Run(const std::wstring& reportFile);
+
+	private:
+		//Sort cost against particle count: comparison sort, radix sort and the coherent path
+		static void ParticleSort(std::ostream& out);
+		//Frame time of a steady stream of a million sparks against the number of simulation threads
+		static void ParticleScaling(std::ostream& out);
+		//Update cost of particles bouncing in a scene like Puma's, with and without collisions
+		static void ParticleCollisions(std::ostream& out);
+		//Update cost of smoke carried by the curl noise field against the number of simulation threads
+		static void SmokeAdvection(std::ostream& out);
+		//Cost of a heat field step against grid size and the number of threads
+		static void HeatDiffusion(std::ostream& out);
+		//Cost of a decal splat against the map size, which should not matter
+		static void DecalSplats(std::ostream& out);
+		//Cost of a frame of the welding cable against its length and the number of threads
+		static void RopeSteps(std::ostream& out);
+		//Cost of joint torques over a whole trajectory against its length and the number of threads
+		static void InverseDynamicsBatch(std::ostream& out);
+		//Cost of a frame of joint servos at the controller rate against the number of robots and threads
+		static void ServoSteps(std::ostream& out);
+		//Cost of a planned and smoothed transfer motion through a cell like Puma's against the number of threads
+		static void PathPlanning(std::ostream& out);
+		//Cost of an optimizer iteration against the number of waypoints and threads
+		static void TrajectoryOptimization(std::ostream& out);
+		//Cost of timing a batch of candidate paths against their number and the number of threads
+		static void PathTimingBatch(std::ostream& out);
+		//Cost of ordering the seams of a fixture against their number and the number of threads
+		static void SeamSequencing(std::ostream& out);
+		//Cost of compiling robot programs and of playing them on several threads at once
+		static void ProgramPlayback(std::ostream& out);
+		//Latency and throughput of targets streamed over the loopback, the listener on its own port
+		static void TargetStreaming(std::ostream& out);
+		//Cost of publishing a telemetry record, alone and with a reader polling the ring all the time
+		static void TelemetryPublishing(std::ostream& out);
+		//Rate of reading joint logs, text and binary, against the number of threads
+		static void JointLogImport(std::ostream& out);
+		//Time of fitting the robot's geometry to measured torch poses against the number of threads
+		static void CalibrationFit(std::ostream& out);
+
+		//Seconds since an arbitrary point in time
+		static double Now();
+		//Milliseconds per call of f, averaged over enough calls to last about minSeconds
+		template<typename F>
+		static double Measure(F f, double minSeconds = 0.2)
+		{
+			unsigned int calls = 0;
+			double start = Now(), elapsed = 0.0;
+			do
+			{
+				f();
+				++calls;
+				elapsed = Now() - start;
+			} while (elapsed < minSeconds);
+			return 1000.0 * elapsed / calls;
+		}
+	};
+}
+
+#endif __GK2_BENCHMARK_H_
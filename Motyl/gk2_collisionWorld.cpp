@@ -0,0 +1,387 @@
+#include "gk2_collisionWorld.h"
+#include <emmintrin.h>
+#include <cmath>
+
+using namespace std;
+using namespace gk2;
+
+const float CollisionWorld::SKIN = 0.001f;
+
+namespace
+{
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+	}
+
+	XMFLOAT3 MulAdd(const XMFLOAT3& a, const XMFLOAT3& b, float s)
+	{
+		return XMFLOAT3(a.x + b.x * s, a.y + b.y * s, a.z + b.z * s);
+	}
+
+	float& Coord(XMFLOAT3& v, unsigned int i)
+	{
+		return (&v.x)[i];
+	}
+
+	float Coord(const XMFLOAT3& v, unsigned int i)
+	{
+		return (&v.x)[i];
+	}
+}
+
+CollisionWorld::CollisionWorld(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float cellSize)
+	: m_restitution(0.5f), m_friction(0.2f), m_budget(1 << 16), m_gridMin(boundsMin), m_cellSize(cellSize)
+{
+	unsigned int cells = 1;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		float size = ceil((Coord(boundsMax, i) - Coord(boundsMin, i)) / cellSize);
+		m_gridSize[i] = size < 1.0f ? 1 : static_cast<unsigned int>(size);
+		cells *= m_gridSize[i];
+	}
+	m_cellStart.assign(cells + 1, 0);
+}
+
+void CollisionWorld::SetMaterial(float restitution, float friction)
+{
+	m_restitution = restitution;
+	m_friction = friction;
+}
+
+unsigned int CollisionWorld::AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal)
+{
+	Plane plane;
+	XMStoreFloat3(&plane.normal, XMVector3Normalize(XMLoadFloat3(&normal)));
+	plane.d = Dot(plane.normal, point);
+	m_planes.push_back(plane);
+	return static_cast<unsigned int>(m_planes.size()) - 1;
+}
+
+unsigned int CollisionWorld::AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose)
+{
+	Shape box;
+	box.type = BOX;
+	box.halfSize = halfSize;
+	m_shapes.push_back(box);
+	unsigned int i = static_cast<unsigned int>(m_shapes.size()) - 1;
+	SetBoxPose(i, pose);
+	return i;
+}
+
+void CollisionWorld::SetBoxPose(unsigned int box, CXMMATRIX pose)
+{
+	Shape& shape = m_shapes[box];
+	XMStoreFloat3(&shape.center, pose.r[3]);
+	for (unsigned int i = 0; i < 3; ++i)
+		XMStoreFloat3(&shape.axes[i], XMVector3Normalize(pose.r[i]));
+	UpdateBounds(shape);
+}
+
+unsigned int CollisionWorld::AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius)
+{
+	Shape cylinder;
+	cylinder.type = CYLINDER;
+	cylinder.center = p0;
+	XMVECTOR axis = XMLoadFloat3(&p1) - XMLoadFloat3(&p0);
+	XMStoreFloat3(&cylinder.axes[0], XMVector3Normalize(axis));
+	cylinder.halfSize = XMFLOAT3(XMVectorGetX(XMVector3Length(axis)), radius, 0.0f);
+	UpdateBounds(cylinder);
+	m_shapes.push_back(cylinder);
+	return static_cast<unsigned int>(m_shapes.size()) - 1;
+}
+
+void CollisionWorld::UpdateBounds(Shape& shape)
+{
+	for (unsigned int j = 0; j < 3; ++j)
+	{
+		float min, max;
+		if (shape.type == BOX)
+		{
+			float extent = 0.0f;
+			for (unsigned int k = 0; k < 3; ++k)
+				extent += fabs(Coord(shape.axes[k], j)) * Coord(shape.halfSize, k);
+			min = Coord(shape.center, j) - extent;
+			max = Coord(shape.center, j) + extent;
+		}
+		else
+		{
+			float end = Coord(shape.center, j) + Coord(shape.axes[0], j) * shape.halfSize.x;
+			min = Coord(shape.center, j) < end ? Coord(shape.center, j) : end;
+			max = Coord(shape.center, j) < end ? end : Coord(shape.center, j);
+			min -= shape.halfSize.y;
+			max += shape.halfSize.y;
+		}
+		Coord(shape.boundsMin, j) = min;
+		Coord(shape.boundsMax, j) = max;
+	}
+}
+
+void CollisionWorld::CellRange(const XMFLOAT3& min, const XMFLOAT3& max, unsigned int first[3],
+	unsigned int last[3]) const
+{
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		float lo = floor((Coord(min, i) - Coord(m_gridMin, i)) / m_cellSize);
+		float hi = floor((Coord(max, i) - Coord(m_gridMin, i)) / m_cellSize);
+		float top = static_cast<float>(m_gridSize[i] - 1);
+		first[i] = static_cast<unsigned int>(lo < 0.0f ? 0.0f : (lo > top ? top : lo));
+		last[i] = static_cast<unsigned int>(hi < 0.0f ? 0.0f : (hi > top ? top : hi));
+	}
+}
+
+void CollisionWorld::Build()
+{
+	//Counting sort of (cell, shape) pairs by cell
+	unsigned int cells = static_cast<unsigned int>(m_cellStart.size()) - 1;
+	m_cellStart.assign(cells + 1, 0);
+	unsigned int first[3], last[3];
+	for (unsigned int s = 0; s < m_shapes.size(); ++s)
+	{
+		CellRange(m_shapes[s].boundsMin, m_shapes[s].boundsMax, first, last);
+		for (unsigned int z = first[2]; z <= last[2]; ++z)
+			for (unsigned int y = first[1]; y <= last[1]; ++y)
+				for (unsigned int x = first[0]; x <= last[0]; ++x)
+					++m_cellStart[Cell(x, y, z) + 1];
+	}
+	for (unsigned int c = 0; c < cells; ++c)
+		m_cellStart[c + 1] += m_cellStart[c];
+	m_cellShapes.resize(m_cellStart[cells]);
+	vector<unsigned int> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+	for (unsigned int s = 0; s < m_shapes.size(); ++s)
+	{
+		CellRange(m_shapes[s].boundsMin, m_shapes[s].boundsMax, first, last);
+		for (unsigned int z = first[2]; z <= last[2]; ++z)
+			for (unsigned int y = first[1]; y <= last[1]; ++y)
+				for (unsigned int x = first[0]; x <= last[0]; ++x)
+					m_cellShapes[fill[Cell(x, y, z)]++] = s;
+	}
+}
+
+bool CollisionWorld::IntersectBox(const Shape& box, const XMFLOAT3& a, const XMFLOAT3& ab, Hit& hit)
+{
+	//Slab test in box coordinates, only steps starting outside the box count
+	XMFLOAT3 d = Sub(a, box.center);
+	float tmin = 0.0f, tmax = 1.0f, sign = 0.0f;
+	int axis = -1;
+	bool inside = true;
+	for (unsigned int k = 0; k < 3; ++k)
+	{
+		float h = Coord(box.halfSize, k);
+		float p = Dot(d, box.axes[k]), v = Dot(ab, box.axes[k]);
+		bool outside = p < -h || p > h;
+		inside = inside && !outside;
+		if (fabs(v) < 1e-12f)
+		{
+			if (outside)
+				return false;
+			continue;
+		}
+		float t1 = (-h - p) / v, t2 = (h - p) / v;
+		float enter = t1 < t2 ? t1 : t2, exit = t1 < t2 ? t2 : t1;
+		if (enter > tmin)
+		{
+			tmin = enter;
+			axis = k;
+			sign = v > 0.0f ? -1.0f : 1.0f;
+		}
+		if (exit < tmax)
+			tmax = exit;
+		if (tmin > tmax)
+			return false;
+	}
+	if (inside || axis < 0)
+		return false;
+	hit.fraction = tmin;
+	hit.normal = XMFLOAT3(box.axes[axis].x * sign, box.axes[axis].y * sign, box.axes[axis].z * sign);
+	return true;
+}
+
+bool CollisionWorld::IntersectCylinder(const Shape& cylinder, const XMFLOAT3& a, const XMFLOAT3& ab, Hit& hit)
+{
+	//Side surface only: the step without its axial part against a circle
+	const XMFLOAT3& w = cylinder.axes[0];
+	float length = cylinder.halfSize.x, radius = cylinder.halfSize.y;
+	XMFLOAT3 d = Sub(a, cylinder.center);
+	float da = Dot(d, w), dab = Dot(ab, w);
+	XMFLOAT3 q = MulAdd(d, w, -da), e = MulAdd(ab, w, -dab);
+	float c = Dot(q, q) - radius * radius;
+	if (c <= 0.0f)
+		return false;
+	float qa = Dot(e, e);
+	if (qa < 1e-12f)
+		return false;
+	float qb = 2.0f * Dot(q, e);
+	float disc = qb * qb - 4.0f * qa * c;
+	if (disc < 0.0f)
+		return false;
+	float s = (-qb - sqrt(disc)) / (2.0f * qa);
+	if (s < 0.0f || s > 1.0f)
+		return false;
+	float h = da + s * dab;
+	if (h < 0.0f || h > length)
+		return false;
+	XMFLOAT3 n = MulAdd(q, e, s);
+	float len = sqrt(Dot(n, n));
+	hit.fraction = s;
+	hit.normal = XMFLOAT3(n.x / len, n.y / len, n.z / len);
+	return true;
+}
+
+void CollisionWorld::Bounce(const CollisionParticles& particles, unsigned int i, const Hit& hit, const XMFLOAT3& a,
+	float prevTime, float gravity) const
+{
+	float t = particles.time[i];
+	XMFLOAT3 b(particles.posX[i], particles.posY[i], particles.posZ[i]);
+	XMFLOAT3 contact = MulAdd(a, Sub(b, a), hit.fraction);
+	float contactTime = prevTime + hit.fraction * (t - prevTime);
+	XMFLOAT3 v(particles.velX[i], particles.velY[i] + gravity * contactTime, particles.velZ[i]);
+	const XMFLOAT3& n = hit.normal;
+	float vn = Dot(v, n);
+	if (vn >= 0.0f)
+		return;
+	//v = vt*(1 - friction) - vn*restitution
+	XMFLOAT3 vt = MulAdd(v, n, -vn);
+	float keep = 1.0f - m_friction;
+	v = MulAdd(XMFLOAT3(vt.x * keep, vt.y * keep, vt.z * keep), n, -vn * m_restitution);
+	XMFLOAT3 start = MulAdd(contact, n, SKIN);
+	float rest = t - contactTime;
+	particles.startX[i] = start.x;
+	particles.startY[i] = start.y;
+	particles.startZ[i] = start.z;
+	particles.velX[i] = v.x;
+	particles.velY[i] = v.y;
+	particles.velZ[i] = v.z;
+	particles.time[i] = rest;
+	particles.posX[i] = start.x + v.x * rest;
+	particles.posY[i] = start.y + (v.y + 0.5f * gravity * rest) * rest;
+	particles.posZ[i] = start.z + v.z * rest;
+}
+
+unsigned int CollisionWorld::Collide(const CollisionParticles& particles, float dt, float gravity) const
+{
+	const __m128 zero = _mm_setzero_ps(), none = _mm_set1_ps(2.0f);
+	const __m128 vdt = _mm_set1_ps(dt), halfG = _mm_set1_ps(0.5f * gravity);
+	const __m128 invCell = _mm_set1_ps(1.0f / m_cellSize);
+	const __m128 gridMin[3] = { _mm_set1_ps(m_gridMin.x), _mm_set1_ps(m_gridMin.y), _mm_set1_ps(m_gridMin.z) };
+	const __m128 gridTop[3] = { _mm_set1_ps(static_cast<float>(m_gridSize[0] - 1)),
+		_mm_set1_ps(static_cast<float>(m_gridSize[1] - 1)), _mm_set1_ps(static_cast<float>(m_gridSize[2] - 1)) };
+	const bool useGrid = !m_cellShapes.empty();
+	unsigned int tests = 0, bounces = 0;
+	float prevTime[4], prevPos[3][4], planeFraction[4];
+	int plane[4], cellA[3][4], cellB[3][4];
+	unsigned int candidates[MAX_CANDIDATES];
+
+	for (unsigned int i = 0; i < particles.count; i += 4)
+	{
+		//Where the particle was dt ago, or where its current path started if it bounced since
+		__m128 t = _mm_load_ps(particles.time + i);
+		__m128 tp = _mm_max_ps(_mm_sub_ps(t, vdt), zero);
+		__m128 a[3], b[3];
+		a[0] = _mm_add_ps(_mm_load_ps(particles.startX + i), _mm_mul_ps(_mm_load_ps(particles.velX + i), tp));
+		a[1] = _mm_add_ps(_mm_load_ps(particles.startY + i),
+			_mm_mul_ps(_mm_add_ps(_mm_load_ps(particles.velY + i), _mm_mul_ps(halfG, tp)), tp));
+		a[2] = _mm_add_ps(_mm_load_ps(particles.startZ + i), _mm_mul_ps(_mm_load_ps(particles.velZ + i), tp));
+		b[0] = _mm_load_ps(particles.posX + i);
+		b[1] = _mm_load_ps(particles.posY + i);
+		b[2] = _mm_load_ps(particles.posZ + i);
+
+		//Earliest plane crossing of the four steps
+		__m128 best = none;
+		__m128i bestPlane = _mm_set1_epi32(-1);
+		for (unsigned int p = 0; p < m_planes.size(); ++p)
+		{
+			const Plane& pl = m_planes[p];
+			__m128 nx = _mm_set1_ps(pl.normal.x), ny = _mm_set1_ps(pl.normal.y), nz = _mm_set1_ps(pl.normal.z);
+			__m128 d = _mm_set1_ps(pl.d);
+			__m128 da = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], nx), _mm_mul_ps(a[1], ny)), _mm_mul_ps(a[2], nz)), d);
+			__m128 db = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(b[0], nx), _mm_mul_ps(b[1], ny)), _mm_mul_ps(b[2], nz)), d);
+			__m128 crossing = _mm_and_ps(_mm_cmpge_ps(da, zero), _mm_cmplt_ps(db, zero));
+			__m128 fraction = _mm_div_ps(da, _mm_sub_ps(da, db));
+			__m128 closer = _mm_and_ps(crossing, _mm_cmplt_ps(fraction, best));
+			best = _mm_or_ps(_mm_and_ps(closer, fraction), _mm_andnot_ps(closer, best));
+			__m128i closerMask = _mm_castps_si128(closer);
+			bestPlane = _mm_or_si128(_mm_and_si128(closerMask, _mm_set1_epi32(p)), _mm_andnot_si128(closerMask, bestPlane));
+		}
+		int crossed = _mm_movemask_ps(_mm_cmplt_ps(best, none));
+		_mm_storeu_ps(planeFraction, best);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(plane), bestPlane);
+		_mm_storeu_ps(prevTime, tp);
+		for (unsigned int k = 0; k < 3; ++k)
+			_mm_storeu_ps(prevPos[k], a[k]);
+
+		//Grid cells of both ends of the steps
+		if (useGrid)
+			for (unsigned int k = 0; k < 3; ++k)
+			{
+				__m128 ca = _mm_mul_ps(_mm_sub_ps(a[k], gridMin[k]), invCell);
+				__m128 cb = _mm_mul_ps(_mm_sub_ps(b[k], gridMin[k]), invCell);
+				ca = _mm_min_ps(_mm_max_ps(ca, zero), gridTop[k]);
+				cb = _mm_min_ps(_mm_max_ps(cb, zero), gridTop[k]);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(cellA[k]), _mm_cvttps_epi32(ca));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(cellB[k]), _mm_cvttps_epi32(cb));
+			}
+
+		unsigned int lanes = particles.count - i < 4 ? particles.count - i : 4;
+		for (unsigned int lane = 0; lane < lanes; ++lane)
+		{
+			Hit hit;
+			bool found = (crossed & (1 << lane)) != 0;
+			if (found)
+			{
+				hit.fraction = planeFraction[lane];
+				hit.normal = m_planes[plane[lane]].normal;
+			}
+			XMFLOAT3 start(prevPos[0][lane], prevPos[1][lane], prevPos[2][lane]);
+			if (useGrid && tests < m_budget)
+			{
+				//Shapes of every cell between both ends, each one once
+				unsigned int first[3], last[3], count = 0;
+				for (unsigned int k = 0; k < 3; ++k)
+				{
+					first[k] = cellA[k][lane] < cellB[k][lane] ? cellA[k][lane] : cellB[k][lane];
+					last[k] = cellA[k][lane] < cellB[k][lane] ? cellB[k][lane] : cellA[k][lane];
+				}
+				for (unsigned int z = first[2]; z <= last[2]; ++z)
+					for (unsigned int y = first[1]; y <= last[1]; ++y)
+						for (unsigned int x = first[0]; x <= last[0]; ++x)
+						{
+							unsigned int c = Cell(x, y, z);
+							for (unsigned int s = m_cellStart[c]; s < m_cellStart[c + 1] && count < MAX_CANDIDATES; ++s)
+							{
+								unsigned int shape = m_cellShapes[s], j = 0;
+								while (j < count && candidates[j] != shape)
+									++j;
+								if (j == count)
+									candidates[count++] = shape;
+							}
+						}
+				unsigned int p = i + lane;
+				XMFLOAT3 step(particles.posX[p] - start.x, particles.posY[p] - start.y, particles.posZ[p] - start.z);
+				for (unsigned int j = 0; j < count; ++j, ++tests)
+				{
+					const Shape& shape = m_shapes[candidates[j]];
+					Hit shapeHit;
+					bool intersects = shape.type == BOX ? IntersectBox(shape, start, step, shapeHit) :
+						IntersectCylinder(shape, start, step, shapeHit);
+					if (intersects && (!found || shapeHit.fraction < hit.fraction))
+					{
+						hit = shapeHit;
+						found = true;
+					}
+				}
+			}
+			if (found)
+			{
+				Bounce(particles, i + lane, hit, start, prevTime[lane], gravity);
+				++bounces;
+			}
+		}
+	}
+	return bounces;
+}
@@ -0,0 +1,104 @@
+#ifndef __GK2_COLLISION_WORLD_H_
+#define __GK2_COLLISION_WORLD_H_
+
+#include <xnamath.h>
+#include <vector>
+
+namespace gk2
+{
+	//Streams of particles following pos = start + vel*time + gravity*time^2/2, see ParticlePool
+	struct CollisionParticles
+	{
+		float* posX; float* posY; float* posZ;
+		float* startX; float* startY; float* startZ;
+		float* velX; float* velY; float* velZ;
+		float* time;
+		unsigned int count;
+	};
+
+	//Static and moving obstacles particles bounce off.
+	//Half-space planes (room walls) are tested against every particle, four at a time. Finite shapes,
+	//oriented boxes and cylinders, are registered in a uniform grid, and a particle is tested only
+	//against the shapes in the cells its last step touched. A bounce restarts the particle's closed-form
+	//path at the contact point, so no per-frame integration is needed afterwards.
+	class CollisionWorld
+	{
+	public:
+		//The grid covers [boundsMin, boundsMax] with cubic cells, shapes outside are clamped to the border cells
+		CollisionWorld(const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax, float cellSize);
+
+		//restitution scales the normal velocity, friction takes away a part of the tangential velocity
+		void SetMaterial(float restitution, float friction);
+		//Limit of particle-shape tests per Collide call, particles over it only collide with planes
+		void SetBudget(unsigned int tests) { m_budget = tests; }
+
+		//Particles are kept on the side the normal points to
+		unsigned int AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal);
+		//Box of the given half size centered at the origin of pose, which must be rigid
+		unsigned int AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose);
+		void SetBoxPose(unsigned int box, CXMMATRIX pose);
+		unsigned int AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius);
+		//Puts finite shapes into the grid, call after moving them and before Collide
+		void Build();
+
+		//Bounces the particles whose last step of length dt went into an obstacle, returns the number of bounces.
+		//Safe to call from several threads at once for different particles.
+		unsigned int Collide(const CollisionParticles& particles, float dt, float gravity) const;
+
+	private:
+		static const float SKIN;		//distance from the surface a bounced particle restarts at
+		static const unsigned int MAX_CANDIDATES = 32;
+
+		enum ShapeType { BOX, CYLINDER };
+
+		struct Plane
+		{
+			XMFLOAT3 normal;
+			float d;
+		};
+
+		struct Shape
+		{
+			ShapeType type;
+			XMFLOAT3 center;		//box center or cylinder base
+			XMFLOAT3 axes[3];		//box axes or cylinder axis in axes[0], unit length
+			XMFLOAT3 halfSize;		//box half size, cylinder length in x and radius in y
+			XMFLOAT3 boundsMin;
+			XMFLOAT3 boundsMax;
+		};
+
+		struct Hit
+		{
+			float fraction;			//part of the step before the contact
+			XMFLOAT3 normal;
+		};
+
+		float m_restitution;
+		float m_friction;
+		unsigned int m_budget;
+
+		std::vector<Plane> m_planes;
+		std::vector<Shape> m_shapes;
+
+		XMFLOAT3 m_gridMin;
+		float m_cellSize;
+		unsigned int m_gridSize[3];
+		std::vector<unsigned int> m_cellStart;	//shapes of cell c are m_cellShapes[m_cellStart[c], m_cellStart[c + 1])
+		std::vector<unsigned int> m_cellShapes;
+
+		void UpdateBounds(Shape& shape);
+		void CellRange(const XMFLOAT3& min, const XMFLOAT3& max, unsigned int first[3], unsigned int last[3]) const;
+		unsigned int Cell(unsigned int x, unsigned int y, unsigned int z) const
+		{
+			return x + m_gridSize[0] * (y + m_gridSize[1] * z);
+		}
+
+		static bool IntersectBox(const Shape& box, const XMFLOAT3& a, const XMFLOAT3& ab, Hit& hit);
+		static bool IntersectCylinder(const Shape& cylinder, const XMFLOAT3& a, const XMFLOAT3& ab, Hit& hit);
+		//a is where the step of particle i started, prevTime its path time there
+		void Bounce(const CollisionParticles& particles, unsigned int i, const Hit& hit, const XMFLOAT3& a,
+			float prevTime, float gravity) const;
+	};
+}
+
+#endif __GK2_COLLISION_WORLD_H_
@@ -0,0 +1,119 @@
+#include "gk2_curlNoise.h"
+#include <emmintrin.h>
+
+using namespace gk2;
+
+const float CurlNoise::DRIFT = 0.25f;
+
+namespace
+{
+	//Low 32 bits of the products, SSE2 has no _mm_mullo_epi32
+	__m128i MulLo(__m128i a, __m128i b)
+	{
+		__m128i even = _mm_mul_epu32(a, b);
+		__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+		return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+			_mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+	}
+
+	__m128 Floor(__m128 x)
+	{
+		__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+		return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+	}
+
+	//Pseudo-random value in [-1, 1) of a lattice corner, from the corner's hashed coordinates
+	__m128 CornerValue(__m128i hx, __m128i hy, __m128i hz, __m128i seed)
+	{
+		__m128i h = _mm_xor_si128(_mm_xor_si128(hx, hy), _mm_xor_si128(hz, seed));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+		h = MulLo(h, _mm_set1_epi32(0x5bd1e995));
+		h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+		return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), _mm_set1_ps(2.0f / 16777216.0f)),
+			_mm_set1_ps(1.0f));
+	}
+
+	//Quintic fade curve and its derivative
+	void Fade(__m128 f, __m128& u, __m128& du)
+	{
+		__m128 f2 = _mm_mul_ps(f, f);
+		__m128 g = _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))),
+			_mm_set1_ps(10.0f));
+		u = _mm_mul_ps(_mm_mul_ps(f2, f), g);
+		__m128 fm1 = _mm_sub_ps(f, _mm_set1_ps(1.0f));
+		du = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(30.0f), f2), _mm_mul_ps(fm1, fm1));
+	}
+}
+
+CurlNoise::CurlNoise(unsigned int seed, float frequency, float strength)
+	: m_frequency(frequency), m_strength(strength), m_time(0.0f)
+{
+	for (unsigned int i = 0; i < 3; ++i)
+		m_seeds[i] = seed * 0x9e3779b9u + 0x7f4a7c15u * (i + 1);
+}
+
+void CurlNoise::NoiseGradients(__m128 x, __m128 y, __m128 z, const unsigned int seeds[3], __m128 gradients[3][3])
+{
+	//Lattice cell and fade weights are shared by all potentials, only the corner values differ
+	__m128 fx = Floor(x), fy = Floor(y), fz = Floor(z);
+	__m128i ix = _mm_cvttps_epi32(fx), iy = _mm_cvttps_epi32(fy), iz = _mm_cvttps_epi32(fz);
+	const __m128i one = _mm_set1_epi32(1);
+	//Per-axis parts of the corner hashes, combined by xor
+	const __m128i px = _mm_set1_epi32(0x8da6b343), py = _mm_set1_epi32(0xd8163841), pz = _mm_set1_epi32(0xcb1ab31f);
+	__m128i hx0 = MulLo(ix, px), hx1 = MulLo(_mm_add_epi32(ix, one), px);
+	__m128i hy0 = MulLo(iy, py), hy1 = MulLo(_mm_add_epi32(iy, one), py);
+	__m128i hz0 = MulLo(iz, pz), hz1 = MulLo(_mm_add_epi32(iz, one), pz);
+
+	__m128 u, v, w, du, dv, dw;
+	Fade(_mm_sub_ps(x, fx), u, du);
+	Fade(_mm_sub_ps(y, fy), v, dv);
+	Fade(_mm_sub_ps(z, fz), w, dw);
+	__m128 uv = _mm_mul_ps(u, v), vw = _mm_mul_ps(v, w), wu = _mm_mul_ps(w, u);
+
+	for (int k = 0; k < 3; ++k)
+	{
+		__m128i s = _mm_set1_epi32(seeds[k]);
+		__m128 a = CornerValue(hx0, hy0, hz0, s), b = CornerValue(hx1, hy0, hz0, s);
+		__m128 c = CornerValue(hx0, hy1, hz0, s), d = CornerValue(hx1, hy1, hz0, s);
+		__m128 e = CornerValue(hx0, hy0, hz1, s), f = CornerValue(hx1, hy0, hz1, s);
+		__m128 g = CornerValue(hx0, hy1, hz1, s), h = CornerValue(hx1, hy1, hz1, s);
+		//n = a + k1 u + k2 v + k3 w + k4 uv + k5 vw + k6 wu + k7 uvw
+		__m128 k1 = _mm_sub_ps(b, a), k2 = _mm_sub_ps(c, a), k3 = _mm_sub_ps(e, a);
+		__m128 k4 = _mm_sub_ps(_mm_add_ps(a, d), _mm_add_ps(b, c));
+		__m128 k5 = _mm_sub_ps(_mm_add_ps(a, g), _mm_add_ps(c, e));
+		__m128 k6 = _mm_sub_ps(_mm_add_ps(a, f), _mm_add_ps(b, e));
+		__m128 k7 = _mm_sub_ps(_mm_add_ps(_mm_add_ps(b, c), _mm_add_ps(e, h)),
+			_mm_add_ps(_mm_add_ps(a, d), _mm_add_ps(f, g)));
+		gradients[k][0] = _mm_mul_ps(du, _mm_add_ps(_mm_add_ps(k1, _mm_mul_ps(k4, v)),
+			_mm_add_ps(_mm_mul_ps(k6, w), _mm_mul_ps(k7, vw))));
+		gradients[k][1] = _mm_mul_ps(dv, _mm_add_ps(_mm_add_ps(k2, _mm_mul_ps(k4, u)),
+			_mm_add_ps(_mm_mul_ps(k5, w), _mm_mul_ps(k7, wu))));
+		gradients[k][2] = _mm_mul_ps(dw, _mm_add_ps(_mm_add_ps(k3, _mm_mul_ps(k6, u)),
+			_mm_add_ps(_mm_mul_ps(k5, v), _mm_mul_ps(k7, uv))));
+	}
+}
+
+void CurlNoise::Sample(const __m128 pos[3], __m128 velocity[3]) const
+{
+	//The field drifts diagonally through the noise, which keeps it changing without a fourth dimension
+	const __m128 frequency = _mm_set1_ps(m_frequency);
+	const __m128 drift = _mm_set1_ps(m_time * DRIFT);
+	__m128 x = _mm_add_ps(_mm_mul_ps(pos[0], frequency), drift);
+	__m128 y = _mm_add_ps(_mm_mul_ps(pos[1], frequency), drift);
+	__m128 z = _mm_add_ps(_mm_mul_ps(pos[2], frequency), drift);
+	__m128 d[3][3];
+	NoiseGradients(x, y, z, m_seeds, d);
+	//curl = (dP2/dy - dP1/dz, dP0/dz - dP2/dx, dP1/dx - dP0/dy), chain rule adds the frequency
+	const __m128 scale = _mm_set1_ps(m_strength * m_frequency);
+	velocity[0] = _mm_mul_ps(scale, _mm_sub_ps(d[2][1], d[1][2]));
+	velocity[1] = _mm_mul_ps(scale, _mm_sub_ps(d[0][2], d[2][0]));
+	velocity[2] = _mm_mul_ps(scale, _mm_sub_ps(d[1][0], d[0][1]));
+}
+
+XMFLOAT3 CurlNoise::Sample(const XMFLOAT3& pos) const
+{
+	__m128 p[3] = { _mm_set1_ps(pos.x), _mm_set1_ps(pos.y), _mm_set1_ps(pos.z) };
+	__m128 v[3];
+	Sample(p, v);
+	return XMFLOAT3(_mm_cvtss_f32(v[0]), _mm_cvtss_f32(v[1]), _mm_cvtss_f32(v[2]));
+}
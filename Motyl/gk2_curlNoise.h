@@ -0,0 +1,38 @@
+#ifndef __GK2_CURL_NOISE_H_
+#define __GK2_CURL_NOISE_H_
+
+#include <xnamath.h>
+
+namespace gk2
+{
+	//Divergence-free velocity field for smoke.
+	//The velocity is the curl of three value noise potentials, computed from their analytic gradients, so
+	//the flow neither gathers nor spreads particles. The potentials share one lattice and differ in seeds,
+	//so cell lookup and interpolation weights are computed once. Points are evaluated four at a time with SSE2.
+	class CurlNoise
+	{
+	public:
+		//frequency is the number of noise cells per unit of length, strength scales the velocity
+		CurlNoise(unsigned int seed, float frequency, float strength);
+
+		void SetTime(float time) { m_time = time; }
+		float getTime() const { return m_time; }
+
+		//Velocity at four points given as x, y and z vectors
+		void Sample(const __m128 pos[3], __m128 velocity[3]) const;
+		XMFLOAT3 Sample(const XMFLOAT3& pos) const;
+
+	private:
+		static const float DRIFT;	//speed at which the field moves through the noise, in cells per second
+
+		unsigned int m_seeds[3];
+		float m_frequency;
+		float m_strength;
+		float m_time;
+
+		//Gradients of three value noises, one per seed, at four points in noise coordinates
+		static void NoiseGradients(__m128 x, __m128 y, __m128 z, const unsigned int seeds[3], __m128 gradients[3][3]);
+	};
+}
+
+#endif __GK2_CURL_NOISE_H_
@@ -0,0 +1,169 @@
+#include "gk2_decalMap.h"
+#include "gk2_utils.h"
+#include <emmintrin.h>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace gk2;
+
+DecalMap::DecalMap(unsigned int width, unsigned int height, float sizeU, float sizeV)
+	: m_width(width < 1 ? 1 : width), m_height(height < 1 ? 1 : height)
+{
+	m_stride = (m_width + 3) & ~3u;
+	m_cellU = sizeU / m_width;
+	m_cellV = sizeV / m_height;
+	size_t layerSize = m_stride * m_height;
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(DECAL_LAYER_COUNT * layerSize * sizeof(float)));
+	for (unsigned int i = 0; i < DECAL_LAYER_COUNT; ++i)
+		m_layers[i] = m_data + i * layerSize;
+	Clear();
+}
+
+DecalMap::~DecalMap()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+void DecalMap::Clear()
+{
+	memset(m_data, 0, DECAL_LAYER_COUNT * m_stride * m_height * sizeof(float));
+	MarkDirty();
+}
+
+void DecalMap::Splat(DecalLayer layer, const XMFLOAT2& from, const XMFLOAT2& to, float radius, float amount)
+{
+	float sizeU = m_cellU * m_width, sizeV = m_cellV * m_height;
+	float ax = from.x * sizeU, ay = from.y * sizeV;
+	float abx = to.x * sizeU - ax, aby = to.y * sizeV - ay;
+	//Texels reached by the antialiased edge
+	float reach = radius + m_cellU + m_cellV;
+	float minX = (abx < 0.0f ? ax + abx : ax) - reach, maxX = (abx < 0.0f ? ax : ax + abx) + reach;
+	float minY = (aby < 0.0f ? ay + aby : ay) - reach, maxY = (aby < 0.0f ? ay : ay + aby) + reach;
+	if (maxX < 0.0f || maxY < 0.0f || minX >= sizeU || minY >= sizeV)
+		return;
+	int x0 = static_cast<int>(minX / m_cellU), x1 = static_cast<int>(maxX / m_cellU);
+	int y0 = static_cast<int>(minY / m_cellV), y1 = static_cast<int>(maxY / m_cellV);
+	x0 = x0 < 0 ? 0 : x0;
+	y0 = y0 < 0 ? 0 : y0;
+	x1 = x1 >= static_cast<int>(m_width) ? m_width - 1 : x1;
+	y1 = y1 >= static_cast<int>(m_height) ? m_height - 1 : y1;
+
+	float length2 = abx * abx + aby * aby;
+	bool moving = length2 > 0.0f;
+	const __m128 vax = _mm_set1_ps(ax), vabx = _mm_set1_ps(abx), vaby = _mm_set1_ps(aby);
+	const __m128 invLength2 = _mm_set1_ps(moving ? 1.0f / length2 : 0.0f);
+	const __m128 vradius = _mm_set1_ps(radius), invEdge = _mm_set1_ps(2.0f / (m_cellU + m_cellV));
+	const __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+	const __m128 vamount = _mm_set1_ps(amount);
+	const __m128 lanes = _mm_mul_ps(_mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f), _mm_set1_ps(m_cellU));
+	const __m128 step = _mm_set1_ps(4.0f * m_cellU);
+	//Moving splats leave out the disc around from, the previous splat has covered it
+	const __m128 startDisc = moving ? one : zero;
+	unsigned int xs = static_cast<unsigned int>(x0) & ~3u;
+	for (int y = y0; y <= y1; ++y)
+	{
+		float* row = m_layers[layer] + y * m_stride;
+		__m128 dy = _mm_set1_ps((y + 0.5f) * m_cellV - ay);
+		__m128 dyab = _mm_mul_ps(dy, vaby);
+		__m128 dx = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(xs * m_cellU), lanes), vax);
+		for (unsigned int x = xs; x <= static_cast<unsigned int>(x1); x += 4, dx = _mm_add_ps(dx, step))
+		{
+			//Distance to the nearest point of the segment
+			__m128 along = _mm_add_ps(_mm_mul_ps(dx, vabx), dyab);
+			__m128 t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(along, invLength2), zero), one);
+			__m128 ex = _mm_sub_ps(dx, _mm_mul_ps(t, vabx)), ey = _mm_sub_ps(dy, _mm_mul_ps(t, vaby));
+			__m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+			__m128 startDist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+			//Opacity falls from 1 to 0 over one texel across the edge
+			__m128 c = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vradius, dist), invEdge), half);
+			c = _mm_min_ps(_mm_max_ps(c, zero), one);
+			__m128 disc = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vradius, startDist), invEdge), half);
+			disc = _mm_mul_ps(_mm_min_ps(_mm_max_ps(disc, zero), one), startDisc);
+			c = _mm_max_ps(_mm_sub_ps(c, disc), zero);
+			__m128 v = _mm_load_ps(row + x);
+			v = _mm_add_ps(v, _mm_mul_ps(_mm_mul_ps(c, vamount), _mm_sub_ps(one, v)));
+			_mm_store_ps(row + x, v);
+		}
+	}
+
+	if (m_dirty.left >= m_dirty.right)
+	{
+		m_dirty.left = x0;
+		m_dirty.top = y0;
+		m_dirty.right = x1 + 1;
+		m_dirty.bottom = y1 + 1;
+	}
+	else
+	{
+		m_dirty.left = x0 < m_dirty.left ? x0 : m_dirty.left;
+		m_dirty.top = y0 < m_dirty.top ? y0 : m_dirty.top;
+		m_dirty.right = x1 + 1 > m_dirty.right ? x1 + 1 : m_dirty.right;
+		m_dirty.bottom = y1 + 1 > m_dirty.bottom ? y1 + 1 : m_dirty.bottom;
+	}
+}
+
+bool DecalMap::getDirtyRect(RECT& rect) const
+{
+	rect = m_dirty;
+	return m_dirty.left < m_dirty.right;
+}
+
+void DecalMap::MarkDirty()
+{
+	m_dirty.left = 0;
+	m_dirty.top = 0;
+	m_dirty.right = m_width;
+	m_dirty.bottom = m_height;
+}
+
+void DecalMap::ClearDirtyRect()
+{
+	m_dirty.left = m_dirty.right = 0;
+	m_dirty.top = m_dirty.bottom = 0;
+}
+
+float DecalMap::getCoverage(DecalLayer layer, float threshold) const
+{
+	const __m128 vthreshold = _mm_set1_ps(threshold), one = _mm_set1_ps(1.0f);
+	double covered = 0.0;
+	unsigned int blocks = m_width & ~3u;
+	for (unsigned int y = 0; y < m_height; ++y)
+	{
+		const float* row = getRow(layer, y);
+		__m128 count = _mm_setzero_ps();
+		for (unsigned int x = 0; x < blocks; x += 4)
+			count = _mm_add_ps(count, _mm_and_ps(_mm_cmpge_ps(_mm_load_ps(row + x), vthreshold), one));
+		float counts[4];
+		_mm_storeu_ps(counts, count);
+		covered += counts[0] + counts[1] + counts[2] + counts[3];
+		for (unsigned int x = blocks; x < m_width; ++x)
+			covered += row[x] >= threshold ? 1.0 : 0.0;
+	}
+	return static_cast<float>(covered / (static_cast<double>(m_width) * m_height));
+}
+
+bool DecalMap::Export(const wstring& fileName) const
+{
+	ofstream out(fileName.c_str(), ios::binary);
+	if (!out)
+		return false;
+	//Negative scale marks little-endian data, rows go from the bottom up
+	out << "PF\n" << m_width << " " << m_height << "\n-1.0\n";
+	float* pixels = new float[3 * m_width];
+	for (unsigned int y = 0; y < m_height; ++y)
+	{
+		const float* bead = getRow(BEAD_LAYER, y);
+		const float* scorch = getRow(SCORCH_LAYER, y);
+		for (unsigned int x = 0; x < m_width; ++x)
+		{
+			pixels[3 * x] = bead[x];
+			pixels[3 * x + 1] = scorch[x];
+			pixels[3 * x + 2] = 0.0f;
+		}
+		out.write(reinterpret_cast<const char*>(pixels), 3 * m_width * sizeof(float));
+	}
+	delete [] pixels;
+	return static_cast<bool>(out);
+}
@@ -0,0 +1,70 @@
+#ifndef __GK2_DECAL_MAP_H_
+#define __GK2_DECAL_MAP_H_
+
+#include <Windows.h>
+#include <xnamath.h>
+#include <string>
+
+namespace gk2
+{
+	enum DecalLayer
+	{
+		BEAD_LAYER,			//weld metal laid down by the torch
+		SCORCH_LAYER,		//discoloration around the weld
+		DECAL_LAYER_COUNT
+	};
+
+	//Marks accumulated on a plate, in plate coordinates (u, v) in [0, 1]^2.
+	//Each layer holds the opacity of its mark per texel. A splat is a capsule around the segment travelled
+	//since the previous splat, drawn with antialiased edges four texels at a time and composited over
+	//what is already there. It touches only the texels of its bounding box, whatever the map size.
+	//A moving splat leaves out the disc around its start, which the previous splat has covered already.
+	class DecalMap
+	{
+	public:
+		//width x height texels over a plate of sizeU x sizeV units
+		DecalMap(unsigned int width, unsigned int height, float sizeU, float sizeV);
+		~DecalMap();
+
+		unsigned int getWidth() const { return m_width; }
+		unsigned int getHeight() const { return m_height; }
+		//Opacity of texel (x, y) is getRow(layer, y)[x]
+		const float* getRow(gk2::DecalLayer layer, unsigned int y) const
+		{
+			return m_layers[layer] + y * m_stride;
+		}
+
+		//Splats a capsule of radius units from from to to, with opacity amount at its core
+		void Splat(gk2::DecalLayer layer, const XMFLOAT2& from, const XMFLOAT2& to, float radius, float amount);
+		void Clear();
+
+		//Fraction of the plate where the layer is at least threshold opaque
+		float getCoverage(gk2::DecalLayer layer, float threshold) const;
+
+		//Texels changed since the last ClearDirtyRect, returns false if there are none
+		bool getDirtyRect(RECT& rect) const;
+		void ClearDirtyRect();
+		//Marks the whole map as changed
+		void MarkDirty();
+
+		//Writes the bead and scorch layers as red and green of a Portable Float Map,
+		//returns false if the file could not be written
+		bool Export(const std::wstring& fileName) const;
+
+	private:
+		unsigned int m_width;
+		unsigned int m_height;
+		unsigned int m_stride;		//row length padded to whole SSE blocks
+		float m_cellU;
+		float m_cellV;
+		RECT m_dirty;
+
+		float* m_data;
+		float* m_layers[DECAL_LAYER_COUNT];
+
+		DecalMap(const DecalMap& right) { }
+		DecalMap& operator=(const DecalMap& right) { return *this; }
+	};
+}
+
+#endif __GK2_DECAL_MAP_H_
@@ -0,0 +1,152 @@
+#include "gk2_distanceField.h"
+#include "gk2_threadPool.h"
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+using namespace gk2;
+
+namespace
+{
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	//Distance to the rectangle [-a, a] x [-b, b] in the plane, negative inside
+	float RectangleDistance(float x, float y, float a, float b)
+	{
+		float dx = fabs(x) - a, dy = fabs(y) - b;
+		float ox = dx > 0.0f ? dx : 0.0f, oy = dy > 0.0f ? dy : 0.0f;
+		float inside = dx > dy ? dx : dy;
+		return sqrt(ox * ox + oy * oy) + (inside < 0.0f ? inside : 0.0f);
+	}
+}
+
+DistanceField::DistanceField(const XMFLOAT3& min, const XMFLOAT3& max, float cellSize)
+	: m_min(min), m_cellSize(cellSize)
+{
+	m_size[0] = static_cast<unsigned int>(ceil((max.x - min.x) / cellSize)) + 1;
+	m_size[1] = static_cast<unsigned int>(ceil((max.y - min.y) / cellSize)) + 1;
+	m_size[2] = static_cast<unsigned int>(ceil((max.z - min.z) / cellSize)) + 1;
+	m_distances.assign(m_size[0] * m_size[1] * m_size[2], FLT_MAX);
+}
+
+void DistanceField::AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal)
+{
+	Shape shape;
+	shape.type = PLANE;
+	shape.center = point;
+	XMStoreFloat3(&shape.axes[0], XMVector3Normalize(XMLoadFloat3(&normal)));
+	m_shapes.push_back(shape);
+}
+
+void DistanceField::AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose)
+{
+	Shape shape;
+	shape.type = BOX;
+	shape.halfSize = halfSize;
+	XMStoreFloat3(&shape.center, pose.r[3]);
+	for (int i = 0; i < 3; ++i)
+		XMStoreFloat3(&shape.axes[i], XMVector3Normalize(pose.r[i]));
+	m_shapes.push_back(shape);
+}
+
+void DistanceField::AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius)
+{
+	Shape shape;
+	shape.type = CYLINDER;
+	shape.center = p0;
+	XMVECTOR axis = XMLoadFloat3(&p1) - XMLoadFloat3(&p0);
+	XMStoreFloat3(&shape.axes[0], XMVector3Normalize(axis));
+	shape.halfSize = XMFLOAT3(XMVectorGetX(XMVector3Length(axis)), radius, 0.0f);
+	m_shapes.push_back(shape);
+}
+
+float DistanceField::Evaluate(const XMFLOAT3& pos) const
+{
+	float distance = FLT_MAX;
+	for (unsigned int s = 0; s < m_shapes.size(); ++s)
+	{
+		const Shape& shape = m_shapes[s];
+		XMFLOAT3 d(pos.x - shape.center.x, pos.y - shape.center.y, pos.z - shape.center.z);
+		float shapeDistance;
+		switch (shape.type)
+		{
+		case PLANE:
+			shapeDistance = Dot(d, shape.axes[0]);
+			break;
+		case BOX:
+			{
+				const float half[3] = { shape.halfSize.x, shape.halfSize.y, shape.halfSize.z };
+				float outside = 0.0f, inside = -FLT_MAX;
+				for (int k = 0; k < 3; ++k)
+				{
+					float excess = fabs(Dot(d, shape.axes[k])) - half[k];
+					outside += excess > 0.0f ? excess * excess : 0.0f;
+					inside = excess > inside ? excess : inside;
+				}
+				shapeDistance = sqrt(outside) + (inside < 0.0f ? inside : 0.0f);
+			}
+			break;
+		default:
+			{
+				//A rectangle in the plane through the axis, centered halfway along it
+				float t = Dot(d, shape.axes[0]);
+				float radial = sqrt(fabs(Dot(d, d) - t * t));
+				shapeDistance = RectangleDistance(t - 0.5f * shape.halfSize.x, radial, 0.5f * shape.halfSize.x,
+					shape.halfSize.y);
+			}
+			break;
+		}
+		distance = shapeDistance < distance ? shapeDistance : distance;
+	}
+	return distance;
+}
+
+void DistanceField::Build(ThreadPool& threads)
+{
+	threads.RunRanges(m_size[2], [this](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int z = begin; z < end; ++z)
+			for (unsigned int y = 0; y < m_size[1]; ++y)
+			{
+				float* row = &m_distances[(z * m_size[1] + y) * m_size[0]];
+				for (unsigned int x = 0; x < m_size[0]; ++x)
+					row[x] = Evaluate(XMFLOAT3(m_min.x + x * m_cellSize, m_min.y + y * m_cellSize,
+						m_min.z + z * m_cellSize));
+			}
+	}, 1);
+}
+
+float DistanceField::Sample(const XMFLOAT3& pos, XMFLOAT3* gradient) const
+{
+	const float p[3] = { (pos.x - m_min.x) / m_cellSize, (pos.y - m_min.y) / m_cellSize,
+		(pos.z - m_min.z) / m_cellSize };
+	unsigned int cell[3];
+	float f[3];
+	for (int k = 0; k < 3; ++k)
+	{
+		float last = static_cast<float>(m_size[k] - 1);
+		float c = p[k] < 0.0f ? 0.0f : (p[k] > last ? last : p[k]);
+		cell[k] = static_cast<unsigned int>(c);
+		cell[k] = cell[k] > m_size[k] - 2 ? m_size[k] - 2 : cell[k];
+		f[k] = c - cell[k];
+	}
+	const unsigned int dy = m_size[0], dz = m_size[0] * m_size[1];
+	const float* d = &m_distances[cell[2] * dz + cell[1] * dy + cell[0]];
+	//Along x first, then y, then z
+	float d00 = d[0] + f[0] * (d[1] - d[0]), d10 = d[dy] + f[0] * (d[dy + 1] - d[dy]);
+	float d01 = d[dz] + f[0] * (d[dz + 1] - d[dz]), d11 = d[dz + dy] + f[0] * (d[dz + dy + 1] - d[dz + dy]);
+	float d0 = d00 + f[1] * (d10 - d00), d1 = d01 + f[1] * (d11 - d01);
+	if (gradient)
+	{
+		float gx00 = d[1] - d[0], gx10 = d[dy + 1] - d[dy], gx01 = d[dz + 1] - d[dz];
+		float gx11 = d[dz + dy + 1] - d[dz + dy];
+		float gx0 = gx00 + f[1] * (gx10 - gx00), gx1 = gx01 + f[1] * (gx11 - gx01);
+		gradient->x = (gx0 + f[2] * (gx1 - gx0)) / m_cellSize;
+		gradient->y = ((d10 - d00) + f[2] * ((d11 - d01) - (d10 - d00))) / m_cellSize;
+		gradient->z = (d1 - d0) / m_cellSize;
+	}
+	return d0 + f[2] * (d1 - d0);
+}
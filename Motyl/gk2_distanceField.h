@@ -0,0 +1,56 @@
+#ifndef __GK2_DISTANCE_FIELD_H_
+#define __GK2_DISTANCE_FIELD_H_
+
+#include <xnamath.h>
+#include <vector>
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Signed distance to the nearest static obstacle, sampled on a regular grid over a box.
+	//Obstacles are planes with free space on the side of the normal, boxes and cylinders, each with an
+	//exact distance function; the field is their minimum, negative inside. Build evaluates every cell,
+	//z slices split between threads. Sample interpolates trilinearly, and its gradient is the derivative of
+	//that interpolation, so it is continuous within a cell. Positions outside the box are clamped to it.
+	class DistanceField
+	{
+	public:
+		DistanceField(const XMFLOAT3& min, const XMFLOAT3& max, float cellSize);
+
+		void AddPlane(const XMFLOAT3& point, const XMFLOAT3& normal);
+		//Box of the given half size centered at the origin of pose, which must be rigid
+		void AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose);
+		void AddCylinder(const XMFLOAT3& p0, const XMFLOAT3& p1, float radius);
+		//Samples the obstacles added so far
+		void Build(gk2::ThreadPool& threads);
+
+		//Distance at pos, and its gradient if asked for
+		float Sample(const XMFLOAT3& pos, XMFLOAT3* gradient = 0) const;
+		//Exact distance from the obstacles, without the grid
+		float Evaluate(const XMFLOAT3& pos) const;
+
+		unsigned int getSizeX() const { return m_size[0]; }
+		unsigned int getSizeY() const { return m_size[1]; }
+		unsigned int getSizeZ() const { return m_size[2]; }
+
+	private:
+		enum ShapeType { PLANE, BOX, CYLINDER };
+
+		struct Shape
+		{
+			ShapeType type;
+			XMFLOAT3 center;		//point on the plane, box center or cylinder base
+			XMFLOAT3 axes[3];		//plane normal or cylinder axis in axes[0], unit length
+			XMFLOAT3 halfSize;		//box half size, cylinder length in x and radius in y
+		};
+
+		XMFLOAT3 m_min;
+		float m_cellSize;
+		unsigned int m_size[3];		//grid points along x, y and z
+		std::vector<Shape> m_shapes;
+		std::vector<float> m_distances;		//x fastest, then y, then z
+	};
+}
+
+#endif __GK2_DISTANCE_FIELD_H_
@@ -0,0 +1,259 @@
+#include "gk2_heatField.h"
+#include "gk2_threadPool.h"
+#include "gk2_utils.h"
+#include <emmintrin.h>
+#include <fstream>
+#include <cmath>
+#include <cstring>
+#include <utility>
+
+using namespace std;
+using namespace gk2;
+
+namespace
+{
+	//Fraction of the stability limit used by a single step
+	const float STABILITY = 0.9f;
+	//Source profiles are cut off this many standard deviations from the centre
+	const float SOURCE_CUTOFF = 4.0f;
+	//Cooling cells are set to zero below this temperature, before they become denormals slowing the stencil down
+	const float COLD = 1e-12f;
+
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	//Fills profile[first, first + count) with the Gaussian at centre with deviation sigma, sampled at cell centres
+	//size apart, multiplied by scale. Cells farther than the cutoff are set to zero.
+	void GaussianProfile(float* profile, unsigned int first, unsigned int count, float size, float centre,
+		float sigma, float scale)
+	{
+		float inv = -0.5f / (sigma * sigma);
+		float cutoff = SOURCE_CUTOFF * sigma;
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			float d = (i + 0.5f) * size - centre;
+			profile[first + i] = (d > cutoff || d < -cutoff) ? 0.0f : scale * exp(d * d * inv);
+		}
+	}
+}
+
+PlateFrame::PlateFrame(const XMFLOAT3& origin, const XMFLOAT3& edgeU, const XMFLOAT3& edgeV)
+	: Origin(origin), EdgeU(edgeU), EdgeV(edgeV)
+{ }
+
+float PlateFrame::getSizeU() const
+{
+	return sqrt(Dot(EdgeU, EdgeU));
+}
+
+float PlateFrame::getSizeV() const
+{
+	return sqrt(Dot(EdgeV, EdgeV));
+}
+
+XMFLOAT3 PlateFrame::getNormal() const
+{
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&EdgeU), XMLoadFloat3(&EdgeV))));
+	return n;
+}
+
+XMFLOAT2 PlateFrame::ToPlate(const XMFLOAT3& pos) const
+{
+	XMFLOAT3 d(pos.x - Origin.x, pos.y - Origin.y, pos.z - Origin.z);
+	return XMFLOAT2(Dot(d, EdgeU) / Dot(EdgeU, EdgeU), Dot(d, EdgeV) / Dot(EdgeV, EdgeV));
+}
+
+XMFLOAT3 PlateFrame::ToWorld(const XMFLOAT2& uv) const
+{
+	return XMFLOAT3(Origin.x + uv.x * EdgeU.x + uv.y * EdgeV.x, Origin.y + uv.x * EdgeU.y + uv.y * EdgeV.y,
+		Origin.z + uv.x * EdgeU.z + uv.y * EdgeV.z);
+}
+
+HeatField::HeatField(unsigned int width, unsigned int height, float sizeU, float sizeV, ThreadPool& threads)
+	: m_threads(threads), m_diffusivity(0.0f), m_cooling(0.0f), m_source(0.0f, 0.0f), m_prevSource(0.0f, 0.0f),
+	  m_sourceRadius(0.0f), m_sourcePower(0.0f), m_sourceStarted(false)
+{
+	m_width = width < 1 ? 1 : (width > MAX_SIZE ? MAX_SIZE : width);
+	m_height = height < 1 ? 1 : (height > MAX_SIZE ? MAX_SIZE : height);
+	//Room for the right border cell and for the last SSE block reading one cell past it
+	m_stride = BORDER + ((m_width + 3) & ~3u) + 4;
+	m_cellU = sizeU / m_width;
+	m_cellV = sizeV / m_height;
+
+	size_t fieldSize = m_stride * (m_height + 2);
+	size_t size = 2 * fieldSize + m_stride + (m_height + 2) + m_threads.getThreadCount() * m_stride;
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(size * sizeof(float)));
+	memset(m_data, 0, size * sizeof(float));
+	m_field = m_data;
+	m_next = m_field + fieldSize;
+	m_sourceU = m_next + fieldSize;
+	m_rowSums = m_sourceU + m_stride;
+	m_sourceV = m_rowSums + m_threads.getThreadCount() * m_stride;
+}
+
+HeatField::~HeatField()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+void HeatField::SetMaterial(float diffusivity, float cooling)
+{
+	m_diffusivity = diffusivity;
+	m_cooling = cooling;
+}
+
+void HeatField::SetSource(const XMFLOAT2& uv, float radius, float power)
+{
+	//The first position has nowhere to move from
+	m_prevSource = m_sourceStarted ? m_source : uv;
+	m_source = uv;
+	m_sourceRadius = radius;
+	m_sourcePower = power;
+	m_sourceStarted = true;
+}
+
+void HeatField::Clear()
+{
+	memset(m_field, 0, m_stride * (m_height + 2) * sizeof(float));
+	memset(m_next, 0, m_stride * (m_height + 2) * sizeof(float));
+}
+
+float HeatField::getTemperature(const XMFLOAT2& uv) const
+{
+	int x = static_cast<int>(uv.x * m_width), y = static_cast<int>(uv.y * m_height);
+	x = x < 0 ? 0 : (x >= static_cast<int>(m_width) ? m_width - 1 : x);
+	y = y < 0 ? 0 : (y >= static_cast<int>(m_height) ? m_height - 1 : y);
+	return getRow(y)[x];
+}
+
+void HeatField::Update(float dt)
+{
+	if (dt <= 0.0f)
+		return;
+	float rate = 2.0f * m_diffusivity * (1.0f / (m_cellU * m_cellU) + 1.0f / (m_cellV * m_cellV)) + m_cooling;
+	unsigned int steps = static_cast<unsigned int>(ceil(dt * rate / STABILITY));
+	steps = steps < 1 ? 1 : (steps > MAX_STEPS ? MAX_STEPS : steps);
+	float step = dt / steps;
+	for (unsigned int s = 0; s < steps; ++s)
+	{
+		float t = (s + 0.5f) / steps;
+		Step(step, XMFLOAT2(m_prevSource.x + t * (m_source.x - m_prevSource.x),
+			m_prevSource.y + t * (m_source.y - m_prevSource.y)));
+	}
+	m_prevSource = m_source;
+}
+
+void HeatField::Step(float dt, const XMFLOAT2& source)
+{
+	float rx = m_diffusivity * dt / (m_cellU * m_cellU);
+	float ry = m_diffusivity * dt / (m_cellV * m_cellV);
+	float cool = m_cooling * dt;
+	float total = 2.0f * (rx + ry) + cool;
+	if (total > STABILITY)
+	{
+		//Too few steps for this frame, slow the spread down rather than diverge
+		float scale = STABILITY / total;
+		rx *= scale;
+		ry *= scale;
+		cool *= scale;
+		total = STABILITY;
+	}
+
+	//Separable source with the analytic normalization, too narrow a Gaussian would miss the cell centres
+	bool heating = m_sourcePower > 0.0f && m_sourceRadius > 0.0f;
+	if (heating)
+	{
+		float sigma = m_sourceRadius;
+		float minSigma = m_cellU > m_cellV ? m_cellU : m_cellV;
+		sigma = sigma < minSigma ? minSigma : sigma;
+		float norm = 1.0f / (sqrt(XM_2PI) * sigma);
+		GaussianProfile(m_sourceU, BORDER, m_width, m_cellU, source.x * m_width * m_cellU, sigma, norm);
+		GaussianProfile(m_sourceV, 1, m_height, m_cellV, source.y * m_height * m_cellV, sigma,
+			norm * m_sourcePower * dt);
+	}
+
+	const float* field = m_field;
+	float* next = m_next;
+	const float* sourceU = m_sourceU;
+	const float* sourceV = m_sourceV;
+	unsigned int width = m_width, stride = m_stride;
+	m_threads.RunRanges(m_height, [=](unsigned int begin, unsigned int end)
+	{
+		__m128 centre = _mm_set1_ps(1.0f - total), horizontal = _mm_set1_ps(rx), vertical = _mm_set1_ps(ry);
+		__m128 cold = _mm_set1_ps(COLD);
+		for (unsigned int y = begin + 1; y <= end; ++y)
+		{
+			const float* row = field + y * stride;
+			const float* up = row - stride;
+			const float* down = row + stride;
+			float* out = next + y * stride;
+			__m128 heat = _mm_set1_ps(heating ? sourceV[y] : 0.0f);
+			bool heated = heating && sourceV[y] != 0.0f;
+			for (unsigned int x = BORDER; x < BORDER + width; x += 4)
+			{
+				__m128 t = _mm_mul_ps(_mm_load_ps(row + x), centre);
+				t = _mm_add_ps(t, _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(row + x - 1), _mm_loadu_ps(row + x + 1)),
+					horizontal));
+				t = _mm_add_ps(t, _mm_mul_ps(_mm_add_ps(_mm_load_ps(up + x), _mm_load_ps(down + x)), vertical));
+				if (heated)
+					t = _mm_add_ps(t, _mm_mul_ps(_mm_load_ps(sourceU + x), heat));
+				_mm_store_ps(out + x, _mm_and_ps(t, _mm_cmpgt_ps(t, cold)));
+			}
+			//Insulated edges: border cells copy their neighbours, so no heat flows across
+			out[BORDER - 1] = out[BORDER];
+			out[BORDER + width] = out[BORDER + width - 1];
+		}
+	}, 8);
+	memcpy(m_next, m_next + m_stride, m_stride * sizeof(float));
+	memcpy(m_next + (m_height + 1) * m_stride, m_next + m_height * m_stride, m_stride * sizeof(float));
+	swap(m_field, m_next);
+}
+
+void HeatField::Downsample(float* dst, unsigned int width, unsigned int height, unsigned int pitch,
+	float scale) const
+{
+	unsigned int threads = m_threads.getThreadCount();
+	threads = threads > height ? height : threads;
+	m_threads.Run(threads, [&](unsigned int t)
+	{
+		float* sums = m_rowSums + t * m_stride;
+		for (unsigned int j = t * height / threads; j < (t + 1) * height / threads; ++j)
+		{
+			//Magnified texels still cover at least one cell
+			unsigned int y0 = j * m_height / height, y1 = (j + 1) * m_height / height;
+			y1 = y1 > y0 ? y1 : y0 + 1;
+			memset(sums, 0, m_stride * sizeof(float));
+			for (unsigned int y = y0; y < y1; ++y)
+			{
+				const float* row = m_field + (y + 1) * m_stride;
+				for (unsigned int x = BORDER; x < BORDER + m_width; x += 4)
+					_mm_store_ps(sums + x, _mm_add_ps(_mm_load_ps(sums + x), _mm_load_ps(row + x)));
+			}
+			float* out = dst + j * pitch;
+			for (unsigned int i = 0; i < width; ++i)
+			{
+				unsigned int x0 = i * m_width / width, x1 = (i + 1) * m_width / width;
+				x1 = x1 > x0 ? x1 : x0 + 1;
+				float sum = 0.0f;
+				for (unsigned int x = x0; x < x1; ++x)
+					sum += sums[BORDER + x];
+				out[i] = sum * scale / ((x1 - x0) * (y1 - y0));
+			}
+		}
+	});
+}
+
+bool HeatField::Export(const wstring& fileName) const
+{
+	ofstream out(fileName.c_str(), ios::binary);
+	if (!out)
+		return false;
+	//Negative scale marks little-endian data, rows go from the bottom up
+	out << "Pf\n" << m_width << " " << m_height << "\n-1.0\n";
+	for (unsigned int y = 0; y < m_height; ++y)
+		out.write(reinterpret_cast<const char*>(getRow(y)), m_width * sizeof(float));
+	return static_cast<bool>(out);
+}
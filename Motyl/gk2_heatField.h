@@ -0,0 +1,97 @@
+#ifndef __GK2_HEAT_FIELD_H_
+#define __GK2_HEAT_FIELD_H_
+
+#include <xnamath.h>
+#include <string>
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Rectangle in space with plate coordinates (u, v) in [0, 1]^2, edges must be perpendicular
+	struct PlateFrame
+	{
+		XMFLOAT3 Origin;		//corner at (0, 0)
+		XMFLOAT3 EdgeU;			//from (0, 0) to (1, 0)
+		XMFLOAT3 EdgeV;			//from (0, 0) to (0, 1)
+
+		PlateFrame(const XMFLOAT3& origin, const XMFLOAT3& edgeU, const XMFLOAT3& edgeV);
+
+		float getSizeU() const;
+		float getSizeV() const;
+		XMFLOAT3 getNormal() const;
+		//Projects pos onto the plate
+		XMFLOAT2 ToPlate(const XMFLOAT3& pos) const;
+		XMFLOAT3 ToWorld(const XMFLOAT2& uv) const;
+	};
+
+	//Temperature over a plate, relative to the surrounding air.
+	//Heat spreads with the explicit five-point stencil, is lost to the air at a rate proportional to the
+	//temperature and comes from a moving Gaussian source. Edges are insulated. The stencil runs on rows
+	//split between the threads of a ThreadPool, four cells per SSE instruction. A frame is divided into
+	//as many steps as stability needs, up to MAX_STEPS; beyond that diffusion and cooling are slowed down
+	//instead of letting the solution blow up.
+	class HeatField
+	{
+	public:
+		static const unsigned int MAX_SIZE = 4096;
+		static const unsigned int MAX_STEPS = 32;
+
+		//width x height cells over a plate of sizeU x sizeV units
+		HeatField(unsigned int width, unsigned int height, float sizeU, float sizeV, gk2::ThreadPool& threads);
+		~HeatField();
+
+		unsigned int getWidth() const { return m_width; }
+		unsigned int getHeight() const { return m_height; }
+		//Temperature of cell (x, y) is getRow(y)[x]
+		const float* getRow(unsigned int y) const { return m_field + (y + 1) * m_stride + BORDER; }
+		float getTemperature(const XMFLOAT2& uv) const;
+
+		//diffusivity in units^2 per second, cooling in 1 per second
+		void SetMaterial(float diffusivity, float cooling);
+		//Gaussian source at uv with the given standard deviation in units, power is the temperature times area
+		//added per second. The source moves linearly from its previous position during the next Update.
+		void SetSource(const XMFLOAT2& uv, float radius, float power);
+		void Update(float dt);
+		void Clear();
+
+		//Box-filters the field into width x height texels, pitch floats apart, multiplied by scale
+		void Downsample(float* dst, unsigned int width, unsigned int height, unsigned int pitch, float scale) const;
+		//Writes the field as a Portable Float Map, returns false if the file could not be written
+		bool Export(const std::wstring& fileName) const;
+
+	private:
+		//Columns before the first cell, so that rows start aligned; the last of them is the left border cell
+		static const unsigned int BORDER = 4;
+
+		gk2::ThreadPool& m_threads;
+		unsigned int m_width;
+		unsigned int m_height;
+		unsigned int m_stride;		//row length with the insulating border and SSE padding
+		float m_cellU;
+		float m_cellV;
+		float m_diffusivity;
+		float m_cooling;
+
+		XMFLOAT2 m_source;
+		XMFLOAT2 m_prevSource;
+		float m_sourceRadius;
+		float m_sourcePower;
+		bool m_sourceStarted;
+
+		//Two fields with a border of cells copying their neighbours, so edges need no special stencil
+		float* m_data;
+		float* m_field;
+		float* m_next;
+		float* m_sourceU;			//source profile along u, nonzero only near the source
+		float* m_sourceV;			//source profile along v, already multiplied by power and step length
+		float* m_rowSums;			//per-thread scratch rows of Downsample
+
+		void Step(float dt, const XMFLOAT2& source);
+
+		HeatField(const HeatField& right) : m_threads(right.m_threads) { }
+		HeatField& operator=(const HeatField& right) { return *this; }
+	};
+}
+
+#endif __GK2_HEAT_FIELD_H_
@@ -0,0 +1,156 @@
+#include "gk2_heatGlow.h"
+#include "gk2_exceptions.h"
+
+using namespace std;
+using namespace gk2;
+
+const D3D11_INPUT_ELEMENT_DESC HeatVertex::Layout[HeatVertex::LayoutElements] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+const unsigned int HeatGlow::TEXTURE_SIZE = 256;
+const float HeatGlow::OFFSET = 0.002f;
+const unsigned int HeatGlow::STRIDE = sizeof(HeatVertex);
+const unsigned int HeatGlow::VB_OFFSET = 0;
+
+HeatGlow::HeatGlow(DeviceHelper& device, const HeatField& field, const PlateFrame& plate, float fullGlow,
+	unsigned int textureSize)
+	: m_field(field), m_scale(1.0f / fullGlow), m_decals(nullptr)
+{
+	//No point in more texels than cells
+	m_textureWidth = textureSize < field.getWidth() ? textureSize : field.getWidth();
+	m_textureHeight = textureSize < field.getHeight() ? textureSize : field.getHeight();
+
+	//One quad in front of each side of the plate, each visible from both sides like the plate itself
+	XMFLOAT3 n = plate.getNormal();
+	HeatVertex vertices[8];
+	for (unsigned int side = 0; side < 2; ++side)
+	{
+		float d = side == 0 ? OFFSET : -OFFSET;
+		for (unsigned int k = 0; k < 4; ++k)
+		{
+			HeatVertex& v = vertices[4 * side + k];
+			v.Tex = XMFLOAT2(static_cast<float>(k & 1), static_cast<float>(k >> 1));
+			v.Pos = plate.ToWorld(v.Tex);
+			v.Pos = XMFLOAT3(v.Pos.x + d * n.x, v.Pos.y + d * n.y, v.Pos.z + d * n.z);
+		}
+	}
+	unsigned short indices[24] = { 0, 1, 3, 0, 3, 2, 0, 3, 1, 0, 2, 3, 4, 5, 7, 4, 7, 6, 4, 7, 5, 4, 6, 7 };
+	m_vertices = device.CreateVertexBuffer(vertices, 8);
+	m_indices = device.CreateIndexBuffer(indices, 24);
+
+	D3D11_TEXTURE2D_DESC td = device.DefaultTexture2DDesc();
+	td.Width = m_textureWidth;
+	td.Height = m_textureHeight;
+	td.MipLevels = 1;
+	td.Format = DXGI_FORMAT_R32_FLOAT;
+	td.Usage = D3D11_USAGE_DYNAMIC;
+	td.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	m_texture = device.CreateTexture2D(td);
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvd = device.DefaultShaderResourceDesc();
+	srvd.Format = DXGI_FORMAT_R32_FLOAT;
+	srvd.Texture2D.MipLevels = 1;
+	m_heatMap = device.CreateShaderResourceView(m_texture, srvd);
+	D3D11_SAMPLER_DESC sd = device.DefaultSamplerDesc();
+	sd.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	m_samplerState = device.CreateSamplerState(sd);
+
+	shared_ptr<ID3DBlob> vsByteCode = device.CompileD3DShader(L"resources/shaders/Heat.hlsl", "VS_Main", "vs_4_0");
+	shared_ptr<ID3DBlob> psByteCode = device.CompileD3DShader(L"resources/shaders/Heat.hlsl", "PS_Main", "ps_4_0");
+	m_vs = device.CreateVertexShader(vsByteCode);
+	m_ps = device.CreatePixelShader(psByteCode);
+	m_layout = device.CreateInputLayout<HeatVertex>(vsByteCode);
+}
+
+void HeatGlow::SetViewMtxBuffer(const shared_ptr<CBMatrix>& view)
+{
+	if (view != nullptr)
+		m_viewCB = view;
+}
+
+void HeatGlow::SetProjMtxBuffer(const shared_ptr<CBMatrix>& proj)
+{
+	if (proj != nullptr)
+		m_projCB = proj;
+}
+
+void HeatGlow::SetDecals(DeviceHelper& device, DecalMap* decals)
+{
+	m_decals = decals;
+	if (decals == nullptr)
+	{
+		m_decalMap.reset();
+		m_decalTexture.reset();
+		return;
+	}
+	D3D11_TEXTURE2D_DESC td = device.DefaultTexture2DDesc();
+	td.Width = decals->getWidth();
+	td.Height = decals->getHeight();
+	td.MipLevels = 1;
+	td.Format = DXGI_FORMAT_R8G8_UNORM;
+	m_decalTexture = device.CreateTexture2D(td);
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvd = device.DefaultShaderResourceDesc();
+	srvd.Format = DXGI_FORMAT_R8G8_UNORM;
+	srvd.Texture2D.MipLevels = 1;
+	m_decalMap = device.CreateShaderResourceView(m_decalTexture, srvd);
+	m_decalTexels.resize(2 * decals->getWidth() * decals->getHeight());
+	//The new texture is empty, whatever the map holds has to be uploaded
+	decals->MarkDirty();
+}
+
+void HeatGlow::UploadDecals(shared_ptr<ID3D11DeviceContext>& context)
+{
+	RECT rect;
+	if (m_decals == nullptr || !m_decals->getDirtyRect(rect))
+		return;
+	unsigned int width = rect.right - rect.left, pitch = 2 * width;
+	for (LONG y = rect.top; y < rect.bottom; ++y)
+	{
+		const float* bead = m_decals->getRow(BEAD_LAYER, y) + rect.left;
+		const float* scorch = m_decals->getRow(SCORCH_LAYER, y) + rect.left;
+		unsigned char* dst = &m_decalTexels[(y - rect.top) * pitch];
+		for (unsigned int x = 0; x < width; ++x)
+		{
+			dst[2 * x] = static_cast<unsigned char>(bead[x] * 255.0f + 0.5f);
+			dst[2 * x + 1] = static_cast<unsigned char>(scorch[x] * 255.0f + 0.5f);
+		}
+	}
+	D3D11_BOX box = { static_cast<UINT>(rect.left), static_cast<UINT>(rect.top), 0, static_cast<UINT>(rect.right),
+		static_cast<UINT>(rect.bottom), 1 };
+	context->UpdateSubresource(m_decalTexture.get(), 0, &box, m_decalTexels.data(), pitch, 0);
+	m_decals->ClearDirtyRect();
+}
+
+void HeatGlow::Update(shared_ptr<ID3D11DeviceContext>& context)
+{
+	UploadDecals(context);
+	D3D11_MAPPED_SUBRESOURCE resource;
+	HRESULT hr = context->Map(m_texture.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
+	if (FAILED(hr))
+		THROW_DX11(hr);
+	m_field.Downsample(reinterpret_cast<float*>(resource.pData), m_textureWidth, m_textureHeight,
+		resource.RowPitch / sizeof(float), m_scale);
+	context->Unmap(m_texture.get(), 0);
+}
+
+void HeatGlow::Render(shared_ptr<ID3D11DeviceContext>& context)
+{
+	context->VSSetShader(m_vs.get(), nullptr, 0);
+	context->PSSetShader(m_ps.get(), nullptr, 0);
+	context->IASetInputLayout(m_layout.get());
+	ID3D11Buffer* vsb[2] = { m_viewCB->getBufferObject().get(), m_projCB->getBufferObject().get() };
+	context->VSSetConstantBuffers(0, 2, vsb);
+	ID3D11ShaderResourceView* srv[2] = { m_heatMap.get(), m_decalMap.get() };
+	context->PSSetShaderResources(0, 2, srv);
+	ID3D11SamplerState* ss[1] = { m_samplerState.get() };
+	context->PSSetSamplers(0, 1, ss);
+	ID3D11Buffer* vb[1] = { m_vertices.get() };
+	context->IASetVertexBuffers(0, 1, vb, &STRIDE, &VB_OFFSET);
+	context->IASetIndexBuffer(m_indices.get(), DXGI_FORMAT_R16_UINT, 0);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	context->DrawIndexed(24, 0, 0);
+	srv[0] = srv[1] = nullptr;
+	context->PSSetShaderResources(0, 2, srv);
+}
@@ -0,0 +1,76 @@
+#ifndef __GK2_HEAT_GLOW_H_
+#define __GK2_HEAT_GLOW_H_
+
+#include <d3d11.h>
+#include <xnamath.h>
+#include <memory>
+#include <vector>
+#include "gk2_deviceHelper.h"
+#include "gk2_constantBuffer.h"
+#include "gk2_heatField.h"
+#include "gk2_decalMap.h"
+
+namespace gk2
+{
+	struct HeatVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT2 Tex;		//plate coordinates
+		static const unsigned int LayoutElements = 2;
+		static const D3D11_INPUT_ELEMENT_DESC Layout[LayoutElements];
+
+		HeatVertex() : Pos(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f) { }
+	};
+
+	//Glow of the hot plate over the marks left on it, drawn over both of its sides.
+	//Every frame the heat field is shrunk to a single-channel texture, which the pixel shader turns into
+	//blackbody-like colours. Temperatures at or above fullGlow are drawn white-hot. Marks live in a texture
+	//of their own, where only the texels changed since the previous frame are uploaded.
+	class HeatGlow
+	{
+	public:
+		HeatGlow(gk2::DeviceHelper& device, const gk2::HeatField& field, const gk2::PlateFrame& plate,
+			float fullGlow, unsigned int textureSize = TEXTURE_SIZE);
+
+		void SetViewMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& view);
+		void SetProjMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& proj);
+		//Draws the bead and scorch layers of decals under the glow, the map must outlive this object
+		void SetDecals(gk2::DeviceHelper& device, gk2::DecalMap* decals);
+
+		void Update(std::shared_ptr<ID3D11DeviceContext>& context);
+		void Render(std::shared_ptr<ID3D11DeviceContext>& context);
+
+	private:
+		static const unsigned int TEXTURE_SIZE;		//default texture width and height
+		static const float OFFSET;					//distance of the glow quads from the plate
+		static const unsigned int STRIDE;
+		static const unsigned int VB_OFFSET;
+
+		const gk2::HeatField& m_field;
+		unsigned int m_textureWidth;
+		unsigned int m_textureHeight;
+		float m_scale;
+
+		std::shared_ptr<ID3D11Buffer> m_vertices;
+		std::shared_ptr<ID3D11Buffer> m_indices;
+		std::shared_ptr<ID3D11Texture2D> m_texture;
+		std::shared_ptr<ID3D11ShaderResourceView> m_heatMap;
+		std::shared_ptr<ID3D11SamplerState> m_samplerState;
+		gk2::DecalMap* m_decals;
+		std::shared_ptr<ID3D11Texture2D> m_decalTexture;
+		std::shared_ptr<ID3D11ShaderResourceView> m_decalMap;
+		std::vector<unsigned char> m_decalTexels;		//changed texels packed for the upload
+		std::shared_ptr<gk2::CBMatrix> m_viewCB;
+		std::shared_ptr<gk2::CBMatrix> m_projCB;
+		std::shared_ptr<ID3D11VertexShader> m_vs;
+		std::shared_ptr<ID3D11PixelShader> m_ps;
+		std::shared_ptr<ID3D11InputLayout> m_layout;
+
+		void UploadDecals(std::shared_ptr<ID3D11DeviceContext>& context);
+
+		HeatGlow(const HeatGlow& right) : m_field(right.m_field) { }
+		HeatGlow& operator=(const HeatGlow& right) { return *this; }
+	};
+}
+
+#endif __GK2_HEAT_GLOW_H_
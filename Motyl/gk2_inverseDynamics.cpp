@@ -0,0 +1,74 @@
+#include "gk2_inverseDynamics.h"
+#include "gk2_threadPool.h"
+
+using namespace gk2;
+
+const unsigned int InverseDynamics::MIN_BATCH = 256;
+
+InverseDynamics::InverseDynamics(const PumaKinematics& kinematics)
+	: m_kinematics(kinematics), m_gravity(0.0f, -9.81f, 0.0f)
+{ }
+
+void InverseDynamics::SetLink(unsigned int link, const MassProperties& mass)
+{
+	m_links[link] = mass;
+}
+
+void InverseDynamics::Solve(const float* angles, const float* velocities, const float* accelerations,
+	float* torques) const
+{
+	XMVECTOR axes[PumaKinematics::LINKS], points[PumaKinematics::LINKS], omega[PumaKinematics::LINKS];
+	XMVECTOR alpha[PumaKinematics::LINKS], accel[PumaKinematics::LINKS];
+	XMMATRIX matrices[PumaKinematics::LINKS];
+
+	//Base at rest, accelerating upwards to stand in for gravity
+	matrices[0] = XMMatrixIdentity();
+	omega[0] = alpha[0] = points[0] = XMVectorZero();
+	accel[0] = -XMLoadFloat3(&m_gravity);
+	for (unsigned int i = 1; i < PumaKinematics::LINKS; ++i)
+	{
+		//Joint i sits on link i - 1, whose pose moves its axis
+		axes[i] = XMVector3TransformNormal(XMLoadFloat3(&m_kinematics.getJointAxis(i)), matrices[i - 1]);
+		points[i] = XMVector3TransformCoord(XMLoadFloat3(&m_kinematics.getJointPoint(i)), matrices[i - 1]);
+		XMVECTOR r = points[i] - points[i - 1];
+		accel[i] = accel[i - 1] + XMVector3Cross(alpha[i - 1], r) +
+			XMVector3Cross(omega[i - 1], XMVector3Cross(omega[i - 1], r));
+		XMVECTOR spin = axes[i] * XMVectorReplicate(velocities[i - 1]);
+		omega[i] = omega[i - 1] + spin;
+		alpha[i] = alpha[i - 1] + axes[i] * XMVectorReplicate(accelerations[i - 1]) +
+			XMVector3Cross(omega[i - 1], spin);
+		matrices[i] = m_kinematics.GetJointMatrix(i, angles[i - 1]) * matrices[i - 1];
+	}
+
+	//Force and moment about the previous joint point passed down from the links above
+	XMVECTOR force = XMVectorZero(), moment = XMVectorZero(), above = XMVectorZero();
+	for (unsigned int i = PumaKinematics::LINKS - 1; i > 0; --i)
+	{
+		const MassProperties& link = m_links[i];
+		XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&link.CenterOfMass), matrices[i]) - points[i];
+		XMVECTOR centerAccel = accel[i] + XMVector3Cross(alpha[i], center) +
+			XMVector3Cross(omega[i], XMVector3Cross(omega[i], center));
+		XMVECTOR linkForce = centerAccel * XMVectorReplicate(link.Mass);
+		//Inertia in world coordinates is R^T I R for row vectors rotated by R
+		XMMATRIX inertia = XMLoadFloat3x3(&link.Inertia), rotationT = XMMatrixTranspose(matrices[i]);
+		XMVECTOR localOmega = XMVector3TransformNormal(omega[i], rotationT);
+		XMVECTOR localAlpha = XMVector3TransformNormal(alpha[i], rotationT);
+		XMVECTOR momentum = XMVector3TransformNormal(XMVector3TransformNormal(localOmega, inertia), matrices[i]);
+		XMVECTOR linkMoment = XMVector3TransformNormal(XMVector3TransformNormal(localAlpha, inertia), matrices[i]) +
+			XMVector3Cross(omega[i], momentum);
+		moment = linkMoment + XMVector3Cross(center, linkForce) + moment + XMVector3Cross(above - points[i], force);
+		force = linkForce + force;
+		above = points[i];
+		torques[i - 1] = XMVectorGetX(XMVector3Dot(axes[i], moment));
+	}
+}
+
+void InverseDynamics::SolveBatch(unsigned int samples, const float* angles, const float* velocities,
+	const float* accelerations, float* torques, ThreadPool& threads) const
+{
+	threads.RunRanges(samples, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int s = begin; s < end; ++s)
+			Solve(angles + s * JOINTS, velocities + s * JOINTS, accelerations + s * JOINTS, torques + s * JOINTS);
+	}, MIN_BATCH);
+}
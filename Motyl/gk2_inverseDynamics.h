@@ -0,0 +1,47 @@
+#ifndef __GK2_INVERSE_DYNAMICS_H_
+#define __GK2_INVERSE_DYNAMICS_H_
+
+#include <xnamath.h>
+#include "gk2_pumaKinematics.h"
+#include "gk2_massProperties.h"
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Joint torques needed to follow a motion, by the recursive Newton-Euler method.
+	//The forward pass carries angular velocity and acceleration and the acceleration of the joint points
+	//from the base to the wrist, the backward pass sums link forces and moments from the wrist down.
+	//Everything is expressed in world coordinates, which is where the joint axes of PumaKinematics live.
+	//Gravity enters as an upward acceleration of the base.
+	class InverseDynamics
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+
+		//Links are massless until SetLink, the kinematics is read on every call
+		InverseDynamics(const gk2::PumaKinematics& kinematics);
+
+		void SetLink(unsigned int link, const gk2::MassProperties& mass);
+		const gk2::MassProperties& getLink(unsigned int link) const { return m_links[link]; }
+		void SetGravity(const XMFLOAT3& gravity) { m_gravity = gravity; }
+
+		//Torques of JOINTS joints at the given joint angles, velocities and accelerations
+		void Solve(const float* angles, const float* velocities, const float* accelerations, float* torques) const;
+		//Solve for samples consecutive sets of JOINTS values in each array, split between threads
+		void SolveBatch(unsigned int samples, const float* angles, const float* velocities,
+			const float* accelerations, float* torques, gk2::ThreadPool& threads) const;
+
+	private:
+		static const unsigned int MIN_BATCH;		//samples per thread worth a task
+
+		const gk2::PumaKinematics& m_kinematics;
+		gk2::MassProperties m_links[gk2::PumaKinematics::LINKS];
+		XMFLOAT3 m_gravity;
+
+		InverseDynamics(const InverseDynamics& right) : m_kinematics(right.m_kinematics) { }
+		InverseDynamics& operator=(const InverseDynamics& right) { return *this; }
+	};
+}
+
+#endif __GK2_INVERSE_DYNAMICS_H_
@@ -0,0 +1,358 @@
+#include "gk2_jointLog.h"
+#include <Windows.h>
+#include <intrin.h>
+#include <emmintrin.h>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+using namespace gk2;
+
+namespace
+{
+	const unsigned int MAX_DIGITS = 19;		//of a mantissa that surely fits in 64 bits
+	const unsigned int MAX_EXACT_POWER = 22;	//largest power of ten a double holds exactly
+	const double POWERS[MAX_EXACT_POWER + 1] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const unsigned long long INTEGER_POWERS[17] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+		10000000ull, 100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+		10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull };
+	const unsigned long long EXACT_MANTISSA = 1ull << 53;
+
+	//Number of digits at text, at most 16
+	unsigned int DigitRun(const char* text, const char* end)
+	{
+		if (end - text < 16)
+		{
+			unsigned int n = 0;
+			while (n < 16 && text + n < end && static_cast<unsigned char>(text[n] - '0') < 10)
+				++n;
+			return n;
+		}
+		//Bytes that are at most 9 after taking '0' away are digits, the rest wrapped around to above 9
+		__m128i values = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text)), _mm_set1_epi8('0'));
+		__m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(values, _mm_set1_epi8(9)), values);
+		unsigned long others = (~_mm_movemask_epi8(digits) & 0xffff) | 0x10000, first;
+		_BitScanForward(&first, others);
+		return first;
+	}
+
+	//Value of n digits at text, 0 < n <= 8
+	unsigned long long Digits8(const char* text, unsigned int n, const char* end)
+	{
+		if (end - text < 8)
+		{
+			unsigned long long value = 0;
+			for (unsigned int i = 0; i < n; ++i)
+				value = 10 * value + (text[i] - '0');
+			return value;
+		}
+		//The first character is the lowest byte, shifting the digits to the top leaves leading zeros below
+		unsigned long long chunk;
+		memcpy(&chunk, text, sizeof(chunk));
+		chunk = (chunk << (8 * (8 - n))) & 0x0f0f0f0f0f0f0f0full;
+		//Pairs of digits to 2-digit numbers, those to 4-digit ones and those to the whole
+		chunk = (chunk * 2561) >> 8;
+		chunk = ((chunk & 0x00ff00ff00ff00ffull) * 6553601) >> 16;
+		return ((chunk & 0x0000ffff0000ffffull) * 42949672960001ull) >> 32;
+	}
+
+	unsigned long long Digits(const char* text, unsigned int n, const char* end)
+	{
+		if (n <= 8)
+			return Digits8(text, n, end);
+		return Digits8(text, 8, end) * INTEGER_POWERS[n - 8] + Digits8(text + 8, n - 8, end);
+	}
+
+	//Number at text in the standard library's way, for the rare ones the fast path cannot take
+	bool ParseSlowly(const char*& text, const char* end, double& value)
+	{
+		char buffer[64];
+		size_t length = end - text < static_cast<ptrdiff_t>(sizeof(buffer)) - 1 ? end - text : sizeof(buffer) - 1;
+		memcpy(buffer, text, length);
+		buffer[length] = 0;
+		char* stop;
+		value = strtod(buffer, &stop);
+		if (stop == buffer)
+			return false;
+		text += stop - buffer;
+		return true;
+	}
+
+	bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	//Start of the first line beginning at or after p
+	const char* LineStart(const char* begin, const char* end, const char* p)
+	{
+		if (p == begin)
+			return p;
+		const char* newLine = static_cast<const char*>(memchr(p - 1, '\n', end - (p - 1)));
+		return newLine ? newLine + 1 : end;
+	}
+}
+
+JointLog::JointLog(ThreadPool& threads)
+	: m_threads(threads), m_file(0), m_mapping(0), m_size(0), m_binary(false), m_samples(0), m_skipped(0)
+{
+}
+
+JointLog::~JointLog()
+{
+	Close();
+}
+
+bool JointLog::Open(const wstring& file)
+{
+	Close();
+	HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		m_error = "cannot open the log";
+		return false;
+	}
+	m_file = handle;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0)
+	{
+		m_error = "the log is empty";
+		Close();
+		return false;
+	}
+	m_size = static_cast<unsigned long long>(size.QuadPart);
+	m_mapping = CreateFileMappingW(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!m_mapping)
+	{
+		m_error = "cannot map the log";
+		Close();
+		return false;
+	}
+	m_binary = false;
+	if (m_size >= sizeof(JointLogHeader))
+	{
+		const JointLogHeader* header = static_cast<const JointLogHeader*>(MapViewOfFile(m_mapping, FILE_MAP_READ,
+			0, 0, sizeof(JointLogHeader)));
+		if (!header)
+		{
+			m_error = "cannot map the log";
+			Close();
+			return false;
+		}
+		m_binary = header->Magic == JointLogHeader::MAGIC;
+		bool known = header->Version == JointLogHeader::VERSION && header->SampleSize == sizeof(JointSample);
+		UnmapViewOfFile(header);
+		if (m_binary && !known)
+		{
+			m_error = "binary log of another version";
+			Close();
+			return false;
+		}
+	}
+	m_error.clear();
+	return true;
+}
+
+void JointLog::Close()
+{
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = m_file = 0;
+	m_size = 0;
+}
+
+bool JointLog::Read(const BatchHandler& handler)
+{
+	m_samples = 0;
+	m_skipped = 0;
+	if (!m_mapping)
+	{
+		m_error = "no log is open";
+		return false;
+	}
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	unsigned long long granularity = info.dwAllocationGranularity;
+	unsigned int tasks = getTaskCount();
+	unsigned long long offset = m_binary ? sizeof(JointLogHeader) : 0;
+	while (offset < m_size)
+	{
+		//Views start at a multiple of the granularity, the part before offset was read with the last one
+		unsigned long long base = offset - offset % granularity;
+		size_t length = static_cast<size_t>(m_size - base < WINDOW_SIZE ? m_size - base : WINDOW_SIZE);
+		const char* view = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ,
+			static_cast<DWORD>(base >> 32), static_cast<DWORD>(base), length));
+		if (!view)
+		{
+			m_error = "cannot map the log";
+			return false;
+		}
+		const char* begin = view + (offset - base);
+		const char* last = view + length;
+		//Whole lines or samples only, the rest is read with the next window
+		const char* end = last;
+		if (m_binary)
+			end = begin + (last - begin) / sizeof(JointSample) * sizeof(JointSample);
+		else if (base + length < m_size)
+			while (end > begin && end[-1] != '\n')
+				--end;
+		if (end == begin)
+		{
+			UnmapViewOfFile(view);
+			if (base + length < m_size)
+			{
+				m_error = "a line of the log is longer than a window";
+				return false;
+			}
+			//Part of a sample at the end of a binary log
+			break;
+		}
+		if (m_binary)
+		{
+			//Samples are handed over straight from the view
+			const JointSample* samples = reinterpret_cast<const JointSample*>(begin);
+			size_t count = (end - begin) / sizeof(JointSample);
+			m_threads.Run(tasks, [&](unsigned int task)
+			{
+				for (size_t i = count * task / tasks, to = count * (task + 1) / tasks; i < to; i += BATCH_SIZE)
+					handler(task, samples + i, static_cast<unsigned int>(to - i < BATCH_SIZE ? to - i : BATCH_SIZE));
+			});
+			m_samples += count;
+		}
+		else
+			m_threads.Run(tasks, [&](unsigned int task)
+			{
+				size_t size = end - begin;
+				const char* from = LineStart(begin, end, begin + size * task / tasks);
+				const char* to = LineStart(begin, end, begin + size * (task + 1) / tasks);
+				ReadLines(task, from, to, end, handler);
+			});
+		UnmapViewOfFile(view);
+		offset = base + (end - view);
+	}
+	return true;
+}
+
+void JointLog::ReadLines(unsigned int task, const char* begin, const char* end, const char* last,
+	const BatchHandler& handler)
+{
+	vector<JointSample> batch(BATCH_SIZE);
+	unsigned int count = 0;
+	unsigned long long samples = 0, skipped = 0;
+	for (const char* line = begin; line < end; )
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(line, '\n', last - line));
+		if (!lineEnd)
+			lineEnd = last;
+		const char* p = line;
+		double values[1 + PumaKinematics::JOINTS];
+		unsigned int fields = 0;
+		while (fields < 1 + PumaKinematics::JOINTS && ParseNumber(p, lineEnd, values[fields]))
+		{
+			++fields;
+			while (p < lineEnd && IsBlank(*p))
+				++p;
+			if (p == lineEnd || *p != ',' || fields == 1 + PumaKinematics::JOINTS)
+				break;
+			++p;
+		}
+		while (p < lineEnd && IsBlank(*p))
+			++p;
+		if (fields == 1 + PumaKinematics::JOINTS && p == lineEnd)
+		{
+			JointSample& sample = batch[count];
+			sample.Time = values[0];
+			for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+				sample.Angles[j] = static_cast<float>(values[1 + j]);
+			sample.Reserved = 0;
+			if (++count == BATCH_SIZE)
+			{
+				handler(task, &batch[0], count);
+				samples += count;
+				count = 0;
+			}
+		}
+		else if (fields > 0 || p != lineEnd)
+			++skipped;
+		line = lineEnd + 1;
+	}
+	if (count > 0)
+		handler(task, &batch[0], count);
+	m_samples += samples + count;
+	m_skipped += skipped;
+}
+
+bool JointLog::ParseNumber(const char*& text, const char* end, double& value)
+{
+	const char* p = text;
+	while (p < end && IsBlank(*p))
+		++p;
+	const char* start = p;
+	bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+'))
+		++p;
+	//Digits of the whole part and then of the fraction make one integer mantissa
+	unsigned long long mantissa = 0;
+	unsigned int digits = 0, fraction = 0;
+	bool exact = true;
+	for (unsigned int part = 0; part < 2; ++part)
+	{
+		if (part == 1)
+		{
+			if (p == end || *p != '.')
+				break;
+			++p;
+		}
+		for (unsigned int n = 16; n == 16; )
+		{
+			n = DigitRun(p, end);
+			if (n == 0)
+				break;
+			if (digits + n > MAX_DIGITS)
+				exact = false;
+			else
+				mantissa = mantissa * INTEGER_POWERS[n] + Digits(p, n, end);
+			digits += n;
+			fraction += part * n;
+			p += n;
+		}
+	}
+	if (digits == 0)
+		return false;
+	int exponent = 0;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		const char* e = p + 1;
+		bool negativeExponent = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+'))
+			++e;
+		if (e < end && static_cast<unsigned char>(*e - '0') < 10)
+		{
+			for (; e < end && static_cast<unsigned char>(*e - '0') < 10 && exponent < 10000; ++e)
+				exponent = 10 * exponent + (*e - '0');
+			exponent = negativeExponent ? -exponent : exponent;
+			p = e;
+		}
+	}
+	int scale = exponent - static_cast<int>(fraction);
+	//A mantissa and a power of ten both exact in doubles give the correctly rounded value in one operation
+	if (!exact || mantissa >= EXACT_MANTISSA || scale > static_cast<int>(MAX_EXACT_POWER) ||
+		scale < -static_cast<int>(MAX_EXACT_POWER))
+	{
+		const char* slow = start;
+		if (!ParseSlowly(slow, end, value))
+			return false;
+		text = slow;
+		return true;
+	}
+	value = static_cast<double>(mantissa);
+	value = scale < 0 ? value / POWERS[-scale] : value * POWERS[scale];
+	value = negative ? -value : value;
+	text = p;
+	return true;
+}
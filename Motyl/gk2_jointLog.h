@@ -0,0 +1,89 @@
+#ifndef __GK2_JOINT_LOG_H_
+#define __GK2_JOINT_LOG_H_
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include "gk2_pumaKinematics.h"
+#include "gk2_threadPool.h"
+
+namespace gk2
+{
+	//Joint encoder reading of a real robot
+	struct JointSample
+	{
+		double Time;		//seconds since the start of the program
+		float Angles[gk2::PumaKinematics::JOINTS];	//radians
+		unsigned int Reserved;
+	};
+
+	//Start of a binary joint log, followed by its samples
+	struct JointLogHeader
+	{
+		static const unsigned int MAGIC = 0x4a324b47;	//"GK2J"
+		static const unsigned int VERSION = 1;
+
+		unsigned int Magic;
+		unsigned int Version;
+		unsigned int SampleSize;	//of JointSample
+		unsigned int Reserved[5];
+	};
+
+	//Reads joint logs of any size, either binary ones or text with a sample per line: the time and the five
+	//angles separated by commas, lines that are not six numbers are skipped. The file is mapped a window
+	//at a time and every window is split between the threads at line boundaries, each parsing its part
+	//into batches of samples handed to the caller. Numbers are parsed 16 characters at a time: SSE2
+	//compares classify them as digits or not, and the digits up to the first other character are turned
+	//into an integer by a few multiplications of 8 digits packed in a 64-bit word.
+	class JointLog
+	{
+	public:
+		static const unsigned int TASKS_PER_THREAD = 4;	//of every window, for threads finishing at different times
+		static const unsigned int BATCH_SIZE = 4096;	//samples handed over at once
+		static const unsigned int WINDOW_SIZE = 1 << 26;	//bytes mapped at once
+
+		//Called with the task number, in [0, getTaskCount()), and a batch of samples; tasks with the same
+		//number never run at the same time
+		typedef std::function<void (unsigned int task, const gk2::JointSample* samples, unsigned int count)>
+			BatchHandler;
+
+		JointLog(gk2::ThreadPool& threads);
+		~JointLog();
+
+		//Opens a log, false with the error set if it cannot be read
+		bool Open(const std::wstring& file);
+		void Close();
+		const std::string& getError() const { return m_error; }
+		bool isBinary() const { return m_binary; }
+		unsigned long long getSize() const { return m_size; }
+		unsigned int getTaskCount() const { return m_threads.getThreadCount() * TASKS_PER_THREAD; }
+
+		//Parses the whole log, false with the error set if a window cannot be mapped or a line does not fit
+		//in one
+		bool Read(const BatchHandler& handler);
+		unsigned long long getSampleCount() const { return m_samples; }
+		unsigned long long getSkippedCount() const { return m_skipped; }
+
+		//Parses a number at text, moving text after it; false, text left where it was, if there is none
+		static bool ParseNumber(const char*& text, const char* end, double& value);
+
+	private:
+		gk2::ThreadPool& m_threads;
+		void* m_file;
+		void* m_mapping;
+		unsigned long long m_size;
+		bool m_binary;
+		std::string m_error;
+		std::atomic<unsigned long long> m_samples;
+		std::atomic<unsigned long long> m_skipped;
+
+		//Parses the lines starting in [begin, end) of a window ending at last
+		void ReadLines(unsigned int task, const char* begin, const char* end, const char* last,
+			const BatchHandler& handler);
+
+		JointLog(const JointLog& right) : m_threads(right.m_threads) { }
+		JointLog& operator=(const JointLog& right) { return *this; }
+	};
+}
+
+#endif __GK2_JOINT_LOG_H_
@@ -0,0 +1,442 @@
+#include "gk2_kinematicCalibration.h"
+#include "gk2_jointLog.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace gk2;
+
+const float KinematicCalibration::DIRECTION_WEIGHT = 0.1f;
+const float KinematicCalibration::INITIAL_DAMPING = 1e-3f;
+const float KinematicCalibration::MAX_DAMPING = 1e8f;
+const float KinematicCalibration::MIN_IMPROVEMENT = 1e-6f;
+
+namespace
+{
+	//Solves a*x = b in place of b for a symmetric positive definite n x n row-major a, destroying a;
+	//false if a is not positive definite
+	bool Solve(double* a, double* b, unsigned int n)
+	{
+		//Cholesky factor in the lower triangle
+		for (unsigned int j = 0; j < n; ++j)
+		{
+			double d = a[j * n + j];
+			for (unsigned int k = 0; k < j; ++k)
+				d -= a[j * n + k] * a[j * n + k];
+			if (d <= 0.0)
+				return false;
+			d = sqrt(d);
+			a[j * n + j] = d;
+			for (unsigned int i = j + 1; i < n; ++i)
+			{
+				double s = a[i * n + j];
+				for (unsigned int k = 0; k < j; ++k)
+					s -= a[i * n + k] * a[j * n + k];
+				a[i * n + j] = s / d;
+			}
+		}
+		for (unsigned int i = 0; i < n; ++i)
+		{
+			for (unsigned int k = 0; k < i; ++k)
+				b[i] -= a[i * n + k] * b[k];
+			b[i] /= a[i * n + i];
+		}
+		for (unsigned int i = n; i-- > 0; )
+		{
+			for (unsigned int k = i + 1; k < n; ++k)
+				b[i] -= a[k * n + i] * b[k];
+			b[i] /= a[i * n + i];
+		}
+		return true;
+	}
+
+	void StoreColumn(double* jacobian, unsigned int columns, unsigned int column, FXMVECTOR position,
+		FXMVECTOR direction, float directionWeight)
+	{
+		jacobian[0 * columns + column] = XMVectorGetX(position);
+		jacobian[1 * columns + column] = XMVectorGetY(position);
+		jacobian[2 * columns + column] = XMVectorGetZ(position);
+		jacobian[3 * columns + column] = directionWeight * XMVectorGetX(direction);
+		jacobian[4 * columns + column] = directionWeight * XMVectorGetY(direction);
+		jacobian[5 * columns + column] = directionWeight * XMVectorGetZ(direction);
+	}
+}
+
+KinematicCalibration::KinematicCalibration(ThreadPool& threads)
+	: m_threads(threads), m_iterations(0)
+{
+	m_model.TorchTip = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	m_model.TorchAxis = XMFLOAT3(1.0f, 0.0f, 0.0f);
+	m_errorsBefore[0] = m_errorsBefore[1] = 0.0f;
+	m_errorsAfter[0] = m_errorsAfter[1] = 0.0f;
+}
+
+bool KinematicCalibration::LoadSamples(const wstring& file)
+{
+	ifstream input(file);
+	if (!input)
+	{
+		m_error = "cannot open the calibration samples";
+		return false;
+	}
+	const unsigned int FIELDS = JOINTS + 6;
+	size_t count = m_samples.size();
+	string line;
+	while (getline(input, line))
+	{
+		const char* p = line.c_str();
+		const char* end = p + line.size();
+		double values[FIELDS];
+		unsigned int fields = 0;
+		while (fields < FIELDS && JointLog::ParseNumber(p, end, values[fields]))
+		{
+			++fields;
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+				++p;
+			if (p == end || *p != ',')
+				break;
+			++p;
+		}
+		if (fields != FIELDS)
+			continue;
+		CalibrationSample sample;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			sample.Angles[j] = static_cast<float>(values[j]);
+		sample.Position = XMFLOAT3(static_cast<float>(values[JOINTS]), static_cast<float>(values[JOINTS + 1]),
+			static_cast<float>(values[JOINTS + 2]));
+		sample.Normal = XMFLOAT3(static_cast<float>(values[JOINTS + 3]), static_cast<float>(values[JOINTS + 4]),
+			static_cast<float>(values[JOINTS + 5]));
+		XMStoreFloat3(&sample.Normal, XMVector3Normalize(XMLoadFloat3(&sample.Normal)));
+		m_samples.push_back(sample);
+	}
+	if (m_samples.size() == count)
+	{
+		m_error = "no calibration samples in the file";
+		return false;
+	}
+	return true;
+}
+
+bool KinematicCalibration::Fit(unsigned int maxIterations)
+{
+	m_iterations = 0;
+	//Every sample gives RESIDUALS equations, a few times more than the parameters keeps the fit determined
+	if (m_samples.size() * RESIDUALS < 4 * PARAMETERS)
+	{
+		m_error = "too few calibration samples";
+		return false;
+	}
+	double n = static_cast<double>(m_samples.size());
+	vector<NormalEquations> equations(2);
+	NormalEquations* current = &equations[0];
+	NormalEquations* candidate = &equations[1];
+	Accumulate(m_model, *current, true);
+	m_errorsBefore[0] = static_cast<float>(sqrt(current->positionError / n));
+	m_errorsBefore[1] = static_cast<float>(sqrt(current->directionError / n));
+
+	double damping = INITIAL_DAMPING;
+	bool converged = false;
+	while (!converged && m_iterations < maxIterations)
+	{
+		bool improved = false;
+		while (!improved && damping < MAX_DAMPING)
+		{
+			double matrix[PARAMETERS * PARAMETERS];
+			double step[PARAMETERS];
+			for (unsigned int i = 0; i < PARAMETERS; ++i)
+			{
+				for (unsigned int j = i; j < PARAMETERS; ++j)
+					matrix[i * PARAMETERS + j] = matrix[j * PARAMETERS + i] = current->matrix[i][j];
+				//A parameter no sample moves still gets a little damping of its own
+				matrix[i * PARAMETERS + i] += damping * (current->matrix[i][i] + 1e-9);
+				step[i] = -current->gradient[i];
+			}
+			if (!Solve(matrix, step, PARAMETERS))
+			{
+				damping *= 10.0;
+				continue;
+			}
+			KinematicModel model = Step(m_model, step);
+			Accumulate(model, *candidate, true);
+			if (candidate->error < current->error)
+			{
+				converged = current->error - candidate->error < MIN_IMPROVEMENT * current->error;
+				m_model = model;
+				swap(current, candidate);
+				damping = damping > 1e-9 ? damping * 0.1 : damping;
+				improved = true;
+			}
+			else
+				damping *= 10.0;
+		}
+		++m_iterations;
+		if (!improved)
+			break;
+	}
+	m_errorsAfter[0] = static_cast<float>(sqrt(current->positionError / n));
+	m_errorsAfter[1] = static_cast<float>(sqrt(current->directionError / n));
+	return true;
+}
+
+void KinematicCalibration::GetErrors(float& positionBefore, float& directionBefore, float& positionAfter,
+	float& directionAfter) const
+{
+	positionBefore = m_errorsBefore[0];
+	directionBefore = m_errorsBefore[1];
+	positionAfter = m_errorsAfter[0];
+	directionAfter = m_errorsAfter[1];
+}
+
+void KinematicCalibration::Evaluate(const KinematicModel& model, const float* angles, const XMFLOAT3& position,
+	const XMFLOAT3& normal, double* residuals, double* jacobian)
+{
+	XMMATRIX links[PumaKinematics::LINKS];
+	model.Kinematics.GetLinkMatrices(angles, links);
+	XMVECTOR tip = XMVector3TransformCoord(XMLoadFloat3(&model.TorchTip), links[JOINTS]);
+	XMVECTOR direction = XMVector3TransformNormal(XMLoadFloat3(&model.TorchAxis), links[JOINTS]);
+	XMVECTOR positionError = tip - XMLoadFloat3(&position);
+	XMVECTOR directionError = direction - XMLoadFloat3(&normal);
+	residuals[0] = XMVectorGetX(positionError);
+	residuals[1] = XMVectorGetY(positionError);
+	residuals[2] = XMVectorGetZ(positionError);
+	residuals[3] = DIRECTION_WEIGHT * XMVectorGetX(directionError);
+	residuals[4] = DIRECTION_WEIGHT * XMVectorGetY(directionError);
+	residuals[5] = DIRECTION_WEIGHT * XMVectorGetZ(directionError);
+	if (!jacobian)
+		return;
+
+	XMVECTOR zero = XMVectorZero();
+	for (unsigned int k = 1; k <= JOINTS; ++k)
+	{
+		//Turning joint k turns the tip about the joint's axis through its point
+		if (k < JOINTS)
+		{
+			XMVECTOR axis = XMVector3TransformNormal(XMLoadFloat3(&model.Kinematics.getJointAxis(k)), links[k - 1]);
+			XMVECTOR point = XMVector3TransformCoord(XMLoadFloat3(&model.Kinematics.getJointPoint(k)), links[k - 1]);
+			StoreColumn(jacobian, PARAMETERS, k - 1, XMVector3Cross(axis, tip - point), XMVector3Cross(axis, direction),
+				DIRECTION_WEIGHT);
+		}
+		//Moving the point of joint k moves everything after it by the offset less the offset turned by the joint
+		XMVECTOR u, v;
+		GetNormals(model.Kinematics.getJointAxis(k), u, v);
+		unsigned int column = (JOINTS - 1) + 2 * (k - 1);
+		StoreColumn(jacobian, PARAMETERS, column,
+			XMVector3TransformNormal(u, links[k - 1]) - XMVector3TransformNormal(u, links[k]), zero, DIRECTION_WEIGHT);
+		StoreColumn(jacobian, PARAMETERS, column + 1,
+			XMVector3TransformNormal(v, links[k - 1]) - XMVector3TransformNormal(v, links[k]), zero, DIRECTION_WEIGHT);
+	}
+	unsigned int column = (JOINTS - 1) + 2 * JOINTS;
+	StoreColumn(jacobian, PARAMETERS, column, XMVector3TransformNormal(XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f), links[JOINTS]),
+		zero, DIRECTION_WEIGHT);
+	StoreColumn(jacobian, PARAMETERS, column + 1, XMVector3TransformNormal(XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f), links[JOINTS]),
+		zero, DIRECTION_WEIGHT);
+	StoreColumn(jacobian, PARAMETERS, column + 2, XMVector3TransformNormal(XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f), links[JOINTS]),
+		zero, DIRECTION_WEIGHT);
+	XMVECTOR u, v;
+	GetNormals(model.TorchAxis, u, v);
+	StoreColumn(jacobian, PARAMETERS, column + 3, zero, XMVector3TransformNormal(u, links[JOINTS]), DIRECTION_WEIGHT);
+	StoreColumn(jacobian, PARAMETERS, column + 4, zero, XMVector3TransformNormal(v, links[JOINTS]), DIRECTION_WEIGHT);
+}
+
+void KinematicCalibration::Accumulate(const KinematicModel& model, NormalEquations& equations, bool derivatives)
+{
+	unsigned int tasks = m_threads.getThreadCount() * JointLog::TASKS_PER_THREAD;
+	unsigned int count = static_cast<unsigned int>(m_samples.size());
+	tasks = tasks < count ? tasks : (count > 0 ? count : 1);
+	vector<NormalEquations> partial(tasks);
+	m_threads.Run(tasks, [&](unsigned int task)
+	{
+		NormalEquations& sums = partial[task];
+		memset(&sums, 0, sizeof(NormalEquations));
+		double residuals[RESIDUALS];
+		double jacobian[RESIDUALS * PARAMETERS];
+		unsigned int end = static_cast<unsigned int>(static_cast<unsigned long long>(count) * (task + 1) / tasks);
+		for (unsigned int i = static_cast<unsigned int>(static_cast<unsigned long long>(count) * task / tasks); i < end; ++i)
+		{
+			const CalibrationSample& sample = m_samples[i];
+			Evaluate(model, sample.Angles, sample.Position, sample.Normal, residuals, derivatives ? jacobian : 0);
+			double position = 0.0, direction = 0.0;
+			for (unsigned int r = 0; r < 3; ++r)
+			{
+				position += residuals[r] * residuals[r];
+				direction += residuals[3 + r] * residuals[3 + r];
+			}
+			sums.error += position + direction;
+			sums.positionError += position;
+			//The chord between unit directions is the angle between them, near enough for small errors
+			sums.directionError += direction / (DIRECTION_WEIGHT * DIRECTION_WEIGHT);
+			if (!derivatives)
+				continue;
+			for (unsigned int r = 0; r < RESIDUALS; ++r)
+			{
+				const double* row = jacobian + r * PARAMETERS;
+				for (unsigned int a = 0; a < PARAMETERS; ++a)
+				{
+					if (row[a] == 0.0)
+						continue;
+					sums.gradient[a] += row[a] * residuals[r];
+					for (unsigned int b = a; b < PARAMETERS; ++b)
+						sums.matrix[a][b] += row[a] * row[b];
+				}
+			}
+		}
+	});
+	memset(&equations, 0, sizeof(NormalEquations));
+	for (unsigned int t = 0; t < tasks; ++t)
+	{
+		equations.error += partial[t].error;
+		equations.positionError += partial[t].positionError;
+		equations.directionError += partial[t].directionError;
+		if (!derivatives)
+			continue;
+		for (unsigned int a = 0; a < PARAMETERS; ++a)
+		{
+			equations.gradient[a] += partial[t].gradient[a];
+			for (unsigned int b = a; b < PARAMETERS; ++b)
+				equations.matrix[a][b] += partial[t].matrix[a][b];
+		}
+	}
+}
+
+KinematicModel KinematicCalibration::Step(const KinematicModel& model, const double* step)
+{
+	KinematicModel result = model;
+	for (unsigned int k = 1; k < JOINTS; ++k)
+		result.Kinematics.SetZero(k, model.Kinematics.getZero(k) + static_cast<float>(step[k - 1]));
+	for (unsigned int k = 1; k <= JOINTS; ++k)
+	{
+		XMVECTOR u, v;
+		GetNormals(model.Kinematics.getJointAxis(k), u, v);
+		unsigned int column = (JOINTS - 1) + 2 * (k - 1);
+		XMFLOAT3 point;
+		XMStoreFloat3(&point, XMLoadFloat3(&model.Kinematics.getJointPoint(k)) +
+			u * static_cast<float>(step[column]) + v * static_cast<float>(step[column + 1]));
+		result.Kinematics.SetJoint(k, point, model.Kinematics.getJointAxis(k));
+	}
+	const double* torch = step + (JOINTS - 1) + 2 * JOINTS;
+	result.TorchTip.x += static_cast<float>(torch[0]);
+	result.TorchTip.y += static_cast<float>(torch[1]);
+	result.TorchTip.z += static_cast<float>(torch[2]);
+	XMVECTOR u, v;
+	GetNormals(model.TorchAxis, u, v);
+	XMStoreFloat3(&result.TorchAxis, XMVector3Normalize(XMLoadFloat3(&model.TorchAxis) +
+		u * static_cast<float>(torch[3]) + v * static_cast<float>(torch[4])));
+	return result;
+}
+
+void KinematicCalibration::GetNormals(const XMFLOAT3& axis, XMVECTOR& u, XMVECTOR& v)
+{
+	XMVECTOR a = XMLoadFloat3(&axis);
+	XMVECTOR other = fabsf(axis.x) < 0.9f ? XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f) : XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+	u = XMVector3Normalize(XMVector3Cross(a, other));
+	v = XMVector3Cross(a, u);
+}
+
+bool KinematicCalibration::SaveModel(const wstring& file, const KinematicModel& model)
+{
+	ofstream output(file);
+	if (!output)
+		return false;
+	output << setprecision(9);
+	output << "#joint, point, axis, zero" << endl;
+	for (unsigned int k = 1; k <= JOINTS; ++k)
+	{
+		const XMFLOAT3& p = model.Kinematics.getJointPoint(k);
+		const XMFLOAT3& a = model.Kinematics.getJointAxis(k);
+		output << "joint " << k << " " << p.x << " " << p.y << " " << p.z << " " << a.x << " " << a.y << " " <<
+			a.z << " " << model.Kinematics.getZero(k) << endl;
+	}
+	output << "#torch tip, axis" << endl;
+	output << "torch " << model.TorchTip.x << " " << model.TorchTip.y << " " << model.TorchTip.z << " " <<
+		model.TorchAxis.x << " " << model.TorchAxis.y << " " << model.TorchAxis.z << endl;
+	return static_cast<bool>(output);
+}
+
+bool KinematicCalibration::LoadModel(const wstring& file, KinematicModel& model)
+{
+	ifstream input(file);
+	if (!input)
+		return false;
+	KinematicModel result = model;
+	unsigned int found = 0;	//bit k for joint k, bit 0 for the torch
+	string line;
+	while (getline(input, line))
+	{
+		istringstream fields(line);
+		string kind;
+		if (!(fields >> kind) || kind[0] == '#')
+			continue;
+		XMFLOAT3 point, axis;
+		if (kind == "joint")
+		{
+			unsigned int k;
+			float zero;
+			if (!(fields >> k >> point.x >> point.y >> point.z >> axis.x >> axis.y >> axis.z >> zero) ||
+				k < 1 || k > JOINTS)
+				return false;
+			result.Kinematics.SetJoint(k, point, axis);
+			result.Kinematics.SetZero(k, zero);
+			found |= 1 << k;
+		}
+		else if (kind == "torch")
+		{
+			if (!(fields >> point.x >> point.y >> point.z >> axis.x >> axis.y >> axis.z))
+				return false;
+			result.TorchTip = point;
+			XMStoreFloat3(&result.TorchAxis, XMVector3Normalize(XMLoadFloat3(&axis)));
+			found |= 1;
+		}
+		else
+			return false;
+	}
+	if (found != (2u << JOINTS) - 1)
+		return false;
+	model = result;
+	return true;
+}
+
+void KinematicCalibration::RefineInverse(const PumaKinematics& kinematics, const XMFLOAT3& torchTip,
+	const XMFLOAT3& torchAxis, const XMFLOAT3& position, const XMFLOAT3& normal, float* angles,
+	unsigned int iterations)
+{
+	XMVECTOR target = XMLoadFloat3(&position);
+	XMVECTOR targetNormal = XMVector3Normalize(XMLoadFloat3(&normal));
+	for (unsigned int iteration = 0; iteration < iterations; ++iteration)
+	{
+		XMMATRIX links[PumaKinematics::LINKS];
+		kinematics.GetLinkMatrices(angles, links);
+		XMVECTOR tip = XMVector3TransformCoord(XMLoadFloat3(&torchTip), links[JOINTS]);
+		XMVECTOR direction = XMVector3TransformNormal(XMLoadFloat3(&torchAxis), links[JOINTS]);
+		double residuals[RESIDUALS], jacobian[RESIDUALS * JOINTS];
+		StoreColumn(residuals, 1, 0, tip - target, direction - targetNormal, DIRECTION_WEIGHT);
+		for (unsigned int k = 1; k <= JOINTS; ++k)
+		{
+			XMVECTOR axis = XMVector3TransformNormal(XMLoadFloat3(&kinematics.getJointAxis(k)), links[k - 1]);
+			XMVECTOR point = XMVector3TransformCoord(XMLoadFloat3(&kinematics.getJointPoint(k)), links[k - 1]);
+			StoreColumn(jacobian, JOINTS, k - 1, XMVector3Cross(axis, tip - point), XMVector3Cross(axis, direction),
+				DIRECTION_WEIGHT);
+		}
+		double matrix[JOINTS * JOINTS], step[JOINTS];
+		for (unsigned int a = 0; a < JOINTS; ++a)
+		{
+			step[a] = 0.0;
+			for (unsigned int b = 0; b < JOINTS; ++b)
+				matrix[a * JOINTS + b] = 0.0;
+			for (unsigned int r = 0; r < RESIDUALS; ++r)
+			{
+				step[a] -= jacobian[r * JOINTS + a] * residuals[r];
+				for (unsigned int b = 0; b < JOINTS; ++b)
+					matrix[a * JOINTS + b] += jacobian[r * JOINTS + a] * jacobian[r * JOINTS + b];
+			}
+			//Near a singular pose the smallest damping keeps the step finite
+			matrix[a * JOINTS + a] += 1e-9;
+		}
+		if (!Solve(matrix, step, JOINTS))
+			return;
+		for (unsigned int k = 0; k < JOINTS; ++k)
+			angles[k] += static_cast<float>(step[k]);
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef __GK2_KINEMATIC_CALIBRATION_H_
+#define __GK2_KINEMATIC_CALIBRATION_H_
+
+#include <xnamath.h>
+#include <string>
+#include <vector>
+#include "gk2_pumaKinematics.h"
+#include "gk2_threadPool.h"
+
+namespace gk2
+{
+	//Torch pose measured on the real robot, with the joint angles its encoders read at the time
+	struct CalibrationSample
+	{
+		float Angles[gk2::PumaKinematics::JOINTS];
+		XMFLOAT3 Position;	//of the torch tip
+		XMFLOAT3 Normal;	//from the tip back along the torch
+	};
+
+	//Robot geometry calibration is fitted to, and FK and IK use once it is
+	struct KinematicModel
+	{
+		gk2::PumaKinematics Kinematics;
+		XMFLOAT3 TorchTip;		//in the coordinates of the meshes, like the joint points
+		XMFLOAT3 TorchAxis;
+	};
+
+	//Fits the joint points, the encoder zeros and the torch on the last link to measured torch poses by
+	//Levenberg-Marquardt. Every iteration linearizes the model where it is: each joint point moves across
+	//its axis in two directions and the torch axis tilts in two, so no parameter slides along a direction
+	//that changes nothing; the zero of the last joint is left out, as turning the torch about that joint
+	//does the same. The derivatives are the screw motions of the joints, analytic and exact, and the
+	//normal equations of the samples are summed by the threads over ranges of samples, then added up in
+	//the same order every time. The step is damped by a multiple of the diagonal, grown until it lowers
+	//the error and shrunk after.
+	class KinematicCalibration
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+		static const unsigned int PARAMETERS = (JOINTS - 1) + 2 * JOINTS + 3 + 2;	//zeros, points, tip, axis
+		static const float DIRECTION_WEIGHT;	//metres of position error as bad as a radian of direction error
+		static const unsigned int DEFAULT_ITERATIONS = 50;
+
+		KinematicCalibration(gk2::ThreadPool& threads);
+
+		void SetModel(const gk2::KinematicModel& model) { m_model = model; }
+		const gk2::KinematicModel& getModel() const { return m_model; }
+
+		void AddSample(const gk2::CalibrationSample& sample) { m_samples.push_back(sample); }
+		//Adds the samples of a text file, a sample per line: the five angles, the position and the normal
+		//separated by commas; false with the error set if the file cannot be read or has no samples
+		bool LoadSamples(const std::wstring& file);
+		unsigned int getSampleCount() const { return static_cast<unsigned int>(m_samples.size()); }
+		const std::string& getError() const { return m_error; }
+
+		//Fits the model to the samples, false with the error set if there are too few of them
+		bool Fit(unsigned int maxIterations = DEFAULT_ITERATIONS);
+		unsigned int getIterations() const { return m_iterations; }
+		//Root mean square torch errors over the samples before and after the fit, metres and radians
+		void GetErrors(float& positionBefore, float& directionBefore, float& positionAfter,
+			float& directionAfter) const;
+
+		//Writes a model to a text file and reads it back, false if it cannot be
+		static bool SaveModel(const std::wstring& file, const gk2::KinematicModel& model);
+		static bool LoadModel(const std::wstring& file, gk2::KinematicModel& model);
+		//Refines angles, near a solution already, into those placing the torch on the last link at a pose,
+		//by Gauss-Newton steps with the same derivatives as the fit
+		static void RefineInverse(const gk2::PumaKinematics& kinematics, const XMFLOAT3& torchTip,
+			const XMFLOAT3& torchAxis, const XMFLOAT3& position, const XMFLOAT3& normal, float* angles,
+			unsigned int iterations = 3);
+
+	private:
+		static const unsigned int RESIDUALS = 6;	//position and weighted direction errors of a sample
+		static const float INITIAL_DAMPING;
+		static const float MAX_DAMPING;			//damping at which the fit gives up looking for a better step
+		static const float MIN_IMPROVEMENT;		//relative error decrease below which the fit has converged
+
+		//Sums of the normal equations over some samples, the upper triangle of the matrix only
+		struct NormalEquations
+		{
+			double matrix[PARAMETERS][PARAMETERS];
+			double gradient[PARAMETERS];
+			double error;				//sum of the squared residuals
+			double positionError;		//sums of the squared errors, unweighted
+			double directionError;
+		};
+
+		gk2::ThreadPool& m_threads;
+		gk2::KinematicModel m_model;
+		std::vector<gk2::CalibrationSample> m_samples;
+		std::string m_error;
+		unsigned int m_iterations;
+		float m_errorsBefore[2];
+		float m_errorsAfter[2];
+
+		//Residuals of a sample and, if jacobian is given, their derivatives by the parameters, row-major
+		static void Evaluate(const gk2::KinematicModel& model, const float* angles, const XMFLOAT3& position,
+			const XMFLOAT3& normal, double* residuals, double* jacobian);
+		//Sums the errors and, with derivatives, the normal equations over all samples on all threads
+		void Accumulate(const gk2::KinematicModel& model, NormalEquations& equations, bool derivatives);
+		//Moves the model by a parameter step
+		static gk2::KinematicModel Step(const gk2::KinematicModel& model, const double* step);
+		//Directions across an axis
+		static void GetNormals(const XMFLOAT3& axis, XMVECTOR& u, XMVECTOR& v);
+
+		KinematicCalibration(const KinematicCalibration& right) : m_threads(right.m_threads) { }
+		KinematicCalibration& operator=(const KinematicCalibration& right) { return *this; }
+	};
+}
+
+#endif __GK2_KINEMATIC_CALIBRATION_H_
@@ -0,0 +1,54 @@
+#include "gk2_massProperties.h"
+
+using namespace gk2;
+
+MassProperties::MassProperties()
+	: Mass(0.0f), CenterOfMass(0.0f, 0.0f, 0.0f), Inertia(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f)
+{ }
+
+MassProperties MassProperties::FromMesh(const VertexPosNormal* vertices, const unsigned short* indices,
+	unsigned int indexCount, float density)
+{
+	//Volume, its first moment and its covariance about the origin, summed in double precision
+	double volume = 0.0, moment[3] = { 0.0, 0.0, 0.0 }, covariance[3][3] = { { 0.0 } };
+	for (unsigned int t = 0; t + 2 < indexCount; t += 3)
+	{
+		double p[3][3];
+		for (int v = 0; v < 3; ++v)
+		{
+			const XMFLOAT3& pos = vertices[indices[t + v]].Pos;
+			p[v][0] = pos.x; p[v][1] = pos.y; p[v][2] = pos.z;
+		}
+		//Six times the signed volume of the tetrahedron (0, p0, p1, p2)
+		double det = p[0][0] * (p[1][1] * p[2][2] - p[1][2] * p[2][1]) -
+			p[0][1] * (p[1][0] * p[2][2] - p[1][2] * p[2][0]) +
+			p[0][2] * (p[1][0] * p[2][1] - p[1][1] * p[2][0]);
+		double sum[3] = { p[0][0] + p[1][0] + p[2][0], p[0][1] + p[1][1] + p[2][1], p[0][2] + p[1][2] + p[2][2] };
+		volume += det / 6.0;
+		for (int i = 0; i < 3; ++i)
+		{
+			moment[i] += det * sum[i] / 24.0;
+			for (int j = 0; j < 3; ++j)
+				covariance[i][j] += det / 120.0 *
+					(p[0][i] * p[0][j] + p[1][i] * p[1][j] + p[2][i] * p[2][j] + sum[i] * sum[j]);
+		}
+	}
+
+	MassProperties result;
+	if (volume == 0.0)
+		return result;
+	//Inward facing triangles give the same integrals with the opposite sign
+	double mass = density * volume, com[3] = { moment[0] / volume, moment[1] / volume, moment[2] / volume };
+	result.Mass = static_cast<float>(mass < 0.0 ? -mass : mass);
+	result.CenterOfMass = XMFLOAT3(static_cast<float>(com[0]), static_cast<float>(com[1]), static_cast<float>(com[2]));
+	//Covariance about the center of mass, then the inertia tensor tr(C) * I - C
+	double c[3][3];
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			c[i][j] = density * (covariance[i][j] - volume * com[i] * com[j]) * (volume < 0.0 ? -1.0 : 1.0);
+	double trace = c[0][0] + c[1][1] + c[2][2];
+	for (int i = 0; i < 3; ++i)
+		for (int j = 0; j < 3; ++j)
+			result.Inertia.m[i][j] = static_cast<float>((i == j ? trace : 0.0) - c[i][j]);
+	return result;
+}
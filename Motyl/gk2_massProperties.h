@@ -0,0 +1,25 @@
+#ifndef __GK2_MASS_PROPERTIES_H_
+#define __GK2_MASS_PROPERTIES_H_
+
+#include <xnamath.h>
+#include "gk2_vertices.h"
+
+namespace gk2
+{
+	//Mass distribution of a rigid body, in the coordinates of its mesh
+	struct MassProperties
+	{
+		float Mass;
+		XMFLOAT3 CenterOfMass;
+		XMFLOAT3X3 Inertia;		//inertia tensor about the center of mass
+
+		MassProperties();
+
+		//Solid of uniform density bounded by a closed triangle mesh with consistent winding.
+		//Integrates over tetrahedra joining every triangle with the origin, so the mesh may be anywhere.
+		static MassProperties FromMesh(const gk2::VertexPosNormal* vertices, const unsigned short* indices,
+			unsigned int indexCount, float density);
+	};
+}
+
+#endif __GK2_MASS_PROPERTIES_H_
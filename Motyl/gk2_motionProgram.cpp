@@ -0,0 +1,431 @@
+#include "gk2_motionProgram.h"
+#include <sstream>
+#include <cmath>
+#include <cfloat>
+#include <cctype>
+
+using namespace std;
+using namespace gk2;
+
+const float MotionProgram::DEFAULT_SPEED = 0.1f;
+const float MotionProgram::DEFAULT_ACCELERATION = 0.5f;
+const float MotionProgram::SMOOTH_TURN = 0.99f;
+const float MotionProgram::REACH_TOLERANCE = 0.001f;
+const float MotionProgram::AIM_TOLERANCE = 0.9999f;
+const float MotionProgram::REACH_STEP = 0.05f;
+
+namespace
+{
+	//Moves shorter than it are left out
+	const float EPSILON = 1e-6f;
+
+	//Reads count numbers and nothing after them
+	bool ReadNumbers(istringstream& in, float* values, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+			if (!(in >> values[i]))
+				return false;
+		string rest;
+		return !(in >> rest);
+	}
+
+	XMFLOAT3 Normalized(FXMVECTOR v)
+	{
+		XMFLOAT3 result;
+		XMStoreFloat3(&result, XMVector3Normalize(v));
+		return result;
+	}
+
+	void Store(vector<float>& operands, const XMFLOAT3& v)
+	{
+		operands.push_back(v.x);
+		operands.push_back(v.y);
+		operands.push_back(v.z);
+	}
+
+	XMVECTOR Load(const float* operands)
+	{
+		return XMVectorSet(operands[0], operands[1], operands[2], 0.0f);
+	}
+}
+
+MotionProgram::MotionProgram()
+	: m_duration(0.0f)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = 1.0f;
+		m_maxAcceleration[j] = 1.0f;
+		m_startAngles[j] = 0.0f;
+	}
+}
+
+void MotionProgram::SetLimits(const float* maxVelocity, const float* maxAcceleration)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = maxVelocity[j];
+		m_maxAcceleration[j] = maxAcceleration[j];
+	}
+}
+
+void MotionProgram::SetKinematics(const InverseKinematics& inverse, const ForwardKinematics& forward)
+{
+	m_inverse = inverse;
+	m_forward = forward;
+}
+
+void MotionProgram::AddJointMove(const float* angles, float dwell, State& state, vector<Segment>& segments,
+	vector<float>& operands, vector<XMFLOAT3>& tangents) const
+{
+	//Along the straight line between the angles, as fast as the joint slowest over its part of it allows
+	Segment segment;
+	segment.length = 1.0f;
+	segment.speed = segment.acceleration = FLT_MAX;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		float change = fabs(angles[j] - state.angles[j]);
+		if (change <= EPSILON)
+			continue;
+		segment.speed = m_maxVelocity[j] / change < segment.speed ? m_maxVelocity[j] / change : segment.speed;
+		segment.acceleration = m_maxAcceleration[j] / change < segment.acceleration ?
+			m_maxAcceleration[j] / change : segment.acceleration;
+	}
+	segment.duration = dwell;
+	if (segment.speed == FLT_MAX)
+	{
+		if (dwell <= 0.0f)
+			return;
+		segment.length = segment.speed = segment.acceleration = 0.0f;
+	}
+	segment.operands = static_cast<unsigned int>(operands.size());
+	segment.operation = JOINT_MOVE;
+	segment.ramps = RAMP_IN | RAMP_OUT;
+	segment.welding = state.welding;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		operands.push_back(state.angles[j]);
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		operands.push_back(angles[j] - state.angles[j]);
+	segments.push_back(segment);
+	tangents.push_back(XMFLOAT3(0.0f, 0.0f, 0.0f));
+	tangents.push_back(XMFLOAT3(0.0f, 0.0f, 0.0f));
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		state.angles[j] = angles[j];
+}
+
+bool MotionProgram::Reach(const XMFLOAT3& position, const XMFLOAT3& normal, float* angles) const
+{
+	//Inverse kinematics clamps what is out of reach to the nearest pose it has, only the forward pass tells
+	m_inverse(position, normal, angles);
+	XMFLOAT3 reached, reachedNormal;
+	m_forward(angles, reached, reachedNormal);
+	float miss = XMVectorGetX(XMVector3Length(XMLoadFloat3(&reached) - XMLoadFloat3(&position)));
+	float aim = XMVectorGetX(XMVector3Dot(XMVector3Normalize(XMLoadFloat3(&reachedNormal)),
+		XMVector3Normalize(XMLoadFloat3(&normal))));
+	//Angles that are not numbers fail both comparisons
+	return miss <= REACH_TOLERANCE && aim >= AIM_TOLERANCE;
+}
+
+bool MotionProgram::CompileLine(const string& line, State& state, vector<Segment>& segments,
+	vector<float>& operands, vector<XMFLOAT3>& tangents)
+{
+	istringstream in(line.substr(0, line.find(';')));
+	string command;
+	if (!(in >> command))
+		return true;
+	for (unsigned int i = 0; i < command.size(); ++i)
+		command[i] = static_cast<char>(toupper(command[i]));
+	float values[6];
+	if (command == "WELD")
+	{
+		string mode, rest;
+		in >> mode;
+		for (unsigned int i = 0; i < mode.size(); ++i)
+			mode[i] = static_cast<char>(toupper(mode[i]));
+		if ((mode != "ON" && mode != "OFF") || (in >> rest))
+		{
+			m_error = "WELD needs ON or OFF";
+			return false;
+		}
+		state.welding = mode == "ON";
+	}
+	else if (command == "SPEED" || command == "ACCEL" || command == "DWELL")
+	{
+		if (!ReadNumbers(in, values, 1) || values[0] <= 0.0f)
+		{
+			m_error = command + " needs a positive number";
+			return false;
+		}
+		if (command == "SPEED")
+			state.speed = values[0];
+		else if (command == "ACCEL")
+			state.acceleration = values[0];
+		else
+			AddJointMove(state.angles, values[0], state, segments, operands, tangents);
+	}
+	else if (command == "TOOL")
+	{
+		if (!ReadNumbers(in, values, 3) || XMVectorGetX(XMVector3Length(Load(values))) <= EPSILON)
+		{
+			m_error = "TOOL needs a direction";
+			return false;
+		}
+		state.tool = Normalized(Load(values));
+	}
+	else if (command == "JOINT")
+	{
+		if (!ReadNumbers(in, values, JOINTS))
+		{
+			m_error = "JOINT needs 5 angles";
+			return false;
+		}
+		AddJointMove(values, 0.0f, state, segments, operands, tangents);
+		m_forward(state.angles, state.position, state.normal);
+		state.tool = state.normal;
+	}
+	else if (command == "PTP")
+	{
+		if (!ReadNumbers(in, values, 3))
+		{
+			m_error = "PTP needs a point";
+			return false;
+		}
+		float angles[JOINTS];
+		state.position = XMFLOAT3(values[0], values[1], values[2]);
+		state.normal = state.tool;
+		if (!Reach(state.position, state.normal, angles))
+		{
+			m_error = "target out of reach";
+			return false;
+		}
+		AddJointMove(angles, 0.0f, state, segments, operands, tangents);
+	}
+	else if (command == "LINE" || command == "ARC")
+	{
+		bool arc = command == "ARC";
+		if (!ReadNumbers(in, values, arc ? 6 : 3))
+		{
+			m_error = arc ? "ARC needs two points" : "LINE needs a point";
+			return false;
+		}
+		XMFLOAT3 endPosition(values[arc ? 3 : 0], values[arc ? 4 : 1], values[arc ? 5 : 2]);
+		Segment segment;
+		segment.operands = static_cast<unsigned int>(operands.size());
+		segment.speed = state.speed;
+		segment.acceleration = state.acceleration;
+		segment.welding = state.welding;
+		XMVECTOR start = XMLoadFloat3(&state.position), end = Load(values + (arc ? 3 : 0));
+		XMFLOAT3 startTangent, endTangent;
+		if (arc)
+		{
+			//Circumcenter of the three points, relative to the end
+			XMVECTOR a = start - end, b = Load(values) - end, normal = XMVector3Cross(a, b);
+			float area = XMVectorGetX(XMVector3LengthSq(normal));
+			if (area <= EPSILON * EPSILON)
+			{
+				m_error = "ARC points are on a line";
+				return false;
+			}
+			XMVECTOR center = end + XMVector3Cross(XMVector3LengthSq(a) * b - XMVector3LengthSq(b) * a, normal) /
+				(2.0f * area);
+			//Start, through and end are counterclockwise about the normal of the triangle they make
+			XMVECTOR u = start - center, v = XMVector3Cross(XMVector3Normalize(normal), u);
+			float sweep = atan2(XMVectorGetX(XMVector3Dot(end - center, v)), XMVectorGetX(XMVector3Dot(end - center, u)));
+			sweep = sweep <= 0.0f ? sweep + XM_2PI : sweep;
+			segment.operation = ARC_MOVE;
+			segment.length = XMVectorGetX(XMVector3Length(u)) * sweep;
+			XMFLOAT3 operand;
+			XMStoreFloat3(&operand, center);
+			Store(operands, operand);
+			XMStoreFloat3(&operand, u);
+			Store(operands, operand);
+			XMStoreFloat3(&operand, v);
+			Store(operands, operand);
+			operands.push_back(sweep);
+			startTangent = Normalized(v);
+			endTangent = Normalized(cos(sweep) * v - sin(sweep) * u);
+		}
+		else
+		{
+			segment.operation = LINE_MOVE;
+			segment.length = XMVectorGetX(XMVector3Length(end - start));
+			if (segment.length <= EPSILON)
+				return true;
+			Store(operands, state.position);
+			XMFLOAT3 change;
+			XMStoreFloat3(&change, end - start);
+			Store(operands, change);
+			startTangent = endTangent = Normalized(end - start);
+		}
+		Store(operands, state.normal);
+		Store(operands, state.tool);
+		//The torch must reach the whole path, not just its end, the last point gives the angles at the end
+		float endAngles[JOINTS];
+		unsigned int points = static_cast<unsigned int>(ceil(segment.length / REACH_STEP));
+		points = points > 0 ? points : 1;
+		for (unsigned int i = 1; i <= points; ++i)
+		{
+			XMFLOAT3 position, normal;
+			PathPose(segment.operation, &operands[segment.operands], static_cast<float>(i) / points, position, normal);
+			if (!Reach(position, normal, endAngles))
+			{
+				m_error = i < points ? "move leaves the reach of the robot" : "target out of reach";
+				return false;
+			}
+		}
+		segments.push_back(segment);
+		tangents.push_back(startTangent);
+		tangents.push_back(endTangent);
+		state.position = endPosition;
+		state.normal = state.tool;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			state.angles[j] = endAngles[j];
+	}
+	else
+	{
+		m_error = "unknown command " + command;
+		return false;
+	}
+	return true;
+}
+
+bool MotionProgram::Compile(const string& source, const float* startAngles)
+{
+	State state;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		state.angles[j] = startAngles[j];
+	m_forward(state.angles, state.position, state.normal);
+	state.tool = state.normal;
+	state.speed = DEFAULT_SPEED;
+	state.acceleration = DEFAULT_ACCELERATION;
+	state.welding = false;
+	vector<Segment> segments;
+	vector<float> operands;
+	vector<XMFLOAT3> tangents;		//at the start and the end of every segment, zero for joint moves
+	istringstream in(source);
+	string line;
+	for (unsigned int number = 1; getline(in, line); ++number)
+		if (!CompileLine(line, state, segments, operands, tangents))
+		{
+			ostringstream error;
+			error << "line " << number << ": " << m_error;
+			m_error = error.str();
+			return false;
+		}
+
+	//Torch moves stop unless they turn into each other smoothly
+	float time = 0.0f;
+	for (unsigned int i = 0; i < segments.size(); ++i)
+	{
+		Segment& segment = segments[i];
+		if (segment.operation != JOINT_MOVE)
+		{
+			XMVECTOR start = XMLoadFloat3(&tangents[2 * i]), end = XMLoadFloat3(&tangents[2 * i + 1]);
+			bool fromPrevious = i > 0 && XMVectorGetX(XMVector3Dot(XMLoadFloat3(&tangents[2 * i - 1]), start)) >= SMOOTH_TURN;
+			bool intoNext = i + 1 < segments.size() &&
+				XMVectorGetX(XMVector3Dot(end, XMLoadFloat3(&tangents[2 * i + 2]))) >= SMOOTH_TURN;
+			segment.ramps = (fromPrevious ? 0 : RAMP_IN) | (intoNext ? 0 : RAMP_OUT);
+		}
+		SetProfile(segment);
+		segment.start = time;
+		time += segment.duration;
+	}
+	m_segments.swap(segments);
+	m_operands.swap(operands);
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		m_startAngles[j] = startAngles[j];
+	m_duration = time;
+	m_error.clear();
+	return true;
+}
+
+void MotionProgram::SetProfile(Segment& segment)
+{
+	if (segment.length <= 0.0f)
+		return;
+	//Too short to reach the top speed, the ramps meet halfway
+	float ramps = static_cast<float>((segment.ramps & RAMP_IN ? 1 : 0) + (segment.ramps & RAMP_OUT ? 1 : 0));
+	float v = segment.speed, a = segment.acceleration;
+	if (ramps * v * v > 2.0f * a * segment.length)
+		segment.speed = v = sqrt(2.0f * a * segment.length / ramps);
+	segment.duration = segment.length / v + ramps * 0.5f * v / a;
+}
+
+float MotionProgram::Distance(const Segment& segment, float t)
+{
+	if (segment.length <= 0.0f)
+		return 0.0f;
+	float v = segment.speed, a = segment.acceleration;
+	float rampIn = segment.ramps & RAMP_IN ? v / a : 0.0f, rampOut = segment.ramps & RAMP_OUT ? v / a : 0.0f;
+	float distance;
+	if (t < rampIn)
+		distance = 0.5f * a * t * t;
+	else if (t > segment.duration - rampOut)
+	{
+		float left = segment.duration - t > 0.0f ? segment.duration - t : 0.0f;
+		distance = segment.length - 0.5f * a * left * left;
+	}
+	else
+		distance = 0.5f * v * rampIn + v * (t - rampIn);
+	return distance < 0.0f ? 0.0f : (distance > segment.length ? segment.length : distance);
+}
+
+void MotionProgram::Evaluate(float time, MotionTarget& target, unsigned int& segment) const
+{
+	unsigned int count = getSegmentCount();
+	if (count == 0)
+	{
+		target.Joint = true;
+		target.Welding = false;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			target.Angles[j] = m_startAngles[j];
+		return;
+	}
+	time = time < 0.0f ? 0.0f : (time > m_duration ? m_duration : time);
+	//Searched only when playback went back, otherwise it moves on a segment or two per frame
+	if (segment >= count || m_segments[segment].start > time)
+	{
+		unsigned int low = 0, high = count;
+		while (high - low > 1)
+		{
+			unsigned int middle = (low + high) / 2;
+			if (m_segments[middle].start > time)
+				high = middle;
+			else
+				low = middle;
+		}
+		segment = low;
+	}
+	while (segment + 1 < count && m_segments[segment + 1].start <= time)
+		++segment;
+
+	const Segment& current = m_segments[segment];
+	const float* operands = &m_operands[current.operands];
+	float f = current.length > 0.0f ? Distance(current, time - current.start) / current.length : 0.0f;
+	target.Welding = current.welding;
+	target.Joint = current.operation == JOINT_MOVE;
+	if (target.Joint)
+	{
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			target.Angles[j] = operands[j] + f * operands[JOINTS + j];
+		return;
+	}
+	PathPose(current.operation, operands, f, target.Position, target.Normal);
+}
+
+void MotionProgram::PathPose(unsigned char operation, const float* operands, float f, XMFLOAT3& position,
+	XMFLOAT3& normal)
+{
+	if (operation == LINE_MOVE)
+	{
+		XMStoreFloat3(&position, Load(operands) + f * Load(operands + 3));
+		operands += 6;
+	}
+	else
+	{
+		float angle = f * operands[9];
+		XMStoreFloat3(&position, Load(operands) + cos(angle) * Load(operands + 3) + sin(angle) * Load(operands + 6));
+		operands += 10;
+	}
+	XMStoreFloat3(&normal, XMVector3Normalize(XMVectorLerp(Load(operands), Load(operands + 3), f)));
+}
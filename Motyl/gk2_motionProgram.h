@@ -0,0 +1,134 @@
+#ifndef __GK2_MOTION_PROGRAM_H_
+#define __GK2_MOTION_PROGRAM_H_
+
+#include <xnamath.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include "gk2_pumaKinematics.h"
+
+namespace gk2
+{
+	//Where the robot should be at some time of a program, the torch pose is set unless the angles are
+	struct MotionTarget
+	{
+		bool Joint;			//the angles are given, the torch follows them
+		bool Welding;
+		float Angles[gk2::PumaKinematics::JOINTS];
+		XMFLOAT3 Position;	//of the torch tip
+		XMFLOAT3 Normal;	//from the tip back along the torch
+	};
+
+	//Robot program compiled once into motion segments, one command per line, ';' starts a comment:
+	//  JOINT a1 a2 a3 a4 a5	joint move to the angles
+	//  PTP x y z				joint move to the torch at the point
+	//  LINE x y z				straight move of the torch to the point
+	//  ARC x y z x y z			circular move through the first point to the second
+	//  SPEED v					of the torch along LINE and ARC, ACCEL a its acceleration at stops
+	//  TOOL x y z				torch direction at the following targets, turned to along the moves
+	//  DWELL t					stay put for t seconds
+	//  WELD ON, WELD OFF		arc on during the following moves
+	//Joint moves go from rest to rest with every joint within its limits. A torch move ramps its speed up
+	//or down only where it does not carry on smoothly from the move before or into the one after. Every
+	//segment is a fixed header with its start time and speed profile and a few operands, its geometry
+	//solved at compile time: the arc's center and axes, the joint angles at both ends. Evaluate only reads
+	//the segments, so any number of threads may play a program at once with no locks and no allocation.
+	class MotionProgram
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+
+		//Joint angles placing the torch at a pose, and the torch pose at joint angles
+		typedef std::function<void (const XMFLOAT3& position, const XMFLOAT3& normal, float* angles)> InverseKinematics;
+		typedef std::function<void (const float* angles, XMFLOAT3& position, XMFLOAT3& normal)> ForwardKinematics;
+
+		MotionProgram();
+
+		void SetLimits(const float* maxVelocity, const float* maxAcceleration);
+		void SetKinematics(const InverseKinematics& inverse, const ForwardKinematics& forward);
+
+		//Compiles source for the robot starting at startAngles, returns false and keeps the previous program
+		//if the source has an error
+		bool Compile(const std::string& source, const float* startAngles);
+		//Line and description of the last compile error
+		const std::string& getError() const { return m_error; }
+		float getDuration() const { return m_duration; }
+		unsigned int getSegmentCount() const { return static_cast<unsigned int>(m_segments.size()); }
+
+		//Target at time, clamped to the program. segment is the playback's position in the program, found
+		//again if time went back, so playing forward takes constant time; start it at 0
+		void Evaluate(float time, gk2::MotionTarget& target, unsigned int& segment) const;
+
+	private:
+		static const float DEFAULT_SPEED;
+		static const float DEFAULT_ACCELERATION;
+		static const float SMOOTH_TURN;		//cosine of the largest turn between moves taken without a stop
+		static const float REACH_TOLERANCE;	//distance from a target the torch may end up at
+		static const float AIM_TOLERANCE;	//cosine of the largest angle between the torch and its direction
+		static const float REACH_STEP;		//distance between the points of a torch move checked for reach
+
+		enum Operation
+		{
+			JOINT_MOVE,		//from angles, angle changes
+			LINE_MOVE,		//from point, point change, normal at the start and the end
+			ARC_MOVE		//center, start radius, radius a quarter turn on, sweep, normal at the start and the end
+		};
+
+		//Ramps of the speed profile
+		static const unsigned char RAMP_IN = 1;
+		static const unsigned char RAMP_OUT = 2;
+
+		struct Segment
+		{
+			float start;
+			float duration;
+			float length;		//of the path, 1 for joint moves
+			float speed;		//top speed along the path
+			float acceleration;
+			unsigned int operands;
+			unsigned char operation;
+			unsigned char ramps;
+			bool welding;
+		};
+
+		//Where the compiler is in the program
+		struct State
+		{
+			float angles[JOINTS];
+			XMFLOAT3 position;
+			XMFLOAT3 normal;
+			XMFLOAT3 tool;
+			float speed;
+			float acceleration;
+			bool welding;
+		};
+
+		float m_maxVelocity[JOINTS];
+		float m_maxAcceleration[JOINTS];
+		InverseKinematics m_inverse;
+		ForwardKinematics m_forward;
+		std::vector<Segment> m_segments;
+		std::vector<float> m_operands;
+		float m_startAngles[JOINTS];		//held by a program without moves
+		float m_duration;
+		std::string m_error;
+
+		//Appends the segments of one command, returns false with the error set if it is wrong
+		bool CompileLine(const std::string& line, State& state, std::vector<Segment>& segments,
+			std::vector<float>& operands, std::vector<XMFLOAT3>& tangents);
+		//Rest to rest move from the state's angles to angles, or a stay of dwell seconds where they are
+		void AddJointMove(const float* angles, float dwell, State& state, std::vector<Segment>& segments,
+			std::vector<float>& operands, std::vector<XMFLOAT3>& tangents) const;
+		//Angles placing the torch at the pose, false if the torch they place misses it
+		bool Reach(const XMFLOAT3& position, const XMFLOAT3& normal, float* angles) const;
+		//Torch pose at fraction f of the path of a line or arc move with the operands
+		static void PathPose(unsigned char operation, const float* operands, float f, XMFLOAT3& position,
+			XMFLOAT3& normal);
+		//Fills in the segment's duration for its length, speed, acceleration and ramps
+		static void SetProfile(Segment& segment);
+		//Distance along the segment's path at time t since its start
+		static float Distance(const Segment& segment, float t);
+	};
+}
+
+#endif __GK2_MOTION_PROGRAM_H_
@@ -0,0 +1,88 @@
+#include "gk2_particleEmitter.h"
+#include "gk2_particleSimulation.h"
+#include <cmath>
+
+using namespace gk2;
+
+ParticleEmitterDesc::ParticleEmitterDesc()
+	: EmissionRate(50.0f), TimeToLive(1.0f), MaxAngle(XM_PIDIV2 / 9.0f), MinVelocity(1.5f), MaxVelocity(2.5f),
+	Size(0.08f), MinAngleVel(-XM_PI), MaxAngleVel(XM_PI), Type(BALLISTIC_PARTICLE)
+{
+
+}
+
+ParticleEmitter::ParticleEmitter(const ParticleEmitterDesc& desc, unsigned int seed)
+	: m_desc(desc), m_random(seed), m_particlesToCreate(0.0f), m_position(0.0f, 0.0f, 0.0f),
+	m_direction(0.0f, 1.0f, 0.0f), m_prevPosition(0.0f, 0.0f, 0.0f), m_prevDirection(0.0f, 1.0f, 0.0f),
+	m_started(false)
+{
+
+}
+
+void ParticleEmitter::Move(const XMFLOAT3& position, const XMFLOAT3& direction)
+{
+	m_position = position;
+	m_direction = direction;
+	if (!m_started)
+	{
+		m_prevPosition = position;
+		m_prevDirection = direction;
+		m_started = true;
+	}
+}
+
+XMFLOAT3 ParticleEmitter::Velocity(FXMVECTOR direction, float spread, float speed) const
+{
+	float a = tan(m_desc.MaxAngle);
+	XMFLOAT3 v(spread * a, 0, 0);
+	XMVECTOR velocity = direction + XMLoadFloat3(&v);
+	velocity = speed * XMVector3Normalize(velocity);
+	v = XMFLOAT3(abs(XMVectorGetX(velocity)),
+		XMVectorGetY(velocity),
+		XMVectorGetZ(velocity));
+	return v;
+}
+
+void ParticleEmitter::Emit(ParticleSimulation& simulation, float dt, float gravity)
+{
+	const float rate = m_desc.EmissionRate;
+	unsigned int count = 0;
+	float firstBirth = 0.0f;
+	if (rate > 0.0f)
+	{
+		//Particle k of the frame is born when the accumulator crosses k, so the count does not depend on dt
+		firstBirth = (1.0f - m_particlesToCreate) / rate;
+		m_particlesToCreate += dt * rate;
+		count = static_cast<unsigned int>(m_particlesToCreate);
+		m_particlesToCreate -= count;
+	}
+
+	XMVECTOR prevPos = XMLoadFloat3(&m_prevPosition), pos = XMLoadFloat3(&m_position);
+	XMVECTOR prevDir = XMLoadFloat3(&m_prevDirection), dir = XMLoadFloat3(&m_direction);
+	unsigned int emitted = 0;
+	while (emitted < count && !simulation.IsFull())
+	{
+		unsigned int batch = count - emitted;
+		if (batch > SPAWN_BATCH)
+			batch = SPAWN_BATCH;
+		//Random values are generated in bulk
+		m_random.Fill(m_spawnSpread, batch, -1.0f, 4.0f);
+		m_random.Fill(m_spawnSpeed, batch, m_desc.MinVelocity, m_desc.MaxVelocity);
+		m_random.Fill(m_spawnSpin, batch, m_desc.MinAngleVel, m_desc.MaxAngleVel);
+		for (unsigned int i = 0; i < batch; ++i)
+		{
+			float birth = firstBirth + (emitted + i) / rate;
+			if (birth > dt)
+				birth = dt;
+			float s = dt > 0.0f ? birth / dt : 1.0f;
+			XMFLOAT3 start;
+			XMStoreFloat3(&start, XMVectorLerp(prevPos, pos, s));
+			XMVECTOR direction = XMVector3Normalize(XMVectorLerp(prevDir, dir, s));
+			simulation.Add(start, Velocity(direction, m_spawnSpread[i], m_spawnSpeed[i]), m_spawnSpin[i], m_desc.Size,
+				m_desc.TimeToLive, dt - birth, gravity, m_desc.Type);
+		}
+		emitted += batch;
+	}
+	m_prevPosition = m_position;
+	m_prevDirection = m_direction;
+}
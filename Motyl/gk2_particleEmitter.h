@@ -0,0 +1,65 @@
+#ifndef __GK2_PARTICLE_EMITTER_H_
+#define __GK2_PARTICLE_EMITTER_H_
+
+#include <xnamath.h>
+#include "gk2_random.h"
+#include "gk2_particlePool.h"
+
+namespace gk2
+{
+	class ParticleSimulation;
+
+	//Parameters of a single emitter, the defaults describe welding sparks
+	struct ParticleEmitterDesc
+	{
+		float EmissionRate;		//number of particles to be born per second
+		float TimeToLive;		//time of particle's life in seconds
+		float MaxAngle;			//maximal angle declination from mean direction
+		float MinVelocity;		//minimal value of particle's velocity
+		float MaxVelocity;		//maximal value of particle's velocity
+		float Size;				//initial size of a particle
+		float MinAngleVel;		//minimal rotation speed
+		float MaxAngleVel;		//maximal rotation speed
+		gk2::ParticleType Type;	//motion model of the emitted particles
+
+		ParticleEmitterDesc();
+	};
+
+	//Source of particles moving along a path. Births are spread evenly over every frame, from where the
+	//emitter was at the end of the previous frame to where it is now.
+	class ParticleEmitter
+	{
+	public:
+		//Emitters seeded with the same value produce the same particles
+		ParticleEmitter(const ParticleEmitterDesc& desc, unsigned int seed);
+
+		const ParticleEmitterDesc& getDesc() const { return m_desc; }
+		void setDesc(const ParticleEmitterDesc& desc) { m_desc = desc; }
+
+		//Position and mean direction of particles' velocity at the end of the current frame
+		void Move(const XMFLOAT3& position, const XMFLOAT3& direction);
+		//Adds the particles born during the last dt seconds
+		void Emit(gk2::ParticleSimulation& simulation, float dt, float gravity);
+
+	private:
+		static const unsigned int SPAWN_BATCH = 64;	//particles whose random values are generated at once
+
+		ParticleEmitterDesc m_desc;
+		gk2::Random m_random;
+		float m_particlesToCreate;		//fraction of a particle carried over to the next frame
+		XMFLOAT3 m_position;
+		XMFLOAT3 m_direction;
+		//State at the end of the previous frame
+		XMFLOAT3 m_prevPosition;
+		XMFLOAT3 m_prevDirection;
+		bool m_started;
+
+		float m_spawnSpread[SPAWN_BATCH];
+		float m_spawnSpeed[SPAWN_BATCH];
+		float m_spawnSpin[SPAWN_BATCH];
+
+		XMFLOAT3 Velocity(FXMVECTOR direction, float spread, float speed) const;
+	};
+}
+
+#endif __GK2_PARTICLE_EMITTER_H_
@@ -0,0 +1,241 @@
+#include "gk2_particlePool.h"
+#include "gk2_particles.h"
+#include "gk2_collisionWorld.h"
+#include "gk2_curlNoise.h"
+#include "gk2_utils.h"
+#include <xmmintrin.h>
+#include <cstring>
+#include <cmath>
+
+using namespace gk2;
+
+SmokeMotion::SmokeMotion()
+	: Noise(nullptr), Buoyancy(0.0f), Drag(0.0f), Growth(0.0f)
+{
+
+}
+
+ParticlePool::ParticlePool(unsigned int capacity)
+	: m_count(0), m_capacity(capacity), m_stride((capacity + 3) & ~3u), m_origin(capacity), m_remap(capacity),
+	m_remapCount(0), m_firstNew(0), m_remapValid(false)
+{
+	size_t size = sizeof(float) * m_stride * STREAM_COUNT;
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(size));
+	//Padding lanes are processed by SSE too, keep them at valid values
+	memset(m_data, 0, size);
+	for (int i = 0; i < STREAM_COUNT; ++i)
+		m_streams[i] = m_data + i * m_stride;
+}
+
+ParticlePool::~ParticlePool()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+bool ParticlePool::Add(const XMFLOAT3& pos, const XMFLOAT3& velocity, float angleVelocity, float size,
+	float timeToLive, float age, float gravity)
+{
+	if (IsFull())
+		return false;
+	unsigned int i = m_count++;
+	//Same closed form as Update, so a particle born between frames is where it would have been
+	m_streams[START_X][i] = pos.x;
+	m_streams[START_Y][i] = pos.y;
+	m_streams[START_Z][i] = pos.z;
+	m_streams[POS_X][i] = pos.x + velocity.x * age;
+	m_streams[POS_Y][i] = pos.y + (velocity.y + 0.5f * gravity * age) * age;
+	m_streams[POS_Z][i] = pos.z + velocity.z * age;
+	m_streams[VEL_X][i] = velocity.x;
+	m_streams[VEL_Y][i] = velocity.y;
+	m_streams[VEL_Z][i] = velocity.z;
+	m_streams[TIME][i] = age;
+	m_streams[AGE][i] = age;
+	m_streams[ANGLE][i] = angleVelocity * age;
+	m_streams[ANGLE_VEL][i] = angleVelocity;
+	m_streams[SIZE][i] = size;
+	m_streams[TTL][i] = timeToLive;
+	return true;
+}
+
+void ParticlePool::Remove(unsigned int i)
+{
+	unsigned int last = --m_count;
+	if (i == last)
+		return;
+	for (int s = 0; s < DEPTH; ++s)
+		m_streams[s][i] = m_streams[s][last];
+	m_origin[i] = m_origin[last];
+}
+
+void ParticlePool::Update(float dt, float gravity, const CollisionWorld* collisions)
+{
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 halfG = _mm_set1_ps(0.5f * gravity);
+	float* px = m_streams[POS_X]; float* py = m_streams[POS_Y]; float* pz = m_streams[POS_Z];
+	const float* sx = m_streams[START_X]; const float* sy = m_streams[START_Y]; const float* sz = m_streams[START_Z];
+	const float* vx = m_streams[VEL_X]; const float* vy = m_streams[VEL_Y]; const float* vz = m_streams[VEL_Z];
+	float* time = m_streams[TIME]; float* age = m_streams[AGE];
+	float* angle = m_streams[ANGLE]; const float* angleVel = m_streams[ANGLE_VEL];
+	for (unsigned int i = 0; i < m_count; i += 4)
+	{
+		__m128 t = _mm_add_ps(_mm_load_ps(time + i), vdt);
+		_mm_store_ps(time + i, t);
+		_mm_store_ps(age + i, _mm_add_ps(_mm_load_ps(age + i), vdt));
+		_mm_store_ps(angle + i, _mm_add_ps(_mm_load_ps(angle + i), _mm_mul_ps(_mm_load_ps(angleVel + i), vdt)));
+		//pos = start + v*t + g*t^2/2, gravity acts along y only
+		_mm_store_ps(px + i, _mm_add_ps(_mm_load_ps(sx + i), _mm_mul_ps(_mm_load_ps(vx + i), t)));
+		_mm_store_ps(py + i, _mm_add_ps(_mm_load_ps(sy + i),
+			_mm_mul_ps(_mm_add_ps(_mm_load_ps(vy + i), _mm_mul_ps(halfG, t)), t)));
+		_mm_store_ps(pz + i, _mm_add_ps(_mm_load_ps(sz + i), _mm_mul_ps(_mm_load_ps(vz + i), t)));
+	}
+
+	unsigned int oldCount = RemoveExpired();
+	if (collisions != nullptr)
+	{
+		CollisionParticles particles = { m_streams[POS_X], m_streams[POS_Y], m_streams[POS_Z],
+			m_streams[START_X], m_streams[START_Y], m_streams[START_Z],
+			m_streams[VEL_X], m_streams[VEL_Y], m_streams[VEL_Z], m_streams[TIME], m_count };
+		collisions->Collide(particles, dt, gravity);
+	}
+	BuildRemap(oldCount);
+}
+
+void ParticlePool::Advect(float dt, const SmokeMotion& motion)
+{
+	const __m128 vdt = _mm_set1_ps(dt);
+	const __m128 decay = _mm_set1_ps(exp(-motion.Drag * dt));
+	const __m128 rise = _mm_set1_ps(motion.Buoyancy * dt);
+	const __m128 growth = _mm_set1_ps(motion.Growth * dt);
+	float* px = m_streams[POS_X]; float* py = m_streams[POS_Y]; float* pz = m_streams[POS_Z];
+	float* vx = m_streams[VEL_X]; float* vy = m_streams[VEL_Y]; float* vz = m_streams[VEL_Z];
+	float* age = m_streams[AGE]; float* size = m_streams[SIZE];
+	float* angle = m_streams[ANGLE]; const float* angleVel = m_streams[ANGLE_VEL];
+	for (unsigned int i = 0; i < m_count; i += 4)
+	{
+		_mm_store_ps(age + i, _mm_add_ps(_mm_load_ps(age + i), vdt));
+		_mm_store_ps(angle + i, _mm_add_ps(_mm_load_ps(angle + i), _mm_mul_ps(_mm_load_ps(angleVel + i), vdt)));
+		_mm_store_ps(size + i, _mm_add_ps(_mm_load_ps(size + i), growth));
+		__m128 v[3] = { _mm_mul_ps(_mm_load_ps(vx + i), decay), _mm_mul_ps(_mm_load_ps(vy + i), decay),
+			_mm_mul_ps(_mm_load_ps(vz + i), decay) };
+		_mm_store_ps(vx + i, v[0]);
+		_mm_store_ps(vy + i, v[1]);
+		_mm_store_ps(vz + i, v[2]);
+		__m128 p[3] = { _mm_load_ps(px + i), _mm_load_ps(py + i), _mm_load_ps(pz + i) };
+		if (motion.Noise != nullptr)
+		{
+			__m128 flow[3];
+			motion.Noise->Sample(p, flow);
+			for (int k = 0; k < 3; ++k)
+				v[k] = _mm_add_ps(v[k], flow[k]);
+		}
+		//Explicit Euler step, the field changes too little within a frame for anything better to pay off
+		_mm_store_ps(px + i, _mm_add_ps(p[0], _mm_mul_ps(v[0], vdt)));
+		_mm_store_ps(py + i, _mm_add_ps(_mm_add_ps(p[1], _mm_mul_ps(v[1], vdt)), rise));
+		_mm_store_ps(pz + i, _mm_add_ps(p[2], _mm_mul_ps(v[2], vdt)));
+	}
+	BuildRemap(RemoveExpired());
+}
+
+unsigned int ParticlePool::RemoveExpired()
+{
+	unsigned int oldCount = m_count;
+	for (unsigned int i = 0; i < oldCount; ++i)
+		m_origin[i] = i;
+
+	//Walk backwards, so the particle moved into a freed slot has already been tested
+	const float* age = m_streams[AGE];
+	const float* ttl = m_streams[TTL];
+	for (int block = static_cast<int>((m_count - 1) & ~3u); m_count > 0 && block >= 0; block -= 4)
+	{
+		int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_load_ps(age + block), _mm_load_ps(ttl + block)));
+		unsigned int valid = m_count - block;
+		if (valid < 4)
+			mask &= (1 << valid) - 1;
+		for (int lane = 3; mask && lane >= 0; --lane)
+			if (mask & (1 << lane))
+			{
+				Remove(block + lane);
+				mask &= ~(1 << lane);
+			}
+	}
+	return oldCount;
+}
+
+void ParticlePool::BuildRemap(unsigned int oldCount)
+{
+	for (unsigned int i = 0; i < oldCount; ++i)
+		m_remap[i] = INVALID_INDEX;
+	for (unsigned int i = 0; i < m_count; ++i)
+		m_remap[m_origin[i]] = i;
+	m_remapCount = oldCount;
+	m_firstNew = m_count;
+	m_remapValid = true;
+}
+
+unsigned int ParticlePool::SamplePaths(float gravity, float step, unsigned int points, unsigned int stride,
+	float* x, float* y, float* z, unsigned int maxPaths) const
+{
+	unsigned int count = m_count < maxPaths ? m_count : maxPaths;
+	const __m128 halfG = _mm_set1_ps(0.5f * gravity);
+	const __m128 zero = _mm_setzero_ps();
+	float lanes[3][4];
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		__m128 time = _mm_load_ps(m_streams[TIME] + i);
+		__m128 sx = _mm_load_ps(m_streams[START_X] + i), sy = _mm_load_ps(m_streams[START_Y] + i);
+		__m128 sz = _mm_load_ps(m_streams[START_Z] + i);
+		__m128 vx = _mm_load_ps(m_streams[VEL_X] + i), vy = _mm_load_ps(m_streams[VEL_Y] + i);
+		__m128 vz = _mm_load_ps(m_streams[VEL_Z] + i);
+		unsigned int valid = count - i < 4 ? count - i : 4;
+		for (unsigned int k = 0; k < points; ++k)
+		{
+			//Same closed form as Update, clamped at the start of the current path
+			__m128 t = _mm_max_ps(_mm_sub_ps(time, _mm_set1_ps(k * step)), zero);
+			_mm_storeu_ps(lanes[0], _mm_add_ps(sx, _mm_mul_ps(vx, t)));
+			_mm_storeu_ps(lanes[1], _mm_add_ps(sy, _mm_mul_ps(_mm_add_ps(vy, _mm_mul_ps(halfG, t)), t)));
+			_mm_storeu_ps(lanes[2], _mm_add_ps(sz, _mm_mul_ps(vz, t)));
+			for (unsigned int lane = 0; lane < valid; ++lane)
+			{
+				unsigned int j = (i + lane) * stride + k;
+				x[j] = lanes[0][lane];
+				y[j] = lanes[1][lane];
+				z[j] = lanes[2][lane];
+			}
+		}
+	}
+	return count;
+}
+
+void ParticlePool::ComputeDepths(const XMFLOAT4& camPos, const XMFLOAT4& camDir)
+{
+	const __m128 cx = _mm_set1_ps(camPos.x), cy = _mm_set1_ps(camPos.y), cz = _mm_set1_ps(camPos.z);
+	const __m128 dx = _mm_set1_ps(camDir.x), dy = _mm_set1_ps(camDir.y), dz = _mm_set1_ps(camDir.z);
+	const float* px = m_streams[POS_X]; const float* py = m_streams[POS_Y]; const float* pz = m_streams[POS_Z];
+	float* depth = m_streams[DEPTH];
+	for (unsigned int i = 0; i < m_count; i += 4)
+	{
+		__m128 d = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(px + i), cx), dx);
+		d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(py + i), cy), dy));
+		d = _mm_add_ps(d, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(pz + i), cz), dz));
+		_mm_store_ps(depth + i, d);
+	}
+}
+
+void ParticlePool::WriteVertices(const ParticlePool* const* pools, const ParticleType* types, unsigned int indexBits,
+	ParticleVertex* dst, const unsigned int* order, unsigned int count)
+{
+	const unsigned int indexMask = (1u << indexBits) - 1;
+	for (unsigned int k = 0; k < count; ++k, ++dst)
+	{
+		unsigned int pool = order[k] >> indexBits;
+		const float* const* streams = pools[pool]->m_streams;
+		unsigned int i = order[k] & indexMask;
+		dst->Pos.x = streams[POS_X][i];
+		dst->Pos.y = streams[POS_Y][i];
+		dst->Pos.z = streams[POS_Z][i];
+		dst->Age = streams[AGE][i] / streams[TTL][i];
+		dst->Angle = streams[ANGLE][i];
+		dst->Size = streams[SIZE][i];
+		dst->Type = static_cast<float>(types[pool]);
+	}
+}
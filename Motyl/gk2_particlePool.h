@@ -0,0 +1,123 @@
+#ifndef __GK2_PARTICLE_POOL_H_
+#define __GK2_PARTICLE_POOL_H_
+
+#include <xnamath.h>
+#include <vector>
+
+namespace gk2
+{
+	struct ParticleVertex;
+	class CollisionWorld;
+	class CurlNoise;
+
+	//Motion model of a particle
+	enum ParticleType
+	{
+		BALLISTIC_PARTICLE,		//flies under gravity along a closed-form path and bounces off obstacles
+		SMOKE_PARTICLE,			//carried by a curl noise field, rises and grows with age
+		PARTICLE_TYPE_COUNT
+	};
+
+	//Forces acting on smoke particles
+	struct SmokeMotion
+	{
+		const gk2::CurlNoise* Noise;	//velocity field the smoke follows, may be null
+		float Buoyancy;					//upward speed
+		float Drag;						//rate at which the launch velocity fades, per second
+		float Growth;					//size increase per second
+
+		SmokeMotion();
+	};
+
+	//Fixed-capacity particle storage laid out as a structure of arrays.
+	//Every stream is 16-byte aligned and padded to a multiple of 4 elements, so Update can process
+	//four particles per SSE instruction. Dead particles are removed with swap-and-pop, so the live
+	//particles always occupy indices [0, getCount()) and nothing is allocated after construction.
+	class ParticlePool
+	{
+	public:
+		ParticlePool(unsigned int capacity);
+		~ParticlePool();
+
+		unsigned int getCount() const { return m_count; }
+		unsigned int getCapacity() const { return m_capacity; }
+		bool IsFull() const { return m_count >= m_capacity; }
+
+		const float* getPosX() const { return m_streams[POS_X]; }
+		const float* getPosY() const { return m_streams[POS_Y]; }
+		const float* getPosZ() const { return m_streams[POS_Z]; }
+		//View depths written by the last ComputeDepths call
+		const float* getDepth() const { return m_streams[DEPTH]; }
+
+		//Maps indices from before the last Update to current ones (INVALID_INDEX for removed particles).
+		//Returns nullptr if the pool was cleared since.
+		const unsigned int* getRemap() const { return m_remapValid ? m_remap.data() : nullptr; }
+		//Number of particles the remap was built for
+		unsigned int getRemapCount() const { return m_remapCount; }
+		//Index of the first particle added after the last Update
+		unsigned int getFirstNew() const { return m_firstNew; }
+
+		//Launches a particle from pos, already advanced by age seconds of ballistic motion under gravity.
+		//Returns false if the pool is full.
+		bool Add(const XMFLOAT3& pos, const XMFLOAT3& velocity, float angleVelocity, float size, float timeToLive,
+			float age, float gravity);
+		//Advances ballistic motion of every particle, bounces it off the obstacles if given, and removes the
+		//particles that outlived their time to live
+		void Update(float dt, float gravity, const gk2::CollisionWorld* collisions = nullptr);
+		//Moves every particle as smoke, integrating its velocity plus the noise field, and removes the
+		//particles that outlived their time to live. Particles of one pool use either Update or Advect.
+		void Advect(float dt, const gk2::SmokeMotion& motion);
+		//Writes count vertices in the given order, e.g. straight into a mapped vertex buffer.
+		//Every order entry is pool << indexBits | index within that pool, types[pool] is the type of its particles.
+		static void WriteVertices(const ParticlePool* const* pools, const gk2::ParticleType* types,
+			unsigned int indexBits, gk2::ParticleVertex* dst, const unsigned int* order, unsigned int count);
+		//Samples points of ballistic particles' paths step seconds apart, going back from the current position
+		//to where the particle was launched or last bounced. Point k of path p is written to [p * stride + k].
+		//Returns the number of paths written, at most maxPaths.
+		unsigned int SamplePaths(float gravity, float step, unsigned int points, unsigned int stride, float* x,
+			float* y, float* z, unsigned int maxPaths) const;
+		//Distance of every particle from camPos along camDir
+		void ComputeDepths(const XMFLOAT4& camPos, const XMFLOAT4& camDir);
+		void Clear() { m_count = 0; m_firstNew = 0; m_remapValid = false; }
+
+		static const unsigned int INVALID_INDEX = 0xffffffffu;
+
+	private:
+		enum Stream
+		{
+			POS_X, POS_Y, POS_Z,
+			START_X, START_Y, START_Z,
+			VEL_X, VEL_Y, VEL_Z,
+			TIME,			//time along the ballistic path from START, smoke neither reads nor advances it
+			AGE,
+			ANGLE,
+			ANGLE_VEL,
+			SIZE,
+			TTL,			//time to live given at emission
+			DEPTH,			//scratch stream for sorting, not preserved by Remove
+			STREAM_COUNT
+		};
+
+		unsigned int m_count;
+		unsigned int m_capacity;
+		unsigned int m_stride;		//capacity rounded up to a multiple of 4
+		float* m_data;
+		float* m_streams[STREAM_COUNT];
+
+		std::vector<unsigned int> m_origin;		//index each particle had before the current Update
+		std::vector<unsigned int> m_remap;
+		unsigned int m_remapCount;
+		unsigned int m_firstNew;
+		bool m_remapValid;
+
+		void Remove(unsigned int i);
+		//Removes dead particles, returns the count from before
+		unsigned int RemoveExpired();
+		void BuildRemap(unsigned int oldCount);
+
+		ParticlePool(const ParticlePool& right) { }
+		ParticlePool& operator=(const ParticlePool& right) { return *this; }
+	};
+}
+
+#endif __GK2_PARTICLE_POOL_H_
@@ -0,0 +1,113 @@
+#include "gk2_particleSimulation.h"
+#include "gk2_particles.h"
+#include "gk2_threadPool.h"
+
+using namespace std;
+using namespace gk2;
+
+ParticleSimulation::ParticleSimulation(unsigned int capacity, ThreadPool& threads)
+	: m_threads(threads), m_capacity(capacity), m_count(0),
+	m_sorter((((capacity + CHUNK_SIZE - 1) >> CHUNK_BITS) + PARTICLE_TYPE_COUNT - 1) << CHUNK_BITS, CHUNK_BITS,
+	&threads), m_order(nullptr), m_orderCount(0)
+{
+	for (int t = 0; t < PARTICLE_TYPE_COUNT; ++t)
+		m_fillChunk[t] = 0;
+	m_chunks.reserve(getMaxChunkCount());
+	m_chunkTypes.reserve(getMaxChunkCount());
+	m_chunkPointers.reserve(getMaxChunkCount());
+	m_segments.reserve(getMaxChunkCount());
+}
+
+bool ParticleSimulation::Add(const XMFLOAT3& pos, const XMFLOAT3& velocity, float angleVelocity, float size,
+	float timeToLive, float age, float gravity, ParticleType type)
+{
+	if (IsFull())
+		return false;
+	unsigned int& fill = m_fillChunk[type];
+	//Empty chunks are taken over by whichever type needs them
+	while (fill < getChunkCount() && m_chunks[fill]->getCount() > 0
+		&& (m_chunkTypes[fill] != type || m_chunks[fill]->IsFull()))
+		++fill;
+	if (fill < getChunkCount())
+		m_chunkTypes[fill] = type;
+	else
+	{
+		if (fill == getMaxChunkCount())
+			return false;
+		//The total count is limited by IsFull, chunks of different types share the capacity
+		unsigned int chunkCapacity = m_capacity < CHUNK_SIZE ? m_capacity : CHUNK_SIZE;
+		m_chunks.push_back(unique_ptr<ParticlePool>(new ParticlePool(chunkCapacity)));
+		m_chunkPointers.push_back(m_chunks.back().get());
+		m_chunkTypes.push_back(type);
+	}
+	//Smoke is not pulled down by gravity
+	m_chunks[fill]->Add(pos, velocity, angleVelocity, size, timeToLive, age,
+		type == BALLISTIC_PARTICLE ? gravity : 0.0f);
+	++m_count;
+	return true;
+}
+
+void ParticleSimulation::CountParticles()
+{
+	m_count = 0;
+	for (unsigned int c = 0; c < getChunkCount(); ++c)
+		m_count += m_chunks[c]->getCount();
+}
+
+void ParticleSimulation::Update(float dt, float gravity, const CollisionWorld* collisions, const SmokeMotion* smoke)
+{
+	const SmokeMotion still;
+	const SmokeMotion& motion = smoke != nullptr ? *smoke : still;
+	m_threads.Run(getChunkCount(), [&](unsigned int c)
+	{
+		if (m_chunkTypes[c] == SMOKE_PARTICLE)
+			m_chunks[c]->Advect(dt, motion);
+		else
+			m_chunks[c]->Update(dt, gravity, collisions);
+	});
+	for (int t = 0; t < PARTICLE_TYPE_COUNT; ++t)
+		m_fillChunk[t] = 0;
+	CountParticles();
+}
+
+unsigned int ParticleSimulation::SamplePaths(float gravity, float step, unsigned int points, unsigned int stride,
+	float* x, float* y, float* z, unsigned int maxPaths) const
+{
+	unsigned int paths = 0;
+	for (unsigned int c = 0; c < getChunkCount() && paths < maxPaths; ++c)
+		if (m_chunkTypes[c] == BALLISTIC_PARTICLE)
+		{
+			unsigned int offset = paths * stride;
+			paths += m_chunks[c]->SamplePaths(gravity, step, points, stride, x + offset, y + offset, z + offset,
+				maxPaths - paths);
+		}
+	return paths;
+}
+
+void ParticleSimulation::Sort(const XMFLOAT4& camPos, const XMFLOAT4& camDir)
+{
+	m_threads.Run(getChunkCount(), [&](unsigned int c) { m_chunks[c]->ComputeDepths(camPos, camDir); });
+	m_segments.resize(getChunkCount());
+	for (unsigned int c = 0; c < getChunkCount(); ++c)
+	{
+		const ParticlePool& chunk = *m_chunks[c];
+		ParticleSorter::Segment segment = { chunk.getDepth(), chunk.getCount(), chunk.getRemap(),
+			chunk.getRemapCount(), chunk.getFirstNew() };
+		m_segments[c] = segment;
+	}
+	m_order = m_sorter.SortCoherent(m_segments.data(), getChunkCount());
+	m_orderCount = m_count;
+}
+
+unsigned int ParticleSimulation::WriteVertices(ParticleVertex* dst)
+{
+	if (m_order == nullptr)
+		return 0;
+	//Every thread writes its own slice of the buffer, so the order is preserved
+	m_threads.RunRanges(m_orderCount, [&](unsigned int begin, unsigned int end)
+	{
+		ParticlePool::WriteVertices(m_chunkPointers.data(), m_chunkTypes.data(), CHUNK_BITS, dst + begin,
+			m_order + begin, end - begin);
+	});
+	return m_orderCount;
+}
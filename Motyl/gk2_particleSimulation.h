@@ -0,0 +1,76 @@
+#ifndef __GK2_PARTICLE_SIMULATION_H_
+#define __GK2_PARTICLE_SIMULATION_H_
+
+#include <xnamath.h>
+#include <vector>
+#include <memory>
+#include "gk2_particlePool.h"
+#include "gk2_particleSorter.h"
+
+namespace gk2
+{
+	class ThreadPool;
+	class CollisionWorld;
+	struct ParticleVertex;
+
+	//CPU side of a particle system that may hold millions of particles.
+	//Particles live in fixed-size chunks, each one a ParticlePool, allocated only when emission needs them.
+	//A chunk holds particles of a single type, so every chunk runs one SIMD motion loop.
+	//Chunks are updated, compacted and given depths independently on the threads of a ThreadPool, then all
+	//of them are sorted together and written out back to front in parallel slices.
+	class ParticleSimulation
+	{
+	public:
+		static const unsigned int CHUNK_BITS = 14;
+		static const unsigned int CHUNK_SIZE = 1 << CHUNK_BITS;
+
+		ParticleSimulation(unsigned int capacity, gk2::ThreadPool& threads);
+
+		unsigned int getCount() const { return m_count; }
+		unsigned int getCapacity() const { return m_capacity; }
+		bool IsFull() const { return m_count >= m_capacity; }
+
+		//Emission is serial, particles go to the first chunk of their type with free space.
+		//Returns false if the simulation is full.
+		bool Add(const XMFLOAT3& pos, const XMFLOAT3& velocity, float angleVelocity, float size, float timeToLive,
+			float age, float gravity, gk2::ParticleType type = gk2::BALLISTIC_PARTICLE);
+		//Advances every chunk, bounces ballistic particles off the obstacles if given, moves smoke as described
+		//by smoke and removes particles that outlived their time to live
+		void Update(float dt, float gravity, const gk2::CollisionWorld* collisions = nullptr,
+			const gk2::SmokeMotion* smoke = nullptr);
+		//Samples recent paths of up to maxPaths ballistic particles, see ParticlePool::SamplePaths
+		unsigned int SamplePaths(float gravity, float step, unsigned int points, unsigned int stride, float* x,
+			float* y, float* z, unsigned int maxPaths) const;
+		//Orders particles back to front as seen from camPos looking along camDir
+		void Sort(const XMFLOAT4& camPos, const XMFLOAT4& camDir);
+		//Writes the particles in the order of the last Sort call, returns the number of vertices written
+		unsigned int WriteVertices(gk2::ParticleVertex* dst);
+
+	private:
+		gk2::ThreadPool& m_threads;
+		unsigned int m_capacity;
+		unsigned int m_count;
+		unsigned int m_fillChunk[gk2::PARTICLE_TYPE_COUNT];	//chunks of a type before these are known to be full
+
+		std::vector<std::unique_ptr<gk2::ParticlePool> > m_chunks;
+		std::vector<gk2::ParticleType> m_chunkTypes;
+		std::vector<const gk2::ParticlePool*> m_chunkPointers;
+		std::vector<gk2::ParticleSorter::Segment> m_segments;
+		gk2::ParticleSorter m_sorter;
+		const unsigned int* m_order;
+		unsigned int m_orderCount;
+
+		unsigned int getChunkCount() const { return static_cast<unsigned int>(m_chunkPointers.size()); }
+		//Every type may leave one chunk partly filled
+		unsigned int getMaxChunkCount() const
+		{
+			return ((m_capacity + CHUNK_SIZE - 1) >> CHUNK_BITS) + gk2::PARTICLE_TYPE_COUNT - 1;
+		}
+		void CountParticles();
+
+		ParticleSimulation(const ParticleSimulation& right) : m_threads(right.m_threads), m_sorter(0) { }
+		ParticleSimulation& operator=(const ParticleSimulation& right) { return *this; }
+	};
+}
+
+#endif __GK2_PARTICLE_SIMULATION_H_
@@ -0,0 +1,327 @@
+#include "gk2_particleSorter.h"
+#include "gk2_threadPool.h"
+#include <emmintrin.h>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+using namespace gk2;
+
+ParticleSorter::ParticleSorter(unsigned int capacity, unsigned int segmentBits, ThreadPool* threads)
+	: m_segmentBits(segmentBits), m_threads(threads), m_particleKeys(capacity), m_keys(capacity), m_order(capacity),
+	m_tmpKeys(capacity), m_tmpOrder(capacity), m_histogram(RADIX_SIZE * RADIX_PASSES),
+	m_prevCounts(capacity > 0 ? ((capacity - 1) >> segmentBits) + 1 : 1), m_prevCount(INVALID_INDEX),
+	m_prevSegments(0), m_incremental(false)
+{
+	if (m_threads != nullptr)
+		m_threadHistograms.resize(RADIX_SIZE * m_threads->getThreadCount());
+}
+
+unsigned int ParticleSorter::DepthToKey(float depth)
+{
+	//Flipping the float bits gives an unsigned key that grows with depth, inverting it puts the farthest
+	//particles first
+	unsigned int bits;
+	memcpy(&bits, &depth, sizeof(float));
+	return (bits & 0x80000000u) ? bits : bits ^ 0x7fffffffu;
+}
+
+void ParticleSorter::ComputeKeys(const float* depth, unsigned int count, unsigned int* keys)
+{
+	const __m128i magnitude = _mm_set1_epi32(0x7fffffff);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i bits = _mm_castps_si128(_mm_loadu_ps(depth + i));
+		__m128i sign = _mm_srai_epi32(bits, 31);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i), _mm_xor_si128(bits, _mm_andnot_si128(sign, magnitude)));
+	}
+	for (; i < count; ++i)
+		keys[i] = DepthToKey(depth[i]);
+}
+
+void ParticleSorter::ComputeKeys(const Segment* segments, unsigned int segmentCount)
+{
+	auto segmentKeys = [&](unsigned int s)
+	{
+		ComputeKeys(segments[s].depth, segments[s].count, m_particleKeys.data() + (s << m_segmentBits));
+	};
+	if (m_threads != nullptr && segmentCount > 1)
+		m_threads->Run(segmentCount, segmentKeys);
+	else
+		for (unsigned int s = 0; s < segmentCount; ++s)
+			segmentKeys(s);
+}
+
+bool ParticleSorter::UseThreads(unsigned int count) const
+{
+	return m_threads != nullptr && m_threads->getThreadCount() > 1 && count >= PARALLEL_THRESHOLD;
+}
+
+void ParticleSorter::RadixSort(unsigned int first, unsigned int count)
+{
+	if (count < 2)
+		return;
+	unsigned int* keys = m_keys.data() + first;
+	unsigned int* order = m_order.data() + first;
+	unsigned int* tmpKeys = m_tmpKeys.data() + first;
+	unsigned int* tmpOrder = m_tmpOrder.data() + first;
+	unsigned int* histogram = m_histogram.data();
+	const unsigned int mask = RADIX_SIZE - 1;
+
+	//All digit histograms are gathered in a single pass over the keys
+	memset(histogram, 0, sizeof(unsigned int) * RADIX_SIZE * RADIX_PASSES);
+	for (unsigned int i = 0; i < count; ++i)
+	{
+		unsigned int k = keys[i];
+		++histogram[k & mask];
+		++histogram[RADIX_SIZE + ((k >> RADIX_BITS) & mask)];
+		++histogram[2 * RADIX_SIZE + (k >> (2 * RADIX_BITS))];
+	}
+
+	bool swapped = false;
+	for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+	{
+		unsigned int* h = histogram + pass * RADIX_SIZE;
+		unsigned int shift = pass * RADIX_BITS;
+		//Every key has the same digit, the pass would not change anything
+		if (h[(keys[0] >> shift) & mask] == count)
+			continue;
+		unsigned int sum = 0;
+		for (unsigned int d = 0; d < RADIX_SIZE; ++d)
+		{
+			unsigned int c = h[d];
+			h[d] = sum;
+			sum += c;
+		}
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			unsigned int k = keys[i];
+			unsigned int dst = h[(k >> shift) & mask]++;
+			tmpKeys[dst] = k;
+			tmpOrder[dst] = order[i];
+		}
+		swap(keys, tmpKeys);
+		swap(order, tmpOrder);
+		swapped = !swapped;
+	}
+	if (swapped)
+	{
+		memcpy(tmpKeys, keys, sizeof(unsigned int) * count);
+		memcpy(tmpOrder, order, sizeof(unsigned int) * count);
+	}
+}
+
+void ParticleSorter::ParallelRadixSort(unsigned int count)
+{
+	const unsigned int threads = m_threads->getThreadCount();
+	const unsigned int mask = RADIX_SIZE - 1;
+	unsigned int* histograms = m_threadHistograms.data();
+	//Every thread owns the same slice of the input in both phases of a pass, which keeps the sort stable
+	auto begin = [&](unsigned int t)
+	{
+		return static_cast<unsigned int>(static_cast<unsigned long long>(count) * t / threads);
+	};
+	for (unsigned int pass = 0; pass < RADIX_PASSES; ++pass)
+	{
+		const unsigned int shift = pass * RADIX_BITS;
+		const unsigned int* keys = m_keys.data();
+		const unsigned int* order = m_order.data();
+		m_threads->Run(threads, [&](unsigned int t)
+		{
+			unsigned int* h = histograms + t * RADIX_SIZE;
+			memset(h, 0, sizeof(unsigned int) * RADIX_SIZE);
+			for (unsigned int i = begin(t), end = begin(t + 1); i < end; ++i)
+				++h[(keys[i] >> shift) & mask];
+		});
+		//Digit-major prefix sum: all particles with a smaller digit first, then those of earlier slices
+		unsigned int sum = 0;
+		bool uniform = false;
+		for (unsigned int d = 0; d < RADIX_SIZE; ++d)
+		{
+			unsigned int first = sum;
+			for (unsigned int t = 0; t < threads; ++t)
+			{
+				unsigned int c = histograms[t * RADIX_SIZE + d];
+				histograms[t * RADIX_SIZE + d] = sum;
+				sum += c;
+			}
+			if (sum - first == count)
+				uniform = true;
+		}
+		if (uniform)
+			continue;
+		unsigned int* tmpKeys = m_tmpKeys.data();
+		unsigned int* tmpOrder = m_tmpOrder.data();
+		m_threads->Run(threads, [&](unsigned int t)
+		{
+			unsigned int* h = histograms + t * RADIX_SIZE;
+			for (unsigned int i = begin(t), end = begin(t + 1); i < end; ++i)
+			{
+				unsigned int k = keys[i];
+				unsigned int dst = h[(k >> shift) & mask]++;
+				tmpKeys[dst] = k;
+				tmpOrder[dst] = order[i];
+			}
+		});
+		m_keys.swap(m_tmpKeys);
+		m_order.swap(m_tmpOrder);
+	}
+}
+
+bool ParticleSorter::InsertionSort(unsigned int first, unsigned int count, unsigned int budget)
+{
+	unsigned int* keys = m_keys.data() + first;
+	unsigned int* order = m_order.data() + first;
+	unsigned int shifts = 0;
+	for (unsigned int i = 1; i < count; ++i)
+	{
+		unsigned int k = keys[i];
+		if (keys[i - 1] <= k)
+			continue;
+		unsigned int o = order[i];
+		unsigned int j = i;
+		do
+		{
+			keys[j] = keys[j - 1];
+			order[j] = order[j - 1];
+			--j;
+		} while (j > 0 && keys[j - 1] > k);
+		keys[j] = k;
+		order[j] = o;
+		shifts += i - j;
+		if (shifts > budget)
+			return false;
+	}
+	return true;
+}
+
+void ParticleSorter::Merge(unsigned int mid, unsigned int count)
+{
+	const unsigned int* keys = m_keys.data();
+	const unsigned int* order = m_order.data();
+	unsigned int* tmpKeys = m_tmpKeys.data();
+	unsigned int* tmpOrder = m_tmpOrder.data();
+	unsigned int a = 0, b = mid, dst = 0;
+	while (a < mid && b < count)
+	{
+		unsigned int src = keys[b] < keys[a] ? b++ : a++;
+		tmpKeys[dst] = keys[src];
+		tmpOrder[dst++] = order[src];
+	}
+	for (; a < mid; ++a, ++dst)
+	{
+		tmpKeys[dst] = keys[a];
+		tmpOrder[dst] = order[a];
+	}
+	for (; b < count; ++b, ++dst)
+	{
+		tmpKeys[dst] = keys[b];
+		tmpOrder[dst] = order[b];
+	}
+	m_keys.swap(m_tmpKeys);
+	m_order.swap(m_tmpOrder);
+}
+
+const unsigned int* ParticleSorter::Sort(const float* depth, unsigned int count)
+{
+	Segment segment = { depth, count, nullptr, 0, 0 };
+	return Sort(&segment, 1);
+}
+
+const unsigned int* ParticleSorter::SortCoherent(const float* depth, unsigned int count, const unsigned int* remap,
+	unsigned int remapCount, unsigned int firstNew)
+{
+	Segment segment = { depth, count, remap, remapCount, firstNew };
+	return SortCoherent(&segment, 1);
+}
+
+const unsigned int* ParticleSorter::Sort(const Segment* segments, unsigned int segmentCount)
+{
+	ComputeKeys(segments, segmentCount);
+	unsigned int count = 0;
+	for (unsigned int s = 0; s < segmentCount; ++s)
+	{
+		unsigned int base = s << m_segmentBits;
+		for (unsigned int i = 0; i < segments[s].count; ++i, ++count)
+		{
+			m_keys[count] = m_particleKeys[base + i];
+			m_order[count] = base + i;
+		}
+		m_prevCounts[s] = segments[s].count;
+	}
+	if (UseThreads(count))
+		ParallelRadixSort(count);
+	else
+		RadixSort(0, count);
+	m_prevCount = count;
+	m_prevSegments = segmentCount;
+	m_incremental = false;
+	return m_order.data();
+}
+
+const unsigned int* ParticleSorter::SortCoherent(const Segment* segments, unsigned int segmentCount)
+{
+	if (m_prevCount == INVALID_INDEX || segmentCount != m_prevSegments)
+		return Sort(segments, segmentCount);
+	unsigned int count = 0, expectedSurvivors = 0;
+	for (unsigned int s = 0; s < segmentCount; ++s)
+	{
+		const Segment& segment = segments[s];
+		if (segment.remap == nullptr || segment.remapCount != m_prevCounts[s] || segment.firstNew > segment.count)
+			return Sort(segments, segmentCount);
+		count += segment.count;
+		expectedSurvivors += segment.firstNew;
+	}
+	if (UseThreads(count))
+		return Sort(segments, segmentCount);
+	ComputeKeys(segments, segmentCount);
+	const unsigned int* particleKeys = m_particleKeys.data();
+	unsigned int* keys = m_keys.data();
+	unsigned int* order = m_order.data();
+	const unsigned int indexMask = (1u << m_segmentBits) - 1;
+
+	//Survivors keep their relative order from the previous frame
+	unsigned int survivors = 0;
+	for (unsigned int k = 0; k < m_prevCount; ++k)
+	{
+		unsigned int s = order[k] >> m_segmentBits;
+		unsigned int i = segments[s].remap[order[k] & indexMask];
+		if (i == INVALID_INDEX)
+			continue;
+		i |= s << m_segmentBits;
+		keys[survivors] = particleKeys[i];
+		order[survivors++] = i;
+	}
+	if (survivors != expectedSurvivors)
+		return Sort(segments, segmentCount);
+	unsigned int k = survivors;
+	for (unsigned int s = 0; s < segmentCount; ++s)
+	{
+		unsigned int base = s << m_segmentBits;
+		for (unsigned int i = segments[s].firstNew; i < segments[s].count; ++i, ++k)
+		{
+			keys[k] = particleKeys[base + i];
+			order[k] = base + i;
+		}
+		m_prevCounts[s] = segments[s].count;
+	}
+
+	m_prevCount = count;
+	if (!InsertionSort(0, survivors, survivors * INSERTION_BUDGET))
+	{
+		//Too much has changed since the last frame
+		RadixSort(0, count);
+		m_incremental = false;
+		return m_order.data();
+	}
+	unsigned int born = count - survivors;
+	if (born > 0)
+	{
+		if (!InsertionSort(survivors, born, born * INSERTION_BUDGET))
+			RadixSort(survivors, born);
+		Merge(survivors, count);
+	}
+	m_incremental = true;
+	return m_order.data();
+}
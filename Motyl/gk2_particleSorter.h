@@ -0,0 +1,89 @@
+#ifndef __GK2_PARTICLE_SORTER_H_
+#define __GK2_PARTICLE_SORTER_H_
+
+#include <vector>
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Orders particles back to front from depths computed once per particle.
+	//Depths are turned into 32-bit integer keys and sorted with an LSD radix sort. When the previous
+	//frame's order is still mostly valid, SortCoherent repairs it with a budgeted insertion sort and
+	//merges newly born particles in, falling back to the radix sort when the budget runs out.
+	//All buffers are allocated up front for the given capacity.
+	//Particles may be spread over several pools (segments). Returned indices then encode both:
+	//segment << segmentBits | index within the segment, and capacity is the size of that index space.
+	//Large sorts are split between the threads of a pool, if one is given.
+	class ParticleSorter
+	{
+	public:
+		static const unsigned int INVALID_INDEX = 0xffffffffu;
+
+		//Particles of one pool, see the single-segment functions for the meaning of the remap fields
+		struct Segment
+		{
+			const float* depth;
+			unsigned int count;
+			const unsigned int* remap;
+			unsigned int remapCount;
+			unsigned int firstNew;
+		};
+
+		ParticleSorter(unsigned int capacity, unsigned int segmentBits = 31, gk2::ThreadPool* threads = nullptr);
+
+		//Full radix sort, returns indices of the farthest particles first
+		const unsigned int* Sort(const float* depth, unsigned int count);
+		//remap translates indices from the previously sorted frame to current ones (INVALID_INDEX for
+		//particles that died), remapCount is the number of particles the remap was built for.
+		//Particles with index >= firstNew were born after the remap was built.
+		const unsigned int* SortCoherent(const float* depth, unsigned int count, const unsigned int* remap,
+			unsigned int remapCount, unsigned int firstNew);
+		//Forces the next SortCoherent to do a full sort
+		void Reset() { m_prevCount = INVALID_INDEX; }
+		const unsigned int* Sort(const Segment* segments, unsigned int segmentCount);
+		const unsigned int* SortCoherent(const Segment* segments, unsigned int segmentCount);
+
+		const unsigned int* getOrder() const { return m_order.data(); }
+		//Whether the last call managed to reuse the previous order
+		bool WasIncremental() const { return m_incremental; }
+
+	private:
+		static const unsigned int RADIX_BITS = 11;
+		static const unsigned int RADIX_SIZE = 1 << RADIX_BITS;
+		static const unsigned int RADIX_PASSES = 3;
+		//Allowed element shifts per particle before the insertion sort gives up
+		static const unsigned int INSERTION_BUDGET = 8;
+		//Particle count from which a parallel radix sort beats repairing the previous order on one thread
+		static const unsigned int PARALLEL_THRESHOLD = 1 << 16;
+
+		unsigned int m_segmentBits;
+		gk2::ThreadPool* m_threads;
+		std::vector<unsigned int> m_particleKeys;	//key of each particle, indexed by encoded index
+		std::vector<unsigned int> m_keys;			//key of each m_order entry
+		std::vector<unsigned int> m_order;
+		std::vector<unsigned int> m_tmpKeys;
+		std::vector<unsigned int> m_tmpOrder;
+		std::vector<unsigned int> m_histogram;
+		std::vector<unsigned int> m_threadHistograms;
+		std::vector<unsigned int> m_prevCounts;		//particles in every segment at the last sort
+		unsigned int m_prevCount;
+		unsigned int m_prevSegments;
+		bool m_incremental;
+
+		static unsigned int DepthToKey(float depth);
+		void ComputeKeys(const float* depth, unsigned int count, unsigned int* keys);
+		void ComputeKeys(const Segment* segments, unsigned int segmentCount);
+		bool UseThreads(unsigned int count) const;
+		//Sorts (m_keys, m_order)[first, first + count) by key
+		void RadixSort(unsigned int first, unsigned int count);
+		//Sorts (m_keys, m_order)[0, count) on all threads of m_threads
+		void ParallelRadixSort(unsigned int count);
+		//Sorts the same range by insertion, returns false after more than budget shifts
+		bool InsertionSort(unsigned int first, unsigned int count, unsigned int budget);
+		//Merges sorted ranges [0, mid) and [mid, count)
+		void Merge(unsigned int mid, unsigned int count);
+	};
+}
+
+#endif __GK2_PARTICLE_SORTER_H_
@@ -1,8 +1,5 @@
 #include "gk2_particles.h"
-#include <ctime>
 #include "gk2_exceptions.h"
-#include <vector>
-#include <algorithm>
 
 using namespace std;
 using namespace gk2;
@@ -12,45 +9,31 @@ const D3D11_INPUT_ELEMENT_DESC ParticleVertex::Layout[ParticleVertex::LayoutElem
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "TEXCOORD", 1, DXGI_FORMAT_R32_FLOAT, 0, 16, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 2, DXGI_FORMAT_R32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+		{ "TEXCOORD", 2, DXGI_FORMAT_R32_FLOAT, 0, 20, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 3, DXGI_FORMAT_R32_FLOAT, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
-bool ParticleComparer::operator()(const ParticleVertex& p1, const ParticleVertex& p2)
-{
-	XMVECTOR p1Pos = XMLoadFloat3(&(p1.Pos));
-	p1Pos.m128_f32[3] = 1.0f;
-	XMVECTOR p2Pos = XMLoadFloat3(&(p2.Pos));
-	p2Pos.m128_f32[3] = 1.0f;
-	XMVECTOR camDir = XMLoadFloat4(&m_camDir);
-	XMVECTOR camPos = XMLoadFloat4(&m_camPos);
-	float d1 = XMVector3Dot(p1Pos - camPos, camDir).m128_f32[0];
-	float d2 = XMVector3Dot(p2Pos - camPos, camDir).m128_f32[0];
-	return d1 > d2;
-}
-
-const XMFLOAT3 ParticleSystem::EMITTER_DIR = XMFLOAT3(0.0f, 1.0f, 0.0f);
-const float ParticleSystem::TIME_TO_LIVE = 1.0f;
-const float ParticleSystem::EMISSION_RATE = 50.0f;
-const float ParticleSystem::MAX_ANGLE = XM_PIDIV2 / 9.0f;
-const float ParticleSystem::MIN_VELOCITY = 1.5f;
-const float ParticleSystem::MAX_VELOCITY = 2.5f;
-const float ParticleSystem::PARTICLE_SIZE = 0.08f;
-const float ParticleSystem::PARTICLE_SCALE = 1.0f;
-const float ParticleSystem::MIN_ANGLE_VEL = -XM_PI;
-const float ParticleSystem::MAX_ANGLE_VEL = XM_PI;
-const int ParticleSystem::MAX_PARTICLES = 1000;
+const unsigned int ParticleSystem::MAX_PARTICLES = 1000;
+const float ParticleSystem::GRAVITY = -4.0f;
+const unsigned int ParticleSystem::NOISE_SEED = 7;
+const float ParticleSystem::NOISE_FREQUENCY = 0.8f;
+const float ParticleSystem::NOISE_STRENGTH = 0.4f;
+const float ParticleSystem::SMOKE_BUOYANCY = 0.3f;
+const float ParticleSystem::SMOKE_DRAG = 2.0f;
+const float ParticleSystem::SMOKE_GROWTH = 0.15f;
 
 const unsigned int ParticleSystem::STRIDE = sizeof(ParticleVertex);
 const unsigned int ParticleSystem::OFFSET = 0;
 
-XMVECTOR ParticleSystem::m_perpendicularToPlane = XMVECTOR();
-XMFLOAT3 ParticleSystem::m_startPosition = XMFLOAT3();
-
-ParticleSystem::ParticleSystem(DeviceHelper& device, XMFLOAT3 emitterPos)
-	: m_particlesCount(0), m_particlesToCreate(0.0f), m_emitterPos(emitterPos)
+ParticleSystem::ParticleSystem(DeviceHelper& device, ThreadPool& threads, unsigned int maxParticles)
+	: m_particlesCount(0), m_simulation(maxParticles, threads), m_noise(NOISE_SEED, NOISE_FREQUENCY, NOISE_STRENGTH),
+	m_time(0.0f)
 {
-	srand(static_cast<unsigned int>(time(0)));
-	m_vertices = device.CreateVertexBuffer<ParticleVertex>(MAX_PARTICLES, D3D11_USAGE_DYNAMIC);
+	m_smoke.Noise = &m_noise;
+	m_smoke.Buoyancy = SMOKE_BUOYANCY;
+	m_smoke.Drag = SMOKE_DRAG;
+	m_smoke.Growth = SMOKE_GROWTH;
+	m_vertices = device.CreateVertexBuffer<ParticleVertex>(maxParticles, D3D11_USAGE_DYNAMIC);
 	shared_ptr<ID3DBlob> vsByteCode = device.CompileD3DShader(L"resources/shaders/Particles.hlsl", "VS_Main", "vs_4_0");
 	shared_ptr<ID3DBlob> gsByteCode = device.CompileD3DShader(L"resources/shaders/Particles.hlsl", "GS_Main", "gs_4_0");
 	shared_ptr<ID3DBlob> psByteCode = device.CompileD3DShader(L"resources/shaders/Particles.hlsl", "PS_Main", "ps_4_0");
@@ -78,46 +61,10 @@ void ParticleSystem::SetProjMtxBuffer(const shared_ptr<CBMatrix>& proj)
 		m_projCB = proj;
 }
 
-XMFLOAT3 ParticleSystem::RandomVelocity()
-{
-	float x;
-	float a = tan(MAX_ANGLE);
-	x = (5.0f * static_cast<float>(rand()) / RAND_MAX - 1.0f);
-	XMFLOAT3 v(x * a,0, 0);
-	XMVECTOR velocity = m_perpendicularToPlane + XMLoadFloat3(&v);
-	float  len = MIN_VELOCITY + (MAX_VELOCITY - MIN_VELOCITY) *
-				 static_cast<float>(rand())/static_cast<float>(RAND_MAX);
-	velocity = len * XMVector3Normalize(velocity);
-	v = XMFLOAT3(abs(XMVectorGetX(velocity)),
-		XMVectorGetY(velocity),
-		XMVectorGetZ(velocity));
-	return v;
-}
-
-void ParticleSystem::AddNewParticle()
-{
-	Particle p;
-	p.Vertex.Pos = m_startPosition;
-	p.Velocities.StartPos = m_startPosition;
-	p.Vertex.Age = 0.0f;
-	p.Vertex.Angle = 0.0f;
-	p.Vertex.Size = PARTICLE_SIZE;
-	p.Velocities.Velocity = RandomVelocity();
-	p.Velocities.StartVelocity = p.Velocities.Velocity;
-	p.Velocities.AngleVelocity = MIN_ANGLE_VEL + (MAX_ANGLE_VEL - MIN_ANGLE_VEL) *
-								 static_cast<float>(rand())/static_cast<float>(RAND_MAX);
-	p.time = 0;
-	m_particles.push_back(p);
-}
-
-XMFLOAT3 operator *(const XMFLOAT3& v1, float d)
+unsigned int ParticleSystem::AddEmitter(const ParticleEmitterDesc& desc, unsigned int seed)
 {
-	return XMFLOAT3(v1.x * d , v1.y * d, v1.z * d);
-}
-
-XMFLOAT3 operator +(const XMFLOAT3& v1, const XMFLOAT3& v2)
-{
-	return XMFLOAT3(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
+	m_emitters.push_back(ParticleEmitter(desc, seed));
+	return static_cast<unsigned int>(m_emitters.size()) - 1;
 }
 
 XMFLOAT4 operator -(const XMFLOAT4& v1, const XMFLOAT4& v2)
@@ -130,69 +77,33 @@ XMFLOAT4 operator -(const XMFLOAT4& v1, const XMFLOAT4& v2)
 	return res;
 }
 
-void ParticleSystem::UpdateParticle(Particle& p, float dt)
-{
-	p.time += (dt);
-	p.Vertex.Age += dt;
-	XMVECTOR gravity = XMVectorSet(0.0f, -4.0f, 0.0f, 1.0f);
-	XMVECTOR v = XMLoadFloat3(&p.Velocities.StartVelocity);
-	XMVECTOR pos = gravity * p.time * p.time / 2.0f + v * p.time + XMLoadFloat3(&p.Velocities.StartPos);
-	XMStoreFloat3(&p.Vertex.Pos, pos);
-	//p.Vertex.Size += PARTICLE_SCALE * PARTICLE_SIZE * dt;
-	p.Vertex.Angle += p.Velocities.AngleVelocity * dt;
-}
-
 void ParticleSystem::UpdateVertexBuffer(shared_ptr<ID3D11DeviceContext>& context, XMFLOAT4 cameraPos)
 {
-	vector<ParticleVertex> vertices(MAX_PARTICLES);
-	typedef std::list<Particle>::iterator list_it_t;
-	typedef std::vector<ParticleVertex>::iterator vect_it_t;
-	vect_it_t vit = vertices.begin();
-	for (list_it_t lit = m_particles.begin(); lit != m_particles.end(); ++vit, ++lit)
-		*vit = lit->Vertex;
+	if (m_particlesCount == 0)
+		return;
 	XMFLOAT4 cameraTarget(0.0f, 0.0f, 0.0f, 1.0f);
-	sort(vertices.begin(), vit, ParticleComparer(cameraTarget - cameraPos, cameraPos));
+	m_simulation.Sort(cameraPos, cameraTarget - cameraPos);
 	D3D11_MAPPED_SUBRESOURCE resource;
 	HRESULT hr = context->Map(m_vertices.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
 	if (FAILED(hr))
 		THROW_DX11(hr);
-	memcpy(resource.pData, vertices.data(), MAX_PARTICLES * sizeof(ParticleVertex));
+	//Particles of all emitters go to one buffer, only live ones and without reading back the mapped memory
+	m_simulation.WriteVertices(reinterpret_cast<ParticleVertex*>(resource.pData));
 	context->Unmap(m_vertices.get(), 0);
 }
 
 void ParticleSystem::Update(shared_ptr<ID3D11DeviceContext>& context, float dt, XMFLOAT4 cameraPos)
 {
-	typedef std::list<Particle>::iterator list_it_t;
-	for (list_it_t it = m_particles.begin(); it != m_particles.end(); )
-	{
-		UpdateParticle(*it, dt);
-		list_it_t prev = it++;
-		if (prev->Vertex.Age >= TIME_TO_LIVE)
-		{
-			m_particles.erase(prev);
-			--m_particlesCount;
-		}
-	}
-	m_particlesToCreate += dt * EMISSION_RATE;
-	while (m_particlesToCreate >= 1.0f)
-	{
-		--m_particlesToCreate;
-		--m_particlesToCreate;
-		if (m_particlesCount < MAX_PARTICLES)
-		{
-			AddNewParticle();
-			XMVECTOR tmp = m_perpendicularToPlane;
-			m_perpendicularToPlane = XMVector3Transform(m_perpendicularToPlane, XMMatrixScaling(1, 1, -1));
-			AddNewParticle();
-			m_perpendicularToPlane = tmp;
-			++m_particlesCount;
-			++m_particlesCount;
-		}
-	}
+	m_time += dt;
+	m_noise.SetTime(m_time);
+	m_simulation.Update(dt, GRAVITY, m_collisions.get(), &m_smoke);
+	for (unsigned int i = 0; i < m_emitters.size(); ++i)
+		m_emitters[i].Emit(m_simulation, dt, GRAVITY);
+	m_particlesCount = m_simulation.getCount();
 	UpdateVertexBuffer(context, cameraPos);
 }
 
-void ParticleSystem::Render(shared_ptr<ID3D11DeviceContext>& context, XMFLOAT3 emitterPos)
+void ParticleSystem::Render(shared_ptr<ID3D11DeviceContext>& context)
 {
 	context->VSSetShader(m_vs.get(), nullptr, 0);
 	context->GSSetShader(m_gs.get(), nullptr, 0);
@@ -3,86 +3,80 @@
 
 #include <d3d11.h>
 #include <xnamath.h>
-#include <list>
 #include <memory>
+#include <vector>
 #include "gk2_deviceHelper.h"
 #include "gk2_constantBuffer.h"
+#include "gk2_particleSimulation.h"
+#include "gk2_threadPool.h"
+#include "gk2_particleEmitter.h"
+#include "gk2_collisionWorld.h"
+#include "gk2_curlNoise.h"
 
 namespace gk2
 {
 	struct ParticleVertex
 	{
 		XMFLOAT3 Pos;
-		float Age;
+		float Age;		//fraction of the particle's time to live
 		float Angle;
 		float Size;
-		static const unsigned int LayoutElements = 4;
+		float Type;		//gk2::ParticleType, picks the texture and the colour ramp
+		static const unsigned int LayoutElements = 5;
 		static const D3D11_INPUT_ELEMENT_DESC Layout[LayoutElements];
 
-		ParticleVertex() : Pos(0.0f, 0.0f, 0.0f), Age(0.0f), Angle(0.0f), Size(0.0f) { }
+		ParticleVertex() : Pos(0.0f, 0.0f, 0.0f), Age(0.0f), Angle(0.0f), Size(0.0f), Type(0.0f) { }
 	};
 	
-	struct ParticleVelocities
-	{
-		XMFLOAT3 Velocity;
-		float AngleVelocity;
-		XMFLOAT3 StartVelocity;
-		XMFLOAT3 StartPos;
-		ParticleVelocities() : Velocity(0.0f, 0.0f, 0.0f), AngleVelocity(0.0f) { }
-	};
-
-	struct Particle
-	{
-		ParticleVertex Vertex;
-		ParticleVelocities Velocities;
-		float time;
-	};
-
-	class ParticleComparer
-	{
-	public:
-		ParticleComparer(XMFLOAT4 camDir, XMFLOAT4 camPos) : m_camDir(camDir), m_camPos(camPos) { }
-
-		bool operator()(const gk2::ParticleVertex& p1, const gk2::ParticleVertex& p2);
-
-	private:
-		XMFLOAT4 m_camDir, m_camPos;
-	};
-
+	//Particles of any number of emitters, simulated together and drawn back to front with a single
+	//vertex buffer upload and a single draw call
 	class ParticleSystem
 	{
 	public:
-		ParticleSystem(gk2::DeviceHelper& device, XMFLOAT3 emitterPos);
+		//Simulation work is split between the threads of the given pool
+		ParticleSystem(gk2::DeviceHelper& device, gk2::ThreadPool& threads, unsigned int maxParticles = MAX_PARTICLES);
 
 		void SetViewMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& view);
 		void SetProjMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& proj);
+		//Obstacles particles bounce off, nullptr disables collisions
+		void SetCollisionWorld(const std::shared_ptr<gk2::CollisionWorld>& collisions) { m_collisions = collisions; }
+
+		//Returns the index of the new emitter
+		unsigned int AddEmitter(const gk2::ParticleEmitterDesc& desc, unsigned int seed);
+		gk2::ParticleEmitter& getEmitter(unsigned int i) { return m_emitters[i]; }
+		unsigned int getEmitterCount() const { return static_cast<unsigned int>(m_emitters.size()); }
+		unsigned int getParticleCount() const { return m_simulation.getCount(); }
+
+		//Samples recent paths of up to maxPaths sparks, see ParticlePool::SamplePaths
+		unsigned int SampleSparkPaths(float step, unsigned int points, unsigned int stride, float* x, float* y,
+			float* z, unsigned int maxPaths) const
+		{
+			return m_simulation.SamplePaths(GRAVITY, step, points, stride, x, y, z, maxPaths);
+		}
 
 		void Update(std::shared_ptr<ID3D11DeviceContext>& context, float dt, XMFLOAT4 cameraPos);
-		void Render(std::shared_ptr<ID3D11DeviceContext>& context, XMFLOAT3 emitterPos);
-		XMFLOAT3 m_emitterPos;
-		static XMVECTOR m_perpendicularToPlane;
-		static XMFLOAT3 m_startPosition;
+		void Render(std::shared_ptr<ID3D11DeviceContext>& context);
 	private:
-		static const XMFLOAT3 EMITTER_DIR;	//mean direction of particles' velocity
-		static const float TIME_TO_LIVE;	//time of particle's life in seconds
-		static const float EMISSION_RATE;	//number of particles to be born per second
-		static const float MAX_ANGLE;		//maximal angle declination from mean direction
-		static const float MIN_VELOCITY;	//minimal value of particle's velocity
-		static const float MAX_VELOCITY;	//maximal value of particle's velocity
-		static const float PARTICLE_SIZE;	//initial size of a particle
-		static const float PARTICLE_SCALE;	//size += size*scale*dtime
-		static const float MIN_ANGLE_VEL;	//minimal rotation speed
-		static const float MAX_ANGLE_VEL;	//maximal rotation speed
-		static const int MAX_PARTICLES;		//maximal number of particles in the system
+		static const unsigned int MAX_PARTICLES;	//default maximal number of particles in the system
+		static const float GRAVITY;			//vertical acceleration of particles
+		static const unsigned int NOISE_SEED;
+		static const float NOISE_FREQUENCY;	//noise cells per unit of length of the field carrying smoke
+		static const float NOISE_STRENGTH;
+		static const float SMOKE_BUOYANCY;		//upward speed of smoke
+		static const float SMOKE_DRAG;			//rate at which smoke loses its launch velocity
+		static const float SMOKE_GROWTH;		//size increase of smoke per second
 		
 		static const unsigned int OFFSET;
 		static const unsigned int STRIDE;
 
-		
-		float m_particlesToCreate;
 		unsigned int m_particlesCount;
 		
-		std::list<Particle> m_particles;
+		gk2::ParticleSimulation m_simulation;
+		std::vector<gk2::ParticleEmitter> m_emitters;
+		std::shared_ptr<gk2::CollisionWorld> m_collisions;
+		gk2::CurlNoise m_noise;
+		gk2::SmokeMotion m_smoke;
+		float m_time;
 
 		std::shared_ptr<ID3D11Buffer> m_vertices;
 		
@@ -98,9 +92,6 @@ namespace gk2
 		std::shared_ptr<ID3D11PixelShader> m_ps;
 		std::shared_ptr<ID3D11InputLayout> m_layout;
 
-		static XMFLOAT3 RandomVelocity();
-		void AddNewParticle();
-		void UpdateParticle(gk2::Particle& p, float dt);
 		void UpdateVertexBuffer(std::shared_ptr<ID3D11DeviceContext>& context, XMFLOAT4 cameraPos);
 	};
 }
@@ -0,0 +1,195 @@
+#include "gk2_pathPlanner.h"
+#include "gk2_armCollision.h"
+#include "gk2_threadPool.h"
+#include <atomic>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int PathPlanner::MIN_BATCH = 8;
+
+unsigned int PathPlanner::Tree::Add(const float* q, unsigned int parent)
+{
+	nodes.insert(nodes.end(), q, q + JOINTS);
+	parents.push_back(parent);
+	return size() - 1;
+}
+
+unsigned int PathPlanner::Tree::Nearest(const float* q) const
+{
+	unsigned int best = 0;
+	float bestDistance = FLT_MAX;
+	for (unsigned int i = 0; i < size(); ++i)
+	{
+		const float* p = node(i);
+		float distance = 0.0f;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			distance += (p[j] - q[j]) * (p[j] - q[j]);
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			best = i;
+		}
+	}
+	return best;
+}
+
+PathPlanner::PathPlanner(const ArmCollision& collision, ThreadPool& threads, unsigned int seed)
+	: m_collision(collision), m_threads(threads), m_random(seed), m_step(0.3f), m_resolution(0.02f), m_nodeCount(0)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_lower[j] = -XM_PI;
+		m_upper[j] = XM_PI;
+	}
+}
+
+void PathPlanner::SetLimits(const float* lower, const float* upper)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_lower[j] = lower[j];
+		m_upper[j] = upper[j];
+	}
+}
+
+void PathPlanner::SetStep(float step, float resolution)
+{
+	m_step = step;
+	m_resolution = resolution;
+}
+
+float PathPlanner::FreeFraction(const float* a, const float* b) const
+{
+	float move = 0.0f;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		move = fabs(b[j] - a[j]) > move ? fabs(b[j] - a[j]) : move;
+	unsigned int samples = static_cast<unsigned int>(ceil(move / m_resolution));
+	samples = samples < 1 ? 1 : samples;
+	//Sample k is at (k + 1) / samples, firstHit is one past the last free one
+	atomic<unsigned int> firstHit(samples);
+	m_threads.RunRanges(samples, [&](unsigned int begin, unsigned int end)
+	{
+		float q[JOINTS];
+		for (unsigned int k = begin; k < end && k < firstHit.load(); ++k)
+		{
+			float t = static_cast<float>(k + 1) / samples;
+			for (unsigned int j = 0; j < JOINTS; ++j)
+				q[j] = a[j] + t * (b[j] - a[j]);
+			if (m_collision.IsFree(q))
+				continue;
+			unsigned int seen = firstHit.load();
+			while (k < seen && !firstHit.compare_exchange_weak(seen, k))
+				;
+			return;
+		}
+	}, MIN_BATCH);
+	return static_cast<float>(firstHit.load()) / samples;
+}
+
+unsigned int PathPlanner::Grow(Tree& tree, unsigned int node, const float* q, bool connect, bool& reached)
+{
+	float from[JOINTS], to[JOINTS], length = 0.0f;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		from[j] = tree.node(node)[j];
+		length += (q[j] - from[j]) * (q[j] - from[j]);
+	}
+	length = sqrt(length);
+	//A single step unless connecting
+	float scale = connect || length <= m_step ? 1.0f : m_step / length;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		to[j] = from[j] + scale * (q[j] - from[j]);
+	float fraction = FreeFraction(from, to);
+	reached = fraction == 1.0f && scale == 1.0f;
+	unsigned int steps = static_cast<unsigned int>(ceil(fraction * scale * length / m_step));
+	float p[JOINTS];
+	for (unsigned int s = 1; s <= steps; ++s)
+	{
+		float t = fraction * s / steps;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			p[j] = from[j] + t * (to[j] - from[j]);
+		node = tree.Add(p, node);
+	}
+	return node;
+}
+
+void PathPlanner::Join(const Tree& first, unsigned int a, const Tree& second, unsigned int b, vector<float>& path)
+{
+	vector<unsigned int> branch;
+	for (unsigned int i = a; i != UINT_MAX; i = first.parents[i])
+		branch.push_back(i);
+	path.clear();
+	for (unsigned int i = static_cast<unsigned int>(branch.size()); i-- > 0; )
+		path.insert(path.end(), first.node(branch[i]), first.node(branch[i]) + JOINTS);
+	//Node b is where the second tree reached node a, skip it
+	for (unsigned int i = second.parents[b]; i != UINT_MAX; i = second.parents[i])
+		path.insert(path.end(), second.node(i), second.node(i) + JOINTS);
+}
+
+bool PathPlanner::Plan(const float* start, const float* goal, vector<float>& path)
+{
+	m_nodeCount = 0;
+	if (!m_collision.IsFree(start) || !m_collision.IsFree(goal))
+		return false;
+	path.clear();
+	if (FreeFraction(start, goal) == 1.0f)
+	{
+		path.insert(path.end(), start, start + JOINTS);
+		path.insert(path.end(), goal, goal + JOINTS);
+		m_nodeCount = 2;
+		return true;
+	}
+	Tree trees[2];
+	trees[0].Add(start, UINT_MAX);
+	trees[1].Add(goal, UINT_MAX);
+	unsigned int grown = 0;		//tree taking the random step, the other one connects
+	float sample[JOINTS], reachedNode[JOINTS];
+	while (trees[0].size() + trees[1].size() < MAX_NODES)
+	{
+		Tree& tree = trees[grown];
+		Tree& other = trees[1 - grown];
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			sample[j] = m_random.NextFloat(m_lower[j], m_upper[j]);
+		unsigned int size = tree.size();
+		bool reached;
+		unsigned int node = Grow(tree, tree.Nearest(sample), sample, false, reached);
+		if (tree.size() > size)
+		{
+			for (unsigned int j = 0; j < JOINTS; ++j)
+				reachedNode[j] = tree.node(node)[j];
+			unsigned int last = Grow(other, other.Nearest(reachedNode), reachedNode, true, reached);
+			if (reached)
+			{
+				m_nodeCount = trees[0].size() + trees[1].size();
+				if (grown == 0)
+					Join(tree, node, other, last, path);
+				else
+					Join(other, last, tree, node, path);
+				return true;
+			}
+		}
+		grown = 1 - grown;
+	}
+	m_nodeCount = trees[0].size() + trees[1].size();
+	return false;
+}
+
+void PathPlanner::Shortcut(vector<float>& path, unsigned int attempts)
+{
+	for (unsigned int i = 0; i < attempts; ++i)
+	{
+		unsigned int waypoints = static_cast<unsigned int>(path.size()) / JOINTS;
+		if (waypoints < 3)
+			return;
+		unsigned int a = m_random.NextUInt() % (waypoints - 2);
+		unsigned int b = a + 2 + m_random.NextUInt() % (waypoints - a - 2);
+		if (FreeFraction(&path[a * JOINTS], &path[b * JOINTS]) == 1.0f)
+			path.erase(path.begin() + (a + 1) * JOINTS, path.begin() + b * JOINTS);
+		else if (waypoints == 3)
+			return;		//the only pair left is blocked
+	}
+}
@@ -0,0 +1,75 @@
+#ifndef __GK2_PATH_PLANNER_H_
+#define __GK2_PATH_PLANNER_H_
+
+#include <vector>
+#include "gk2_pumaKinematics.h"
+#include "gk2_random.h"
+
+namespace gk2
+{
+	class ArmCollision;
+	class ThreadPool;
+
+	//Collision-free joint space paths by RRT-Connect with shortcut smoothing.
+	//Trees grow from both ends in turn: one takes a step towards a random sample, the other then reaches
+	//for the new node in a straight line as far as it is free. A straight edge is checked at configurations
+	//no more than the resolution apart on any joint. They are checked as one batch split between threads,
+	//and the batch stops early once a part of the edge closer to its start is known to collide.
+	class PathPlanner
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+		static const unsigned int MAX_NODES = 20000;		//in both trees together, Plan fails past it
+
+		PathPlanner(const gk2::ArmCollision& collision, gk2::ThreadPool& threads,
+			unsigned int seed = gk2::Random::DEFAULT_SEED);
+
+		void SetLimits(const float* lower, const float* upper);
+		//step is the longest tree edge, resolution the largest joint move between checked configurations
+		void SetStep(float step, float resolution);
+
+		//Waypoints from start to goal, JOINTS angles each, returns false if there is no path within MAX_NODES
+		bool Plan(const float* start, const float* goal, std::vector<float>& path);
+		//Replaces parts of path by straight edges between random pairs of its waypoints where they are free
+		void Shortcut(std::vector<float>& path, unsigned int attempts);
+
+		//Part of the straight edge from a to b that is free, from 0 to 1, a itself is not checked
+		float FreeFraction(const float* a, const float* b) const;
+		unsigned int getNodeCount() const { return m_nodeCount; }
+
+	private:
+		static const unsigned int MIN_BATCH;		//configurations per thread worth a task
+
+		struct Tree
+		{
+			std::vector<float> nodes;
+			std::vector<unsigned int> parents;
+
+			unsigned int size() const { return static_cast<unsigned int>(parents.size()); }
+			const float* node(unsigned int i) const { return &nodes[i * JOINTS]; }
+			unsigned int Add(const float* q, unsigned int parent);
+			unsigned int Nearest(const float* q) const;
+		};
+
+		const gk2::ArmCollision& m_collision;
+		gk2::ThreadPool& m_threads;
+		gk2::Random m_random;
+		float m_lower[JOINTS];
+		float m_upper[JOINTS];
+		float m_step;
+		float m_resolution;
+		unsigned int m_nodeCount;
+
+		//Adds nodes at most m_step apart along the free part of the edge from node to q,
+		//returns the last node and whether it is q
+		unsigned int Grow(Tree& tree, unsigned int node, const float* q, bool connect, bool& reached);
+		//Joins the branches of both trees at their nodes a and b into path
+		static void Join(const Tree& first, unsigned int a, const Tree& second, unsigned int b,
+			std::vector<float>& path);
+
+		PathPlanner(const PathPlanner& right) : m_collision(right.m_collision), m_threads(right.m_threads) { }
+		PathPlanner& operator=(const PathPlanner& right) { return *this; }
+	};
+}
+
+#endif __GK2_PATH_PLANNER_H_
@@ -0,0 +1,227 @@
+#include "gk2_pathTiming.h"
+#include "gk2_threadPool.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int PathTiming::MIN_BATCH = 4;
+const float PathTiming::MAX_SPEED = 1e12f;
+
+namespace
+{
+	//Derivatives below it do not constrain anything
+	const float EPSILON = 1e-6f;
+}
+
+PathTiming::PathTiming()
+	: m_duration(0.0f)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = 1.0f;
+		m_maxAcceleration[j] = 1.0f;
+	}
+}
+
+void PathTiming::SetLimits(const float* maxVelocity, const float* maxAcceleration)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = maxVelocity[j];
+		m_maxAcceleration[j] = maxAcceleration[j];
+	}
+}
+
+float PathTiming::GetConstraints(const float* waypoints, unsigned int count, unsigned int i, Line* lower,
+	Line* upper, unsigned int& lines) const
+{
+	//Derivatives of the Catmull-Rom segment Sample plays from waypoint i to the next, at both its ends
+	const float* q1 = waypoints + i * JOINTS;
+	const float* q2 = q1 + JOINTS;
+	float maxX = MAX_SPEED;
+	lines = 0;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		float q0 = i > 0 ? (q1 - JOINTS)[j] : 2.0f * q1[j] - q2[j];
+		float q3 = i + 2 < count ? q2[j + JOINTS] : 2.0f * q2[j] - q1[j];
+		float d = 0.5f * (q2[j] - q0), dd = 2.0f * q0 - 5.0f * q1[j] + 4.0f * q2[j] - q3;
+		float endD = 0.5f * (q3 - q1[j]), endDd = -q0 + 4.0f * q1[j] - 5.0f * q2[j] + 2.0f * q3;
+		//Joint velocity d * sqrt(x), joint acceleration d * u + dd * x at the start and, as x + 2u is the x
+		//at the end, (endD + 2 endDd) * u + endDd * x at the end
+		if (fabs(d) > EPSILON)
+		{
+			float x = m_maxVelocity[j] * m_maxVelocity[j] / (d * d);
+			maxX = x < maxX ? x : maxX;
+		}
+		AddConstraint(d, dd, m_maxAcceleration[j], lower, upper, lines, maxX);
+		AddConstraint(endD + 2.0f * endDd, endDd, m_maxAcceleration[j], lower, upper, lines, maxX);
+	}
+	return maxX;
+}
+
+void PathTiming::AddConstraint(float du, float dx, float limit, Line* lower, Line* upper, unsigned int& lines,
+	float& maxX)
+{
+	//|du * u + dx * x| <= limit
+	if (fabs(du) > EPSILON)
+	{
+		lower[lines].slope = upper[lines].slope = -dx / du;
+		upper[lines].offset = limit / fabs(du);
+		lower[lines].offset = -upper[lines].offset;
+		++lines;
+	}
+	else if (fabs(dx) > EPSILON)
+	{
+		float x = limit / fabs(dx);
+		maxX = x < maxX ? x : maxX;
+	}
+}
+
+float PathTiming::Solve(const float* waypoints, unsigned int count, float* lowerX, float* upperX, float* speeds,
+	float* controls, float* times) const
+{
+	Line lower[2 * JOINTS + 1], upper[2 * JOINTS + 1];
+	unsigned int lines;
+	//Backward, the controllable intervals
+	lowerX[count - 1] = upperX[count - 1] = 0.0f;
+	for (unsigned int i = count - 1; i-- > 0; )
+	{
+		float maxX = GetConstraints(waypoints, count, i, lower, upper, lines);
+		//x + 2u within the interval of the next waypoint
+		lower[lines].slope = upper[lines].slope = -0.5f;
+		lower[lines].offset = 0.5f * lowerX[i + 1];
+		upper[lines].offset = 0.5f * upperX[i + 1];
+		++lines;
+		//Some u is above every lower line and below every upper one, so every pair must cross
+		float lo = 0.0f, hi = maxX;
+		for (unsigned int k = 0; k < lines; ++k)
+			for (unsigned int m = 0; m < lines; ++m)
+			{
+				float slope = lower[k].slope - upper[m].slope, room = upper[m].offset - lower[k].offset;
+				if (slope > EPSILON)
+					hi = room / slope < hi ? room / slope : hi;
+				else if (slope < -EPSILON)
+					lo = room / slope > lo ? room / slope : lo;
+				else if (room < 0.0f)
+					return -1.0f;
+			}
+		if (lo > hi)
+			return -1.0f;
+		lowerX[i] = lo;
+		upperX[i] = hi;
+	}
+	//Forward from rest, as fast as the intervals let
+	float x = 0.0f, time = 0.0f;
+	for (unsigned int i = 0; i + 1 < count; ++i)
+	{
+		GetConstraints(waypoints, count, i, lower, upper, lines);
+		float uLow = 0.5f * (lowerX[i + 1] - x), uHigh = 0.5f * (upperX[i + 1] - x);
+		for (unsigned int k = 0; k < lines; ++k)
+		{
+			float low = lower[k].slope * x + lower[k].offset, high = upper[k].slope * x + upper[k].offset;
+			uLow = low > uLow ? low : uLow;
+			uHigh = high < uHigh ? high : uHigh;
+		}
+		float next = x + 2.0f * (uHigh > uLow ? uHigh : uLow);
+		next = next < lowerX[i + 1] ? lowerX[i + 1] : (next > upperX[i + 1] ? upperX[i + 1] : next);
+		float speed = sqrt(x), nextSpeed = sqrt(next);
+		if (speeds)
+		{
+			speeds[i] = speed;
+			controls[i] = 0.5f * (next - x);
+			times[i] = time;
+		}
+		time += speed + nextSpeed > 0.0f ? 2.0f / (speed + nextSpeed) : 0.0f;
+		x = next;
+	}
+	if (speeds)
+	{
+		speeds[count - 1] = sqrt(x);
+		controls[count - 1] = 0.0f;
+		times[count - 1] = time;
+	}
+	return time;
+}
+
+float PathTiming::Compute(const float* waypoints, unsigned int count)
+{
+	m_path.assign(waypoints, waypoints + count * JOINTS);
+	m_lower.resize(count);
+	m_upper.resize(count);
+	m_speeds.resize(count);
+	m_controls.resize(count);
+	m_times.resize(count);
+	m_duration = count > 1 ? Solve(waypoints, count, &m_lower[0], &m_upper[0], &m_speeds[0], &m_controls[0],
+		&m_times[0]) : 0.0f;
+	return m_duration;
+}
+
+float PathTiming::SamplePath(float time) const
+{
+	unsigned int count = static_cast<unsigned int>(m_times.size());
+	if (count < 2 || m_duration <= 0.0f)
+		return 0.0f;
+	time = time < 0.0f ? 0.0f : (time > m_duration ? m_duration : time);
+	unsigned int i = static_cast<unsigned int>(upper_bound(m_times.begin(), m_times.end(), time) - m_times.begin());
+	i = i < 1 ? 0 : (i > count - 1 ? count - 2 : i - 1);
+	float tau = time - m_times[i];
+	float s = i + m_speeds[i] * tau + 0.5f * m_controls[i] * tau * tau;
+	return s < i ? static_cast<float>(i) : (s > i + 1 ? static_cast<float>(i + 1) : s);
+}
+
+void PathTiming::Sample(float time, float* angles) const
+{
+	unsigned int count = static_cast<unsigned int>(m_times.size());
+	if (count == 0)
+		return;
+	float s = SamplePath(time);
+	unsigned int i = static_cast<unsigned int>(s);
+	i = i + 1 < count ? i : (count > 1 ? count - 2 : 0);
+	if (count == 1)
+	{
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			angles[j] = m_path[j];
+		return;
+	}
+	//Catmull-Rom, its tangents at the waypoints are the differences the timing used,
+	//so past the ends the path goes on straight
+	float f = s - i;
+	const float* q1 = &m_path[i * JOINTS];
+	const float* q2 = q1 + JOINTS;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		float q0 = i > 0 ? (q1 - JOINTS)[j] : 2.0f * q1[j] - q2[j];
+		float q3 = i + 2 < count ? q2[j + JOINTS] : 2.0f * q2[j] - q1[j];
+		angles[j] = q1[j] + 0.5f * f * (q2[j] - q0 + f * (2.0f * q0 - 5.0f * q1[j] + 4.0f * q2[j] - q3 +
+			f * (3.0f * (q1[j] - q2[j]) + q3 - q0)));
+	}
+}
+
+bool PathTiming::Resample(float dt, vector<float>& trajectory) const
+{
+	if (m_duration <= 0.0f || dt <= 0.0f)
+	{
+		trajectory.clear();
+		return false;
+	}
+	unsigned int samples = static_cast<unsigned int>(ceil(m_duration / dt)) + 1;
+	trajectory.resize(samples * JOINTS);
+	for (unsigned int k = 0; k < samples; ++k)
+		Sample(k * dt < m_duration ? k * dt : m_duration, &trajectory[k * JOINTS]);
+	return true;
+}
+
+void PathTiming::ComputeBatch(const float* paths, unsigned int pathCount, unsigned int count, float* durations,
+	ThreadPool& threads) const
+{
+	threads.RunRanges(pathCount, [&](unsigned int begin, unsigned int end)
+	{
+		//Intervals of one path at a time, reused along the range
+		vector<float> lowerX(count + 1), upperX(count + 1);
+		for (unsigned int p = begin; p < end; ++p)
+			durations[p] = count > 1 ? Solve(paths + p * count * JOINTS, count, &lowerX[0], &upperX[0], 0, 0, 0) :
+				0.0f;
+	}, MIN_BATCH);
+}
@@ -0,0 +1,76 @@
+#ifndef __GK2_PATH_TIMING_H_
+#define __GK2_PATH_TIMING_H_
+
+#include <vector>
+#include "gk2_pumaKinematics.h"
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Time-optimal timing of a joint space path under joint velocity and acceleration limits (TOPP-RA).
+	//The path goes through waypoints at path parameter 0, 1, 2..., derivatives are taken by differences.
+	//The state at a waypoint is the squared parameter speed x, the control the parameter acceleration u,
+	//constant until the next waypoint, and the joint limits are linear in both. A backward pass finds at
+	//every waypoint the interval of x from which the end can still be reached at rest: u is eliminated
+	//from the constraints pairwise, leaving bounds on x alone. A forward pass from rest then takes the
+	//largest u that keeps x in those intervals. Paths of a batch are timed in ranges split between threads.
+	class PathTiming
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+
+		PathTiming();
+
+		void SetLimits(const float* maxVelocity, const float* maxAcceleration);
+
+		//Times the path through count waypoints, JOINTS angles each, from rest to rest, returns its duration
+		float Compute(const float* waypoints, unsigned int count);
+		float getDuration() const { return m_duration; }
+		//Path parameter reached at time, from 0 to the number of waypoints less one
+		float SamplePath(float time) const;
+		//Joint angles at time, on the Catmull-Rom spline through the waypoints
+		void Sample(float time, float* angles) const;
+		//Joint angles every dt from start to end of the path; false, trajectory empty, if dt or the duration is not
+		//positive, as for an infeasible path
+		bool Resample(float dt, std::vector<float>& trajectory) const;
+
+		//Durations of pathCount paths of count waypoints each, one after another in paths
+		void ComputeBatch(const float* paths, unsigned int pathCount, unsigned int count, float* durations,
+			gk2::ThreadPool& threads) const;
+
+	private:
+		static const unsigned int MIN_BATCH;		//paths per thread worth a task
+		static const float MAX_SPEED;			//squared parameter speed of a path that does not move
+
+		//u >= slope * x + offset or u <= slope * x + offset
+		struct Line
+		{
+			float slope;
+			float offset;
+		};
+
+		float m_maxVelocity[JOINTS];
+		float m_maxAcceleration[JOINTS];
+		std::vector<float> m_path;
+		std::vector<float> m_lower;		//controllable x at every waypoint
+		std::vector<float> m_upper;
+		std::vector<float> m_speeds;	//parameter speed, not squared
+		std::vector<float> m_controls;
+		std::vector<float> m_times;
+		float m_duration;
+
+		//Lines bounding u from waypoint i by the joint accelerations at both ends of the segment to the next,
+		//returns the largest x the limits allow
+		float GetConstraints(const float* waypoints, unsigned int count, unsigned int i, Line* lower, Line* upper,
+			unsigned int& lines) const;
+		//Adds the lines of |du * u + dx * x| <= limit, or lowers maxX if u does not matter
+		static void AddConstraint(float du, float dx, float limit, Line* lower, Line* upper, unsigned int& lines,
+			float& maxX);
+		//Duration of the fastest timing, speeds, controls and times of the waypoints are stored if given
+		float Solve(const float* waypoints, unsigned int count, float* lowerX, float* upperX, float* speeds,
+			float* controls, float* times) const;
+	};
+}
+
+#endif __GK2_PATH_TIMING_H_
@@ -4,6 +4,8 @@
 #include "gk2_window.h"
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
 
 using namespace std;
 using namespace gk2;
@@ -20,6 +22,8 @@ const wstring Puma::PumaFiles[6] = {
 	RESOURCES_PATH L"puma/mesh5.txt",
 	RESOURCES_PATH L"puma/mesh6.txt"
 };
+const wstring Puma::ProgramFile = RESOURCES_PATH L"programs/weld.txt";
+const wstring Puma::CalibrationFile = RESOURCES_PATH L"puma/calibration.txt";
 
 XMFLOAT4 Puma::lightPos = XMFLOAT4(-4, 4, -4, 1);
 const unsigned int Puma::VB_STRIDE = sizeof(VertexPosNormal);
@@ -27,7 +31,21 @@ const unsigned int Puma::VB_OFFSET = 0;
 const unsigned int Puma::BS_MASK = 0xffffffff;
 
 
-const float Puma::LAP_TIME = 10.0f;
+const unsigned int Puma::PARTICLES_SEED = 1;
+const unsigned int Puma::TRAIL_POINTS = 256;
+const float Puma::LINK_DENSITY = 1000.0f;
+const float Puma::REPORT_TIME = 0.25f;
+const float Puma::HOME_ANGLES[PumaKinematics::JOINTS] = { XM_PIDIV2, 0.0f, 0.0f, 0.0f, 0.0f };
+const float Puma::APPROACH_DISTANCE = 0.3f;
+const unsigned int Puma::TRANSFER_WAYPOINTS = 200;
+const float Puma::MAX_JOINT_VELOCITY[PumaKinematics::JOINTS] = { 0.3f, 0.3f, 0.4f, 0.8f, 0.8f };
+const float Puma::MAX_JOINT_ACCELERATION[PumaKinematics::JOINTS] = { 0.5f, 0.5f, 0.8f, 2.0f, 2.0f };
+const float Puma::STREAM_TIMEOUT = 0.5f;
+const BYTE Puma::SESSION_KEYS[Puma::SESSION_KEY_COUNT] = { DIK_W, DIK_S, DIK_A, DIK_D, DIK_Z, DIK_X, DIK_H };
+const PlateFrame Puma::PLATE(XMFLOAT3(-0.9f, -1.0f, -2.0f), XMFLOAT3(-1.5f, 1.5f * sqrtf(3.0f), 0.0f),
+	XMFLOAT3(0.0f, 0.0f, 4.0f));
+const float Puma::PLATE_THICKNESS = 0.01f;
+const XMFLOAT3 Puma::CYLINDER_ENDS[2] = { XMFLOAT3(-0.5f, -0.5f, 1.0f), XMFLOAT3(2.5f, -0.5f, 1.0f) };
 
 void* Puma::operator new(size_t size)
 {
@@ -40,11 +58,43 @@ void Puma::operator delete(void* ptr)
 }
 
 Puma::Puma(HINSTANCE hInstance)
-	: ApplicationBase(hInstance), m_camera(0.01f, 100.0f)
+	: ApplicationBase(hInstance), m_camera(0.01f, 100.0f), m_calibrated(false), m_seed(PARTICLES_SEED),
+	  m_replaying(false), m_headless(false), m_divergedFrames(0), m_firstDiverged(0)
 {
 
 }
 
+void Puma::RecordSession(const wstring& file)
+{
+	m_sessionFile = file;
+	m_recorder.reset(new SessionRecorder());
+	m_player.reset();
+}
+
+void Puma::ReplaySession(const wstring& file, const wstring& report, const wstring& baseline)
+{
+	m_sessionFile = file;
+	m_reportFile = report;
+	m_baselineFile = baseline;
+	m_player.reset(new SessionPlayer());
+	m_recorder.reset();
+	m_headless = true;
+}
+
+void Puma::CompareLog(const wstring& log, const wstring& report)
+{
+	m_jointLogFile = log;
+	m_reportFile = report;
+	m_headless = true;
+}
+
+void Puma::Calibrate(const wstring& samples, const wstring& report)
+{
+	m_calibrationSamplesFile = samples;
+	m_reportFile = report;
+	m_headless = true;
+}
+
 Puma::~Puma()
 {
 
@@ -313,6 +363,11 @@ void Puma::InitializePuma()
 		pumaIndicesCount[i] = 3 * trianglesCount;
 		m_pumaMtx[i] = XMMatrixIdentity();
 	}
+	m_dynamics.reset(new InverseDynamics(m_kinematics));
+	for (int i = 0; i < 6; i++)
+		m_dynamics->SetLink(i, MassProperties::FromMesh(&vertices[i][0], &indices[i][0], pumaIndicesCount[i],
+			LINK_DENSITY));
+	m_jointSamples = 0;
 
 }
 void Puma::InitializeCyllinder()
@@ -453,12 +508,54 @@ bool Puma::LoadContent()
 	InitializePuma();
 	InitializePlane();
 	InitializeCircle();
+	InitializeProgram();
+	if (!InitializeSession())
+		return false;
+	InitializeStream();
+	InitializeTelemetry();
 	InitializeCyllinder();
 	InitializeShadowEffects();
 
-	m_particles.reset(new ParticleSystem(m_device, XMFLOAT3(-1.0f, -1.1f, 0.46f)));
+	m_threads.reset(new ThreadPool());
+	InitializeServos();
+	m_particles.reset(new ParticleSystem(m_device, *m_threads));
+	ParticleEmitterDesc sparks;
+	sparks.EmissionRate /= 2.0f;
+	for (unsigned int i = 0; i < 2; ++i)
+		m_sparkEmitters[i] = m_particles->AddEmitter(sparks, m_seed + i);
+	ParticleEmitterDesc smoke;
+	smoke.Type = SMOKE_PARTICLE;
+	smoke.EmissionRate = 30.0f;
+	smoke.TimeToLive = 3.0f;
+	smoke.MaxAngle = XM_PIDIV4;
+	smoke.MinVelocity = 0.1f;
+	smoke.MaxVelocity = 0.3f;
+	smoke.Size = 0.05f;
+	smoke.MinAngleVel = -XM_PIDIV4;
+	smoke.MaxAngleVel = XM_PIDIV4;
+	m_smokeEmitter = m_particles->AddEmitter(smoke, m_seed + 2);
+	m_emissionRates[0] = m_emissionRates[1] = sparks.EmissionRate;
+	m_emissionRates[2] = smoke.EmissionRate;
 	m_particles->SetViewMtxBuffer(m_cbView);
 	m_particles->SetProjMtxBuffer(m_cbProj);
+	InitializeCollisions();
+	m_trails.reset(new TrailSystem(m_device, 1, TRAIL_POINTS, 1000));
+	m_torchTrail = m_trails->AddTrail(0.02f, 1.5f);
+	m_trails->SetStreakSource(m_particles.get(), 0.04f, 0.01f);
+	m_trails->SetViewMtxBuffer(m_cbView);
+	m_trails->SetProjMtxBuffer(m_cbProj);
+	m_heatField.reset(new HeatField(384, 512, PLATE.getSizeU(), PLATE.getSizeV(), *m_threads));
+	m_heatField->SetMaterial(0.002f, 0.3f);
+	m_heatGlow.reset(new HeatGlow(m_device, *m_heatField, PLATE, 1.0f));
+	m_heatGlow->SetViewMtxBuffer(m_cbView);
+	m_heatGlow->SetProjMtxBuffer(m_cbProj);
+	m_decals.reset(new DecalMap(768, 1024, PLATE.getSizeU(), PLATE.getSizeV()));
+	m_heatGlow->SetDecals(m_device, m_decals.get());
+	m_welding = false;
+	SetArc(false);
+	m_bead.reset(new BeadMesh(m_device, 0.016f, 0.006f, 0.01f));
+	InitializeRope();
+	InitializePlanner();
 
 	SetShaders();
 	SetConstantBuffers();
@@ -576,6 +673,37 @@ void Puma::DrawCyllinder()
 	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 }
 
+void Puma::DrawBead()
+{
+	const XMMATRIX worldMtx = XMMatrixIdentity();
+	m_cbWorld->Update(m_context, worldMtx);
+	m_bead->Render(m_context);
+}
+
+void Puma::DrawRope()
+{
+	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
+	const XMMATRIX worldMtx = XMMatrixIdentity();
+	m_cbWorld->Update(m_context, worldMtx);
+	ID3D11Buffer* b = m_vbRope.get();
+	m_context->IASetVertexBuffers(0, 1, &b, &VB_STRIDE, &VB_OFFSET);
+	m_context->Draw(m_rope->getPointCount(), 0);
+	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
+void Puma::DrawTransfer()
+{
+	if (m_transferPoints == 0)
+		return;
+	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINESTRIP);
+	const XMMATRIX worldMtx = XMMatrixIdentity();
+	m_cbWorld->Update(m_context, worldMtx);
+	ID3D11Buffer* b = m_vbTransfer.get();
+	m_context->IASetVertexBuffers(0, 1, &b, &VB_STRIDE, &VB_OFFSET);
+	m_context->Draw(m_transferPoints, 0);
+	m_context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+}
+
 void Puma::DrawMirroredWorld()
 {
 	//Setup render state for writing to the stencil buffer
@@ -613,6 +741,9 @@ void Puma::DrawMirroredWorld()
 	DrawPuma();
 	DrawCircle();
 	DrawCyllinder();
+	DrawBead();
+	DrawRope();
+	DrawTransfer();
 	m_context->RSSetState(NULL);
 
 	//Restore rendering state to it's original values
@@ -645,115 +776,745 @@ void Puma::inverse_kinematics(XMFLOAT3 pos, XMFLOAT3 normal, float &a1, float &a
 	
 	a5 = acosf(normal1.x);
 	a4 = atan2(normal1.z, normal1.y);
+
+	//The closed form is for the nominal geometry, a calibrated one is reached from there
+	if (m_calibrated)
+	{
+		float angles[PumaKinematics::JOINTS] = { a1, a2, a3, a4, a5 };
+		KinematicCalibration::RefineInverse(m_kinematics, m_torchTip, m_torchAxis, pos, normal, angles);
+		a1 = angles[0];
+		a2 = angles[1];
+		a3 = angles[2];
+		a4 = angles[3];
+		a5 = angles[4];
+	}
 }
 
 
-void Puma::UpdatePuma(float dt)
+void Puma::InitializeProgram()
 {
-	static float counter = 0;
-	static float lap = 0.0f;
-	lap += dt;
-	while (lap > LAP_TIME)
-		lap -= LAP_TIME;
-	float t = 2 * lap / LAP_TIME;
-	t *= XM_2PI;
-
+	//The torch on the last link, from the pose at the first point of the circle
 	XMFLOAT3 norm = XMFLOAT3(sqrtf(3) / 2.0f, 0.5f, 0.0f);
+	float angles[PumaKinematics::JOINTS];
+	inverse_kinematics(circleVertices[0].Pos, norm, angles[0], angles[1], angles[2], angles[3], angles[4]);
+	XMMATRIX matrices[PumaKinematics::LINKS];
+	XMVECTOR det;
+	m_kinematics.GetLinkMatrices(angles, matrices);
+	XMMATRIX link = XMMatrixInverse(&det, matrices[5]);
+	XMStoreFloat3(&m_torchTip, XMVector3TransformCoord(XMLoadFloat3(&circleVertices[0].Pos), link));
+	XMStoreFloat3(&m_torchAxis, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&norm), link)));
+	//The real robot's geometry replaces the nominal one, the torch included
+	KinematicModel model;
+	model.Kinematics = m_kinematics;
+	model.TorchTip = m_torchTip;
+	model.TorchAxis = m_torchAxis;
+	m_calibrated = KinematicCalibration::LoadModel(CalibrationFile, model);
+	if (m_calibrated)
+	{
+		m_kinematics = model.Kinematics;
+		m_torchTip = model.TorchTip;
+		m_torchAxis = model.TorchAxis;
+	}
+
+	m_program.SetLimits(MAX_JOINT_VELOCITY, MAX_JOINT_ACCELERATION);
+	m_program.SetKinematics([this](const XMFLOAT3& pos, const XMFLOAT3& normal, float* a)
+	{
+		inverse_kinematics(pos, normal, a[0], a[1], a[2], a[3], a[4]);
+	}, [this](const float* a, XMFLOAT3& pos, XMFLOAT3& normal)
+	{
+		GetTorch(a, pos, normal);
+	});
+	//Without a program the robot stays home
+	ifstream file(ProgramFile);
+	stringstream source;
+	source << file.rdbuf();
+	if (!m_program.Compile(source.str(), HOME_ANGLES))
+	{
+		string error = m_program.getError();
+		MessageBoxW(NULL, wstring(error.begin(), error.end()).c_str(), ProgramFile.c_str(), MB_OK);
+	}
+	m_programTime = 0.0f;
+	m_programSegment = 0;
+}
+
+void Puma::InitializeStream()
+{
+	m_streamAge = STREAM_TIMEOUT;
+	m_maxStreamLatency = 0.0;
+	//A replay takes its targets from the log
+	if (m_player)
+		return;
+	m_listener.reset(new TargetListener());
+	//Another instance may have the port, this one plays its program then
+	if (!m_listener->Start())
+		m_listener.reset();
+}
+
+void Puma::InitializeTelemetry()
+{
+	m_telemetryRecord = TelemetryRecord();
+	m_telemetry.reset(new TelemetryWriter());
+	//Another instance may be publishing already
+	if (!m_telemetry->Create())
+		m_telemetry.reset();
+}
+
+bool Puma::InitializeSession()
+{
+	m_seed = PARTICLES_SEED;
+	m_replaying = false;
+	m_divergedFrames = 0;
+	if (m_player)
+	{
+		if (!m_player->Open(m_sessionFile))
+		{
+			ofstream report(m_reportFile);
+			report << "# " << m_player->getError() << endl;
+			return false;
+		}
+		m_seed = m_player->getSeed();
+		m_replaying = true;
+	}
+	if (m_recorder && !m_recorder->Open(m_sessionFile, m_seed))
+	{
+		MessageBoxW(NULL, L"Cannot write the session log", m_sessionFile.c_str(), MB_OK);
+		m_recorder.reset();
+	}
+	return true;
+}
 
-	float a1, a2, a3, a4, a5;
-	XMFLOAT3 p = circleVertices[((int)counter) % 120].Pos;
-	counter += 0.1f;
-	m_particles.get()->m_emitterPos = p;
+void Puma::UpdatePuma(const SessionFrame& frame)
+{
+	float dt = frame.Dt;
+	//Torch moves give the torch pose, joint moves the angles; the program waits while targets are streamed
+	MotionTarget target;
+	if (ReceiveTargets(frame))
+	{
+		target.Joint = false;
+		target.Welding = (m_streamTarget.Flags & TargetMessage::WELDING) != 0;
+		target.Position = XMFLOAT3(m_streamTarget.Position[0], m_streamTarget.Position[1], m_streamTarget.Position[2]);
+		target.Normal = XMFLOAT3(m_streamTarget.Normal[0], m_streamTarget.Normal[1], m_streamTarget.Normal[2]);
+	}
+	else
+	{
+		m_programTime += dt;
+		while (m_program.getDuration() > 0.0f && m_programTime > m_program.getDuration())
+			m_programTime -= m_program.getDuration();
+		m_program.Evaluate(m_programTime, target, m_programSegment);
+	}
+	float angles[PumaKinematics::JOINTS];
+	XMFLOAT3 p = target.Position, norm = target.Normal;
+	if (target.Joint)
+	{
+		for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+			angles[i] = target.Angles[i];
+		GetTorch(angles, p, norm);
+	}
+	else
+		inverse_kinematics(p, norm, angles[0], angles[1], angles[2], angles[3], angles[4]);
+	if (target.Welding != m_welding)
+	{
+		SetArc(target.Welding);
+		if (!target.Welding)
+			m_bead->Break();
+	}
 	XMVECTOR rVec = XMLoadFloat3(&p) - XMLoadFloat3(&XMFLOAT3(circleCenter.x, circleCenter.y, 0.0f));
-	m_particles.get()->m_perpendicularToPlane = rVec;
-	m_particles.get()->m_startPosition = p;
-	inverse_kinematics(p, norm, a1, a2, a3, a4, a5);
-	//a1 = 0;
-	vector<VertexPosNormal> newVertices[6];
-	for (int i = 1; i < 6; i++)
+	XMFLOAT3 sparkDir[2];
+	XMStoreFloat3(&sparkDir[0], rVec);
+	XMStoreFloat3(&sparkDir[1], XMVector3Transform(rVec, XMMatrixScaling(1, 1, -1)));
+	for (unsigned int i = 0; i < 2; ++i)
+		m_particles->getEmitter(m_sparkEmitters[i]).Move(p, sparkDir[i]);
+	//Smoke leaves the weld away from the plate
+	m_particles->getEmitter(m_smokeEmitter).Move(p, norm);
+	m_trails->Push(m_torchTrail, p);
+	XMFLOAT2 weld = PLATE.ToPlate(p);
+	m_heatField->SetSource(weld, 0.03f, target.Welding ? 0.05f : 0.0f);
+	if (target.Welding)
+	{
+		//Splats cover the whole way from the previous frame, however far the torch jumped
+		XMFLOAT2 from = m_welding ? m_lastWeld : weld;
+		m_decals->Splat(BEAD_LAYER, from, weld, 0.012f, 1.0f);
+		m_decals->Splat(SCORCH_LAYER, from, weld, 0.05f, 1.5f * dt);
+		m_lastWeld = weld;
+		m_bead->AddPoint(p, norm);
+	}
+	m_welding = target.Welding;
+	if (m_jointSamples == 0)
+		for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+			m_servos->Reset(i, angles[i]);
+	UpdateJointTorques(angles, dt);
+	UpdateServos(angles, p, dt);
+	UpdateCollisions();
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+		m_telemetryRecord.Commanded[i] = angles[i];
+	m_telemetryRecord.TorchPosition[0] = p.x;
+	m_telemetryRecord.TorchPosition[1] = p.y;
+	m_telemetryRecord.TorchPosition[2] = p.z;
+	m_telemetryRecord.TorchNormal[0] = norm.x;
+	m_telemetryRecord.TorchNormal[1] = norm.y;
+	m_telemetryRecord.TorchNormal[2] = norm.z;
+}
+
+bool Puma::ReceiveTargets(const SessionFrame& frame)
+{
+	m_streamAge += frame.Dt;
+	if (frame.Target)
 	{
-		XMMATRIX tr;
-		switch (i)
+		for (unsigned int i = 0; i < 3; ++i)
 		{
-		case 1:
-			m_pumaMtx[i] = XMMatrixRotationY(a1);
-			break;
-		case 2:
-			m_pumaMtx[i] = XMMatrixTranslation(0, -0.27f, 0) * XMMatrixRotationZ(a2) * XMMatrixTranslation(0, 0.27f, 0) * XMMatrixRotationY(a1);
-			break;
-		case 3:
-			m_pumaMtx[i] = XMMatrixTranslation(0, -0.27f, 0) *XMMatrixTranslation(0.91f, 0, 0) * XMMatrixRotationZ(a3) *
-				XMMatrixTranslation(-0.91f, 0, 0)  * XMMatrixRotationZ(a2) *XMMatrixTranslation(0, 0.27f, 0) * XMMatrixRotationY(a1);
-			break;
-		case 4:
-			m_pumaMtx[i] = XMMatrixTranslation(0, -0.27f, 0) *
-				XMMatrixTranslation(0, 0, 0.26f) *XMMatrixRotationX(a4) * XMMatrixTranslation(0, 0, -0.26f) *XMMatrixTranslation(+0.91f, 0, 0)
-				*XMMatrixRotationZ(a3) * XMMatrixTranslation(-0.91f, 0, 0) *XMMatrixRotationZ(a2) *XMMatrixTranslation(0, 0.27f, 0) *
-				XMMatrixRotationY(a1);
-			break;
-		case 5:
-			m_pumaMtx[i] = XMMatrixTranslation(0, -0.27f, 0)* XMMatrixTranslation(1.72f, 0, 0) *XMMatrixRotationZ(a5) * XMMatrixTranslation(-1.72f, 0, 0) *
-				XMMatrixTranslation(0, 0, 0.26f) * XMMatrixRotationX(a4) *XMMatrixTranslation(0, 0, -0.26f) * XMMatrixTranslation(+0.91f, 0, 0) 
-				*	XMMatrixRotationZ(a3)* XMMatrixTranslation(-0.91f, 0, 0) *XMMatrixRotationZ(a2)* 
-				XMMatrixTranslation(0, 0.27f, 0) *XMMatrixRotationY(a1);
-			break;
+			m_streamTarget.Position[i] = frame.TargetPosition[i];
+			m_streamTarget.Normal[i] = frame.TargetNormal[i];
 		}
+		m_streamTarget.Flags = frame.TargetFlags;
+		m_streamAge = 0.0f;
 	}
+	return m_streamAge < STREAM_TIMEOUT;
+}
+
+void Puma::GetTorch(const float* angles, XMFLOAT3& pos, XMFLOAT3& normal) const
+{
+	XMMATRIX matrices[PumaKinematics::LINKS];
+	m_kinematics.GetLinkMatrices(angles, matrices);
+	XMStoreFloat3(&pos, XMVector3TransformCoord(XMLoadFloat3(&m_torchTip), matrices[5]));
+	XMStoreFloat3(&normal, XMVector3TransformNormal(XMLoadFloat3(&m_torchAxis), matrices[5]));
 }
 
-void Puma::UpdateInput()
+void Puma::SetArc(bool on)
 {
-	static KeyboardState state;
-	if (!m_keyboard->GetState(state))
+	//Sparks and smoke come only from a burning arc
+	unsigned int emitters[3] = { m_sparkEmitters[0], m_sparkEmitters[1], m_smokeEmitter };
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		ParticleEmitterDesc desc = m_particles->getEmitter(emitters[i]).getDesc();
+		desc.EmissionRate = on ? m_emissionRates[i] : 0.0f;
+		m_particles->getEmitter(emitters[i]).setDesc(desc);
+	}
+}
+
+void Puma::UpdateJointTorques(const float* angles, float dt)
+{
+	if (dt <= 0.0f)
+		return;
+	//Velocities and accelerations by differences over the last frames, the motor loads need both
+	float velocities[PumaKinematics::JOINTS], accelerations[PumaKinematics::JOINTS];
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+	{
+		float delta = angles[i] - m_jointAngles[i];
+		while (delta > XM_PI)
+			delta -= XM_2PI;
+		while (delta < -XM_PI)
+			delta += XM_2PI;
+		velocities[i] = m_jointSamples > 0 ? delta / dt : 0.0f;
+		accelerations[i] = m_jointSamples > 1 ? (velocities[i] - m_jointVelocities[i]) / dt : 0.0f;
+		m_jointAngles[i] = angles[i];
+		m_jointVelocities[i] = velocities[i];
+	}
+	m_jointSamples = m_jointSamples < 2 ? m_jointSamples + 1 : 2;
+	m_dynamics->Solve(angles, velocities, accelerations, m_jointTorques);
+}
+
+void Puma::InitializeServos()
+{
+	//Motors as seen from the joints, the base and shoulder carry the heaviest links
+	const float inertia[] = { 5.0f, 10.0f, 5.0f, 0.5f, 0.2f };
+	const float viscous[] = { 20.0f, 40.0f, 20.0f, 2.0f, 1.0f };
+	const float coulomb[] = { 20.0f, 50.0f, 20.0f, 2.0f, 1.0f };
+	const float maxTorque[] = { 1500.0f, 4000.0f, 1500.0f, 200.0f, 100.0f };
+	m_servos.reset(new ServoBank(PumaKinematics::JOINTS, *m_threads));
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+	{
+		m_servos->SetMotor(i, inertia[i], viscous[i], coulomb[i], maxTorque[i]);
+		m_servos->Tune(i, 150.0f);
+	}
+	m_maxTorchError = 0.0f;
+	m_reportTime = 0.0f;
+}
+
+void Puma::UpdateServos(const float* angles, const XMFLOAT3& torch, float dt)
+{
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+	{
+		m_servos->SetTarget(i, angles[i]);
+		m_servos->SetLoad(i, m_jointTorques[i]);
+	}
+	m_servos->Update(dt);
+	float actual[PumaKinematics::JOINTS];
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+		actual[i] = m_servos->getAngle(i);
+	m_kinematics.GetLinkMatrices(actual, m_pumaMtx);
+
+	//The torch tip moves with the last link, so its error is how far that link is off
+	XMMATRIX commanded[PumaKinematics::LINKS];
+	m_kinematics.GetLinkMatrices(angles, commanded);
+	XMVECTOR det, target = XMLoadFloat3(&torch);
+	XMVECTOR tip = XMVector3TransformCoord(target, XMMatrixInverse(&det, commanded[5]) * m_pumaMtx[5]);
+	float torchError = XMVectorGetX(XMVector3Length(tip - target));
+	m_maxTorchError = torchError > m_maxTorchError ? torchError : m_maxTorchError;
+	m_reportTime += dt;
+	if (m_reportTime < REPORT_TIME)
 		return;
-	float factor = 0.01f;
-	if (state.isKeyDown(DIK_W))
+	float jointError = 0.0f;
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+		jointError = m_servos->getMaxTrackingError(i) > jointError ? m_servos->getMaxTrackingError(i) : jointError;
+	wostringstream title;
+	title << L"PUMA - tracking error: torch " << fixed << setprecision(2) << 1000.0f * m_maxTorchError <<
+		L" mm, joints " << setprecision(3) << XMConvertToDegrees(jointError) << L" deg";
+	if (m_streamAge < STREAM_TIMEOUT)
+		title << L", stream latency " << setprecision(2) << 1000.0 * m_maxStreamLatency << L" ms";
+	m_maxStreamLatency = 0.0;
+	SetWindowTextW(getMainWindow()->getHandle(), title.str().c_str());
+	m_servos->ResetStats();
+	m_maxTorchError = 0.0f;
+	m_reportTime = 0.0f;
+}
+
+template<typename Obstacles>
+void Puma::AddCellObstacles(Obstacles& obstacles) const
+{
+	//Room walls, the same box as in InitializeRoom
+	obstacles.AddPlane(XMFLOAT3(0.0f, -1.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	obstacles.AddPlane(XMFLOAT3(0.0f, 10.0f, 0.0f), XMFLOAT3(0.0f, -1.0f, 0.0f));
+	obstacles.AddPlane(XMFLOAT3(-10.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 0.0f, 0.0f));
+	obstacles.AddPlane(XMFLOAT3(10.0f, 0.0f, 0.0f), XMFLOAT3(-1.0f, 0.0f, 0.0f));
+	obstacles.AddPlane(XMFLOAT3(0.0f, 0.0f, -10.0f), XMFLOAT3(0.0f, 0.0f, 1.0f));
+	obstacles.AddPlane(XMFLOAT3(0.0f, 0.0f, 10.0f), XMFLOAT3(0.0f, 0.0f, -1.0f));
+	//Plate from InitializePlane as a thin box, sparks are born on its surface
+	XMVECTOR plateU = XMLoadFloat3(&PLATE.EdgeU), plateV = XMLoadFloat3(&PLATE.EdgeV);
+	XMMATRIX platePose;
+	platePose.r[0] = XMVector3Normalize(plateU);
+	platePose.r[1] = XMVector3Normalize(plateV);
+	platePose.r[2] = XMVector3Cross(platePose.r[0], platePose.r[1]);
+	platePose.r[3] = XMVectorSetW(XMLoadFloat3(&PLATE.Origin) + 0.5f * (plateU + plateV), 1.0f);
+	obstacles.AddBox(XMFLOAT3(0.5f * PLATE.getSizeU(), 0.5f * PLATE.getSizeV(), 0.5f * PLATE_THICKNESS), platePose);
+	//Cylinder from InitializeCyllinder
+	obstacles.AddCylinder(CYLINDER_ENDS[0], CYLINDER_ENDS[1], circleRadius);
+}
+
+void Puma::InitializeCollisions()
+{
+	m_collisions.reset(new CollisionWorld(XMFLOAT3(-10.0f, -1.0f, -10.0f), XMFLOAT3(10.0f, 10.0f, 10.0f), 0.5f));
+	m_collisions->SetMaterial(0.4f, 0.3f);
+	AddCellObstacles(*m_collisions);
+	//Bounding boxes of the links, posed by m_pumaMtx every frame
+	for (int i = 0; i < 6; i++)
+	{
+		XMVECTOR min = XMLoadFloat3(&vertexes[i][0]), max = min;
+		for (unsigned int j = 1; j < vertexes[i].size(); j++)
+		{
+			min = XMVectorMin(min, XMLoadFloat3(&vertexes[i][j]));
+			max = XMVectorMax(max, XMLoadFloat3(&vertexes[i][j]));
+		}
+		XMFLOAT3 halfSize;
+		XMStoreFloat3(&m_linkCenters[i], 0.5f * (min + max));
+		XMStoreFloat3(&halfSize, 0.5f * (max - min));
+		m_linkBoxes[i] = m_collisions->AddBox(halfSize,
+			XMMatrixTranslation(m_linkCenters[i].x, m_linkCenters[i].y, m_linkCenters[i].z) * m_pumaMtx[i]);
+	}
+	m_collisions->Build();
+	m_particles->SetCollisionWorld(m_collisions);
+}
+
+void Puma::UpdateCollisions()
+{
+	for (int i = 0; i < 6; i++)
+		m_collisions->SetBoxPose(m_linkBoxes[i],
+			XMMatrixTranslation(m_linkCenters[i].x, m_linkCenters[i].y, m_linkCenters[i].z) * m_pumaMtx[i]);
+	m_collisions->Build();
+}
+
+void Puma::InitializeRope()
+{
+	//The cable runs from the top of the upper arm to the top of the wrist, the links between are obstacles
+	for (int i = 2; i < 6; i += 3)
+	{
+		float top = vertexes[i][0].y;
+		for (unsigned int j = 1; j < vertexes[i].size(); j++)
+			top = vertexes[i][j].y > top ? vertexes[i][j].y : top;
+		m_ropeMounts[i / 3] = XMFLOAT3(m_linkCenters[i].x, top, m_linkCenters[i].z);
+	}
+	XMVECTOR span = XMVector3Transform(XMLoadFloat3(&m_ropeMounts[1]), m_pumaMtx[5]) -
+		XMVector3Transform(XMLoadFloat3(&m_ropeMounts[0]), m_pumaMtx[2]);
+	m_rope.reset(new Rope(200, 1.5f * XMVectorGetX(XMVector3Length(span)), 0.02f, *m_threads));
+	m_rope->SetFloor(-1.0f);
+	for (int i = 0; i < 6; i++)
+	{
+		if (i == 2 || i == 5)
+			continue;
+		XMVECTOR min = XMLoadFloat3(&vertexes[i][0]), max = min;
+		for (unsigned int j = 1; j < vertexes[i].size(); j++)
+		{
+			min = XMVectorMin(min, XMLoadFloat3(&vertexes[i][j]));
+			max = XMVectorMax(max, XMLoadFloat3(&vertexes[i][j]));
+		}
+		XMFLOAT3 halfSize;
+		XMStoreFloat3(&halfSize, 0.5f * (max - min));
+		m_ropeBoxes[i] = m_rope->AddBox(halfSize,
+			XMMatrixTranslation(m_linkCenters[i].x, m_linkCenters[i].y, m_linkCenters[i].z) * m_pumaMtx[i]);
+	}
+	m_vbRope = m_device.CreateVertexBuffer<VertexPosNormal>(m_rope->getPointCount(), D3D11_USAGE_DYNAMIC);
+}
+
+void Puma::UpdateRope(float dt)
+{
+	for (int i = 0; i < 6; i++)
+		if (i != 2 && i != 5)
+			m_rope->SetBoxPose(m_ropeBoxes[i],
+				XMMatrixTranslation(m_linkCenters[i].x, m_linkCenters[i].y, m_linkCenters[i].z) * m_pumaMtx[i]);
+	XMFLOAT3 ends[2];
+	XMStoreFloat3(&ends[0], XMVector3Transform(XMLoadFloat3(&m_ropeMounts[0]), m_pumaMtx[2]));
+	XMStoreFloat3(&ends[1], XMVector3Transform(XMLoadFloat3(&m_ropeMounts[1]), m_pumaMtx[5]));
+	m_rope->Attach(ends[0], ends[1]);
+	m_rope->Update(dt);
+
+	D3D11_MAPPED_SUBRESOURCE resource;
+	HRESULT hr = m_context->Map(m_vbRope.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
+	if (FAILED(hr))
+		THROW_DX11(hr);
+	VertexPosNormal* vertices = reinterpret_cast<VertexPosNormal*>(resource.pData);
+	for (unsigned int i = 0; i < m_rope->getPointCount(); ++i)
+	{
+		vertices[i].Pos = m_rope->getPoint(i);
+		vertices[i].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	}
+	m_context->Unmap(m_vbRope.get(), 0);
+}
+
+void Puma::InitializePlanner()
+{
+	//Moving links against the cell, the base stands on the floor and never moves
+	m_armCollision.reset(new ArmCollision(m_kinematics, 0.03f));
+	for (int i = 1; i < 6; i++)
+		m_armCollision->AddLink(i, &vertices[i][0], &indices[i][0], pumaIndicesCount[i]);
+	AddCellObstacles(*m_armCollision);
+	m_planner.reset(new PathPlanner(*m_armCollision, *m_threads));
+	//The same cell sampled over the reach of the arm
+	m_distanceField.reset(new DistanceField(XMFLOAT3(-2.5f, -1.2f, -2.5f), XMFLOAT3(2.5f, 2.6f, 2.5f), 0.05f));
+	AddCellObstacles(*m_distanceField);
+	m_distanceField->Build(*m_threads);
+	m_optimizer.reset(new TrajectoryOptimizer(m_kinematics, *m_distanceField, *m_threads));
+	for (int i = 1; i < 6; i++)
+		m_optimizer->AddLink(i, &vertices[i][0], static_cast<unsigned int>(vertices[i].size()), 0.1f);
+	//Half a turn either way from the zero pose
+	float lower[PumaKinematics::JOINTS], upper[PumaKinematics::JOINTS];
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+	{
+		lower[i] = -XM_PI;
+		upper[i] = XM_PI;
+	}
+	m_planner->SetLimits(lower, upper);
+	m_optimizer->SetLimits(lower, upper);
+
+	//Torch above the first point of the weld, pointing at the plate
+	XMFLOAT3 norm = XMFLOAT3(sqrtf(3) / 2.0f, 0.5f, 0.0f);
+	XMFLOAT3 approach = circleVertices[0].Pos;
+	approach = XMFLOAT3(approach.x + APPROACH_DISTANCE * norm.x, approach.y + APPROACH_DISTANCE * norm.y,
+		approach.z + APPROACH_DISTANCE * norm.z);
+	float goal[PumaKinematics::JOINTS];
+	inverse_kinematics(approach, norm, goal[0], goal[1], goal[2], goal[3], goal[4]);
+	m_transferPoints = 0;
+	if (!m_planner->Plan(HOME_ANGLES, goal, m_transferPath))
+		return;
+	m_planner->Shortcut(m_transferPath, 100);
+	//Smoothed and pushed away from the obstacles, the distance field is coarse so the result is checked again
+	vector<float> trajectory;
+	TrajectoryOptimizer::Resample(m_transferPath, TRANSFER_WAYPOINTS, trajectory);
+	m_optimizer->Optimize(trajectory, 300);
+	bool clear = true;
+	for (unsigned int w = 0; clear && w + 1 < TRANSFER_WAYPOINTS; ++w)
+		clear = m_planner->FreeFraction(&trajectory[w * PumaKinematics::JOINTS],
+			&trajectory[(w + 1) * PumaKinematics::JOINTS]) == 1.0f;
+	if (clear)
+		m_transferPath.swap(trajectory);
+
+	//The tip is where the torch points to at the goal, it moves with the last link
+	XMMATRIX matrices[PumaKinematics::LINKS];
+	XMVECTOR det;
+	m_kinematics.GetLinkMatrices(goal, matrices);
+	XMVECTOR tip = XMVector3TransformCoord(XMLoadFloat3(&approach), XMMatrixInverse(&det, matrices[5]));
+	vector<VertexPosNormal> trace;
+	unsigned int waypoints = static_cast<unsigned int>(m_transferPath.size()) / PumaKinematics::JOINTS;
+	for (unsigned int w = 0; w + 1 < waypoints; ++w)
+	{
+		const float* from = &m_transferPath[w * PumaKinematics::JOINTS];
+		const float* to = from + PumaKinematics::JOINTS;
+		float move = 0.0f;
+		for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+			move = fabs(to[j] - from[j]) > move ? fabs(to[j] - from[j]) : move;
+		unsigned int steps = static_cast<unsigned int>(ceil(move / 0.02f));
+		steps = steps < 1 ? 1 : steps;
+		for (unsigned int s = w == 0 ? 0 : 1; s <= steps; ++s)
+		{
+			float angles[PumaKinematics::JOINTS];
+			for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+				angles[j] = from[j] + (to[j] - from[j]) * s / steps;
+			m_kinematics.GetLinkMatrices(angles, matrices);
+			VertexPosNormal v;
+			XMStoreFloat3(&v.Pos, XMVector3TransformCoord(tip, matrices[5]));
+			v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			trace.push_back(v);
+		}
+	}
+	m_vbTransfer = m_device.CreateVertexBuffer(trace);
+	m_transferPoints = static_cast<unsigned int>(trace.size());
+}
+
+bool Puma::ReadInput(float dt, SessionFrame& frame)
+{
+	frame = SessionFrame();
+	frame.Dt = dt;
+	KeyboardState keys;
+	if (m_keyboard->GetState(keys))
+		for (unsigned int i = 0; i < SESSION_KEY_COUNT; ++i)
+			if (keys.isKeyDown(SESSION_KEYS[i]))
+				frame.Keys |= 1 << i;
+	static MouseState prevState;
+	MouseState currentState;
+	if (!m_mouse->GetState(currentState))
+		return false;
+	if (prevState.isButtonDown(0))
+	{
+		POINT d = currentState.getMousePositionChange();
+		frame.MouseX = d.x;
+		frame.MouseY = d.y;
+	}
+	prevState = currentState;
+	if (!m_listener)
+		return true;
+	//Only the newest target counts, the ones before it are late already
+	for (const TargetSample* sample = m_listener->Front(); sample; sample = m_listener->Front())
+	{
+		frame.Target = true;
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			frame.TargetPosition[i] = sample->Message.Position[i];
+			frame.TargetNormal[i] = sample->Message.Normal[i];
+		}
+		frame.TargetFlags = sample->Message.Flags;
+		double latency = TargetListener::Now() - sample->Message.Time;
+		m_maxStreamLatency = latency > m_maxStreamLatency ? latency : m_maxStreamLatency;
+		m_listener->Pop();
+	}
+	return true;
+}
+
+bool Puma::isKeyDown(const SessionFrame& frame, BYTE key)
+{
+	for (unsigned int i = 0; i < SESSION_KEY_COUNT; ++i)
+		if (SESSION_KEYS[i] == key)
+			return (frame.Keys & (1 << i)) != 0;
+	return false;
+}
+
+void Puma::UpdateInput(const SessionFrame& frame)
+{
+	if (frame.MouseX != 0 || frame.MouseY != 0)
+		m_camera.Rotate(frame.MouseX / 300.f, frame.MouseY / 300.f);
+	if (isKeyDown(frame, DIK_W))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(m_camera.camTarget));
 	}
-	if (state.isKeyDown(DIK_S))
+	if (isKeyDown(frame, DIK_S))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(-m_camera.camTarget));
 	}
-	if (state.isKeyDown(DIK_A))
+	if (isKeyDown(frame, DIK_A))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(XMVector3Cross(XMVector3Normalize(m_camera.camTarget), m_camera.camUp)));
 	}
-	if (state.isKeyDown(DIK_D))
+	if (isKeyDown(frame, DIK_D))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(XMVector3Cross(m_camera.camUp, XMVector3Normalize(m_camera.camTarget))));
 	}
-	if (state.isKeyDown(DIK_Z))
+	if (isKeyDown(frame, DIK_Z))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(m_camera.camUp));
 	}
-	if (state.isKeyDown(DIK_X))
+	if (isKeyDown(frame, DIK_X))
 	{
 		m_camera.UpdatePosition(XMVector3Normalize(-m_camera.camUp));
 	}
+	//Saves the plate temperatures and marks once per key press
+	static bool exported = false;
+	if (isKeyDown(frame, DIK_H))
+	{
+		if (!exported)
+		{
+			m_heatField->Export(L"heat.pfm");
+			m_decals->Export(L"decals.pfm");
+		}
+		exported = true;
+	}
+	else
+		exported = false;
 }
 
 void Puma::Update(float dt)
 {
-	UpdateInput();
-	static MouseState prevState;
-	MouseState currentState;
-	if (!m_mouse->GetState(currentState))
+	if (!m_jointLogFile.empty())
+	{
+		CompareJointLog();
 		return;
-	bool change = true;
-	if (prevState.isButtonDown(0))
+	}
+	if (!m_calibrationSamplesFile.empty())
 	{
-		POINT d = currentState.getMousePositionChange();
-		m_camera.Rotate(d.x / 300.f, d.y / 300.f);
+		CalibrateKinematics();
+		return;
 	}
-	else
-		change = false;
-	prevState = currentState;
-	//if (change)
-		UpdateCamera(m_camera.GetViewMatrix());
-	UpdatePuma(dt);
+	//Everything from outside comes in through the frame, so that a replay of it steps the same way
+	SessionFrame frame;
+	unsigned int recorded = 0;
+	if (m_player)
+	{
+		if (!m_replaying)
+			return;
+		if (!m_player->Next(frame, recorded))
+		{
+			FinishReplay();
+			return;
+		}
+		dt = frame.Dt;
+	}
+	else if (!ReadInput(dt, frame))
+		return;
+	UpdateInput(frame);
+	UpdateCamera(m_camera.GetViewMatrix());
+	double start = TargetListener::Now();
+	UpdatePuma(frame);
+	start = EndStage(ROBOT_STAGE, start);
+	UpdateRope(dt);
+	start = EndStage(ROPE_STAGE, start);
 
 	m_particles->Update(m_context, dt, m_camera.GetPosition());
+	start = EndStage(PARTICLES_STAGE, start);
+	m_trails->Update(m_context, dt, m_camera.GetPosition());
+	start = EndStage(TRAILS_STAGE, start);
+	m_heatField->Update(dt);
+	start = EndStage(HEAT_STAGE, start);
+	m_heatGlow->Update(m_context);
+	start = EndStage(GLOW_STAGE, start);
+	m_bead->Update(m_context);
+	EndStage(BEAD_STAGE, start);
+	PublishTelemetry();
+	if (m_recorder)
+		m_recorder->Record(frame, SessionRecorder::Checksum(m_telemetryRecord));
+	if (m_player)
+	{
+		m_replayTiming.Add(m_telemetryRecord.StageTimes);
+		if (SessionRecorder::Checksum(m_telemetryRecord) != recorded && m_divergedFrames++ == 0)
+			m_firstDiverged = m_player->getFrameCount();
+	}
+}
+
+void Puma::FinishReplay()
+{
+	m_replaying = false;
+	ofstream report(m_reportFile);
+	m_replayTiming.Write(report);
+	int exitCode = 0;
+	if (!m_player->getError().empty())
+		report << "# " << m_player->getError() << endl;
+	if (m_divergedFrames > 0)
+	{
+		report << "# state differs from the recording in " << m_divergedFrames << " frames, the first is frame " <<
+			m_firstDiverged << endl;
+		exitCode = 1;
+	}
+	ifstream baseline(m_baselineFile);
+	if (!baseline)
+		report << "# no baseline" << endl;
+	else if (!m_replayTiming.Compare(baseline, ReplayTiming::DEFAULT_TOLERANCE, report))
+		exitCode = 1;
+	PostQuitMessage(exitCode);
+}
+
+void Puma::CompareJointLog()
+{
+	//The program and the torch on the last link as the simulator plays them
+	TwinComparison twin(m_program, [this](const float* a, XMFLOAT3& pos, XMFLOAT3& normal)
+	{
+		GetTorch(a, pos, normal);
+	}, [this](const XMFLOAT3& pos, const XMFLOAT3& normal, float* a)
+	{
+		inverse_kinematics(pos, normal, a[0], a[1], a[2], a[3], a[4]);
+	});
+	JointLog log(*m_threads);
+	ofstream report(m_reportFile);
+	double start = TargetListener::Now();
+	if (!log.Open(m_jointLogFile) || !twin.Compare(log))
+	{
+		report << "# " << log.getError() << endl;
+		PostQuitMessage(1);
+	}
+	else
+	{
+		double seconds = TargetListener::Now() - start;
+		twin.Write(report);
+		report << "# " << log.getSampleCount() << " samples, " << log.getSkippedCount() << " lines skipped, " <<
+			fixed << setprecision(0) << log.getSize() / seconds / 1e6 << " MB/s" << endl;
+		PostQuitMessage(0);
+	}
+	m_jointLogFile.clear();
+}
+
+void Puma::CalibrateKinematics()
+{
+	//Fitted from the geometry in use, the last calibration if there is one
+	KinematicModel model;
+	model.Kinematics = m_kinematics;
+	model.TorchTip = m_torchTip;
+	model.TorchAxis = m_torchAxis;
+	KinematicCalibration calibration(*m_threads);
+	calibration.SetModel(model);
+	ofstream report(m_reportFile);
+	double start = TargetListener::Now();
+	if (!calibration.LoadSamples(m_calibrationSamplesFile) || !calibration.Fit())
+	{
+		report << "# " << calibration.getError() << endl;
+		PostQuitMessage(1);
+	}
+	else
+	{
+		double seconds = TargetListener::Now() - start;
+		float positionBefore, directionBefore, positionAfter, directionAfter;
+		calibration.GetErrors(positionBefore, directionBefore, positionAfter, directionAfter);
+		report << setw(10) << "" << setw(11) << "pos rms" << setw(11) << "dir rms" << endl;
+		report << setw(10) << "" << setw(11) << "[mm]" << setw(11) << "[deg]" << endl;
+		report << fixed << setprecision(3);
+		report << setw(10) << "before" << setw(11) << 1000.0f * positionBefore << setw(11) <<
+			XMConvertToDegrees(directionBefore) << endl;
+		report << setw(10) << "after" << setw(11) << 1000.0f * positionAfter << setw(11) <<
+			XMConvertToDegrees(directionAfter) << endl;
+		report << "# " << calibration.getSampleCount() << " samples, " << calibration.getIterations() <<
+			" iterations, " << setprecision(0) << 1000.0 * seconds << " ms" << endl;
+		if (KinematicCalibration::SaveModel(CalibrationFile, calibration.getModel()))
+			PostQuitMessage(0);
+		else
+		{
+			report << "# cannot write the calibration" << endl;
+			PostQuitMessage(1);
+		}
+	}
+	m_calibrationSamplesFile.clear();
+}
+
+double Puma::EndStage(TelemetryStage stage, double start)
+{
+	double now = TargetListener::Now();
+	m_telemetryRecord.StageTimes[stage] = static_cast<float>(now - start);
+	return now;
+}
+
+void Puma::PublishTelemetry()
+{
+	m_telemetryRecord.Particles = m_particles->getParticleCount();
+	m_telemetryRecord.Time = TargetListener::Now();
+	for (unsigned int i = 0; i < PumaKinematics::JOINTS; ++i)
+		m_telemetryRecord.Angles[i] = m_servos->getAngle(i);
+	for (unsigned int i = 0; i < PumaKinematics::LINKS; ++i)
+		XMStoreFloat4x4(reinterpret_cast<XMFLOAT4X4*>(m_telemetryRecord.Links[i]), m_pumaMtx[i]);
+	if (m_telemetry)
+		m_telemetry->Publish(m_telemetryRecord);
+	++m_telemetryRecord.Step;
 }
 
 XMFLOAT3 Puma::ComputeNormalVectorForTriangle(int elementNumber, int triangle)
@@ -997,12 +1758,16 @@ void Puma::DrawScene(bool mirrored)
 	DrawPuma();
 	DrawCircle();
 	DrawCyllinder();
+	DrawBead();
+	DrawRope();
+	DrawTransfer();
 }
 
 
 void Puma::Render()
 {
-	if (m_context == nullptr)
+	//Replays and log comparisons draw nothing
+	if (m_context == nullptr || m_headless)
 		return;
 
 	/*float clearColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -1027,7 +1792,6 @@ void Puma::Render()
 	//m_phongEffect->Begin(m_context);
 	//DrawScene(false);
 	//m_phongEffect->End();
-	////m_particles->Render(m_context, XMFLOAT3());
 	//m_lightShadowEffect->EndShadow();
 	//
 	//ResetRenderTarget();
@@ -1042,11 +1806,17 @@ void Puma::Render()
 	DrawScene(true);
 	//m_lightShadowEffect->End();
 
-	//m_context->OMSetBlendState(m_bsAlpha.get(), nullptr, BS_MASK);
-	//m_context->OMSetDepthStencilState(m_dssNoWrite.get(), 0);
-	//m_particles->Render(m_context, XMFLOAT3());
-	//m_context->OMSetDepthStencilState(nullptr, 0);
-	//m_context->OMSetBlendState(nullptr, nullptr, BS_MASK);
+	//Transparent passes after the opaque geometry, blended over it without writing depth
+	m_context->OMSetBlendState(m_bsAlpha.get(), nullptr, BS_MASK);
+	m_context->OMSetDepthStencilState(m_dssNoWrite.get(), 0);
+	m_heatGlow->Render(m_context);
+	m_particles->Render(m_context);
+	m_trails->Render(m_context);
+	m_context->OMSetDepthStencilState(nullptr, 0);
+	m_context->OMSetBlendState(nullptr, nullptr, BS_MASK);
+	//The scene is drawn next frame with its shaders and buffers bound once
+	SetShaders();
+	SetConstantBuffers();
 
 	m_swapChain->Present(0, 0);
 }
\ No newline at end of file
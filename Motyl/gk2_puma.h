@@ -10,6 +10,23 @@
 #include "gk2_phongEffect.h"
 
 #include "gk2_particles.h"
+#include "gk2_trails.h"
+#include "gk2_heatGlow.h"
+#include "gk2_beadMesh.h"
+#include "gk2_rope.h"
+#include "gk2_pumaKinematics.h"
+#include "gk2_inverseDynamics.h"
+#include "gk2_servoBank.h"
+#include "gk2_armCollision.h"
+#include "gk2_pathPlanner.h"
+#include "gk2_distanceField.h"
+#include "gk2_trajectoryOptimizer.h"
+#include "gk2_motionProgram.h"
+#include "gk2_targetStream.h"
+#include "gk2_telemetry.h"
+#include "gk2_sessionLog.h"
+#include "gk2_twinComparison.h"
+#include "gk2_kinematicCalibration.h"
 
 using namespace std;
 namespace gk2
@@ -21,6 +38,20 @@ namespace gk2
 		virtual ~Puma();
 		static void* operator new(size_t size);
 		static void operator delete(void* ptr);
+
+		//Before Run: records the frame inputs of the session to a log
+		void RecordSession(const std::wstring& file);
+		//Before Run: replays a session log instead of taking input, drawing nothing, then writes the times of
+		//the update stages to report, compares them with baseline if there is one and quits, with 1 if the
+		//replay was slower or did not reach the recorded states
+		void ReplaySession(const std::wstring& file, const std::wstring& report, const std::wstring& baseline);
+		//Before Run: compares a joint log of the real robot with the program instead of running, writes the
+		//deviations per segment to report and quits, with 1 if the log cannot be read
+		void CompareLog(const std::wstring& log, const std::wstring& report);
+		//Before Run: fits the robot's geometry to torch poses measured on the real robot instead of running,
+		//saves it for the next runs, writes the errors before and after to report and quits, with 1 if the
+		//samples cannot be read or fitted
+		void Calibrate(const std::wstring& samples, const std::wstring& report);
 	protected:
 		virtual bool LoadContent();
 		virtual void UnloadContent();
@@ -32,7 +63,21 @@ namespace gk2
 		static const unsigned int VB_OFFSET;
 		static const unsigned int BS_MASK;
 
-		static const float LAP_TIME;
+		static const unsigned int PARTICLES_SEED;
+		static const unsigned int TRAIL_POINTS;	//history length of the torch trail
+		static const gk2::PlateFrame PLATE;		//weld plate, as built by InitializePlane
+		static const float PLATE_THICKNESS;		//of the plate as an obstacle
+		static const XMFLOAT3 CYLINDER_ENDS[2];	//axis of the cylinder built by InitializeCyllinder
+		static const float LINK_DENSITY;		//kg per cubic unit of the link meshes, a hollow casting
+		static const float REPORT_TIME;			//seconds between tracking error reports in the title bar
+		static const float HOME_ANGLES[gk2::PumaKinematics::JOINTS];		//rest pose, clear of the cell
+		static const float APPROACH_DISTANCE;	//torch distance from the plate before the weld starts
+		static const unsigned int TRANSFER_WAYPOINTS;	//of the optimized transfer
+		static const float MAX_JOINT_VELOCITY[gk2::PumaKinematics::JOINTS];		//radians per second
+		static const float MAX_JOINT_ACCELERATION[gk2::PumaKinematics::JOINTS];
+		static const float STREAM_TIMEOUT;		//seconds without streamed targets before the program takes over
+		static const unsigned int SESSION_KEY_COUNT = 7;
+		static const BYTE SESSION_KEYS[SESSION_KEY_COUNT];		//keys UpdateInput watches, in SessionFrame::Keys order
 
 		gk2::Camera m_camera;
 
@@ -108,11 +153,91 @@ namespace gk2
 		std::shared_ptr<ID3D11Buffer> m_cbSurfaceColor;
 		std::shared_ptr<ID3D11InputLayout> m_layout;
 
-
+		//Worker threads shared by the CPU-side simulations
+		std::shared_ptr<gk2::ThreadPool> m_threads;
 		std::shared_ptr<gk2::ParticleSystem> m_particles;
+		//Sparks flying to both sides of the plate
+		unsigned int m_sparkEmitters[2];
+		//Weld smoke rising from the plate
+		unsigned int m_smokeEmitter;
+		//Ribbon following the torch tip and streaks behind the sparks
+		std::shared_ptr<gk2::TrailSystem> m_trails;
+		unsigned int m_torchTrail;
+		//Heat spreading from the weld over the plate and its glow
+		std::shared_ptr<gk2::HeatField> m_heatField;
+		std::shared_ptr<gk2::HeatGlow> m_heatGlow;
+		//Weld bead and scorch marks left along the torch path
+		std::shared_ptr<gk2::DecalMap> m_decals;
+		XMFLOAT2 m_lastWeld;		//plate coordinates of the previous splat
+		bool m_welding;
+		//Weld bead laid along the torch path as geometry
+		std::shared_ptr<gk2::BeadMesh> m_bead;
+		//Room, plate, cylinder and robot links for the sparks to bounce off
+		std::shared_ptr<gk2::CollisionWorld> m_collisions;
+		unsigned int m_linkBoxes[6];
+		XMFLOAT3 m_linkCenters[6];		//centers of the links' bounding boxes in mesh coordinates
+		//Welding cable hanging from the arm to the torch, kept out of the other links
+		std::shared_ptr<gk2::Rope> m_rope;
+		std::shared_ptr<ID3D11Buffer> m_vbRope;
+		unsigned int m_ropeBoxes[6];
+		XMFLOAT3 m_ropeMounts[2];		//ends of the cable in mesh coordinates of links 2 and 5
+		//Joint geometry behind m_pumaMtx and the motor loads along the path, calibrated to the real robot
+		//if there is a calibration
+		gk2::PumaKinematics m_kinematics;
+		bool m_calibrated;
+		std::shared_ptr<gk2::InverseDynamics> m_dynamics;
+		float m_jointAngles[gk2::PumaKinematics::JOINTS];
+		float m_jointVelocities[gk2::PumaKinematics::JOINTS];
+		float m_jointTorques[gk2::PumaKinematics::JOINTS];
+		unsigned int m_jointSamples;		//frames of joint angles seen, up to the two differences need
+		//Joint motors following the IK angles, m_pumaMtx shows where they actually are
+		std::shared_ptr<gk2::ServoBank> m_servos;
+		float m_maxTorchError;			//since the last report
+		float m_reportTime;
+		//Collision-free transfer from the home pose to above the start of the weld, drawn as the torch tip's path
+		std::shared_ptr<gk2::ArmCollision> m_armCollision;
+		std::shared_ptr<gk2::PathPlanner> m_planner;
+		//Distances to the cell for smoothing the planned transfer away from the obstacles
+		std::shared_ptr<gk2::DistanceField> m_distanceField;
+		std::shared_ptr<gk2::TrajectoryOptimizer> m_optimizer;
+		std::vector<float> m_transferPath;		//waypoints, JOINTS angles each
+		std::shared_ptr<ID3D11Buffer> m_vbTransfer;
+		unsigned int m_transferPoints;
+		//Welding program played over and over, the torch tip is at m_torchTip on the last link and points
+		//back along m_torchAxis
+		gk2::MotionProgram m_program;
+		float m_programTime;
+		unsigned int m_programSegment;
+		XMFLOAT3 m_torchTip;
+		XMFLOAT3 m_torchAxis;
+		float m_emissionRates[3];		//of both spark emitters and the smoke with the arc on
+		//Targets streamed by the cell controller, they drive the torch instead of the program while they come
+		std::shared_ptr<gk2::TargetListener> m_listener;
+		gk2::TargetMessage m_streamTarget;
+		float m_streamAge;				//seconds since the last target
+		double m_maxStreamLatency;		//from sending to use, since the last report
+		//State of every step in shared memory for tools outside, filled in as the step goes
+		std::shared_ptr<gk2::TelemetryWriter> m_telemetry;
+		gk2::TelemetryRecord m_telemetryRecord;
+		//Frame inputs logged for a replay, or taken from one instead of the devices and the stream
+		unsigned int m_seed;			//of the particle emitters
+		std::wstring m_sessionFile;
+		std::wstring m_reportFile;
+		std::wstring m_baselineFile;
+		std::shared_ptr<gk2::SessionRecorder> m_recorder;
+		std::shared_ptr<gk2::SessionPlayer> m_player;
+		gk2::ReplayTiming m_replayTiming;
+		bool m_replaying;
+		bool m_headless;				//nothing is drawn, the window stays hidden
+		std::wstring m_jointLogFile;	//compared once the content is loaded
+		std::wstring m_calibrationSamplesFile;	//fitted once the content is loaded
+		unsigned int m_divergedFrames;	//whose state differs from the recording
+		unsigned int m_firstDiverged;
 
 		static const std::wstring ShaderFile;
 		static const std::wstring PumaFiles[6];
+		static const std::wstring ProgramFile;
+		static const std::wstring CalibrationFile;
 
 		void InitializeShaders();
 		void InitializeConstantBuffers();
@@ -125,11 +250,42 @@ namespace gk2
 		void InitializePuma();
 		void InitializeCircle();
 		void InitializeCyllinder();
+		void InitializeCollisions();
+		//Adds the room walls, the plate and the cylinder to obstacles, so that sparks, the planner and the
+		//optimizer see the same cell
+		template<typename Obstacles> void AddCellObstacles(Obstacles& obstacles) const;
+		void InitializeRope();
+		void InitializeServos();
+		void InitializePlanner();
+		void InitializeProgram();
+		void InitializeStream();
+		void InitializeTelemetry();
+		//Opens the session log, false if the one to replay cannot be read
+		bool InitializeSession();
 
 
 		void UpdateCamera(const XMMATRIX& view);
-		void UpdatePuma(float dt);
-		void UpdateInput();
+		void UpdatePuma(const gk2::SessionFrame& frame);
+		//Takes the frame's target if it has one, true while streamed targets drive the torch
+		bool ReceiveTargets(const gk2::SessionFrame& frame);
+		//Stores the time since start as the stage's and returns the time now
+		double EndStage(gk2::TelemetryStage stage, double start);
+		void PublishTelemetry();
+		void UpdateCollisions();
+		void UpdateJointTorques(const float* angles, float dt);
+		void UpdateServos(const float* angles, const XMFLOAT3& torch, float dt);
+		void UpdateRope(float dt);
+		//Fills the frame from the input devices and the target stream, false if the mouse is lost
+		bool ReadInput(float dt, gk2::SessionFrame& frame);
+		void UpdateInput(const gk2::SessionFrame& frame);
+		static bool isKeyDown(const gk2::SessionFrame& frame, BYTE key);
+		//Writes the replay's report and quits
+		void FinishReplay();
+		void CompareJointLog();
+		void CalibrateKinematics();
+		//Torch tip and direction at the joint angles
+		void GetTorch(const float* angles, XMFLOAT3& pos, XMFLOAT3& normal) const;
+		void SetArc(bool on);
 
 		void SetShaders();
 		void SetConstantBuffers();
@@ -143,6 +299,9 @@ namespace gk2
 		void DrawShadowVolumes();
 		void DrawCircle();
 		void DrawCyllinder();
+		void DrawBead();
+		void DrawRope();
+		void DrawTransfer();
 		void DrawMirroredWorld();
 
 		void ComputeShadowVolume();
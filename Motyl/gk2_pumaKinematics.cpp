@@ -0,0 +1,36 @@
+#include "gk2_pumaKinematics.h"
+
+using namespace gk2;
+
+PumaKinematics::PumaKinematics()
+{
+	m_points[0] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	m_axes[0] = XMFLOAT3(0.0f, 1.0f, 0.0f);
+	for (unsigned int i = 0; i < LINKS; ++i)
+		m_zeros[i] = 0.0f;
+	SetJoint(1, XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 1.0f, 0.0f));
+	SetJoint(2, XMFLOAT3(0.0f, 0.27f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f));
+	SetJoint(3, XMFLOAT3(-0.91f, 0.27f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f));
+	SetJoint(4, XMFLOAT3(0.0f, 0.27f, -0.26f), XMFLOAT3(1.0f, 0.0f, 0.0f));
+	SetJoint(5, XMFLOAT3(-1.72f, 0.27f, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f));
+}
+
+void PumaKinematics::SetJoint(unsigned int joint, const XMFLOAT3& point, const XMFLOAT3& axis)
+{
+	m_points[joint] = point;
+	XMStoreFloat3(&m_axes[joint], XMVector3Normalize(XMLoadFloat3(&axis)));
+}
+
+XMMATRIX PumaKinematics::GetJointMatrix(unsigned int joint, float angle) const
+{
+	const XMFLOAT3& p = m_points[joint];
+	return XMMatrixTranslation(-p.x, -p.y, -p.z) *
+		XMMatrixRotationAxis(XMLoadFloat3(&m_axes[joint]), angle + m_zeros[joint]) * XMMatrixTranslation(p.x, p.y, p.z);
+}
+
+void PumaKinematics::GetLinkMatrices(const float* angles, XMMATRIX* matrices) const
+{
+	matrices[0] = XMMatrixIdentity();
+	for (unsigned int i = 1; i < LINKS; ++i)
+		matrices[i] = GetJointMatrix(i, angles[i - 1]) * matrices[i - 1];
+}
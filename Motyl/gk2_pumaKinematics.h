@@ -0,0 +1,39 @@
+#ifndef __GK2_PUMA_KINEMATICS_H_
+#define __GK2_PUMA_KINEMATICS_H_
+
+#include <xnamath.h>
+
+namespace gk2
+{
+	//Geometry of the robot's joints. Link 0 is the fixed base, joint i turns link i and everything after it.
+	//Every joint is given by a point on its axis and the axis direction, in mesh coordinates with all
+	//angles at zero, so the pose of link i is the rotation of joint i applied after the pose of link i - 1.
+	//A joint turns by its angle plus its zero, which calibration fits to the encoder's actual zero.
+	class PumaKinematics
+	{
+	public:
+		static const unsigned int JOINTS = 5;
+		static const unsigned int LINKS = JOINTS + 1;
+
+		//Joints of the robot in puma/mesh1.txt - mesh6.txt
+		PumaKinematics();
+
+		void SetJoint(unsigned int joint, const XMFLOAT3& point, const XMFLOAT3& axis);
+		const XMFLOAT3& getJointPoint(unsigned int joint) const { return m_points[joint]; }
+		const XMFLOAT3& getJointAxis(unsigned int joint) const { return m_axes[joint]; }
+		void SetZero(unsigned int joint, float zero) { m_zeros[joint] = zero; }
+		float getZero(unsigned int joint) const { return m_zeros[joint]; }
+
+		//Transformation of joint's link relative to the previous one, joint is 1-based like the links
+		XMMATRIX GetJointMatrix(unsigned int joint, float angle) const;
+		//World matrices of all LINKS links for JOINTS joint angles
+		void GetLinkMatrices(const float* angles, XMMATRIX* matrices) const;
+
+	private:
+		XMFLOAT3 m_points[LINKS];		//index 0 is unused, the base does not move
+		XMFLOAT3 m_axes[LINKS];			//unit length
+		float m_zeros[LINKS];
+	};
+}
+
+#endif __GK2_PUMA_KINEMATICS_H_
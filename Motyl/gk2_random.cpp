@@ -0,0 +1,110 @@
+#include "gk2_random.h"
+#include <emmintrin.h>
+
+using namespace gk2;
+
+const float Random::UNIT = 1.0f / 16777216.0f;
+
+namespace
+{
+	//Finalizer of MurmurHash3, spreads the seed over all state words
+	unsigned int Mix(unsigned int h)
+	{
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35u;
+		h ^= h >> 16;
+		return h;
+	}
+}
+
+Random::Random(unsigned int seed)
+{
+	Seed(seed);
+}
+
+void Random::Seed(unsigned int seed)
+{
+	for (unsigned int lane = 0; lane < 4; ++lane)
+	{
+		unsigned int any = 0;
+		for (unsigned int word = 0; word < 4; ++word)
+		{
+			m_state[word][lane] = Mix(seed + 0x9e3779b9u * (lane * 4 + word + 1));
+			any |= m_state[word][lane];
+		}
+		//xorshift never leaves the all-zero state
+		if (!any)
+			m_state[0][lane] = 1;
+	}
+	m_next = 4;
+}
+
+void Random::Step(unsigned int out[4])
+{
+	for (unsigned int lane = 0; lane < 4; ++lane)
+	{
+		unsigned int t = m_state[0][lane];
+		t ^= t << 11;
+		unsigned int w = m_state[3][lane];
+		m_state[0][lane] = m_state[1][lane];
+		m_state[1][lane] = m_state[2][lane];
+		m_state[2][lane] = w;
+		w ^= (w >> 19) ^ t ^ (t >> 8);
+		m_state[3][lane] = w;
+		out[lane] = w;
+	}
+}
+
+void Random::StepSIMD(float* dst, float min, float scale)
+{
+	__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_state[0]));
+	__m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_state[1]));
+	__m128i z = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_state[2]));
+	__m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_state[3]));
+	__m128i t = _mm_xor_si128(x, _mm_slli_epi32(x, 11));
+	__m128i n = _mm_xor_si128(_mm_xor_si128(w, _mm_srli_epi32(w, 19)), _mm_xor_si128(t, _mm_srli_epi32(t, 8)));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m_state[0]), y);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m_state[1]), z);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m_state[2]), w);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m_state[3]), n);
+	//The top 24 bits convert to float exactly, as in NextFloat
+	__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(n, 8)), _mm_set1_ps(UNIT));
+	_mm_storeu_ps(dst, _mm_add_ps(_mm_set1_ps(min), _mm_mul_ps(f, _mm_set1_ps(scale))));
+}
+
+unsigned int Random::NextUInt()
+{
+	if (m_next == 4)
+	{
+		Step(m_buffer);
+		m_next = 0;
+	}
+	return m_buffer[m_next++];
+}
+
+float Random::NextFloat()
+{
+	return static_cast<float>(static_cast<int>(NextUInt() >> 8)) * UNIT;
+}
+
+float Random::NextFloat(float min, float max)
+{
+	return min + NextFloat() * (max - min);
+}
+
+void Random::Fill(float* dst, unsigned int count, float min, float max)
+{
+	float scale = max - min;
+	//Values left over from a previous scalar step come first
+	while (count > 0 && m_next < 4)
+	{
+		*dst++ = NextFloat(min, max);
+		--count;
+	}
+	for (; count >= 4; count -= 4, dst += 4)
+		StepSIMD(dst, min, scale);
+	for (; count > 0; --count)
+		*dst++ = NextFloat(min, max);
+}
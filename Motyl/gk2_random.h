@@ -0,0 +1,41 @@
+#ifndef __GK2_RANDOM_H_
+#define __GK2_RANDOM_H_
+
+namespace gk2
+{
+	//Deterministic pseudo-random number generator meant to be owned by a single emitter.
+	//Four independent xorshift128 streams are interleaved: the k-th value of the sequence comes from
+	//lane k % 4. Only 32-bit shifts and xors are involved, so a seed gives the same sequence on every
+	//platform, and Fill produces four values per SSE2 instruction with exactly the same results as
+	//repeated NextFloat calls.
+	class Random
+	{
+	public:
+		static const unsigned int DEFAULT_SEED = 0x9e3779b9u;
+
+		Random(unsigned int seed = DEFAULT_SEED);
+
+		void Seed(unsigned int seed);
+		unsigned int NextUInt();
+		//Uniform in [0, 1), with 24 bits of precision
+		float NextFloat();
+		//Uniform in [min, max)
+		float NextFloat(float min, float max);
+		//Writes the next count values of the NextFloat(min, max) sequence
+		void Fill(float* dst, unsigned int count, float min, float max);
+
+	private:
+		static const float UNIT;	//2^-24
+
+		//Lane-major state, m_state[word][lane]
+		unsigned int m_state[4][4];
+		unsigned int m_buffer[4];
+		unsigned int m_next;
+
+		//Advances every lane by one step
+		void Step(unsigned int out[4]);
+		void StepSIMD(float* dst, float min, float scale);
+	};
+}
+
+#endif __GK2_RANDOM_H_
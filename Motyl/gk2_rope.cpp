@@ -0,0 +1,347 @@
+#include "gk2_rope.h"
+#include "gk2_threadPool.h"
+#include "gk2_utils.h"
+#include <emmintrin.h>
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+using namespace std;
+using namespace gk2;
+
+const float Rope::STEP = 1.0f / 960.0f;
+
+namespace
+{
+	const float GRAVITY = -9.81f;
+	//Blocks per thread below which a pass is not worth splitting
+	const unsigned int MIN_BLOCKS = 32;
+
+	__m128 Select(__m128 mask, __m128 a, __m128 b)
+	{
+		return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+	}
+}
+
+Rope::Rope(unsigned int segments, float length, float radius, ThreadPool& threads)
+	: m_threads(threads), m_radius(radius), m_damping(0.999f), m_floor(-FLT_MAX), m_time(0.0f), m_attached(false)
+{
+	segments = segments < 2 ? 2 : segments;
+	m_count = segments + 1;
+	m_segment = length / segments;
+	m_capacity = ((m_count + 7) & ~7u) + 8;
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(7 * m_capacity * sizeof(float)));
+	memset(m_data, 0, 7 * m_capacity * sizeof(float));
+	float* streams[7];
+	for (unsigned int i = 0; i < 7; ++i)
+		streams[i] = m_data + i * m_capacity;
+	m_x = streams[0]; m_y = streams[1]; m_z = streams[2];
+	m_prevX = streams[3]; m_prevY = streams[4]; m_prevZ = streams[5];
+	m_invMass = streams[6];
+	for (unsigned int i = 1; i + 1 < m_count; ++i)
+		m_invMass[i] = 1.0f;
+	SetStiffness(1.0f, 0.1f);
+}
+
+Rope::~Rope()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+void Rope::SetStiffness(float stretch, float bend)
+{
+	//Per-iteration factors giving the requested correction after all iterations of a step
+	m_stretch = 1.0f - pow(1.0f - (stretch > 1.0f ? 1.0f : stretch), 1.0f / ITERATIONS);
+	m_bend = 1.0f - pow(1.0f - (bend > 1.0f ? 1.0f : bend), 1.0f / ITERATIONS);
+}
+
+unsigned int Rope::AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose)
+{
+	Box box;
+	box.halfSize = halfSize;
+	m_boxes.push_back(box);
+	SetBoxPose(static_cast<unsigned int>(m_boxes.size()) - 1, pose);
+	return static_cast<unsigned int>(m_boxes.size()) - 1;
+}
+
+void Rope::SetBoxPose(unsigned int box, CXMMATRIX pose)
+{
+	Box& b = m_boxes[box];
+	XMStoreFloat3(&b.center, pose.r[3]);
+	for (int i = 0; i < 3; ++i)
+		XMStoreFloat3(&b.axes[i], XMVector3Normalize(pose.r[i]));
+}
+
+void Rope::Attach(const XMFLOAT3& start, const XMFLOAT3& end)
+{
+	if (!m_attached)
+	{
+		//A parabola sagging about as much as the rope is longer than the span
+		XMFLOAT3 d(end.x - start.x, end.y - start.y, end.z - start.z);
+		float span = sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+		float slack = m_segment * (m_count - 1) - span;
+		float sag = slack > 0.0f ? sqrt(0.375f * span * slack) : 0.0f;
+		for (unsigned int i = 0; i < m_count; ++i)
+		{
+			float t = static_cast<float>(i) / (m_count - 1);
+			m_x[i] = m_prevX[i] = start.x + t * d.x;
+			m_y[i] = m_prevY[i] = start.y + t * d.y - 4.0f * sag * t * (1.0f - t);
+			m_z[i] = m_prevZ[i] = start.z + t * d.z;
+		}
+		m_prevEnds[0] = m_ends[0] = start;
+		m_prevEnds[1] = m_ends[1] = end;
+		m_attached = true;
+		return;
+	}
+	m_ends[0] = start;
+	m_ends[1] = end;
+}
+
+void Rope::Update(float dt)
+{
+	if (!m_attached)
+		return;
+	m_time += dt;
+	unsigned int steps = static_cast<unsigned int>(m_time / STEP);
+	if (steps > MAX_STEPS)
+	{
+		steps = MAX_STEPS;
+		m_time = 0.0f;
+	}
+	else
+		m_time -= steps * STEP;
+	for (unsigned int s = 0; s < steps; ++s)
+		Step(STEP, static_cast<float>(s + 1) / steps);
+	if (steps > 0)
+	{
+		m_prevEnds[0] = m_ends[0];
+		m_prevEnds[1] = m_ends[1];
+	}
+}
+
+template<typename F>
+void Rope::RunBlocks(unsigned int blocks, F pass)
+{
+	m_threads.RunRanges(blocks, pass, MIN_BLOCKS);
+}
+
+void Rope::Step(float h, float t)
+{
+	//Attached ends follow their targets, they have no mass for the solver to move
+	unsigned int last = m_count - 1;
+	m_x[0] = m_prevEnds[0].x + t * (m_ends[0].x - m_prevEnds[0].x);
+	m_y[0] = m_prevEnds[0].y + t * (m_ends[0].y - m_prevEnds[0].y);
+	m_z[0] = m_prevEnds[0].z + t * (m_ends[0].z - m_prevEnds[0].z);
+	m_x[last] = m_prevEnds[1].x + t * (m_ends[1].x - m_prevEnds[1].x);
+	m_y[last] = m_prevEnds[1].y + t * (m_ends[1].y - m_prevEnds[1].y);
+	m_z[last] = m_prevEnds[1].z + t * (m_ends[1].z - m_prevEnds[1].z);
+
+	unsigned int quads = (m_count + 3) / 4;
+	RunBlocks(quads, [&](unsigned int begin, unsigned int end) { Integrate(h, begin, end); });
+	//Blocks of eight points starting at the first point of a colour's first constraint
+	unsigned int stretchBlocks[2] = { (m_count + 7) / 8, (m_count + 6) / 8 };
+	unsigned int bendBlocks[2] = { (m_count + 7) / 8, (m_count + 5) / 8 };
+	for (unsigned int i = 0; i < ITERATIONS; ++i)
+	{
+		for (unsigned int c = 0; c < 2; ++c)
+			RunBlocks(stretchBlocks[c], [&](unsigned int begin, unsigned int end)
+			{
+				Project(c, 1, m_segment, m_stretch, begin, end);
+			});
+		for (unsigned int c = 0; c < 2; ++c)
+			RunBlocks(bendBlocks[c], [&](unsigned int begin, unsigned int end)
+			{
+				Project(2 * c, 2, 2.0f * m_segment, m_bend, begin, end);
+			});
+		RunBlocks(quads, [&](unsigned int begin, unsigned int end) { Tether(begin, end); Collide(begin, end); });
+	}
+}
+
+void Rope::Integrate(float h, unsigned int begin, unsigned int end)
+{
+	const __m128 damping = _mm_set1_ps(m_damping), fall = _mm_set1_ps(GRAVITY * h * h);
+	const __m128 zero = _mm_setzero_ps();
+	for (unsigned int i = 4 * begin; i < 4 * end; i += 4)
+	{
+		__m128 moving = _mm_cmpgt_ps(_mm_load_ps(m_invMass + i), zero);
+		__m128 x = _mm_load_ps(m_x + i), y = _mm_load_ps(m_y + i), z = _mm_load_ps(m_z + i);
+		//Verlet: the velocity is the last step's displacement
+		__m128 vx = _mm_mul_ps(_mm_sub_ps(x, _mm_load_ps(m_prevX + i)), damping);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(y, _mm_load_ps(m_prevY + i)), damping), fall);
+		__m128 vz = _mm_mul_ps(_mm_sub_ps(z, _mm_load_ps(m_prevZ + i)), damping);
+		_mm_store_ps(m_prevX + i, x);
+		_mm_store_ps(m_prevY + i, y);
+		_mm_store_ps(m_prevZ + i, z);
+		_mm_store_ps(m_x + i, _mm_add_ps(x, _mm_and_ps(vx, moving)));
+		_mm_store_ps(m_y + i, _mm_add_ps(y, _mm_and_ps(vy, moving)));
+		_mm_store_ps(m_z + i, _mm_add_ps(z, _mm_and_ps(vz, moving)));
+	}
+}
+
+void Rope::Project(unsigned int first, unsigned int gap, float rest, float stiffness, unsigned int begin,
+	unsigned int end)
+{
+	const __m128 vrest = _mm_set1_ps(rest), k = _mm_set1_ps(stiffness);
+	const __m128 tiny = _mm_set1_ps(1e-12f), zero = _mm_setzero_ps();
+	//Offsets of the second points of the four constraints in a block
+	const __m128i second = gap == 1 ? _mm_set_epi32(7, 5, 3, 1) : _mm_set_epi32(7, 6, 3, 2);
+	const __m128i count = _mm_set1_epi32(m_count);
+	float* streams[4] = { m_x, m_y, m_z, m_invMass };
+	for (unsigned int block = begin; block < end; ++block)
+	{
+		unsigned int base = first + 8 * block;
+		//Split the block into the first and the second points of its constraints
+		__m128 a[4], b[4];
+		for (int s = 0; s < 4; ++s)
+		{
+			__m128 lo = _mm_loadu_ps(streams[s] + base), hi = _mm_loadu_ps(streams[s] + base + 4);
+			if (gap == 1)
+			{
+				a[s] = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+				b[s] = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+			}
+			else
+			{
+				a[s] = _mm_movelh_ps(lo, hi);
+				b[s] = _mm_movehl_ps(hi, lo);
+			}
+		}
+		__m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_add_epi32(_mm_set1_epi32(base), second), count));
+		__m128 dx = _mm_sub_ps(b[0], a[0]), dy = _mm_sub_ps(b[1], a[1]), dz = _mm_sub_ps(b[2], a[2]);
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 weights = _mm_add_ps(a[3], b[3]);
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(length2, tiny), _mm_cmpgt_ps(weights, zero)));
+		length2 = _mm_max_ps(length2, tiny);
+		weights = _mm_max_ps(weights, tiny);
+		__m128 length = _mm_sqrt_ps(length2);
+		//Moves both points along the constraint by their share of the error
+		__m128 s = _mm_div_ps(_mm_mul_ps(k, _mm_sub_ps(length, vrest)), _mm_mul_ps(length, weights));
+		s = _mm_and_ps(s, valid);
+		__m128 sa = _mm_mul_ps(s, a[3]), sb = _mm_mul_ps(s, b[3]);
+		a[0] = _mm_add_ps(a[0], _mm_mul_ps(sa, dx)); b[0] = _mm_sub_ps(b[0], _mm_mul_ps(sb, dx));
+		a[1] = _mm_add_ps(a[1], _mm_mul_ps(sa, dy)); b[1] = _mm_sub_ps(b[1], _mm_mul_ps(sb, dy));
+		a[2] = _mm_add_ps(a[2], _mm_mul_ps(sa, dz)); b[2] = _mm_sub_ps(b[2], _mm_mul_ps(sb, dz));
+		for (int s = 0; s < 3; ++s)
+		{
+			if (gap == 1)
+			{
+				_mm_storeu_ps(streams[s] + base, _mm_unpacklo_ps(a[s], b[s]));
+				_mm_storeu_ps(streams[s] + base + 4, _mm_unpackhi_ps(a[s], b[s]));
+			}
+			else
+			{
+				_mm_storeu_ps(streams[s] + base, _mm_movelh_ps(a[s], b[s]));
+				_mm_storeu_ps(streams[s] + base + 4, _mm_movehl_ps(b[s], a[s]));
+			}
+		}
+	}
+}
+
+void Rope::Tether(unsigned int begin, unsigned int end)
+{
+	const __m128 zero = _mm_setzero_ps(), tiny = _mm_set1_ps(1e-12f), segment = _mm_set1_ps(m_segment);
+	const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), last = _mm_set1_ps(static_cast<float>(m_count - 1));
+	unsigned int ends[2] = { 0, m_count - 1 };
+	for (unsigned int i = 4 * begin; i < 4 * end; i += 4)
+	{
+		__m128 moving = _mm_cmpgt_ps(_mm_load_ps(m_invMass + i), zero);
+		__m128 p[3] = { _mm_load_ps(m_x + i), _mm_load_ps(m_y + i), _mm_load_ps(m_z + i) };
+		__m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+		//Points can be no farther from an end than the rope between them is long
+		__m128 reach[2] = { _mm_mul_ps(index, segment), _mm_mul_ps(_mm_sub_ps(last, index), segment) };
+		for (int e = 0; e < 2; ++e)
+		{
+			__m128 dx = _mm_sub_ps(p[0], _mm_set1_ps(m_x[ends[e]]));
+			__m128 dy = _mm_sub_ps(p[1], _mm_set1_ps(m_y[ends[e]]));
+			__m128 dz = _mm_sub_ps(p[2], _mm_set1_ps(m_z[ends[e]]));
+			__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 length = _mm_sqrt_ps(_mm_max_ps(length2, tiny));
+			__m128 s = _mm_div_ps(_mm_sub_ps(length, reach[e]), length);
+			s = _mm_and_ps(s, _mm_and_ps(moving, _mm_cmpgt_ps(s, zero)));
+			p[0] = _mm_sub_ps(p[0], _mm_mul_ps(s, dx));
+			p[1] = _mm_sub_ps(p[1], _mm_mul_ps(s, dy));
+			p[2] = _mm_sub_ps(p[2], _mm_mul_ps(s, dz));
+		}
+		_mm_store_ps(m_x + i, p[0]);
+		_mm_store_ps(m_y + i, p[1]);
+		_mm_store_ps(m_z + i, p[2]);
+	}
+}
+
+void Rope::Collide(unsigned int begin, unsigned int end)
+{
+	const __m128 zero = _mm_setzero_ps(), radius = _mm_set1_ps(m_radius);
+	const __m128 floor = _mm_set1_ps(m_floor + m_radius);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for (unsigned int i = 4 * begin; i < 4 * end; i += 4)
+	{
+		__m128 moving = _mm_cmpgt_ps(_mm_load_ps(m_invMass + i), zero);
+		__m128 p[3] = { _mm_load_ps(m_x + i), _mm_load_ps(m_y + i), _mm_load_ps(m_z + i) };
+		p[1] = Select(moving, _mm_max_ps(p[1], floor), p[1]);
+		for (unsigned int b = 0; b < m_boxes.size(); ++b)
+		{
+			const Box& box = m_boxes[b];
+			__m128 d[3] = { _mm_sub_ps(p[0], _mm_set1_ps(box.center.x)), _mm_sub_ps(p[1], _mm_set1_ps(box.center.y)),
+				_mm_sub_ps(p[2], _mm_set1_ps(box.center.z)) };
+			//Depth below each pair of faces, the point is inside if all are positive
+			__m128 inside = moving, minDepth = _mm_set1_ps(FLT_MAX), push[3] = { zero, zero, zero };
+			for (int k = 0; k < 3; ++k)
+			{
+				const XMFLOAT3& axis = box.axes[k];
+				__m128 local = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d[0], _mm_set1_ps(axis.x)),
+					_mm_mul_ps(d[1], _mm_set1_ps(axis.y))), _mm_mul_ps(d[2], _mm_set1_ps(axis.z)));
+				float half = k == 0 ? box.halfSize.x : (k == 1 ? box.halfSize.y : box.halfSize.z);
+				__m128 depth = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(half), radius), _mm_andnot_ps(signBit, local));
+				inside = _mm_and_ps(inside, _mm_cmpgt_ps(depth, zero));
+				//Out through the nearest face
+				__m128 nearer = _mm_cmplt_ps(depth, minDepth);
+				minDepth = Select(nearer, depth, minDepth);
+				__m128 out = _mm_or_ps(depth, _mm_and_ps(signBit, local));
+				push[0] = Select(nearer, _mm_mul_ps(out, _mm_set1_ps(axis.x)), push[0]);
+				push[1] = Select(nearer, _mm_mul_ps(out, _mm_set1_ps(axis.y)), push[1]);
+				push[2] = Select(nearer, _mm_mul_ps(out, _mm_set1_ps(axis.z)), push[2]);
+			}
+			for (int k = 0; k < 3; ++k)
+				p[k] = _mm_add_ps(p[k], _mm_and_ps(push[k], inside));
+		}
+		_mm_store_ps(m_x + i, p[0]);
+		_mm_store_ps(m_y + i, p[1]);
+		_mm_store_ps(m_z + i, p[2]);
+	}
+}
+
+float Rope::getClearance() const
+{
+	float clearance = FLT_MAX;
+	for (unsigned int b = 0; b < m_boxes.size(); ++b)
+	{
+		const Box& box = m_boxes[b];
+		const float half[3] = { box.halfSize.x, box.halfSize.y, box.halfSize.z };
+		for (unsigned int i = 0; i < m_count; ++i)
+		{
+			XMFLOAT3 d(m_x[i] - box.center.x, m_y[i] - box.center.y, m_z[i] - box.center.z);
+			float outside = 0.0f, inside = -FLT_MAX;
+			for (int k = 0; k < 3; ++k)
+			{
+				float local = fabs(d.x * box.axes[k].x + d.y * box.axes[k].y + d.z * box.axes[k].z) - half[k];
+				outside += local > 0.0f ? local * local : 0.0f;
+				inside = local > inside ? local : inside;
+			}
+			float distance = (inside > 0.0f ? sqrt(outside) : inside) - m_radius;
+			clearance = distance < clearance ? distance : clearance;
+		}
+	}
+	return clearance;
+}
+
+float Rope::getMaxStretch() const
+{
+	float stretch = 0.0f;
+	for (unsigned int i = 0; i + 1 < m_count; ++i)
+	{
+		float dx = m_x[i + 1] - m_x[i], dy = m_y[i + 1] - m_y[i], dz = m_z[i + 1] - m_z[i];
+		float ratio = sqrt(dx * dx + dy * dy + dz * dz) / m_segment;
+		stretch = ratio > stretch ? ratio : stretch;
+	}
+	return stretch;
+}
@@ -0,0 +1,95 @@
+#ifndef __GK2_ROPE_H_
+#define __GK2_ROPE_H_
+
+#include <xnamath.h>
+#include <vector>
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Cable hanging between two moving points, simulated with position-based dynamics at a fixed rate.
+	//Points are kept as streams of coordinates. Each iteration projects stretch constraints between
+	//neighbours and bending constraints between points two apart, then pushes points out of the obstacles.
+	//Constraints are split into four colours, (i, i + 1) for even i, for odd i, (i, i + 2) for i mod 4 < 2
+	//and for the rest, so that no two constraints of a colour share a point. A colour is solved in blocks
+	//of eight points, four constraints at a time, and blocks can go to different threads.
+	//Points are also tethered to the attached ends, so the rope does not sag longer than it is.
+	class Rope
+	{
+	public:
+		static const float STEP;				//length of a simulation step in seconds
+		static const unsigned int MAX_STEPS = 32;	//steps per Update, the rest of the time is dropped
+		static const unsigned int ITERATIONS = 4;		//short steps converge faster than more iterations
+
+		//segments + 1 points spaced length / segments apart, the rope is radius thick
+		Rope(unsigned int segments, float length, float radius, gk2::ThreadPool& threads);
+		~Rope();
+
+		//Fractions of a constraint's error corrected per step, from 0 to 1
+		void SetStiffness(float stretch, float bend);
+		void SetDamping(float damping) { m_damping = damping; }
+		//Points stay above this height
+		void SetFloor(float y) { m_floor = y; }
+		//Box of the given half size centered at the origin of pose, which must be rigid
+		unsigned int AddBox(const XMFLOAT3& halfSize, CXMMATRIX pose);
+		void SetBoxPose(unsigned int box, CXMMATRIX pose);
+
+		//Moves the ends of the rope, they get there over the steps of the next Update.
+		//The first call lays the rope between the points.
+		void Attach(const XMFLOAT3& start, const XMFLOAT3& end);
+		void Update(float dt);
+
+		unsigned int getPointCount() const { return m_count; }
+		XMFLOAT3 getPoint(unsigned int i) const { return XMFLOAT3(m_x[i], m_y[i], m_z[i]); }
+		//Smallest distance between the surface of the rope and a box, negative if the rope goes into one
+		float getClearance() const;
+		//Largest ratio of a segment's length to its rest length
+		float getMaxStretch() const;
+
+	private:
+		struct Box
+		{
+			XMFLOAT3 center;
+			XMFLOAT3 axes[3];		//unit length
+			XMFLOAT3 halfSize;
+		};
+
+		gk2::ThreadPool& m_threads;
+		unsigned int m_count;
+		unsigned int m_capacity;	//stream length, room for the last block of every colour
+		float m_segment;
+		float m_radius;
+		float m_stretch;
+		float m_bend;
+		float m_damping;
+		float m_floor;
+		float m_time;
+		bool m_attached;
+		XMFLOAT3 m_ends[2];
+		XMFLOAT3 m_prevEnds[2];
+		std::vector<Box> m_boxes;
+
+		float* m_data;
+		float* m_x; float* m_y; float* m_z;
+		float* m_prevX; float* m_prevY; float* m_prevZ;
+		float* m_invMass;			//0 at the attached ends and past the last point
+
+		void Step(float h, float t);
+		void Integrate(float h, unsigned int begin, unsigned int end);
+		//Projects constraints (i, i + gap) for i = first + 8 * block + lane, see the class description
+		void Project(unsigned int first, unsigned int gap, float rest, float stiffness, unsigned int begin,
+			unsigned int end);
+		//Pulls points back within reach of the attached ends, which plain projection is slow to do on long ropes
+		void Tether(unsigned int begin, unsigned int end);
+		void Collide(unsigned int begin, unsigned int end);
+		//Runs pass(begin, end) over blocks [0, blocks) split between threads
+		template<typename F>
+		void RunBlocks(unsigned int blocks, F pass);
+
+		Rope(const Rope& right) : m_threads(right.m_threads) { }
+		Rope& operator=(const Rope& right) { return *this; }
+	};
+}
+
+#endif __GK2_ROPE_H_
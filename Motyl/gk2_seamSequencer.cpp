@@ -0,0 +1,225 @@
+#include "gk2_seamSequencer.h"
+#include "gk2_threadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int SeamSequencer::MIN_ROWS = 16;
+
+namespace
+{
+	//Smallest gain worth a move, against rounding making moves back and forth
+	const float MIN_GAIN = 1e-5f;
+}
+
+SeamSequencer::SeamSequencer(ThreadPool& threads, unsigned int seed)
+	: m_threads(threads), m_seed(seed), m_cycleTime(0.0f), m_transferTime(0.0f)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = 1.0f;
+		m_maxAcceleration[j] = 1.0f;
+		m_home[j] = 0.0f;
+	}
+}
+
+void SeamSequencer::SetLimits(const float* maxVelocity, const float* maxAcceleration)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_maxVelocity[j] = maxVelocity[j];
+		m_maxAcceleration[j] = maxAcceleration[j];
+	}
+}
+
+void SeamSequencer::SetHome(const float* angles)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		m_home[j] = angles[j];
+}
+
+unsigned int SeamSequencer::AddSeam(const float* start, const float* end, float duration)
+{
+	m_points.insert(m_points.end(), start, start + JOINTS);
+	m_points.insert(m_points.end(), end, end + JOINTS);
+	m_durations.push_back(duration);
+	return getSeamCount() - 1;
+}
+
+float SeamSequencer::TransferTime(const float* from, const float* to) const
+{
+	float time = 0.0f;
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		//Triangular profile if the joint never reaches its top speed, trapezoidal otherwise
+		float distance = fabs(to[j] - from[j]), v = m_maxVelocity[j], a = m_maxAcceleration[j];
+		float t = distance * a < v * v ? 2.0f * sqrt(distance / a) : distance / v + v / a;
+		time = t > time ? t : time;
+	}
+	return time;
+}
+
+float SeamSequencer::Length(const Tour& tour) const
+{
+	unsigned int home = 2 * getSeamCount();
+	if (tour.empty())
+		return 0.0f;
+	float length = Transfer(home, tour[0]) + Transfer(tour.back() ^ 1, home);
+	for (unsigned int k = 0; k + 1 < tour.size(); ++k)
+		length += Transfer(tour[k] ^ 1, tour[k + 1]);
+	return length;
+}
+
+void SeamSequencer::Construct(unsigned int first, Tour& tour) const
+{
+	unsigned int n = getSeamCount();
+	vector<bool> visited(n, false);
+	tour.clear();
+	tour.push_back(first);
+	visited[first / 2] = true;
+	while (tour.size() < n)
+	{
+		unsigned int exit = tour.back() ^ 1, best = 0;
+		float bestTime = FLT_MAX;
+		for (unsigned int e = 0; e < 2 * n; ++e)
+			if (!visited[e / 2] && Transfer(exit, e) < bestTime)
+			{
+				bestTime = Transfer(exit, e);
+				best = e;
+			}
+		tour.push_back(best);
+		visited[best / 2] = true;
+	}
+}
+
+bool SeamSequencer::TwoOpt(Tour& tour) const
+{
+	unsigned int n = static_cast<unsigned int>(tour.size()), home = 2 * n;
+	bool improved = false;
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		unsigned int before = i > 0 ? tour[i - 1] ^ 1 : home;
+		for (unsigned int j = i; j < n; ++j)
+		{
+			//Turning [i, j] around: its last seam's end becomes the entry and its first seam's start the exit
+			unsigned int entry = tour[i], exit = tour[j] ^ 1, after = j + 1 < n ? tour[j + 1] : home;
+			float gain = Transfer(before, entry) + Transfer(exit, after) - Transfer(before, exit) -
+				Transfer(entry, after);
+			if (gain <= MIN_GAIN)
+				continue;
+			reverse(tour.begin() + i, tour.begin() + j + 1);
+			for (unsigned int k = i; k <= j; ++k)
+				tour[k] ^= 1;
+			improved = true;
+		}
+	}
+	return improved;
+}
+
+bool SeamSequencer::OrOpt(Tour& tour) const
+{
+	unsigned int n = static_cast<unsigned int>(tour.size()), home = 2 * n;
+	bool improved = false;
+	for (unsigned int length = 1; length <= MAX_MOVED && length < n; ++length)
+		for (unsigned int i = 0; i + length <= n; ++i)
+		{
+			unsigned int first = tour[i], last = tour[i + length - 1] ^ 1;
+			unsigned int before = i > 0 ? tour[i - 1] ^ 1 : home;
+			unsigned int after = i + length < n ? tour[i + length] : home;
+			float removed = Transfer(before, first) + Transfer(last, after) - Transfer(before, after);
+			//Best gap between the seams left, gap g is before position g of the tour
+			float bestGain = MIN_GAIN;
+			unsigned int bestGap = 0;
+			bool bestReversed = false;
+			for (unsigned int g = 0; g <= n; ++g)
+			{
+				if (g >= i && g <= i + length)
+					continue;
+				unsigned int a = g > 0 ? tour[g - 1] ^ 1 : home, b = g < n ? tour[g] : home;
+				float forward = removed - Transfer(a, first) - Transfer(last, b) + Transfer(a, b);
+				float backward = removed - Transfer(a, last) - Transfer(first, b) + Transfer(a, b);
+				if (forward > bestGain || backward > bestGain)
+				{
+					bestReversed = backward > forward;
+					bestGain = bestReversed ? backward : forward;
+					bestGap = g;
+				}
+			}
+			if (bestGain <= MIN_GAIN)
+				continue;
+			unsigned int moved[MAX_MOVED];
+			for (unsigned int k = 0; k < length; ++k)
+				moved[k] = bestReversed ? tour[i + length - 1 - k] ^ 1 : tour[i + k];
+			tour.erase(tour.begin() + i, tour.begin() + i + length);
+			unsigned int gap = bestGap > i ? bestGap - length : bestGap;
+			tour.insert(tour.begin() + gap, moved, moved + length);
+			improved = true;
+		}
+	return improved;
+}
+
+float SeamSequencer::Improve(Tour& tour) const
+{
+	for (bool improved = true; improved; )
+	{
+		improved = TwoOpt(tour);
+		improved = OrOpt(tour) || improved;
+	}
+	return Length(tour);
+}
+
+float SeamSequencer::Solve(unsigned int starts)
+{
+	unsigned int n = getSeamCount(), points = 2 * n + 1;
+	m_program.clear();
+	m_cycleTime = m_transferTime = 0.0f;
+	if (n == 0)
+		return 0.0f;
+	m_transfers.resize(points * points);
+	m_threads.RunRanges(points, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int from = begin; from < end; ++from)
+		{
+			const float* p = from < 2 * n ? &m_points[from * JOINTS] : m_home;
+			for (unsigned int to = 0; to < points; ++to)
+				m_transfers[from * points + to] = TransferTime(p, to < 2 * n ? &m_points[to * JOINTS] : m_home);
+		}
+	}, MIN_ROWS);
+
+	//The first search starts with the seam end nearest to home, the others with random ones
+	starts = starts == 0 ? m_threads.getThreadCount() : starts;
+	vector<Tour> tours(starts);
+	vector<float> lengths(starts);
+	m_threads.Run(starts, [&](unsigned int task)
+	{
+		unsigned int first = 0;
+		if (task == 0)
+		{
+			for (unsigned int e = 1; e < 2 * n; ++e)
+				first = Transfer(2 * n, e) < Transfer(2 * n, first) ? e : first;
+		}
+		else
+		{
+			Random random(m_seed + task);
+			first = random.NextUInt() % (2 * n);
+		}
+		Construct(first, tours[task]);
+		lengths[task] = Improve(tours[task]);
+	});
+	unsigned int best = static_cast<unsigned int>(min_element(lengths.begin(), lengths.end()) - lengths.begin());
+
+	m_transferTime = lengths[best];
+	m_cycleTime = m_transferTime;
+	for (unsigned int k = 0; k < n; ++k)
+	{
+		SeamStep step;
+		step.Seam = tours[best][k] / 2;
+		step.Reversed = (tours[best][k] & 1) != 0;
+		m_program.push_back(step);
+		m_cycleTime += m_durations[step.Seam];
+	}
+	return m_cycleTime;
+}
@@ -0,0 +1,88 @@
+#ifndef __GK2_SEAM_SEQUENCER_H_
+#define __GK2_SEAM_SEQUENCER_H_
+
+#include <vector>
+#include "gk2_pumaKinematics.h"
+#include "gk2_random.h"
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Step of a welding program: the seam, welded from its end to its start if reversed
+	struct SeamStep
+	{
+		unsigned int Seam;
+		bool Reversed;
+	};
+
+	//Orders the seams of a fixture and picks their directions for the shortest cycle from home and back.
+	//A transfer takes the rest to rest time of the slowest joint moving straight at its velocity and
+	//acceleration limits. Transfers between all seam ends are computed once, rows split between threads.
+	//The order is a travelling salesman tour over the seams in which every seam is entered at one of its
+	//ends and left at the other. Each thread improves a different nearest neighbour tour by 2-opt, which
+	//turns a stretch of the tour around and so reverses its seams, and by Or-opt, which moves up to three
+	//seams elsewhere either way round, until neither finds a shorter tour; the best one is kept.
+	class SeamSequencer
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+		static const unsigned int MAX_MOVED = 3;		//seams moved at once by Or-opt
+
+		SeamSequencer(gk2::ThreadPool& threads, unsigned int seed = gk2::Random::DEFAULT_SEED);
+
+		void SetLimits(const float* maxVelocity, const float* maxAcceleration);
+		void SetHome(const float* angles);
+		//Seam welded between the joint angles start and end in duration, returns its index
+		unsigned int AddSeam(const float* start, const float* end, float duration);
+
+		//Orders the seams with a local search from every one of starts tours, 0 is one per thread,
+		//returns the cycle time
+		float Solve(unsigned int starts = 0);
+		const std::vector<gk2::SeamStep>& getProgram() const { return m_program; }
+		float getCycleTime() const { return m_cycleTime; }
+		//Time spent between seams in the cycle
+		float getTransferTime() const { return m_transferTime; }
+
+		//Rest to rest time of the slowest joint
+		float TransferTime(const float* from, const float* to) const;
+
+	private:
+		static const unsigned int MIN_ROWS;		//transfer matrix rows per thread worth a task
+
+		//Entry points of the seams in order, 2 * seam for the start and 2 * seam + 1 for the end,
+		//so the exit point of entry e is e ^ 1
+		typedef std::vector<unsigned int> Tour;
+
+		gk2::ThreadPool& m_threads;
+		unsigned int m_seed;
+		float m_maxVelocity[JOINTS];
+		float m_maxAcceleration[JOINTS];
+		float m_home[JOINTS];
+		//Seam starts and ends as points 0 to 2n - 1, home is point 2n
+		std::vector<float> m_points;
+		std::vector<float> m_durations;
+		std::vector<float> m_transfers;		//between every pair of points, row major
+		std::vector<gk2::SeamStep> m_program;
+		float m_cycleTime;
+		float m_transferTime;
+
+		float Transfer(unsigned int from, unsigned int to) const
+		{
+			return m_transfers[from * (2 * getSeamCount() + 1) + to];
+		}
+		unsigned int getSeamCount() const { return static_cast<unsigned int>(m_durations.size()); }
+		float Length(const Tour& tour) const;
+		//Nearest neighbour tour starting with the seam entered at first
+		void Construct(unsigned int first, Tour& tour) const;
+		//Improves by 2-opt and Or-opt moves until none is left, returns the length
+		float Improve(Tour& tour) const;
+		bool TwoOpt(Tour& tour) const;
+		bool OrOpt(Tour& tour) const;
+
+		SeamSequencer(const SeamSequencer& right) : m_threads(right.m_threads) { }
+		SeamSequencer& operator=(const SeamSequencer& right) { return *this; }
+	};
+}
+
+#endif __GK2_SEAM_SEQUENCER_H_
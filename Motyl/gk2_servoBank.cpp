@@ -0,0 +1,148 @@
+#include "gk2_servoBank.h"
+#include "gk2_threadPool.h"
+#include "gk2_utils.h"
+#include <xnamath.h>
+#include <emmintrin.h>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+using namespace gk2;
+
+const float ServoBank::STEP = 1.0f / 2000.0f;
+const unsigned int ServoBank::MIN_BLOCKS = 64;
+
+ServoBank::ServoBank(unsigned int channels, ThreadPool& threads)
+	: m_threads(threads), m_count(channels), m_time(0.0f)
+{
+	m_stride = (channels + 3) & ~3u;
+	m_stride = m_stride == 0 ? 4 : m_stride;
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(STREAMS * m_stride * sizeof(float)));
+	memset(m_data, 0, STREAMS * m_stride * sizeof(float));
+	float** streams[STREAMS] = { &m_angle, &m_velocity, &m_integral, &m_torque, &m_error, &m_maxError,
+		&m_target, &m_prevTarget, &m_load, &m_positionGain, &m_velocityGain, &m_integralGain,
+		&m_inertia, &m_viscous, &m_coulomb, &m_maxTorque };
+	for (unsigned int i = 0; i < STREAMS; ++i)
+		*streams[i] = m_data + i * m_stride;
+	//Channels past the last one keep zero inverse inertia and never move
+	for (unsigned int i = 0; i < m_count; ++i)
+	{
+		SetMotor(i, 1.0f, 0.0f, 0.0f, 1.0f);
+		Tune(i, 100.0f);
+	}
+}
+
+ServoBank::~ServoBank()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+void ServoBank::SetMotor(unsigned int channel, float inertia, float viscous, float coulomb, float maxTorque)
+{
+	//Inertia is kept inverted, the step only divides by it
+	m_inertia[channel] = 1.0f / inertia;
+	m_viscous[channel] = viscous;
+	m_coulomb[channel] = coulomb;
+	m_maxTorque[channel] = maxTorque;
+}
+
+void ServoBank::SetGains(unsigned int channel, float position, float velocity, float integral)
+{
+	m_positionGain[channel] = position;
+	m_velocityGain[channel] = velocity;
+	m_integralGain[channel] = integral;
+}
+
+void ServoBank::Tune(unsigned int channel, float bandwidth)
+{
+	float velocity = bandwidth / m_inertia[channel];
+	SetGains(channel, 0.25f * bandwidth, velocity, 0.25f * bandwidth * velocity);
+}
+
+void ServoBank::Reset(unsigned int channel, float angle)
+{
+	m_angle[channel] = m_target[channel] = m_prevTarget[channel] = angle;
+	m_velocity[channel] = m_integral[channel] = m_torque[channel] = 0.0f;
+	m_error[channel] = m_maxError[channel] = 0.0f;
+}
+
+void ServoBank::SetTarget(unsigned int channel, float angle)
+{
+	float delta = angle - m_target[channel];
+	m_target[channel] += delta - XM_2PI * floor((delta + XM_PI) / XM_2PI);
+}
+
+void ServoBank::ResetStats()
+{
+	memset(m_maxError, 0, m_stride * sizeof(float));
+}
+
+void ServoBank::Update(float dt)
+{
+	m_time += dt;
+	unsigned int steps = static_cast<unsigned int>(m_time / STEP);
+	if (steps > MAX_STEPS)
+	{
+		steps = MAX_STEPS;
+		m_time = 0.0f;
+	}
+	else
+		m_time -= steps * STEP;
+	if (steps == 0)
+		return;
+	//Channels are independent, so every thread runs all the steps for its own blocks
+	m_threads.RunRanges(m_stride / 4, [&](unsigned int begin, unsigned int end)
+	{
+		Step(STEP, steps, steps * STEP, begin, end);
+	}, MIN_BLOCKS);
+	memcpy(m_prevTarget, m_target, m_stride * sizeof(float));
+}
+
+void ServoBank::Step(float h, unsigned int steps, float dt, unsigned int begin, unsigned int end)
+{
+	const __m128 vh = _mm_set1_ps(h), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	for (unsigned int i = 4 * begin; i < 4 * end; i += 4)
+	{
+		__m128 angle = _mm_load_ps(m_angle + i), velocity = _mm_load_ps(m_velocity + i);
+		__m128 integral = _mm_load_ps(m_integral + i), torque = zero, error = zero;
+		__m128 maxError = _mm_load_ps(m_maxError + i);
+		__m128 from = _mm_load_ps(m_prevTarget + i), to = _mm_load_ps(m_target + i);
+		__m128 load = _mm_load_ps(m_load + i);
+		__m128 kp = _mm_load_ps(m_positionGain + i), kv = _mm_load_ps(m_velocityGain + i);
+		__m128 ki = _mm_load_ps(m_integralGain + i), invInertia = _mm_load_ps(m_inertia + i);
+		__m128 maxTorque = _mm_load_ps(m_maxTorque + i);
+		//Viscous friction is implicit, which turns it into a division
+		__m128 viscousScale = _mm_div_ps(one, _mm_add_ps(one, _mm_mul_ps(vh, _mm_mul_ps(_mm_load_ps(m_viscous + i),
+			invInertia))));
+		__m128 stick = _mm_mul_ps(vh, _mm_mul_ps(_mm_load_ps(m_coulomb + i), invInertia));
+		__m128 commandVelocity = _mm_div_ps(_mm_sub_ps(to, from), _mm_set1_ps(dt));
+		for (unsigned int s = 0; s < steps; ++s)
+		{
+			__m128 target = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from),
+				_mm_set1_ps(static_cast<float>(s + 1) / steps)));
+			//Position loop sets the velocity, velocity loop the torque
+			__m128 velocityError = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(kp, _mm_sub_ps(target, angle)), commandVelocity),
+				velocity);
+			__m128 demand = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kv, velocityError), _mm_mul_ps(ki, integral)), load);
+			torque = _mm_max_ps(_mm_min_ps(demand, maxTorque), _mm_sub_ps(zero, maxTorque));
+			__m128 unsaturated = _mm_cmple_ps(_mm_andnot_ps(signBit, demand), maxTorque);
+			integral = _mm_add_ps(integral, _mm_and_ps(unsaturated, _mm_mul_ps(velocityError, vh)));
+
+			__m128 next = _mm_mul_ps(_mm_add_ps(velocity, _mm_mul_ps(vh, _mm_mul_ps(_mm_sub_ps(torque, load),
+				invInertia))), viscousScale);
+			//Coulomb friction takes up to stick off the speed but never reverses it
+			__m128 speed = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, next), stick), zero);
+			velocity = _mm_or_ps(speed, _mm_and_ps(signBit, next));
+			angle = _mm_add_ps(angle, _mm_mul_ps(vh, velocity));
+			error = _mm_sub_ps(target, angle);
+			maxError = _mm_max_ps(maxError, _mm_andnot_ps(signBit, error));
+		}
+		_mm_store_ps(m_angle + i, angle);
+		_mm_store_ps(m_velocity + i, velocity);
+		_mm_store_ps(m_integral + i, integral);
+		_mm_store_ps(m_torque + i, torque);
+		_mm_store_ps(m_error + i, error);
+		_mm_store_ps(m_maxError + i, maxError);
+	}
+}
@@ -0,0 +1,79 @@
+#ifndef __GK2_SERVO_BANK_H_
+#define __GK2_SERVO_BANK_H_
+
+namespace gk2
+{
+	class ThreadPool;
+
+	//Position servos of robot joints, each a motor with inertia, viscous and Coulomb friction and limited torque.
+	//Control is cascaded: the position error sets a velocity on top of the commanded one, and a PI loop on
+	//velocity sets the torque, together with the feedforward torque of the load. The integrator stops while
+	//the torque is saturated. Motion uses semi-implicit Euler with friction applied implicitly, so joints
+	//stick instead of chattering around zero velocity.
+	//Channels are stored as streams and stepped four at a time. Update runs fixed steps of STEP, whatever the
+	//frame time, and splits the channels between threads, each running every step for its channels.
+	class ServoBank
+	{
+	public:
+		static const float STEP;				//length of a controller step in seconds
+		static const unsigned int MAX_STEPS = 256;	//steps per Update, the rest of the time is dropped
+
+		ServoBank(unsigned int channels, gk2::ThreadPool& threads);
+		~ServoBank();
+
+		unsigned int getChannelCount() const { return m_count; }
+
+		//inertia in kg m^2, viscous friction in N m s, Coulomb friction and maxTorque in N m, all at the joint
+		void SetMotor(unsigned int channel, float inertia, float viscous, float coulomb, float maxTorque);
+		//position in 1 / s, velocity in N m s, integral in N m
+		void SetGains(unsigned int channel, float position, float velocity, float integral);
+		//Gains for a velocity loop of the given bandwidth in rad / s with the position loop four times slower
+		void Tune(unsigned int channel, float bandwidth);
+
+		//Places the joint at angle at rest, commanded to stay there
+		void Reset(unsigned int channel, float angle);
+		//Angle to reach by the end of the next Update, taken modulo a full turn closest to the previous one
+		void SetTarget(unsigned int channel, float angle);
+		//Torque the load takes from the motor, fed forward as well
+		void SetLoad(unsigned int channel, float torque) { m_load[channel] = torque; }
+		void Update(float dt);
+
+		float getAngle(unsigned int channel) const { return m_angle[channel]; }
+		float getVelocity(unsigned int channel) const { return m_velocity[channel]; }
+		float getTorque(unsigned int channel) const { return m_torque[channel]; }
+		float getTarget(unsigned int channel) const { return m_target[channel]; }
+		//Commanded angle minus the actual one after the last step
+		float getTrackingError(unsigned int channel) const { return m_error[channel]; }
+		//Largest absolute tracking error of any step since the last ResetStats
+		float getMaxTrackingError(unsigned int channel) const { return m_maxError[channel]; }
+		void ResetStats();
+
+	private:
+		static const unsigned int MIN_BLOCKS;		//blocks of four channels per thread worth a task
+		static const unsigned int STREAMS = 16;
+
+		gk2::ThreadPool& m_threads;
+		unsigned int m_count;
+		unsigned int m_stride;		//channel count rounded up to whole SSE blocks
+		float m_time;
+
+		float* m_data;
+		//State
+		float* m_angle; float* m_velocity; float* m_integral; float* m_torque;
+		float* m_error; float* m_maxError;
+		//Commands
+		float* m_target; float* m_prevTarget; float* m_load;
+		//Parameters
+		float* m_positionGain; float* m_velocityGain; float* m_integralGain;
+		float* m_inertia;			//inverse, 0 in the padding
+		float* m_viscous; float* m_coulomb; float* m_maxTorque;
+
+		//Runs steps steps of h for the channels of blocks [begin, end)
+		void Step(float h, unsigned int steps, float dt, unsigned int begin, unsigned int end);
+
+		ServoBank(const ServoBank& right) : m_threads(right.m_threads) { }
+		ServoBank& operator=(const ServoBank& right) { return *this; }
+	};
+}
+
+#endif __GK2_SERVO_BANK_H_
@@ -0,0 +1,336 @@
+#include "gk2_sessionLog.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+using namespace gk2;
+
+const float ReplayTiming::DEFAULT_TOLERANCE = 0.1f;
+const float ReplayTiming::MIN_REGRESSION = 0.02f;
+
+namespace
+{
+	const unsigned int HEADER_SIZE = 3 * sizeof(unsigned int);
+
+	//Small magnitudes of either sign to small values
+	unsigned int ZigZag(int value)
+	{
+		return (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+	}
+
+	int UnZigZag(unsigned int value)
+	{
+		return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+	}
+
+	bool SameBits(float a, float b)
+	{
+		return memcmp(&a, &b, sizeof(float)) == 0;
+	}
+
+	//Component i of a frame's target, position first, in the order of the change mask
+	float* TargetFloats(SessionFrame& frame, unsigned int i)
+	{
+		return i < 3 ? &frame.TargetPosition[i] : &frame.TargetNormal[i - 3];
+	}
+
+	const float* TargetFloats(const SessionFrame& frame, unsigned int i)
+	{
+		return i < 3 ? &frame.TargetPosition[i] : &frame.TargetNormal[i - 3];
+	}
+}
+
+SessionRecorder::SessionRecorder()
+	: m_open(false), m_failed(false), m_previous(SessionFrame())
+{
+}
+
+SessionRecorder::~SessionRecorder()
+{
+	Flush();
+}
+
+bool SessionRecorder::Open(const wstring& file, unsigned int seed)
+{
+	ofstream out(file.c_str(), ios::binary | ios::trunc);
+	const unsigned int header[3] = { MAGIC, VERSION, seed };
+	out.write(reinterpret_cast<const char*>(header), HEADER_SIZE);
+	if (!out)
+		return false;
+	m_file = file;
+	m_open = true;
+	m_failed = false;
+	m_buffer.clear();
+	m_buffer.reserve(FLUSH_SIZE);
+	m_previous = SessionFrame();
+	return true;
+}
+
+void SessionRecorder::Record(const SessionFrame& frame, unsigned int checksum)
+{
+	if (!m_open)
+		return;
+	unsigned char flags = 0;
+	if (!SameBits(frame.Dt, m_previous.Dt))
+		flags |= DT_CHANGED;
+	if (frame.Keys != m_previous.Keys)
+		flags |= KEYS_CHANGED;
+	if (frame.MouseX != 0 || frame.MouseY != 0)
+		flags |= MOUSE_MOVED;
+	if (frame.Target)
+		flags |= TARGET_ARRIVED;
+	Write(&flags, 1);
+	if (flags & DT_CHANGED)
+		Write(&frame.Dt, sizeof(float));
+	if (flags & KEYS_CHANGED)
+		WriteVarint(frame.Keys);
+	if (flags & MOUSE_MOVED)
+	{
+		WriteVarint(ZigZag(frame.MouseX));
+		WriteVarint(ZigZag(frame.MouseY));
+	}
+	if (flags & TARGET_ARRIVED)
+	{
+		//Against the previous target, which the frames without one carry along
+		unsigned char changed = 0;
+		for (unsigned int i = 0; i < TARGET_FLOATS; ++i)
+			if (!SameBits(*TargetFloats(frame, i), *TargetFloats(m_previous, i)))
+				changed |= 1 << i;
+		if (frame.TargetFlags != m_previous.TargetFlags)
+			changed |= TARGET_FLAGS_CHANGED;
+		Write(&changed, 1);
+		for (unsigned int i = 0; i < TARGET_FLOATS; ++i)
+			if (changed & (1 << i))
+				Write(TargetFloats(frame, i), sizeof(float));
+		if (changed & TARGET_FLAGS_CHANGED)
+			WriteVarint(frame.TargetFlags);
+	}
+	Write(&checksum, sizeof(unsigned int));
+
+	SessionFrame previous = m_previous;
+	m_previous = frame;
+	if (!frame.Target)
+	{
+		memcpy(m_previous.TargetPosition, previous.TargetPosition, sizeof(m_previous.TargetPosition));
+		memcpy(m_previous.TargetNormal, previous.TargetNormal, sizeof(m_previous.TargetNormal));
+		m_previous.TargetFlags = previous.TargetFlags;
+	}
+	if (m_buffer.size() >= FLUSH_SIZE)
+		Flush();
+}
+
+bool SessionRecorder::Flush()
+{
+	if (!m_open || m_buffer.empty())
+		return !m_failed;
+	ofstream out(m_file.c_str(), ios::binary | ios::app);
+	out.write(reinterpret_cast<const char*>(&m_buffer[0]), m_buffer.size());
+	if (!out)
+		m_failed = true;
+	m_buffer.clear();
+	return !m_failed;
+}
+
+unsigned int SessionRecorder::Checksum(const TelemetryRecord& record)
+{
+	//FNV-1a over the bytes of the state
+	unsigned int hash = 2166136261u;
+	auto add = [&hash](const void* data, unsigned int size)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		for (unsigned int i = 0; i < size; ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+	};
+	add(&record.Particles, sizeof(record.Particles));
+	add(record.Commanded, sizeof(record.Commanded));
+	add(record.Angles, sizeof(record.Angles));
+	add(record.TorchPosition, sizeof(record.TorchPosition));
+	add(record.TorchNormal, sizeof(record.TorchNormal));
+	add(record.Links, sizeof(record.Links));
+	return hash;
+}
+
+void SessionRecorder::Write(const void* data, unsigned int size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	m_buffer.insert(m_buffer.end(), bytes, bytes + size);
+}
+
+void SessionRecorder::WriteVarint(unsigned int value)
+{
+	while (value >= 0x80)
+	{
+		m_buffer.push_back(static_cast<unsigned char>(value | 0x80));
+		value >>= 7;
+	}
+	m_buffer.push_back(static_cast<unsigned char>(value));
+}
+
+SessionPlayer::SessionPlayer()
+	: m_position(0), m_seed(0), m_frames(0), m_previous(SessionFrame())
+{
+}
+
+bool SessionPlayer::Open(const wstring& file)
+{
+	ifstream in(file.c_str(), ios::binary);
+	if (!in)
+	{
+		m_error = "cannot open the session log";
+		return false;
+	}
+	m_data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	m_position = 0;
+	m_frames = 0;
+	m_previous = SessionFrame();
+	unsigned int header[3];
+	if (!Read(header, HEADER_SIZE) || header[0] != SessionRecorder::MAGIC)
+	{
+		m_error = "not a session log";
+		return false;
+	}
+	if (header[1] != SessionRecorder::VERSION)
+	{
+		m_error = "session log of another version";
+		return false;
+	}
+	m_seed = header[2];
+	m_error.clear();
+	return true;
+}
+
+bool SessionPlayer::Next(SessionFrame& frame, unsigned int& checksum)
+{
+	if (m_position == m_data.size())
+		return false;
+	frame = m_previous;
+	frame.MouseX = frame.MouseY = 0;
+	unsigned char flags;
+	bool read = Read(&flags, 1);
+	if (read && (flags & SessionRecorder::DT_CHANGED))
+		read = Read(&frame.Dt, sizeof(float));
+	if (read && (flags & SessionRecorder::KEYS_CHANGED))
+		read = ReadVarint(frame.Keys);
+	unsigned int x, y;
+	if (read && (flags & SessionRecorder::MOUSE_MOVED) && (read = ReadVarint(x) && ReadVarint(y)))
+	{
+		frame.MouseX = UnZigZag(x);
+		frame.MouseY = UnZigZag(y);
+	}
+	frame.Target = (flags & SessionRecorder::TARGET_ARRIVED) != 0;
+	if (read && frame.Target)
+	{
+		unsigned char changed;
+		read = Read(&changed, 1);
+		for (unsigned int i = 0; read && i < SessionRecorder::TARGET_FLOATS; ++i)
+			if (changed & (1 << i))
+				read = Read(TargetFloats(frame, i), sizeof(float));
+		if (read && (changed & SessionRecorder::TARGET_FLAGS_CHANGED))
+			read = ReadVarint(frame.TargetFlags);
+	}
+	if (read)
+		read = Read(&checksum, sizeof(unsigned int));
+	if (!read)
+	{
+		//A log cut short by a crash still replays up to its last whole frame
+		m_error = "session log ends inside a frame";
+		m_position = static_cast<unsigned int>(m_data.size());
+		return false;
+	}
+	m_previous = frame;
+	++m_frames;
+	return true;
+}
+
+bool SessionPlayer::Read(void* data, unsigned int size)
+{
+	if (m_data.size() - m_position < size)
+		return false;
+	memcpy(data, &m_data[m_position], size);
+	m_position += size;
+	return true;
+}
+
+bool SessionPlayer::ReadVarint(unsigned int& value)
+{
+	value = 0;
+	for (unsigned int shift = 0; shift < 32; shift += 7)
+	{
+		if (m_position == m_data.size())
+			return false;
+		unsigned char byte = m_data[m_position++];
+		value |= static_cast<unsigned int>(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void ReplayTiming::Add(const float* stageTimes)
+{
+	for (unsigned int s = 0; s < TELEMETRY_STAGE_COUNT; ++s)
+		m_times[s].push_back(stageTimes[s]);
+}
+
+void ReplayTiming::Summarize(unsigned int stage, float& median, float& high) const
+{
+	median = high = 0.0f;
+	if (m_times[stage].empty())
+		return;
+	vector<float> times = m_times[stage];
+	sort(times.begin(), times.end());
+	median = 1000.0f * times[times.size() / 2];
+	high = 1000.0f * times[times.size() * 99 / 100];
+}
+
+void ReplayTiming::Write(ostream& out) const
+{
+	out << "# frames " << getFrameCount() << ", stage median and 99% in ms" << endl;
+	out << fixed << setprecision(4);
+	for (unsigned int s = 0; s < TELEMETRY_STAGE_COUNT; ++s)
+	{
+		float median, high;
+		Summarize(s, median, high);
+		out << setw(10) << TelemetryRecord::STAGE_NAMES[s] << setw(11) << median << setw(11) << high << endl;
+	}
+}
+
+bool ReplayTiming::Compare(istream& baseline, float tolerance, ostream& out) const
+{
+	bool faster = true;
+	unsigned int stages = 0;
+	string line;
+	while (getline(baseline, line))
+	{
+		if (line.empty() || line[0] == '#')
+			continue;
+		istringstream fields(line);
+		string name;
+		float baseMedian, baseHigh;
+		if (!(fields >> name >> baseMedian >> baseHigh))
+			continue;
+		for (unsigned int s = 0; s < TELEMETRY_STAGE_COUNT; ++s)
+		{
+			if (name != TelemetryRecord::STAGE_NAMES[s])
+				continue;
+			++stages;
+			float median, high;
+			Summarize(s, median, high);
+			if (median <= baseMedian * (1.0f + tolerance) || median - baseMedian <= MIN_REGRESSION)
+				break;
+			out << name << " slower: median " << fixed << setprecision(4) << baseMedian << " -> " << median << " ms" <<
+				endl;
+			faster = false;
+			break;
+		}
+	}
+	if (stages == 0)
+	{
+		out << "baseline has no stages" << endl;
+		return false;
+	}
+	return faster;
+}
@@ -0,0 +1,130 @@
+#ifndef __GK2_SESSION_LOG_H_
+#define __GK2_SESSION_LOG_H_
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+#include "gk2_telemetry.h"
+
+namespace gk2
+{
+	//Everything from outside the simulation that one frame used
+	struct SessionFrame
+	{
+		float Dt;
+		unsigned int Keys;			//bit i set while the i-th key the application watches is down
+		int MouseX, MouseY;			//camera rotation by the mouse, in pixels
+		bool Target;				//a streamed target arrived, the newest of the frame follows
+		float TargetPosition[3];
+		float TargetNormal[3];
+		unsigned int TargetFlags;	//TargetMessage::Flags
+	};
+
+	//Writes the frames of a session to a binary log to be replayed later. The log starts with a header
+	//holding the seed of the simulation's random generators, then every frame is a byte of flags naming
+	//what changed since the frame before, the changed values only and a checksum of the state the frame
+	//left behind: a frame of a steady session takes five bytes.
+	class SessionRecorder
+	{
+	public:
+		static const unsigned int MAGIC = 0x53324b47;	//"GK2S"
+		static const unsigned int VERSION = 1;
+
+		SessionRecorder();
+		~SessionRecorder();
+
+		//Creates the log of a session seeded with seed, false if the file cannot be written
+		bool Open(const std::wstring& file, unsigned int seed);
+		void Record(const gk2::SessionFrame& frame, unsigned int checksum);
+		//Writes out the frames recorded so far, false if writing failed
+		bool Flush();
+
+		//Hash of the simulated state in a record, its step number and times left out
+		static unsigned int Checksum(const gk2::TelemetryRecord& record);
+
+	private:
+		//Frame flags
+		static const unsigned char DT_CHANGED = 1;
+		static const unsigned char KEYS_CHANGED = 2;
+		static const unsigned char MOUSE_MOVED = 4;
+		static const unsigned char TARGET_ARRIVED = 8;
+		//Target components changed since the previous target, the bits after them for the flags
+		static const unsigned int TARGET_FLOATS = 6;
+		static const unsigned char TARGET_FLAGS_CHANGED = 1 << TARGET_FLOATS;
+		static const unsigned int FLUSH_SIZE = 1 << 16;
+
+		std::wstring m_file;
+		bool m_open;
+		bool m_failed;
+		std::vector<unsigned char> m_buffer;
+		gk2::SessionFrame m_previous;
+
+		void Write(const void* data, unsigned int size);
+		void WriteVarint(unsigned int value);
+
+		SessionRecorder(const SessionRecorder& right) { }
+		SessionRecorder& operator=(const SessionRecorder& right) { return *this; }
+
+		friend class SessionPlayer;
+	};
+
+	//Reads the frames of a log SessionRecorder wrote, all of it loaded at once so that replaying a frame
+	//costs no file access
+	class SessionPlayer
+	{
+	public:
+		SessionPlayer();
+
+		//Loads a log, false with the error set if it is missing or is not one
+		bool Open(const std::wstring& file);
+		const std::string& getError() const { return m_error; }
+		unsigned int getSeed() const { return m_seed; }
+		//Frames read so far
+		unsigned int getFrameCount() const { return m_frames; }
+
+		//Next frame and the checksum of the state it left when recorded, false at the end of the log
+		bool Next(gk2::SessionFrame& frame, unsigned int& checksum);
+
+	private:
+		std::vector<unsigned char> m_data;
+		unsigned int m_position;
+		unsigned int m_seed;
+		unsigned int m_frames;
+		gk2::SessionFrame m_previous;
+		std::string m_error;
+
+		bool Read(void* data, unsigned int size);
+		bool ReadVarint(unsigned int& value);
+
+		SessionPlayer(const SessionPlayer& right) { }
+		SessionPlayer& operator=(const SessionPlayer& right) { return *this; }
+	};
+
+	//Times of the update stages over the frames of a replay, summarized to compare one run with another
+	class ReplayTiming
+	{
+	public:
+		//Relative slowdown of a stage's median taken for a regression, and the least one in milliseconds,
+		//below which timer noise is all there is
+		static const float DEFAULT_TOLERANCE;
+		static const float MIN_REGRESSION;
+
+		//Adds a frame's times of the TELEMETRY_STAGE_COUNT stages, in seconds
+		void Add(const float* stageTimes);
+		unsigned int getFrameCount() const { return static_cast<unsigned int>(m_times[0].size()); }
+
+		//Writes the median and the 99th percentile of every stage in milliseconds, a stage per line
+		void Write(std::ostream& out) const;
+		//Compares with a summary Write made before, writing a line for every stage slower by more than
+		//tolerance; returns false if there is such a stage or the baseline cannot be read
+		bool Compare(std::istream& baseline, float tolerance, std::ostream& out) const;
+
+	private:
+		std::vector<float> m_times[gk2::TELEMETRY_STAGE_COUNT];
+
+		//Median and 99th percentile of a stage in milliseconds
+		void Summarize(unsigned int stage, float& median, float& high) const;
+	};
+}
+
+#endif __GK2_SESSION_LOG_H_
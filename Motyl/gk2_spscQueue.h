@@ -0,0 +1,84 @@
+#ifndef __GK2_SPSC_QUEUE_H_
+#define __GK2_SPSC_QUEUE_H_
+
+#include <atomic>
+
+namespace gk2
+{
+	//Bounded lock-free queue between one producer and one consumer thread, SIZE a power of two.
+	//Items stay in place from the producer writing them to the consumer reading them: the producer fills the
+	//slot from BeginPush and publishes it with EndPush, the consumer reads Front and frees it with Pop.
+	//Each side owns one index and caches the other's, so it reads the other side's cache line only when
+	//the queue looks full or empty, and the two indices live on separate cache lines.
+	template<typename T, unsigned int SIZE>
+	class SpscQueue
+	{
+	public:
+		SpscQueue()
+			: m_head(0), m_tailSeen(0), m_tail(0), m_headSeen(0)
+		{ }
+
+		//Producer: slot for the next item, 0 if the queue is full
+		T* BeginPush()
+		{
+			unsigned int tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_headSeen == SIZE)
+			{
+				m_headSeen = m_head.load(std::memory_order_acquire);
+				if (tail - m_headSeen == SIZE)
+					return 0;
+			}
+			return &m_items[tail & (SIZE - 1)];
+		}
+		//Producer: hands the slot from BeginPush over to the consumer
+		void EndPush()
+		{
+			m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+		bool Push(const T& item)
+		{
+			T* slot = BeginPush();
+			if (!slot)
+				return false;
+			*slot = item;
+			EndPush();
+			return true;
+		}
+
+		//Consumer: oldest item, 0 if the queue is empty
+		const T* Front()
+		{
+			unsigned int head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tailSeen)
+			{
+				m_tailSeen = m_tail.load(std::memory_order_acquire);
+				if (head == m_tailSeen)
+					return 0;
+			}
+			return &m_items[head & (SIZE - 1)];
+		}
+		//Consumer: gives the slot of Front back to the producer
+		void Pop()
+		{
+			m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+
+	private:
+		static const unsigned int CACHE_LINE = 64;
+
+		//Consumer side
+		std::atomic<unsigned int> m_head;
+		unsigned int m_tailSeen;
+		char m_consumerPadding[CACHE_LINE];
+		//Producer side
+		std::atomic<unsigned int> m_tail;
+		unsigned int m_headSeen;
+		char m_producerPadding[CACHE_LINE];
+		T m_items[SIZE];
+
+		SpscQueue(const SpscQueue& right) { }
+		SpscQueue& operator=(const SpscQueue& right) { return *this; }
+	};
+}
+
+#endif __GK2_SPSC_QUEUE_H_
@@ -0,0 +1,149 @@
+#include <WinSock2.h>
+#include "gk2_targetStream.h"
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int TargetListener::RECEIVE_TIMEOUT = 100;
+
+namespace
+{
+	//Room for bursts the receiving thread has not caught up with yet
+	const int RECEIVE_BUFFER = 1 << 20;
+
+	sockaddr_in LoopbackAddress(unsigned short port)
+	{
+		sockaddr_in address = { };
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		return address;
+	}
+}
+
+TargetListener::TargetListener(unsigned short port)
+	: m_port(port), m_socket(INVALID_SOCKET), m_running(false), m_dropped(0)
+{
+}
+
+TargetListener::~TargetListener()
+{
+	Stop();
+}
+
+double TargetListener::Now()
+{
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return static_cast<double>(counter.QuadPart) / static_cast<double>(frequency.QuadPart);
+}
+
+bool TargetListener::Start()
+{
+	if (m_running)
+		return true;
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return false;
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	DWORD timeout = RECEIVE_TIMEOUT;
+	sockaddr_in address = LoopbackAddress(m_port);
+	if (s == INVALID_SOCKET ||
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout)) != 0 ||
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&RECEIVE_BUFFER), sizeof(RECEIVE_BUFFER)) != 0 ||
+		bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		if (s != INVALID_SOCKET)
+			closesocket(s);
+		WSACleanup();
+		return false;
+	}
+	m_socket = s;
+	m_running = true;
+	m_thread = thread(&TargetListener::Receive, this);
+	return true;
+}
+
+void TargetListener::Stop()
+{
+	if (!m_running)
+		return;
+	m_running = false;
+	m_thread.join();
+	closesocket(m_socket);
+	m_socket = INVALID_SOCKET;
+	WSACleanup();
+}
+
+void TargetListener::Receive()
+{
+	TargetMessage discarded;
+	while (m_running)
+	{
+		//Received where the consumer will read it, unless the queue is full
+		TargetSample* slot = m_queue.BeginPush();
+		TargetMessage* message = slot ? &slot->Message : &discarded;
+		int size = recv(m_socket, reinterpret_cast<char*>(message), sizeof(TargetMessage), 0);
+		if (size == SOCKET_ERROR)
+		{
+			//Timeouts only let Stop be noticed, longer datagrams are not targets
+			if (WSAGetLastError() == WSAEMSGSIZE)
+				++m_dropped;
+			continue;
+		}
+		double received = Now();
+		if (!slot || size != sizeof(TargetMessage) || message->Magic != TargetMessage::MAGIC)
+		{
+			++m_dropped;
+			continue;
+		}
+		slot->Received = received;
+		m_queue.EndPush();
+	}
+}
+
+TargetSender::TargetSender(unsigned short port)
+	: m_socket(INVALID_SOCKET), m_port(port), m_sequence(0)
+{
+	WSADATA data;
+	if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+		return;
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	sockaddr_in address = LoopbackAddress(m_port);
+	if (s == INVALID_SOCKET || connect(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		if (s != INVALID_SOCKET)
+			closesocket(s);
+		WSACleanup();
+		return;
+	}
+	m_socket = s;
+}
+
+TargetSender::~TargetSender()
+{
+	if (m_socket == INVALID_SOCKET)
+		return;
+	closesocket(m_socket);
+	WSACleanup();
+}
+
+bool TargetSender::Send(const float* position, const float* normal, bool welding)
+{
+	if (m_socket == INVALID_SOCKET)
+		return false;
+	//The message is its own wire format
+	TargetMessage message;
+	message.Magic = TargetMessage::MAGIC;
+	message.Sequence = m_sequence++;
+	for (unsigned int i = 0; i < 3; ++i)
+	{
+		message.Position[i] = position[i];
+		message.Normal[i] = normal[i];
+	}
+	message.Flags = welding ? TargetMessage::WELDING : 0;
+	message.Reserved = 0;
+	message.Time = TargetListener::Now();
+	return send(m_socket, reinterpret_cast<const char*>(&message), sizeof(message), 0) == sizeof(message);
+}
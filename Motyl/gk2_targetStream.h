@@ -0,0 +1,95 @@
+#ifndef __GK2_TARGET_STREAM_H_
+#define __GK2_TARGET_STREAM_H_
+
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include "gk2_spscQueue.h"
+
+namespace gk2
+{
+	//Torch pose for the robot to go to, as sent in one datagram, little-endian
+	struct TargetMessage
+	{
+		static const unsigned int MAGIC = 0x54474b32;	//"2KGT"
+		static const unsigned int WELDING = 1;			//flag for the arc on
+
+		unsigned int Magic;
+		unsigned int Sequence;
+		double Time;				//sender's TargetListener::Now when sent
+		float Position[3];			//of the torch tip
+		float Normal[3];			//from the tip back along the torch
+		unsigned int Flags;
+		unsigned int Reserved;
+	};
+
+	//Received target and when it arrived
+	struct TargetSample
+	{
+		gk2::TargetMessage Message;
+		double Received;
+	};
+
+	//Listens on a loopback UDP port for targets from the cell controller on a thread of its own, which
+	//receives every datagram straight into a free slot of a lock-free queue and checks it there; the
+	//consumer reads the samples in place. A target arriving to a full queue is dropped rather than waiting,
+	//so a consumer emptying the queue every frame sees each target within a frame of its arrival.
+	class TargetListener
+	{
+	public:
+		static const unsigned short DEFAULT_PORT = 27015;
+		static const unsigned int QUEUE_SIZE = 256;
+
+		TargetListener(unsigned short port = DEFAULT_PORT);
+		~TargetListener();
+
+		//Binds the port and starts receiving, false if the port is taken or there is no network
+		bool Start();
+		void Stop();
+
+		//Oldest target not taken yet, 0 if there is none; only the thread calling Pop may call it
+		const gk2::TargetSample* Front() { return m_queue.Front(); }
+		void Pop() { m_queue.Pop(); }
+		//Datagrams that were not targets or found the queue full
+		unsigned int getDropped() const { return m_dropped; }
+
+		//Seconds on the performance counter, the clock of TargetMessage::Time
+		static double Now();
+
+	private:
+		static const unsigned int RECEIVE_TIMEOUT;	//milliseconds between checks for Stop
+
+		unsigned short m_port;
+		uintptr_t m_socket;
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<unsigned int> m_dropped;
+		gk2::SpscQueue<gk2::TargetSample, QUEUE_SIZE> m_queue;
+
+		void Receive();
+
+		TargetListener(const TargetListener& right) { }
+		TargetListener& operator=(const TargetListener& right) { return *this; }
+	};
+
+	//Sends targets to a TargetListener on the same machine, stamped with the time and a sequence number
+	class TargetSender
+	{
+	public:
+		TargetSender(unsigned short port = TargetListener::DEFAULT_PORT);
+		~TargetSender();
+
+		bool Send(const float* position, const float* normal, bool welding);
+		unsigned int getSent() const { return m_sequence; }
+
+	private:
+		uintptr_t m_socket;
+		unsigned short m_port;
+		unsigned int m_sequence;
+
+		TargetSender(const TargetSender& right) { }
+		TargetSender& operator=(const TargetSender& right) { return *this; }
+	};
+}
+
+#endif __GK2_TARGET_STREAM_H_
@@ -0,0 +1,190 @@
+#include "gk2_telemetry.h"
+#include "gk2_targetStream.h"
+#include <Windows.h>
+#include <fstream>
+#include <cstring>
+#include <new>
+
+using namespace std;
+using namespace gk2;
+
+const char* TelemetryRecord::STAGE_NAMES[TELEMETRY_STAGE_COUNT] = { "robot", "rope", "particles", "trails", "heat",
+	"glow", "bead" };
+const wchar_t* TelemetryWriter::DEFAULT_NAME = L"Local\\MotylTelemetry";
+
+TelemetryWriter::TelemetryWriter(const wchar_t* name, unsigned int capacity)
+	: m_name(name), m_capacity(capacity), m_mapping(0), m_header(0), m_slots(0)
+{
+}
+
+TelemetryWriter::~TelemetryWriter()
+{
+	if (m_header)
+		UnmapViewOfFile(m_header);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+}
+
+bool TelemetryWriter::Create()
+{
+	if (m_header)
+		return true;
+	DWORD size = static_cast<DWORD>(sizeof(TelemetryHeader) + m_capacity * sizeof(TelemetrySlot));
+	HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, size, m_name.c_str());
+	if (!mapping)
+		return false;
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!view)
+	{
+		CloseHandle(mapping);
+		return false;
+	}
+	m_mapping = mapping;
+	m_header = new (view) TelemetryHeader();
+	m_slots = reinterpret_cast<TelemetrySlot*>(m_header + 1);
+	for (unsigned int i = 0; i < m_capacity; ++i)
+		new (&m_slots[i]) TelemetrySlot();
+	m_header->Version = TelemetryHeader::VERSION;
+	m_header->RecordSize = sizeof(TelemetryRecord);
+	m_header->Capacity = m_capacity;
+	m_header->Written.store(0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	m_header->Magic = TelemetryHeader::MAGIC;
+	return true;
+}
+
+void TelemetryWriter::Publish(const TelemetryRecord& record)
+{
+	if (!m_header)
+		return;
+	unsigned int n = m_header->Written.load(memory_order_relaxed);
+	TelemetrySlot& slot = m_slots[n % m_capacity];
+	slot.Sequence.store(2 * n + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(&slot.Record, &record, sizeof(record));
+	slot.Sequence.store(2 * n + 2, memory_order_release);
+	m_header->Written.store(n + 1, memory_order_release);
+}
+
+TelemetryReader::TelemetryReader()
+	: m_mapping(0), m_header(0), m_slots(0)
+{
+}
+
+TelemetryReader::~TelemetryReader()
+{
+	Close();
+}
+
+bool TelemetryReader::Open(const wchar_t* name)
+{
+	Close();
+	HANDLE mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+	if (!mapping)
+		return false;
+	const TelemetryHeader* header = static_cast<const TelemetryHeader*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!header || header->Magic != TelemetryHeader::MAGIC || header->Version != TelemetryHeader::VERSION ||
+		header->RecordSize != sizeof(TelemetryRecord))
+	{
+		if (header)
+			UnmapViewOfFile(header);
+		CloseHandle(mapping);
+		return false;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	m_mapping = mapping;
+	m_header = header;
+	m_slots = reinterpret_cast<const TelemetrySlot*>(header + 1);
+	return true;
+}
+
+void TelemetryReader::Close()
+{
+	if (m_header)
+		UnmapViewOfFile(m_header);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	m_mapping = 0;
+	m_header = 0;
+	m_slots = 0;
+}
+
+bool TelemetryReader::Read(unsigned int n, TelemetryRecord& record) const
+{
+	const TelemetrySlot& slot = m_slots[n % m_header->Capacity];
+	unsigned int sequence = slot.Sequence.load(memory_order_acquire);
+	if (sequence != 2 * n + 2)
+		return false;
+	memcpy(&record, &slot.Record, sizeof(record));
+	atomic_thread_fence(memory_order_acquire);
+	return slot.Sequence.load(memory_order_relaxed) == sequence;
+}
+
+int TelemetryReader::Dump(const wstring& file, float seconds)
+{
+	//The simulation may still be starting
+	TelemetryReader reader;
+	double start = TargetListener::Now();
+	while (!reader.Open())
+	{
+		if (TargetListener::Now() - start > seconds)
+			return -1;
+		Sleep(100);
+	}
+	ofstream out(file.c_str());
+	if (!out)
+		return -1;
+	out << "step,time,particles";
+	for (unsigned int j = 1; j <= PumaKinematics::JOINTS; ++j)
+		out << ",commanded" << j;
+	for (unsigned int j = 1; j <= PumaKinematics::JOINTS; ++j)
+		out << ",angle" << j;
+	out << ",x,y,z,nx,ny,nz";
+	for (unsigned int s = 0; s < TELEMETRY_STAGE_COUNT; ++s)
+		out << "," << TelemetryRecord::STAGE_NAMES[s];
+	out << '\n';
+	unsigned int capacity = reader.m_header->Capacity, next = reader.getWritten(), read = 0, lost = 0;
+	start = TargetListener::Now();
+	while (TargetListener::Now() - start < seconds)
+	{
+		unsigned int written = reader.getWritten();
+		//Records already overwritten are not even tried
+		if (written - next > capacity)
+		{
+			lost += written - next - capacity;
+			next = written - capacity;
+		}
+		for (; next != written; ++next)
+		{
+			TelemetryRecord record;
+			if (!reader.Read(next, record))
+			{
+				++lost;
+				continue;
+			}
+			++read;
+			out << record.Step << "," << record.Time << "," << record.Particles;
+			for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+				out << "," << record.Commanded[j];
+			for (unsigned int j = 0; j < PumaKinematics::JOINTS; ++j)
+				out << "," << record.Angles[j];
+			for (unsigned int i = 0; i < 3; ++i)
+				out << "," << record.TorchPosition[i];
+			for (unsigned int i = 0; i < 3; ++i)
+				out << "," << record.TorchNormal[i];
+			for (unsigned int s = 0; s < TELEMETRY_STAGE_COUNT; ++s)
+				out << "," << record.StageTimes[s];
+			out << '\n';
+		}
+		//Once per drained batch, a flush per record would keep the reader behind a fast ring
+		out.flush();
+		Sleep(1);
+	}
+	out << "# read " << read << ", lost " << lost << endl;
+	return 0;
+}
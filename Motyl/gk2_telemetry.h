@@ -0,0 +1,119 @@
+#ifndef __GK2_TELEMETRY_H_
+#define __GK2_TELEMETRY_H_
+
+#include <atomic>
+#include <string>
+#include "gk2_pumaKinematics.h"
+
+namespace gk2
+{
+	//Parts of a simulation step timed in every record
+	enum TelemetryStage
+	{
+		ROBOT_STAGE,		//motion source, inverse kinematics, dynamics and servos
+		ROPE_STAGE,
+		PARTICLES_STAGE,
+		TRAILS_STAGE,
+		HEAT_STAGE,
+		GLOW_STAGE,
+		BEAD_STAGE,
+		TELEMETRY_STAGE_COUNT
+	};
+
+	//State of the robot after one simulation step, as laid out in shared memory
+	struct TelemetryRecord
+	{
+		static const char* STAGE_NAMES[TELEMETRY_STAGE_COUNT];
+
+		unsigned int Step;
+		unsigned int Particles;		//alive in the particle system
+		double Time;				//TargetListener::Now at the end of the step, the clock of streamed targets
+		float Commanded[gk2::PumaKinematics::JOINTS];	//joint angles sent to the servos
+		float Angles[gk2::PumaKinematics::JOINTS];		//joint angles the servos reached
+		float TorchPosition[3];		//commanded torch tip
+		float TorchNormal[3];
+		float Links[gk2::PumaKinematics::LINKS][16];	//world matrices of the links, row-major
+		float StageTimes[TELEMETRY_STAGE_COUNT];		//seconds
+	};
+
+	//Start of the shared memory, followed by the slots of the ring
+	struct TelemetryHeader
+	{
+		static const unsigned int MAGIC = 0x4d4c4554;	//"TELM"
+		static const unsigned int VERSION = 1;
+
+		unsigned int Magic;			//set last, once the rest is valid
+		unsigned int Version;
+		unsigned int RecordSize;	//of TelemetryRecord, readers of another layout refuse it
+		unsigned int Capacity;		//slots in the ring
+		std::atomic<unsigned int> Written;	//records published so far
+		unsigned int Reserved[3];
+	};
+
+	struct TelemetrySlot
+	{
+		//2n + 1 while record n is written, 2n + 2 once it is complete
+		std::atomic<unsigned int> Sequence;
+		unsigned int Reserved;
+		gk2::TelemetryRecord Record;
+	};
+
+	//Publishes a record every simulation step into a ring in named shared memory, for tools on the same
+	//machine. There is a single writer and every slot is a seqlock: the writer marks the slot odd, copies
+	//the record and marks it even with the record's number, never waiting for anyone. A reader copies a
+	//slot between two reads of its sequence and keeps the copy only if both show the record it wanted, so
+	//readers polling at any rate cost the simulation nothing and see a record whole or not at all.
+	class TelemetryWriter
+	{
+	public:
+		static const wchar_t* DEFAULT_NAME;
+		static const unsigned int DEFAULT_CAPACITY = 1024;
+
+		TelemetryWriter(const wchar_t* name = DEFAULT_NAME, unsigned int capacity = DEFAULT_CAPACITY);
+		~TelemetryWriter();
+
+		//Creates the shared memory, false if it cannot or another writer has it already
+		bool Create();
+		void Publish(const gk2::TelemetryRecord& record);
+
+	private:
+		std::wstring m_name;
+		unsigned int m_capacity;
+		void* m_mapping;
+		gk2::TelemetryHeader* m_header;
+		gk2::TelemetrySlot* m_slots;
+
+		TelemetryWriter(const TelemetryWriter& right) { }
+		TelemetryWriter& operator=(const TelemetryWriter& right) { return *this; }
+	};
+
+	//Reads the records of a TelemetryWriter in another process
+	class TelemetryReader
+	{
+	public:
+		TelemetryReader();
+		~TelemetryReader();
+
+		//Opens the shared memory, false if there is none or its layout is not this one
+		bool Open(const wchar_t* name = TelemetryWriter::DEFAULT_NAME);
+		void Close();
+
+		unsigned int getWritten() const { return m_header->Written.load(std::memory_order_acquire); }
+		//Copies record number n, false if it is not published yet or was overwritten before it was read
+		bool Read(unsigned int n, gk2::TelemetryRecord& record) const;
+
+		//Reader utility: writes the records published in the next seconds to a CSV file, polling every
+		//millisecond, and ends it with the number of records read and lost; returns an exit code
+		static int Dump(const std::wstring& file, float seconds);
+
+	private:
+		void* m_mapping;
+		const gk2::TelemetryHeader* m_header;
+		const gk2::TelemetrySlot* m_slots;
+
+		TelemetryReader(const TelemetryReader& right) { }
+		TelemetryReader& operator=(const TelemetryReader& right) { return *this; }
+	};
+}
+
+#endif __GK2_TELEMETRY_H_
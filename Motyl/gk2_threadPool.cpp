@@ -0,0 +1,105 @@
+#include "gk2_threadPool.h"
+
+using namespace std;
+using namespace gk2;
+
+ThreadPool::ThreadPool(unsigned int threads)
+	: m_task(nullptr), m_tasks(0), m_generation(0), m_active(0), m_quit(false), m_nextTask(0)
+{
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	m_workers.reserve(threads - 1);
+	for (unsigned int i = 1; i < threads; ++i)
+		m_workers.push_back(thread(&ThreadPool::WorkerLoop, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (unsigned int i = 0; i < m_workers.size(); ++i)
+		m_workers[i].join();
+}
+
+void ThreadPool::Work(const function<void (unsigned int)>& task, unsigned int tasks)
+{
+	for (unsigned int i = m_nextTask++; i < tasks; i = m_nextTask++)
+		task(i);
+}
+
+void ThreadPool::WorkerLoop()
+{
+	unsigned int generation = 0;
+	for (;;)
+	{
+		const function<void (unsigned int)>* task;
+		unsigned int tasks;
+		{
+			unique_lock<mutex> lock(m_mutex);
+			while (!m_quit && generation == m_generation)
+				m_wake.wait(lock);
+			if (m_quit)
+				return;
+			generation = m_generation;
+			task = m_task;
+			tasks = m_tasks;
+			++m_active;
+		}
+		Work(*task, tasks);
+		{
+			unique_lock<mutex> lock(m_mutex);
+			--m_active;
+		}
+		m_done.notify_all();
+	}
+}
+
+void ThreadPool::Run(unsigned int tasks, const function<void (unsigned int)>& task)
+{
+	if (tasks == 0)
+		return;
+	if (tasks == 1 || m_workers.empty())
+	{
+		for (unsigned int i = 0; i < tasks; ++i)
+			task(i);
+		return;
+	}
+	{
+		//A worker that joined the previous batch late may still hold its task pointer
+		unique_lock<mutex> lock(m_mutex);
+		while (m_active > 0)
+			m_done.wait(lock);
+		m_task = &task;
+		m_tasks = tasks;
+		m_nextTask = 0;
+		++m_generation;
+	}
+	m_wake.notify_all();
+	Work(task, tasks);
+	unique_lock<mutex> lock(m_mutex);
+	while (m_active > 0)
+		m_done.wait(lock);
+}
+
+void ThreadPool::RunRanges(unsigned int count, const function<void (unsigned int, unsigned int)>& task,
+	unsigned int minRange)
+{
+	if (count == 0)
+		return;
+	unsigned int ranges = getThreadCount();
+	if (minRange == 0)
+		minRange = 1;
+	if (ranges > (count + minRange - 1) / minRange)
+		ranges = (count + minRange - 1) / minRange;
+	Run(ranges, [&](unsigned int r)
+	{
+		unsigned int begin = static_cast<unsigned int>(static_cast<unsigned long long>(count) * r / ranges);
+		unsigned int end = static_cast<unsigned int>(static_cast<unsigned long long>(count) * (r + 1) / ranges);
+		task(begin, end);
+	});
+}
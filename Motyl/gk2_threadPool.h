@@ -0,0 +1,53 @@
+#ifndef __GK2_THREAD_POOL_H_
+#define __GK2_THREAD_POOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+namespace gk2
+{
+	//Fixed set of worker threads executing batches of independent tasks.
+	//Run blocks until every task of the batch has finished; the calling thread works on the batch too.
+	class ThreadPool
+	{
+	public:
+		//threads is the total number of threads working on a batch, including the caller.
+		//0 uses one thread per hardware thread.
+		ThreadPool(unsigned int threads = 0);
+		~ThreadPool();
+
+		unsigned int getThreadCount() const { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+		//Calls task(i) for every i in [0, tasks)
+		void Run(unsigned int tasks, const std::function<void (unsigned int)>& task);
+		//Splits [0, count) into about one range per thread and calls task(begin, end) for each
+		void RunRanges(unsigned int count, const std::function<void (unsigned int, unsigned int)>& task,
+			unsigned int minRange = 1024);
+
+	private:
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		std::condition_variable m_done;
+
+		//Batch state, only changed while no worker is active
+		const std::function<void (unsigned int)>* m_task;
+		unsigned int m_tasks;
+		unsigned int m_generation;
+		unsigned int m_active;
+		bool m_quit;
+		std::atomic<unsigned int> m_nextTask;
+
+		void WorkerLoop();
+		void Work(const std::function<void (unsigned int)>& task, unsigned int tasks);
+
+		ThreadPool(const ThreadPool& right) { }
+		ThreadPool& operator=(const ThreadPool& right) { return *this; }
+	};
+}
+
+#endif __GK2_THREAD_POOL_H_
@@ -0,0 +1,246 @@
+#include "gk2_trails.h"
+#include "gk2_particles.h"
+#include "gk2_exceptions.h"
+#include "gk2_utils.h"
+#include <xmmintrin.h>
+#include <cstring>
+
+using namespace std;
+using namespace gk2;
+
+const D3D11_INPUT_ELEMENT_DESC TrailVertex::Layout[TrailVertex::LayoutElements] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+const unsigned int TrailSystem::STRIDE = sizeof(TrailVertex);
+const unsigned int TrailSystem::OFFSET = 0;
+
+TrailSystem::TrailSystem(DeviceHelper& device, unsigned int maxTrails, unsigned int maxPoints,
+	unsigned int maxStreaks)
+	: m_maxTrails(maxTrails), m_maxPoints(maxPoints), m_maxStreaks(maxStreaks), m_time(0.0f),
+	m_cameraPos(0.0f, 0.0f, 0.0f, 1.0f), m_verticesCount(0), m_streakSource(nullptr), m_streakLength(0.0f),
+	m_streakWidth(0.0f)
+{
+	m_trails.reserve(maxTrails);
+	//Scratch arrays get a pad before the first point and slack for the last SSE block
+	unsigned int scratchSize = maxPoints + 8;
+	unsigned int streaksSize = maxStreaks * STREAK_STRIDE + 8;
+	size_t size = sizeof(float) * (maxTrails * 4 * maxPoints + 4 * scratchSize + 3 * streaksSize);
+	m_data = reinterpret_cast<float*>(Utils::New16Aligned(size));
+	memset(m_data, 0, size);
+	m_rings = m_data;
+	float* scratch = m_rings + maxTrails * 4 * maxPoints;
+	for (int i = 0; i < 4; ++i)
+		m_scratch[i] = scratch + i * scratchSize + 1;
+	scratch += 4 * scratchSize;
+	for (int i = 0; i < 3; ++i)
+		m_streaks[i] = scratch + i * streaksSize;
+	for (unsigned int k = 0; k < STREAK_STRIDE + 4; ++k)
+	{
+		float fade = (static_cast<float>(k) - 1.0f) / (STREAK_POINTS - 1);
+		m_streakFade[k] = fade < 0.0f ? 0.0f : (fade > 1.0f ? 1.0f : fade);
+	}
+
+	unsigned int maxVertices = maxTrails * (2 * maxPoints + 2) + maxStreaks * (2 * STREAK_POINTS + 2);
+	m_vertices = device.CreateVertexBuffer<TrailVertex>(maxVertices, D3D11_USAGE_DYNAMIC);
+	shared_ptr<ID3DBlob> vsByteCode = device.CompileD3DShader(L"resources/shaders/Trails.hlsl", "VS_Main", "vs_4_0");
+	shared_ptr<ID3DBlob> psByteCode = device.CompileD3DShader(L"resources/shaders/Trails.hlsl", "PS_Main", "ps_4_0");
+	m_vs = device.CreateVertexShader(vsByteCode);
+	m_ps = device.CreatePixelShader(psByteCode);
+	m_layout = device.CreateInputLayout<TrailVertex>(vsByteCode);
+	//Ribbons turn around, both sides have to be visible
+	D3D11_RASTERIZER_DESC rsDesc = device.DefaultRasterizerDesc();
+	rsDesc.CullMode = D3D11_CULL_NONE;
+	m_rsNoCull = device.CreateRasterizerState(rsDesc);
+}
+
+TrailSystem::~TrailSystem()
+{
+	Utils::Delete16Aligned(m_data);
+}
+
+void TrailSystem::SetViewMtxBuffer(const shared_ptr<CBMatrix>& view)
+{
+	if (view != nullptr)
+		m_viewCB = view;
+}
+
+void TrailSystem::SetProjMtxBuffer(const shared_ptr<CBMatrix>& proj)
+{
+	if (proj != nullptr)
+		m_projCB = proj;
+}
+
+void TrailSystem::SetStreakSource(const ParticleSystem* particles, float length, float width)
+{
+	m_streakSource = particles;
+	m_streakLength = length;
+	m_streakWidth = width;
+}
+
+unsigned int TrailSystem::AddTrail(float width, float lifetime)
+{
+	if (m_trails.size() == m_maxTrails)
+		return INVALID_TRAIL;
+	Trail trail = { width, lifetime, m_maxPoints - 1, 0 };
+	m_trails.push_back(trail);
+	return static_cast<unsigned int>(m_trails.size()) - 1;
+}
+
+void TrailSystem::Push(unsigned int trail, const XMFLOAT3& pos)
+{
+	Trail& t = m_trails[trail];
+	t.head = t.head + 1 == m_maxPoints ? 0 : t.head + 1;
+	if (t.count < m_maxPoints)
+		++t.count;
+	Ring(trail, 0)[t.head] = pos.x;
+	Ring(trail, 1)[t.head] = pos.y;
+	Ring(trail, 2)[t.head] = pos.z;
+	Ring(trail, 3)[t.head] = m_time;
+}
+
+void TrailSystem::Clear(unsigned int trail)
+{
+	m_trails[trail].count = 0;
+}
+
+TrailVertex* TrailSystem::WriteRibbon(const float* x, const float* y, const float* z, const float* fade,
+	unsigned int count, float width, TrailVertex* dst, TrailVertex& last, bool join) const
+{
+	const __m128 cx = _mm_set1_ps(m_cameraPos.x), cy = _mm_set1_ps(m_cameraPos.y), cz = _mm_set1_ps(m_cameraPos.z);
+	const __m128 halfWidth = _mm_set1_ps(0.5f * width);
+	const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+	float left[3][4], right[3][4], fades[4];
+	for (unsigned int i = 0; i < count; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+		//Tangent from the neighbours, the pads make it one-sided at the ends
+		__m128 tx = _mm_sub_ps(_mm_loadu_ps(x + i + 1), _mm_loadu_ps(x + i - 1));
+		__m128 ty = _mm_sub_ps(_mm_loadu_ps(y + i + 1), _mm_loadu_ps(y + i - 1));
+		__m128 tz = _mm_sub_ps(_mm_loadu_ps(z + i + 1), _mm_loadu_ps(z + i - 1));
+		__m128 vx = _mm_sub_ps(cx, px), vy = _mm_sub_ps(cy, py), vz = _mm_sub_ps(cz, pz);
+		//Side vector perpendicular to the tangent and to the direction towards the camera
+		__m128 sx = _mm_sub_ps(_mm_mul_ps(ty, vz), _mm_mul_ps(tz, vy));
+		__m128 sy = _mm_sub_ps(_mm_mul_ps(tz, vx), _mm_mul_ps(tx, vz));
+		__m128 sz = _mm_sub_ps(_mm_mul_ps(tx, vy), _mm_mul_ps(ty, vx));
+		__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+		len2 = _mm_max_ps(len2, _mm_set1_ps(1e-12f));
+		//One Newton step makes the estimate exact enough for a ribbon width
+		__m128 inv = _mm_rsqrt_ps(len2);
+		inv = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), inv),
+			_mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(len2, inv), inv)));
+		//Ribbons taper towards the tail
+		__m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(fade + i), zero), one);
+		__m128 scale = _mm_mul_ps(inv, _mm_mul_ps(halfWidth, _mm_sub_ps(one, f)));
+		sx = _mm_mul_ps(sx, scale); sy = _mm_mul_ps(sy, scale); sz = _mm_mul_ps(sz, scale);
+		_mm_storeu_ps(left[0], _mm_sub_ps(px, sx));
+		_mm_storeu_ps(left[1], _mm_sub_ps(py, sy));
+		_mm_storeu_ps(left[2], _mm_sub_ps(pz, sz));
+		_mm_storeu_ps(right[0], _mm_add_ps(px, sx));
+		_mm_storeu_ps(right[1], _mm_add_ps(py, sy));
+		_mm_storeu_ps(right[2], _mm_add_ps(pz, sz));
+		_mm_storeu_ps(fades, f);
+		unsigned int lanes = count - i < 4 ? count - i : 4;
+		for (unsigned int lane = 0; lane < lanes; ++lane, dst += 2)
+		{
+			TrailVertex l, r;
+			l.Pos = XMFLOAT3(left[0][lane], left[1][lane], left[2][lane]);
+			l.Tex = XMFLOAT2(fades[lane], 0.0f);
+			r.Pos = XMFLOAT3(right[0][lane], right[1][lane], right[2][lane]);
+			r.Tex = XMFLOAT2(fades[lane], 1.0f);
+			if (join && i + lane == 0)
+			{
+				//Repeating the end of the previous ribbon and the start of this one gives zero-area triangles
+				dst[0] = last;
+				dst[1] = l;
+				dst += 2;
+			}
+			dst[0] = l;
+			dst[1] = r;
+			last = r;
+		}
+	}
+	return dst;
+}
+
+void TrailSystem::Update(shared_ptr<ID3D11DeviceContext>& context, float dt, XMFLOAT4 cameraPos)
+{
+	m_time += dt;
+	m_cameraPos = cameraPos;
+	D3D11_MAPPED_SUBRESOURCE resource;
+	HRESULT hr = context->Map(m_vertices.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
+	if (FAILED(hr))
+		THROW_DX11(hr);
+	TrailVertex* begin = reinterpret_cast<TrailVertex*>(resource.pData);
+	TrailVertex* dst = begin;
+	TrailVertex last;
+
+	for (unsigned int i = 0; i < m_trails.size(); ++i)
+	{
+		Trail& trail = m_trails[i];
+		const float* ring[4] = { Ring(i, 0), Ring(i, 1), Ring(i, 2), Ring(i, 3) };
+		//Drop points that outlived the trail, the oldest ones are at the tail
+		while (trail.count > 0 &&
+			m_time - ring[3][(trail.head + m_maxPoints - trail.count + 1) % m_maxPoints] > trail.lifetime)
+			--trail.count;
+		if (trail.count < 2)
+			continue;
+		//Unroll the ring head first, the time stream becomes the fade
+		unsigned int r = trail.head;
+		for (unsigned int k = 0; k < trail.count; ++k)
+		{
+			m_scratch[0][k] = ring[0][r];
+			m_scratch[1][k] = ring[1][r];
+			m_scratch[2][k] = ring[2][r];
+			m_scratch[3][k] = (m_time - ring[3][r]) / trail.lifetime;
+			r = r == 0 ? m_maxPoints - 1 : r - 1;
+		}
+		for (int s = 0; s < 3; ++s)
+		{
+			m_scratch[s][-1] = m_scratch[s][0];
+			m_scratch[s][trail.count] = m_scratch[s][trail.count - 1];
+		}
+		dst = WriteRibbon(m_scratch[0], m_scratch[1], m_scratch[2], m_scratch[3], trail.count, trail.width, dst, last,
+			dst != begin);
+	}
+
+	if (m_streakSource != nullptr && m_maxStreaks > 0)
+	{
+		//Point k of streak p is at [p * STREAK_STRIDE + 1 + k], between the pads
+		unsigned int streaks = m_streakSource->SampleSparkPaths(m_streakLength / (STREAK_POINTS - 1), STREAK_POINTS,
+			STREAK_STRIDE, m_streaks[0] + 1, m_streaks[1] + 1, m_streaks[2] + 1, m_maxStreaks);
+		for (unsigned int p = 0; p < streaks; ++p)
+		{
+			float* streak[3] = { m_streaks[0] + p * STREAK_STRIDE, m_streaks[1] + p * STREAK_STRIDE,
+				m_streaks[2] + p * STREAK_STRIDE };
+			for (int s = 0; s < 3; ++s)
+			{
+				streak[s][0] = streak[s][1];
+				streak[s][STREAK_POINTS + 1] = streak[s][STREAK_POINTS];
+			}
+			dst = WriteRibbon(streak[0] + 1, streak[1] + 1, streak[2] + 1, m_streakFade + 1, STREAK_POINTS,
+				m_streakWidth, dst, last, dst != begin);
+		}
+	}
+	context->Unmap(m_vertices.get(), 0);
+	m_verticesCount = static_cast<unsigned int>(dst - begin);
+}
+
+void TrailSystem::Render(shared_ptr<ID3D11DeviceContext>& context)
+{
+	if (m_verticesCount == 0)
+		return;
+	context->VSSetShader(m_vs.get(), nullptr, 0);
+	context->PSSetShader(m_ps.get(), nullptr, 0);
+	context->IASetInputLayout(m_layout.get());
+	ID3D11Buffer* vsb[2] = { m_viewCB->getBufferObject().get(), m_projCB->getBufferObject().get() };
+	context->VSSetConstantBuffers(0, 2, vsb);
+	context->RSSetState(m_rsNoCull.get());
+	ID3D11Buffer* vb[1] = { m_vertices.get() };
+	context->IASetVertexBuffers(0, 1, vb, &STRIDE, &OFFSET);
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	context->Draw(m_verticesCount, 0);
+	context->RSSetState(nullptr);
+}
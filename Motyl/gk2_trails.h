@@ -0,0 +1,107 @@
+#ifndef __GK2_TRAILS_H_
+#define __GK2_TRAILS_H_
+
+#include <d3d11.h>
+#include <xnamath.h>
+#include <memory>
+#include <vector>
+#include "gk2_deviceHelper.h"
+#include "gk2_constantBuffer.h"
+
+namespace gk2
+{
+	class ParticleSystem;
+
+	struct TrailVertex
+	{
+		XMFLOAT3 Pos;
+		XMFLOAT2 Tex;		//x goes from 0 at the head to 1 at the tail, y from one edge to the other
+		static const unsigned int LayoutElements = 2;
+		static const D3D11_INPUT_ELEMENT_DESC Layout[LayoutElements];
+
+		TrailVertex() : Pos(0.0f, 0.0f, 0.0f), Tex(0.0f, 0.0f) { }
+	};
+
+	//Camera-facing ribbons drawn from one dynamic vertex buffer with a single draw call.
+	//A trail keeps the points pushed to it in a fixed-size ring buffer and drops those older than its
+	//lifetime. Streaks behind sparks are sampled from their ballistic paths every frame, so they need
+	//no history. Ribbons are generated four points at a time with SSE straight into the mapped buffer
+	//and joined into one strip by degenerate triangles. All memory is allocated up front.
+	class TrailSystem
+	{
+	public:
+		TrailSystem(gk2::DeviceHelper& device, unsigned int maxTrails, unsigned int maxPoints,
+			unsigned int maxStreaks = 0);
+		~TrailSystem();
+
+		void SetViewMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& view);
+		void SetProjMtxBuffer(const std::shared_ptr<gk2::CBMatrix>& proj);
+		//Sparks of particles get streaks length seconds long, nullptr disables them
+		void SetStreakSource(const gk2::ParticleSystem* particles, float length, float width);
+
+		//Returns the index of the new trail, or INVALID_TRAIL if there are maxTrails trails already
+		unsigned int AddTrail(float width, float lifetime);
+		//Adds a point at the head of the trail, the oldest point is overwritten if the ring is full
+		void Push(unsigned int trail, const XMFLOAT3& pos);
+		void Clear(unsigned int trail);
+
+		void Update(std::shared_ptr<ID3D11DeviceContext>& context, float dt, XMFLOAT4 cameraPos);
+		void Render(std::shared_ptr<ID3D11DeviceContext>& context);
+
+		static const unsigned int INVALID_TRAIL = 0xffffffffu;
+
+	private:
+		static const unsigned int STREAK_POINTS = 4;
+		static const unsigned int STREAK_STRIDE = STREAK_POINTS + 2;	//points of a streak with both end pads
+		static const unsigned int OFFSET;
+		static const unsigned int STRIDE;
+
+		struct Trail
+		{
+			float width;
+			float lifetime;
+			unsigned int head;		//ring index of the newest point
+			unsigned int count;
+		};
+
+		unsigned int m_maxTrails;
+		unsigned int m_maxPoints;
+		unsigned int m_maxStreaks;
+		std::vector<Trail> m_trails;
+		float m_time;
+		XMFLOAT4 m_cameraPos;
+		unsigned int m_verticesCount;
+
+		//Rings are x, y, z and time streams of maxPoints each, scratch arrays hold one ribbon's points
+		//with a pad on both ends, so neighbours of every point can be loaded without branches
+		float* m_data;
+		float* m_rings;
+		float* m_scratch[4];
+		float* m_streaks[3];
+		float m_streakFade[STREAK_STRIDE + 4];
+
+		const gk2::ParticleSystem* m_streakSource;
+		float m_streakLength;
+		float m_streakWidth;
+
+		std::shared_ptr<ID3D11Buffer> m_vertices;
+		std::shared_ptr<gk2::CBMatrix> m_viewCB;
+		std::shared_ptr<gk2::CBMatrix> m_projCB;
+		std::shared_ptr<ID3D11RasterizerState> m_rsNoCull;
+		std::shared_ptr<ID3D11VertexShader> m_vs;
+		std::shared_ptr<ID3D11PixelShader> m_ps;
+		std::shared_ptr<ID3D11InputLayout> m_layout;
+
+		float* Ring(unsigned int trail, unsigned int stream) { return m_rings + (trail * 4 + stream) * m_maxPoints; }
+		//Writes two vertices per point, x[-1] and x[count] must hold copies of the end points.
+		//If join is set, the ribbon is joined to the one ending with last by two repeated vertices.
+		//last is set to the final vertex written. Returns the end of the written vertices.
+		gk2::TrailVertex* WriteRibbon(const float* x, const float* y, const float* z, const float* fade,
+			unsigned int count, float width, gk2::TrailVertex* dst, gk2::TrailVertex& last, bool join) const;
+
+		TrailSystem(const TrailSystem& right) { }
+		TrailSystem& operator=(const TrailSystem& right) { return *this; }
+	};
+}
+
+#endif __GK2_TRAILS_H_
@@ -0,0 +1,249 @@
+#include "gk2_trajectoryOptimizer.h"
+#include "gk2_distanceField.h"
+#include "gk2_threadPool.h"
+#include <cmath>
+#include <cfloat>
+#include <map>
+
+using namespace std;
+using namespace gk2;
+
+const unsigned int TrajectoryOptimizer::MIN_BATCH = 16;
+
+namespace
+{
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z;
+	}
+
+	//Cell of pos on a grid of the given spacing, packed into one key
+	long long GridKey(const XMFLOAT3& pos, float spacing)
+	{
+		const long long OFFSET = 1 << 20;
+		long long x = static_cast<long long>(floor(pos.x / spacing)) + OFFSET;
+		long long y = static_cast<long long>(floor(pos.y / spacing)) + OFFSET;
+		long long z = static_cast<long long>(floor(pos.z / spacing)) + OFFSET;
+		return (x << 42) | (y << 21) | z;
+	}
+}
+
+TrajectoryOptimizer::TrajectoryOptimizer(const PumaKinematics& kinematics, const DistanceField& field,
+	ThreadPool& threads)
+	: m_kinematics(kinematics), m_field(field), m_threads(threads), m_smoothness(0.1f), m_clearance(0.15f),
+	m_step(0.2f), m_iterations(0), m_minClearance(FLT_MAX)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_lower[j] = -FLT_MAX;
+		m_upper[j] = FLT_MAX;
+	}
+}
+
+void TrajectoryOptimizer::AddSphere(unsigned int link, const XMFLOAT3& center, float radius)
+{
+	Sphere sphere;
+	sphere.link = link;
+	sphere.center = center;
+	sphere.radius = radius;
+	m_spheres.push_back(sphere);
+}
+
+void TrajectoryOptimizer::AddLink(unsigned int link, const VertexPosNormal* vertices, unsigned int count,
+	float cubeSize)
+{
+	map<long long, vector<XMFLOAT3>> cubes;
+	for (unsigned int i = 0; i < count; ++i)
+		cubes[GridKey(vertices[i].Pos, cubeSize)].push_back(vertices[i].Pos);
+	for (map<long long, vector<XMFLOAT3>>::iterator it = cubes.begin(); it != cubes.end(); ++it)
+	{
+		const vector<XMFLOAT3>& points = it->second;
+		XMVECTOR min = XMLoadFloat3(&points[0]), max = min;
+		for (unsigned int i = 1; i < points.size(); ++i)
+		{
+			min = XMVectorMin(min, XMLoadFloat3(&points[i]));
+			max = XMVectorMax(max, XMLoadFloat3(&points[i]));
+		}
+		XMFLOAT3 center;
+		XMStoreFloat3(&center, 0.5f * (min + max));
+		float radius = 0.0f;
+		for (unsigned int i = 0; i < points.size(); ++i)
+		{
+			XMFLOAT3 d(points[i].x - center.x, points[i].y - center.y, points[i].z - center.z);
+			radius = Dot(d, d) > radius * radius ? sqrt(Dot(d, d)) : radius;
+		}
+		AddSphere(link, center, radius);
+	}
+}
+
+void TrajectoryOptimizer::SetLimits(const float* lower, const float* upper)
+{
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		m_lower[j] = lower[j];
+		m_upper[j] = upper[j];
+	}
+}
+
+void TrajectoryOptimizer::SetWeights(float smoothness, float clearance, float step)
+{
+	m_smoothness = smoothness;
+	m_clearance = clearance;
+	m_step = step;
+}
+
+void TrajectoryOptimizer::Resample(const vector<float>& path, unsigned int waypoints, vector<float>& trajectory)
+{
+	unsigned int count = static_cast<unsigned int>(path.size()) / JOINTS;
+	trajectory.resize(waypoints * JOINTS);
+	if (count == 0)
+		return;
+	vector<float> lengths(count, 0.0f);
+	for (unsigned int i = 1; i < count; ++i)
+	{
+		float length = 0.0f;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			length += (path[i * JOINTS + j] - path[(i - 1) * JOINTS + j]) * (path[i * JOINTS + j] - path[(i - 1) * JOINTS + j]);
+		lengths[i] = lengths[i - 1] + sqrt(length);
+	}
+	unsigned int segment = 0;
+	for (unsigned int w = 0; w < waypoints; ++w)
+	{
+		float target = waypoints > 1 ? lengths[count - 1] * w / (waypoints - 1) : 0.0f;
+		while (segment + 2 < count && lengths[segment + 1] < target)
+			++segment;
+		unsigned int next = segment + 1 < count ? segment + 1 : segment;
+		float span = lengths[next] - lengths[segment];
+		float t = span > 0.0f ? (target - lengths[segment]) / span : 0.0f;
+		t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+		for (unsigned int j = 0; j < JOINTS; ++j)
+			trajectory[w * JOINTS + j] = path[segment * JOINTS + j] + t * (path[next * JOINTS + j] - path[segment * JOINTS + j]);
+	}
+	//The ends exactly, interpolation may round them
+	for (unsigned int j = 0; j < JOINTS; ++j)
+	{
+		trajectory[j] = path[j];
+		trajectory[(waypoints - 1) * JOINTS + j] = path[(count - 1) * JOINTS + j];
+	}
+}
+
+float TrajectoryOptimizer::ObstacleCost(const float* angles, float* gradient, float& clearance) const
+{
+	XMMATRIX matrices[PumaKinematics::LINKS];
+	m_kinematics.GetLinkMatrices(angles, matrices);
+	//Joint j turns the links from j on about its axis as it is posed by link j
+	XMFLOAT3 points[PumaKinematics::LINKS], axes[PumaKinematics::LINKS];
+	for (unsigned int j = 1; j < PumaKinematics::LINKS; ++j)
+	{
+		XMStoreFloat3(&points[j], XMVector3TransformCoord(XMLoadFloat3(&m_kinematics.getJointPoint(j)), matrices[j]));
+		XMStoreFloat3(&axes[j], XMVector3TransformNormal(XMLoadFloat3(&m_kinematics.getJointAxis(j)), matrices[j]));
+	}
+	for (unsigned int j = 0; j < JOINTS; ++j)
+		gradient[j] = 0.0f;
+	clearance = FLT_MAX;
+	float cost = 0.0f;
+	for (unsigned int s = 0; s < m_spheres.size(); ++s)
+	{
+		const Sphere& sphere = m_spheres[s];
+		XMFLOAT3 center, normal;
+		XMStoreFloat3(&center, XMVector3TransformCoord(XMLoadFloat3(&sphere.center), matrices[sphere.link]));
+		float distance = m_field.Sample(center, &normal) - sphere.radius;
+		clearance = distance < clearance ? distance : clearance;
+		if (distance >= m_clearance)
+			continue;
+		//Derivative of the cost by the distance
+		float slope;
+		if (distance < 0.0f)
+		{
+			cost += 0.5f * m_clearance - distance;
+			slope = -1.0f;
+		}
+		else
+		{
+			float depth = m_clearance - distance;
+			cost += 0.5f * depth * depth / m_clearance;
+			slope = -depth / m_clearance;
+		}
+		for (unsigned int j = 1; j <= sphere.link; ++j)
+		{
+			XMFLOAT3 r(center.x - points[j].x, center.y - points[j].y, center.z - points[j].z);
+			const XMFLOAT3& a = axes[j];
+			XMFLOAT3 velocity(a.y * r.z - a.z * r.y, a.z * r.x - a.x * r.z, a.x * r.y - a.y * r.x);
+			gradient[j - 1] += slope * Dot(normal, velocity);
+		}
+	}
+	return cost;
+}
+
+float TrajectoryOptimizer::EvaluateObstacles(const vector<float>& trajectory)
+{
+	unsigned int waypoints = static_cast<unsigned int>(trajectory.size()) / JOINTS;
+	m_threads.RunRanges(waypoints - 2, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin + 1; i < end + 1; ++i)
+			m_costs[i] = ObstacleCost(&trajectory[i * JOINTS], &m_gradients[i * JOINTS], m_clearances[i]);
+	}, MIN_BATCH);
+	float cost = 0.0f;
+	m_minClearance = FLT_MAX;
+	for (unsigned int i = 1; i + 1 < waypoints; ++i)
+	{
+		cost += m_costs[i];
+		m_minClearance = m_clearances[i] < m_minClearance ? m_clearances[i] : m_minClearance;
+	}
+	return cost;
+}
+
+float TrajectoryOptimizer::Optimize(vector<float>& trajectory, unsigned int maxIterations, float tolerance)
+{
+	unsigned int waypoints = static_cast<unsigned int>(trajectory.size()) / JOINTS;
+	m_iterations = 0;
+	if (waypoints < 3)
+		return 0.0f;
+	unsigned int inner = waypoints - 2;
+	m_gradients.resize(waypoints * JOINTS);
+	m_costs.resize(waypoints);
+	m_clearances.resize(waypoints);
+	//Both terms are integrals over the trajectory's duration, taken as 1
+	float scale = static_cast<float>(waypoints - 1), dt = 1.0f / scale;
+	//Forward elimination factors of the metric's tridiagonal (-1, 2, -1), the same for every joint
+	vector<float> pivots(inner), direction(inner);
+	pivots[0] = 0.5f;
+	for (unsigned int k = 1; k < inner; ++k)
+		pivots[k] = 1.0f / (2.0f - pivots[k - 1]);
+	float previous = FLT_MAX, cost;
+	for (;;)
+	{
+		float obstacles = EvaluateObstacles(trajectory);
+		float smoothness = 0.0f;
+		for (unsigned int i = 0; i + 1 < waypoints; ++i)
+			for (unsigned int j = 0; j < JOINTS; ++j)
+				smoothness += (trajectory[(i + 1) * JOINTS + j] - trajectory[i * JOINTS + j]) *
+					(trajectory[(i + 1) * JOINTS + j] - trajectory[i * JOINTS + j]);
+		cost = 0.5f * scale * m_smoothness * smoothness + dt * obstacles;
+		if (m_iterations == maxIterations || fabs(previous - cost) <= tolerance * cost)
+			break;
+		previous = cost;
+		++m_iterations;
+		for (unsigned int j = 0; j < JOINTS; ++j)
+		{
+			//Gradient of the cost, eliminated on the way
+			for (unsigned int k = 0; k < inner; ++k)
+			{
+				const float* q = &trajectory[(k + 1) * JOINTS + j];
+				float gradient = scale * m_smoothness * (2.0f * q[0] - q[-static_cast<int>(JOINTS)] - q[JOINTS]) +
+					dt * m_gradients[(k + 1) * JOINTS + j];
+				direction[k] = (gradient + (k > 0 ? direction[k - 1] : 0.0f)) * pivots[k];
+			}
+			for (unsigned int k = inner - 1; k-- > 0; )
+				direction[k] += pivots[k] * direction[k + 1];
+			//The metric is the smoothness Hessian, so a step of 1 would straighten the path at once
+			for (unsigned int k = 0; k < inner; ++k)
+			{
+				float& q = trajectory[(k + 1) * JOINTS + j];
+				q -= m_step / (scale * m_smoothness) * direction[k];
+				q = q < m_lower[j] ? m_lower[j] : (q > m_upper[j] ? m_upper[j] : q);
+			}
+		}
+	}
+	return cost;
+}
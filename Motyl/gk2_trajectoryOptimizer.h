@@ -0,0 +1,86 @@
+#ifndef __GK2_TRAJECTORY_OPTIMIZER_H_
+#define __GK2_TRAJECTORY_OPTIMIZER_H_
+
+#include <xnamath.h>
+#include <vector>
+#include "gk2_pumaKinematics.h"
+#include "gk2_vertices.h"
+
+namespace gk2
+{
+	class DistanceField;
+	class ThreadPool;
+
+	//Smooths a joint trajectory and pushes it away from obstacles by covariant gradient descent (CHOMP).
+	//The cost is the integral of squared joint velocities plus the integral of an obstacle cost of spheres
+	//covering the links, which grows quadratically once a sphere comes closer than the clearance to an
+	//obstacle of the distance field and linearly once it is inside. Obstacle gradients of the waypoints are
+	//independent and are computed in ranges split between threads, each through the link Jacobian.
+	//Every step is preconditioned by the inverse of the smoothness metric, a tridiagonal solve per joint,
+	//which spreads a push over the whole trajectory instead of bending a single waypoint. The ends of the
+	//trajectory stay where they are and the other waypoints are clamped to the joint limits.
+	class TrajectoryOptimizer
+	{
+	public:
+		static const unsigned int JOINTS = gk2::PumaKinematics::JOINTS;
+
+		TrajectoryOptimizer(const gk2::PumaKinematics& kinematics, const gk2::DistanceField& field,
+			gk2::ThreadPool& threads);
+
+		//Sphere moving with link, center in mesh coordinates
+		void AddSphere(unsigned int link, const XMFLOAT3& center, float radius);
+		//Covers a mesh moving with link with spheres around its vertices, grouped into cubes of cubeSize
+		void AddLink(unsigned int link, const gk2::VertexPosNormal* vertices, unsigned int count, float cubeSize);
+		void SetLimits(const float* lower, const float* upper);
+		//smoothness weighs the velocity term against the obstacle term, obstacles closer than clearance cost,
+		//step is the part of the way towards the optimum of the current linearization taken at once
+		void SetWeights(float smoothness, float clearance, float step);
+
+		//Waypoints evenly spaced by joint space length along path, JOINTS angles each
+		static void Resample(const std::vector<float>& path, unsigned int waypoints, std::vector<float>& trajectory);
+		//Improves trajectory in place until the cost changes by less than tolerance of itself, returns the cost
+		float Optimize(std::vector<float>& trajectory, unsigned int maxIterations, float tolerance = 1e-4f);
+
+		unsigned int getSphereCount() const { return static_cast<unsigned int>(m_spheres.size()); }
+		unsigned int getIterations() const { return m_iterations; }
+		//Smallest distance between a sphere and an obstacle at the last evaluated waypoints
+		float getClearance() const { return m_minClearance; }
+
+	private:
+		static const unsigned int MIN_BATCH;		//waypoints per thread worth a task
+
+		struct Sphere
+		{
+			unsigned int link;
+			XMFLOAT3 center;
+			float radius;
+		};
+
+		const gk2::PumaKinematics& m_kinematics;
+		const gk2::DistanceField& m_field;
+		gk2::ThreadPool& m_threads;
+		std::vector<Sphere> m_spheres;
+		float m_lower[JOINTS];
+		float m_upper[JOINTS];
+		float m_smoothness;
+		float m_clearance;
+		float m_step;
+		unsigned int m_iterations;
+		float m_minClearance;
+		//Per waypoint results of the parallel pass
+		std::vector<float> m_gradients;
+		std::vector<float> m_costs;
+		std::vector<float> m_clearances;
+
+		//Obstacle cost of the arm at angles, its gradient and the smallest sphere distance
+		float ObstacleCost(const float* angles, float* gradient, float& clearance) const;
+		//Obstacle costs and gradients of the inner waypoints, returns their sum
+		float EvaluateObstacles(const std::vector<float>& trajectory);
+
+		TrajectoryOptimizer(const TrajectoryOptimizer& right)
+			: m_kinematics(right.m_kinematics), m_field(right.m_field), m_threads(right.m_threads) { }
+		TrajectoryOptimizer& operator=(const TrajectoryOptimizer& right) { return *this; }
+	};
+}
+
+#endif __GK2_TRAJECTORY_OPTIMIZER_H_
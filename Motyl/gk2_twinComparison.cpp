@@ -0,0 +1,121 @@
+#include "gk2_twinComparison.h"
+#include <iomanip>
+#include <ostream>
+#include <cmath>
+
+using namespace std;
+using namespace gk2;
+
+TwinComparison::TwinComparison(const MotionProgram& program, const MotionProgram::ForwardKinematics& forward,
+	const MotionProgram::InverseKinematics& inverse)
+	: m_program(program), m_forward(forward), m_inverse(inverse), m_total(DeviationStats())
+{
+}
+
+bool TwinComparison::Compare(JointLog& log)
+{
+	unsigned int segments = m_program.getSegmentCount() > 0 ? m_program.getSegmentCount() : 1;
+	vector<vector<DeviationStats>> taskSegments(log.getTaskCount(), vector<DeviationStats>(segments, DeviationStats()));
+	vector<unsigned int> positions(log.getTaskCount(), 0);
+	bool read = log.Read([&](unsigned int task, const JointSample* samples, unsigned int count)
+	{
+		for (unsigned int i = 0; i < count; ++i)
+			Add(samples[i], taskSegments[task], positions[task]);
+	});
+	m_segments.assign(segments, DeviationStats());
+	m_total = DeviationStats();
+	for (unsigned int t = 0; t < taskSegments.size(); ++t)
+		for (unsigned int s = 0; s < segments; ++s)
+		{
+			Merge(m_segments[s], taskSegments[t][s]);
+			Merge(m_total, taskSegments[t][s]);
+		}
+	return read;
+}
+
+void TwinComparison::Add(const JointSample& sample, vector<DeviationStats>& segments, unsigned int& segment) const
+{
+	float duration = m_program.getDuration();
+	float time = static_cast<float>(duration > 0.0f ? fmod(sample.Time, static_cast<double>(duration)) : 0.0);
+	MotionTarget target;
+	m_program.Evaluate(time < 0.0f ? time + duration : time, target, segment);
+
+	XMFLOAT3 position, normal, commandedPosition, commandedNormal;
+	m_forward(sample.Angles, position, normal);
+	float commanded[MotionProgram::JOINTS];
+	if (target.Joint)
+	{
+		for (unsigned int j = 0; j < MotionProgram::JOINTS; ++j)
+			commanded[j] = target.Angles[j];
+		m_forward(commanded, commandedPosition, commandedNormal);
+	}
+	else
+	{
+		commandedPosition = target.Position;
+		commandedNormal = target.Normal;
+		m_inverse(commandedPosition, commandedNormal, commanded);
+	}
+
+	float positionError = XMVectorGetX(XMVector3Length(XMLoadFloat3(&position) - XMLoadFloat3(&commandedPosition)));
+	float cosine = XMVectorGetX(XMVector3Dot(XMVector3Normalize(XMLoadFloat3(&normal)),
+		XMVector3Normalize(XMLoadFloat3(&commandedNormal))));
+	float orientationError = acosf(cosine > 1.0f ? 1.0f : (cosine < -1.0f ? -1.0f : cosine));
+	float jointError = 0.0f;
+	for (unsigned int j = 0; j < MotionProgram::JOINTS; ++j)
+	{
+		//The same pose a turn apart is no error
+		float error = fabsf(remainderf(sample.Angles[j] - commanded[j], XM_2PI));
+		jointError = error > jointError ? error : jointError;
+	}
+
+	DeviationStats& stats = segments[segment < segments.size() ? segment : segments.size() - 1];
+	++stats.Samples;
+	stats.PositionSum += positionError;
+	stats.PositionSquares += static_cast<double>(positionError) * positionError;
+	stats.PositionMax = positionError > stats.PositionMax ? positionError : stats.PositionMax;
+	stats.OrientationSum += orientationError;
+	stats.OrientationMax = orientationError > stats.OrientationMax ? orientationError : stats.OrientationMax;
+	stats.JointSum += jointError;
+	stats.JointMax = jointError > stats.JointMax ? jointError : stats.JointMax;
+}
+
+void TwinComparison::Merge(DeviationStats& stats, const DeviationStats& other)
+{
+	stats.Samples += other.Samples;
+	stats.PositionSum += other.PositionSum;
+	stats.PositionSquares += other.PositionSquares;
+	stats.PositionMax = other.PositionMax > stats.PositionMax ? other.PositionMax : stats.PositionMax;
+	stats.OrientationSum += other.OrientationSum;
+	stats.OrientationMax = other.OrientationMax > stats.OrientationMax ? other.OrientationMax : stats.OrientationMax;
+	stats.JointSum += other.JointSum;
+	stats.JointMax = other.JointMax > stats.JointMax ? other.JointMax : stats.JointMax;
+}
+
+void TwinComparison::WriteLine(ostream& out, const DeviationStats& stats)
+{
+	double n = stats.Samples > 0 ? static_cast<double>(stats.Samples) : 1.0;
+	out << setw(11) << stats.Samples << fixed << setprecision(3) <<
+		setw(11) << 1000.0 * stats.PositionSum / n << setw(11) << 1000.0 * sqrt(stats.PositionSquares / n) <<
+		setw(11) << 1000.0f * stats.PositionMax <<
+		setw(11) << XMConvertToDegrees(static_cast<float>(stats.OrientationSum / n)) <<
+		setw(11) << XMConvertToDegrees(stats.OrientationMax) <<
+		setw(11) << XMConvertToDegrees(static_cast<float>(stats.JointSum / n)) <<
+		setw(11) << XMConvertToDegrees(stats.JointMax) << endl;
+}
+
+void TwinComparison::Write(ostream& out) const
+{
+	out << setw(10) << "segment" << setw(11) << "samples" << setw(11) << "pos mean" << setw(11) << "pos rms" <<
+		setw(11) << "pos max" << setw(11) << "dir mean" << setw(11) << "dir max" << setw(11) << "joint mean" <<
+		setw(11) << "joint max" << endl;
+	out << setw(10) << "" << setw(11) << "" << setw(11) << "[mm]" << setw(11) << "[mm]" << setw(11) << "[mm]" <<
+		setw(11) << "[deg]" << setw(11) << "[deg]" << setw(11) << "[deg]" << setw(11) << "[deg]" << endl;
+	for (unsigned int s = 0; s < m_segments.size(); ++s)
+		if (m_segments[s].Samples > 0)
+		{
+			out << setw(10) << s;
+			WriteLine(out, m_segments[s]);
+		}
+	out << setw(10) << "all";
+	WriteLine(out, m_total);
+}
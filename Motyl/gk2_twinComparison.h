@@ -0,0 +1,62 @@
+#ifndef __GK2_TWIN_COMPARISON_H_
+#define __GK2_TWIN_COMPARISON_H_
+
+#include <vector>
+#include <iosfwd>
+#include "gk2_motionProgram.h"
+#include "gk2_jointLog.h"
+
+namespace gk2
+{
+	//How far a real robot was from its program over a number of samples
+	struct DeviationStats
+	{
+		unsigned long long Samples;
+		double PositionSum;			//torch tip from the commanded one, metres
+		double PositionSquares;
+		float PositionMax;
+		double OrientationSum;		//torch direction from the commanded one, radians
+		float OrientationMax;
+		double JointSum;			//largest joint angle from the simulator's inverse kinematics, radians
+		float JointMax;
+	};
+
+	//Compares joint logs of a real robot with its digital twin. The torch pose of every sample comes from
+	//the simulator's forward kinematics, the commanded pose from the program at the sample's time, taken
+	//modulo the program's duration as the simulator loops it, and the commanded angles from the
+	//simulator's inverse kinematics of that pose. Each thread of the log's reader keeps statistics of its
+	//own per segment of the program, added up once the whole log is read.
+	class TwinComparison
+	{
+	public:
+		TwinComparison(const gk2::MotionProgram& program, const gk2::MotionProgram::ForwardKinematics& forward,
+			const gk2::MotionProgram::InverseKinematics& inverse);
+
+		//Compares every sample of the open log, false with the log's error set if it cannot be read
+		bool Compare(gk2::JointLog& log);
+		const std::vector<gk2::DeviationStats>& getSegments() const { return m_segments; }
+		const gk2::DeviationStats& getTotal() const { return m_total; }
+
+		//Writes the statistics of every segment with samples and of all of them, in millimetres and degrees
+		void Write(std::ostream& out) const;
+
+	private:
+		const gk2::MotionProgram& m_program;
+		gk2::MotionProgram::ForwardKinematics m_forward;
+		gk2::MotionProgram::InverseKinematics m_inverse;
+		std::vector<gk2::DeviationStats> m_segments;
+		gk2::DeviationStats m_total;
+
+		//Adds a sample's deviations to the statistics of its segment, segment being the reader's position in
+		//the program
+		void Add(const gk2::JointSample& sample, std::vector<gk2::DeviationStats>& segments,
+			unsigned int& segment) const;
+		static void Merge(gk2::DeviationStats& stats, const gk2::DeviationStats& other);
+		static void WriteLine(std::ostream& out, const gk2::DeviationStats& stats);
+
+		TwinComparison(const TwinComparison& right) : m_program(right.m_program) { }
+		TwinComparison& operator=(const TwinComparison& right) { return *this; }
+	};
+}
+
+#endif __GK2_TWIN_COMPARISON_H_
@@ -21,8 +21,8 @@ void* Utils::New16Aligned(size_t size)
 {
 	BYTE* ptr = new BYTE[size + 16];
 	BYTE* shifted = ptr + 16;
-	BYTE missalignment = (BYTE)((ULONG)shifted & 0xf);
-	shifted = (BYTE*)((ULONG)shifted &~(ULONG)0xf);
+	BYTE missalignment = (BYTE)((ULONG_PTR)shifted & 0xf);
+	shifted = (BYTE*)((ULONG_PTR)shifted &~(ULONG_PTR)0xf);
 	shifted[-1] = missalignment;
 	return (void*)shifted;
 }
@@ -31,7 +31,7 @@ void Utils::Delete16Aligned(void* ptr)
 {
 	BYTE* shifted = (BYTE*)ptr;
 	BYTE missalignment = shifted[-1];
-	shifted = (BYTE*)((ULONG)shifted | (ULONG)missalignment);
+	shifted = (BYTE*)((ULONG_PTR)shifted | (ULONG_PTR)missalignment);
 	BYTE* original = shifted - 16;
 	delete [] original;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "gk2_window.h"
 #include "gk2_exceptions.h"
 #include "gk2_puma.h"
+#include "gk2_benchmark.h"
 
 using namespace std;
 using namespace gk2;
@@ -9,15 +10,31 @@ using namespace gk2;
 int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE prevInstance, LPWSTR cmdLine, int cmdShow)
 {
 	UNREFERENCED_PARAMETER(prevInstance);
-	UNREFERENCED_PARAMETER(cmdLine);
+	if (cmdLine != nullptr && wcsstr(cmdLine, L"-benchmark") != nullptr)
+		return Benchmark::Run(L"benchmark.txt");
+	if (cmdLine != nullptr && wcsstr(cmdLine, L"-telemetry") != nullptr)
+		return TelemetryReader::Dump(L"telemetry.csv", 10.0f);
+	//A replay, a comparison or a calibration runs with the window hidden and quits when done
+	bool replay = cmdLine != nullptr && wcsstr(cmdLine, L"-replay") != nullptr;
+	bool compare = cmdLine != nullptr && wcsstr(cmdLine, L"-compare") != nullptr;
+	bool calibrate = cmdLine != nullptr && wcsstr(cmdLine, L"-calibrate") != nullptr;
 	shared_ptr<ApplicationBase> app;
 	shared_ptr<Window> w;
 	int exitCode = 0;
 	try
 	{
-		app.reset(new Puma(hInstance));
+		Puma* puma = new Puma(hInstance);
+		app.reset(puma);
+		if (replay)
+			puma->ReplaySession(L"session.gk2s", L"replay.txt", L"baseline.txt");
+		else if (compare)
+			puma->CompareLog(L"joints.csv", L"twin.txt");
+		else if (calibrate)
+			puma->Calibrate(L"calibration.csv", L"fit.txt");
+		else if (cmdLine != nullptr && wcsstr(cmdLine, L"-record") != nullptr)
+			puma->RecordSession(L"session.gk2s");
 		w.reset(new Window(hInstance, 800, 800, L"PUMA"));
-		exitCode = app->Run(w.get(), cmdShow);
+		exitCode = app->Run(w.get(), replay || compare || calibrate ? SW_HIDE : cmdShow);
 	}
 	catch (Exception& e)
 	{
@@ -0,0 +1,59 @@
+Texture2D heatMap : register(t0);
+Texture2D decalMap : register(t1);
+SamplerState heatSampler : register(s0);
+
+cbuffer cbView : register(b0) //Vertex Shader constant buffer slot 0
+{
+	matrix viewMatrix;
+};
+
+cbuffer cbProj : register(b1) //Vertex Shader constant buffer slot 1
+{
+	matrix projMatrix;
+};
+
+struct VSInput
+{
+	float3 pos : POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+struct PSInput
+{
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+PSInput VS_Main(VSInput i)
+{
+	PSInput o = (PSInput)0;
+	o.pos = float4(i.pos, 1.0f);
+	o.pos = mul(viewMatrix, o.pos);
+	o.pos = mul(projMatrix, o.pos);
+	o.tex = i.tex;
+	return o;
+}
+
+static const float3 BeadColor = float3(0.55f, 0.55f, 0.6f);
+static const float3 ScorchColor = float3(0.15f, 0.08f, 0.05f);
+
+float4 PS_Main(PSInput i) : SV_TARGET
+{
+	//Bead and scorch opacities, the map is empty if no decals are bound
+	float2 marks = decalMap.Sample(heatSampler, i.tex).rg;
+	float3 surface = lerp(ScorchColor, BeadColor, saturate(marks.r / max(marks.r + marks.g, 0.001f)));
+	float surfaceAlpha = 1.0f - (1.0f - marks.r) * (1.0f - 0.8f * marks.g);
+
+	//Heat map holds temperature as a fraction of the white-hot one
+	float t = saturate(heatMap.Sample(heatSampler, i.tex).r);
+	//Dark red through orange and yellow to white, like a heated body
+	float3 glow = float3(saturate(3.0f * t), saturate(3.0f * t - 1.0f), saturate(3.0f * t - 2.0f));
+	float glowAlpha = t < 0.02f ? 0.0f : saturate(2.0f * t);
+
+	//Glow over the marks
+	float alpha = 1.0f - (1.0f - surfaceAlpha) * (1.0f - glowAlpha);
+	if (alpha < 0.01f)
+		discard;
+	float3 color = (surface * surfaceAlpha * (1.0f - glowAlpha) + glow * glowAlpha) / alpha;
+	return float4(color, alpha);
+}
@@ -15,9 +15,10 @@ cbuffer cbProj : register(b0) //Geometry Shader constant buffer slot 2
 struct VSInput
 {
 	float3 pos : POSITION;
-	float age : TEXCOORD0;
+	float age : TEXCOORD0;	//fraction of the time to live
 	float angle : TEXCOORD1;
 	float size : TEXCOORD2;
+	float type : TEXCOORD3;	//gk2::ParticleType
 };
 
 struct GSInput
@@ -26,6 +27,7 @@ struct GSInput
 	float age : TEXCOORD0;
 	float angle : TEXCOORD1;
 	float size : TEXCOORD2;
+	float type : TEXCOORD3;
 };
 
 struct PSInput
@@ -33,9 +35,10 @@ struct PSInput
 	float4 pos : SV_POSITION;
 	float2 tex1: TEXCOORD0;
 	float2 tex2: TEXCOORD1;
+	nointerpolation float type : TEXCOORD2;
 };
 
-static const float TimeToLive = 4.0f;
+static const float SmokeType = 1.0f;	//SMOKE_PARTICLE
 
 GSInput VS_Main(VSInput i)
 {
@@ -45,6 +48,7 @@ GSInput VS_Main(VSInput i)
 	o.age = i.age;
 	o.angle = i.angle;
 	o.size = i.size;
+	o.type = i.type;
 	return o;
 }
 
@@ -57,7 +61,8 @@ void GS_Main(point GSInput inArray[1], inout TriangleStream<PSInput> ostream)
 	float dx = (cosa - sina) * 0.5 * i.size;
 	float dy = (cosa + sina) * 0.5 * i.size;
 	PSInput o = (PSInput)0;
-	o.tex2 = float2(i.age/TimeToLive, 0.5f);
+	o.tex2 = float2(i.age, 0.5f);
+	o.type = i.type;
 
 	o.pos = i.pos + float4(-dx, -dy, 0.0f, 0.0f);
 	o.pos = mul(projMatrix, o.pos);
@@ -82,12 +87,29 @@ void GS_Main(point GSInput inArray[1], inout TriangleStream<PSInput> ostream)
 	ostream.RestartStrip();
 }
 
-float4 PS_Main(PSInput i) : SV_TARGET
+//Smoke: the cloud texture faded by the ramp of smokecolors.png over the particle's life
+float4 SmokeColor(PSInput i)
 {
 	float4 color = cloudMap.Sample(colorSampler, i.tex1);
 	float4 opacity = opacityMap.Sample(colorSampler, i.tex2);
-	float alpha = color.a * opacity.a * 0.3f;
-	if (alpha == 0.0f)
+	return float4(color.xyz, color.a * opacity.a * 0.3f);
+}
+
+//Sparks: a round glow cooling from white through yellow to dark red over the particle's life
+float4 SparkColor(PSInput i)
+{
+	float r = length(i.tex1 * 2.0f - 1.0f);
+	float glow = saturate(1.0f - r * r);
+	float age = saturate(i.tex2.x);
+	float3 hot = lerp(float3(1.0f, 1.0f, 0.9f), float3(1.0f, 0.8f, 0.2f), saturate(age * 2.0f));
+	float3 color = lerp(hot, float3(0.6f, 0.1f, 0.0f), saturate(age * 2.0f - 1.0f));
+	return float4(color, glow * (1.0f - age * age));
+}
+
+float4 PS_Main(PSInput i) : SV_TARGET
+{
+	float4 color = i.type == SmokeType ? SmokeColor(i) : SparkColor(i);
+	if (color.a == 0.0f)
 		discard;
-	return float4(color.xyz,alpha);
+	return color;
 }
\ No newline at end of file
@@ -0,0 +1,44 @@
+cbuffer cbView : register(b0) //Vertex Shader constant buffer slot 0
+{
+	matrix viewMatrix;
+};
+
+cbuffer cbProj : register(b1) //Vertex Shader constant buffer slot 1
+{
+	matrix projMatrix;
+};
+
+struct VSInput
+{
+	float3 pos : POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+struct PSInput
+{
+	float4 pos : SV_POSITION;
+	float2 tex : TEXCOORD0;
+};
+
+static const float3 HeadColor = float3(1.0f, 0.95f, 0.7f);
+static const float3 TailColor = float3(1.0f, 0.35f, 0.05f);
+
+PSInput VS_Main(VSInput i)
+{
+	PSInput o = (PSInput)0;
+	o.pos = float4(i.pos, 1.0f);
+	o.pos = mul(viewMatrix, o.pos);
+	o.pos = mul(projMatrix, o.pos);
+	o.tex = i.tex;
+	return o;
+}
+
+float4 PS_Main(PSInput i) : SV_TARGET
+{
+	//Hot at the head, cooling and fading towards the tail, soft on both edges
+	float edge = 1.0f - abs(2.0f * i.tex.y - 1.0f);
+	float alpha = (1.0f - i.tex.x) * edge;
+	if (alpha <= 0.0f)
+		discard;
+	return float4(lerp(HeadColor, TailColor, i.tex.x), alpha);
+}